@@ -140,7 +140,7 @@ get_user_information_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, get_user_information_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "Account", task, send_response_in_thread_func);
 }
 
 static gboolean
@@ -265,9 +265,10 @@ account_new (XdpDbusImplAccount *impl)
   return account;
 }
 
-void
-init_account (XdpContext *context)
+DexFuture *
+init_account (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Account) account = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -277,19 +278,19 @@ init_account (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, ACCOUNT_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
-  impl = xdp_dbus_impl_account_proxy_new_sync (connection,
-                                               G_DBUS_PROXY_FLAGS_NONE,
-                                               impl_config->dbus_name,
-                                               DESKTOP_DBUS_PATH,
-                                               NULL,
-                                               &error);
+  impl = dex_await_object (xdp_dbus_impl_account_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
 
   if (impl == NULL)
     {
       g_warning ("Failed to create account proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   account = account_new (impl);
@@ -297,4 +298,6 @@ init_account (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&account)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -22,6 +22,7 @@
 #include "xdp-portal-config.h"
 #include "xdp-request.h"
 #include "xdp-utils.h"
+#include "xdp-worker-pool.h"
 
 /* Implementation notes:
  *
@@ -60,6 +61,7 @@ struct _Background
 {
   XdpDbusBackgroundSkeleton parent_instance;
 
+  XdpContext *context;
   XdpDbusImplBackground *impl;
   XdpDbusImplAccess *access_impl;
   GFileMonitor *instance_monitor;
@@ -929,18 +931,17 @@ handle_request_background_in_thread_func (GTask *task,
 
       g_variant_builder_add (&opt_builder, "{sv}", "deny_label", g_variant_new_string (_("Don't allow")));
       g_variant_builder_add (&opt_builder, "{sv}", "grant_label", g_variant_new_string (_("Allow")));
-      if (!xdp_dbus_impl_access_call_access_dialog_sync (background->access_impl,
-                                                         request->id,
-                                                         id,
-                                                         "",
-                                                         title,
-                                                         subtitle,
-                                                         body,
-                                                         g_variant_builder_end (&opt_builder),
-                                                         &response,
-                                                         &results,
-                                                         NULL,
-                                                         &error))
+      if (!xdp_request_call_access_dialog_sync (request,
+                                                background->access_impl,
+                                                id,
+                                                "",
+                                                title,
+                                                subtitle,
+                                                body,
+                                                g_variant_builder_end (&opt_builder),
+                                                &response,
+                                                &results,
+                                                &error))
         {
           g_warning ("AccessDialog call failed: %s", error->message);
           g_clear_error (&error);
@@ -1121,6 +1122,12 @@ handle_request_background (XdpDbusBackground *object,
     }
 
   xdp_request_set_impl_request (request, impl_request);
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
 
   xdp_dbus_background_complete_request_background (object, invocation, request->id);
@@ -1128,7 +1135,7 @@ handle_request_background (XdpDbusBackground *object,
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_request_background);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_request_background_in_thread_func);
+  xdp_request_run_in_worker (request, "Background", task, handle_request_background_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -1273,6 +1280,7 @@ handle_set_status (XdpDbusBackground     *object,
                    GDBusMethodInvocation *invocation,
                    GVariant              *arg_options)
 {
+  Background *background = (Background *) object;
   XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
   g_autoptr(GVariant) options = NULL;
   g_autoptr(GError) error = NULL;
@@ -1311,6 +1319,14 @@ handle_set_status (XdpDbusBackground     *object,
       return G_DBUS_METHOD_INVOCATION_HANDLED;
     }
 
+  if (!xdp_worker_pool_check_queue (xdp_context_get_worker_pool (background->context),
+                                    xdp_app_info_get_id (app_info),
+                                    &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   options = g_variant_ref_sink (g_variant_builder_end (&opt_builder));
 
   g_object_set_data_full (G_OBJECT (invocation),
@@ -1321,7 +1337,11 @@ handle_set_status (XdpDbusBackground     *object,
   task = g_task_new (object, NULL, set_status_finished_cb, NULL);
   g_task_set_source_tag (task, handle_set_status);
   g_task_set_task_data (task, g_object_ref (invocation), g_object_unref);
-  g_task_run_in_thread (task, handle_set_status_in_thread_func);
+  xdp_worker_pool_run_task (xdp_context_get_worker_pool (background->context),
+                            "Background",
+                            xdp_app_info_get_id (app_info),
+                            task,
+                            handle_set_status_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -1370,7 +1390,8 @@ background_class_init (BackgroundClass *klass)
 }
 
 static Background *
-background_new (XdpDbusImplBackground *background_impl,
+background_new (XdpContext            *context,
+                XdpDbusImplBackground *background_impl,
                 XdpDbusImplAccess     *access_impl,
                 XdpBackgroundMonitor  *background_monitor)
 {
@@ -1380,6 +1401,7 @@ background_new (XdpDbusImplBackground *background_impl,
   g_autoptr(GError) error = NULL;
 
   background = g_object_new (background_get_type (), NULL);
+  background->context = context;
   background->impl = g_object_ref (background_impl);
   background->access_impl = g_object_ref (access_impl);
   background->monitor = g_object_ref (background_monitor);
@@ -1421,9 +1443,10 @@ background_new (XdpDbusImplBackground *background_impl,
   return g_steal_pointer (&background);
 }
 
-void
-init_background (XdpContext *context)
+DexFuture *
+init_background (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Background) background = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1435,37 +1458,39 @@ init_background (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, BACKGROUND_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
   access_impl = xdp_context_get_access_impl (context);
   if (access_impl == NULL)
     {
       g_warning ("The background portal requires an access impl");
-      return;
+      return dex_future_new_false ();
     }
 
-  background_impl = xdp_dbus_impl_background_proxy_new_sync (connection,
-                                                             G_DBUS_PROXY_FLAGS_NONE,
-                                                             impl_config->dbus_name,
-                                                             DESKTOP_DBUS_PATH,
-                                                             NULL,
-                                                             &error);
+  background_impl = dex_await_object (xdp_dbus_impl_background_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (background_impl == NULL)
     {
       g_warning ("Failed to create background proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   background_monitor = xdp_background_monitor_new (NULL, &error);
   if (background_monitor == NULL)
     {
       g_warning ("Failed to create background monitor: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
-  background = background_new (background_impl, access_impl, background_monitor);
+  background = background_new (context, background_impl, access_impl, background_monitor);
 
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&background)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
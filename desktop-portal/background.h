@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_background (XdpContext *context);
+DexFuture * init_background (gpointer user_data);
@@ -112,18 +112,17 @@ query_permission_sync (Camera     *camera,
 
       g_debug ("Calling backend for device access to camera");
 
-      if (!xdp_dbus_impl_access_call_access_dialog_sync (camera->access_impl,
-                                                         request->id,
-                                                         app_id,
-                                                         "",
-                                                         title,
-                                                         subtitle,
-                                                         body,
-                                                         g_variant_builder_end (&opt_builder),
-                                                         &response,
-                                                         &results,
-                                                         NULL,
-                                                         &error))
+      if (!xdp_request_call_access_dialog_sync (request,
+                                                camera->access_impl,
+                                                app_id,
+                                                "",
+                                                title,
+                                                subtitle,
+                                                body,
+                                                g_variant_builder_end (&opt_builder),
+                                                &response,
+                                                &results,
+                                                &error))
         {
           g_warning ("A backend call failed: %s", error->message);
           /* We do not want to set the permission if there was an error and the
@@ -186,6 +185,7 @@ handle_access_camera (XdpDbusCamera *object,
   Camera *camera = (Camera *) object;
   XdpRequest *request = xdp_request_from_invocation (invocation);
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
 
   if (xdp_dbus_impl_lockdown_get_disable_camera (camera->lockdown_impl))
     {
@@ -199,6 +199,12 @@ handle_access_camera (XdpDbusCamera *object,
 
   REQUEST_AUTOLOCK (request);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
 
   xdp_dbus_camera_complete_access_camera (object, invocation, request->id);
@@ -206,7 +212,7 @@ handle_access_camera (XdpDbusCamera *object,
   task = g_task_new (camera, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_access_camera);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_access_camera_in_thread_func);
+  xdp_request_run_in_worker (request, "Camera", task, handle_access_camera_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -528,9 +534,10 @@ camera_new (XdpDbusImplAccess   *access_impl,
   return camera;
 }
 
-void
-init_camera (XdpContext *context)
+DexFuture *
+init_camera (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Camera) camera = NULL;
   XdpDbusImplAccess *access_impl;
   XdpDbusImplLockdown *lockdown_impl;
@@ -539,7 +546,7 @@ init_camera (XdpContext *context)
   if (access_impl == NULL)
     {
       g_warning ("The camera portal requires an access impl");
-      return;
+      return dex_future_new_false ();
     }
 
   lockdown_impl = xdp_context_get_lockdown_impl (context);
@@ -549,4 +556,6 @@ init_camera (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&camera)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_camera (XdpContext *context);
+DexFuture * init_camera (gpointer user_data);
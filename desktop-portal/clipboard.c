@@ -618,9 +618,10 @@ clipboard_new (XdpDbusImplClipboard *impl)
   return clipboard;
 }
 
-void
-init_clipboard (XdpContext *context)
+DexFuture *
+init_clipboard (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Clipboard) clipboard = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -630,18 +631,18 @@ init_clipboard (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, CLIPBOARD_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_clipboard_proxy_new_sync (connection,
-                                                 G_DBUS_PROXY_FLAGS_NONE,
-                                                 impl_config->dbus_name,
-                                                 DESKTOP_DBUS_PATH,
-                                                 NULL,
-                                                 &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_clipboard_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create clipboard: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   clipboard = clipboard_new (impl);
@@ -649,4 +650,6 @@ init_clipboard (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&clipboard)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_clipboard (XdpContext *context);
+DexFuture * init_clipboard (gpointer user_data);
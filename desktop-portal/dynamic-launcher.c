@@ -12,8 +12,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <gio/gdesktopappinfo.h>
 #include <gio/gio.h>
@@ -888,13 +891,20 @@ error:
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+/* Icons are usually smaller than 1 MiB. Set a 10 MiB
+ * limit so we can't use a huge amount of memory or hit
+ * the D-Bus message size limit
+ */
+#define MAX_ICON_SIZE_BYTES 10485760
+
 static gboolean
-handle_get_icon (XdpDbusDynamicLauncher *object,
-                 GDBusMethodInvocation  *invocation,
-                 const gchar            *arg_desktop_file_id)
+lookup_launcher_icon (XdpAppInfo   *app_info,
+                      const char   *desktop_file_id,
+                      char        **icon_path_out,
+                      const char  **icon_format_out,
+                      int          *icon_size_out,
+                      GError      **error)
 {
-  XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
-  g_autoptr(GError) error = NULL;
   g_autofree char *desktop_dir = NULL;
   g_autofree char *contents = NULL;
   g_autofree char *desktop_path = NULL;
@@ -902,36 +912,30 @@ handle_get_icon (XdpDbusDynamicLauncher *object,
   g_autofree char *icon_path = NULL;
   gsize length;
   g_autoptr(GKeyFile) key_file = NULL;
-  g_autoptr(GFile) icon_file = NULL;
-  g_autoptr(GIcon) icon = NULL;
-  g_autoptr(GInputStream) stream = NULL;
-  g_autoptr(GBytes) bytes = NULL;
-  g_autoptr(GIcon) bytes_icon = NULL;
-  g_autoptr(GVariant) icon_v = NULL;
   const gchar *icon_format = NULL;
   int icon_size = 0;
 
-  if (!validate_desktop_file_id (app_info, arg_desktop_file_id, &error))
-    goto error;
+  if (!validate_desktop_file_id (app_info, desktop_file_id, error))
+    return FALSE;
 
   desktop_dir = g_build_filename (g_get_user_data_dir (), XDG_PORTAL_APPLICATIONS_DIR, NULL);
   icon_dir = g_build_filename (g_get_user_data_dir (), XDG_PORTAL_ICONS_DIR, NULL);
 
-  desktop_path = g_build_filename (desktop_dir, arg_desktop_file_id, NULL);
-  if (!g_file_get_contents (desktop_path, &contents, &length, &error))
-    goto error;
+  desktop_path = g_build_filename (desktop_dir, desktop_file_id, NULL);
+  if (!g_file_get_contents (desktop_path, &contents, &length, error))
+    return FALSE;
   if (length > MAX_DESKTOP_SIZE_BYTES)
     {
-      g_set_error (&error,
+      g_set_error (error,
                    XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_FAILED,
                    _("Desktop file exceeds max size (%d): %s"),
-                   MAX_DESKTOP_SIZE_BYTES, arg_desktop_file_id);
-      goto error;
+                   MAX_DESKTOP_SIZE_BYTES, desktop_file_id);
+      return FALSE;
     }
 
   key_file = g_key_file_new ();
-  if (!g_key_file_load_from_data (key_file, contents, -1, G_KEY_FILE_NONE, &error))
-    goto error;
+  if (!g_key_file_load_from_data (key_file, contents, -1, G_KEY_FILE_NONE, error))
+    return FALSE;
 
   icon_path = g_key_file_get_string (key_file, G_KEY_FILE_DESKTOP_GROUP, "Icon", NULL);
   if (icon_path && g_str_has_prefix (icon_path, icon_dir))
@@ -962,22 +966,47 @@ handle_get_icon (XdpDbusDynamicLauncher *object,
 
   if (!icon_format || icon_size <= 0 || icon_size > 4096)
     {
-      g_set_error (&error,
+      g_set_error (error,
                    XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_FAILED,
-                   _("Desktop file '%s' icon at unrecognized path"), arg_desktop_file_id);
-      goto error;
+                   _("Desktop file '%s' icon at unrecognized path"), desktop_file_id);
+      return FALSE;
     }
 
+  *icon_path_out = g_steal_pointer (&icon_path);
+  *icon_format_out = icon_format;
+  *icon_size_out = icon_size;
+
+  return TRUE;
+}
+
+static gboolean
+handle_get_icon (XdpDbusDynamicLauncher *object,
+                 GDBusMethodInvocation  *invocation,
+                 const gchar            *arg_desktop_file_id)
+{
+  XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
+  g_autoptr(GError) error = NULL;
+  g_autofree char *icon_path = NULL;
+  g_autoptr(GFile) icon_file = NULL;
+  g_autoptr(GIcon) icon = NULL;
+  g_autoptr(GInputStream) stream = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GIcon) bytes_icon = NULL;
+  g_autoptr(GVariant) icon_v = NULL;
+  const gchar *icon_format = NULL;
+  int icon_size = 0;
+
+  if (!lookup_launcher_icon (app_info, arg_desktop_file_id,
+                             &icon_path, &icon_format, &icon_size,
+                             &error))
+    goto error;
+
   icon_file = g_file_new_for_path (icon_path);
   icon = g_file_icon_new (icon_file);
   stream = g_loadable_icon_load (G_LOADABLE_ICON (icon), 0, NULL, NULL, NULL);
 
-  /* Icons are usually smaller than 1 MiB. Set a 10 MiB
-   * limit so we can't use a huge amount of memory or hit
-   * the D-Bus message size limit
-   */
   if (stream)
-      bytes = g_input_stream_read_bytes (stream, 10485760 /* 10 MiB */, NULL, NULL);
+      bytes = g_input_stream_read_bytes (stream, MAX_ICON_SIZE_BYTES, NULL, NULL);
   if (bytes)
       bytes_icon = g_bytes_icon_new (bytes);
   if (bytes_icon)
@@ -1001,6 +1030,189 @@ error:
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+static gboolean
+set_copy_error (int      saved_errno,
+                GError **error)
+{
+  g_set_error (error,
+               G_IO_ERROR, g_io_error_from_errno (saved_errno),
+               "Failed to copy icon: %s", g_strerror (saved_errno));
+  return FALSE;
+}
+
+/* Copies @length bytes of @in_fd into @out_fd, in the kernel if possible */
+static gboolean
+copy_fd_contents (int      in_fd,
+                  int      out_fd,
+                  off_t    length,
+                  GError **error)
+{
+  gboolean use_sendfile = TRUE;
+  off_t copied = 0;
+
+  while (copied < length)
+    {
+      ssize_t n;
+
+      if (use_sendfile)
+        {
+          n = sendfile (out_fd, in_fd, NULL, length - copied);
+          if (n < 0 && (errno == EINVAL || errno == ENOSYS) && copied == 0)
+            {
+              use_sendfile = FALSE;
+              continue;
+            }
+        }
+      else
+        {
+          char buffer[16384];
+          ssize_t n_written = 0;
+
+          n = read (in_fd, buffer, MIN (sizeof (buffer), (size_t) (length - copied)));
+          while (n > 0 && n_written < n)
+            {
+              ssize_t res = write (out_fd, buffer + n_written, n - n_written);
+
+              if (res < 0 && errno != EINTR)
+                return set_copy_error (errno, error);
+              if (res > 0)
+                n_written += res;
+            }
+        }
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          return set_copy_error (errno, error);
+        }
+
+      /* The file got truncated under us */
+      if (n == 0)
+        break;
+
+      copied += n;
+    }
+
+  return TRUE;
+}
+
+static XdpSealedFd *
+load_icon_sealed_fd (const char  *icon_path,
+                     GError     **error)
+{
+  g_autofd int icon_fd = -1;
+  g_autofd int memfd = -1;
+  struct stat buf;
+
+  icon_fd = open (icon_path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+  if (icon_fd == -1)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Failed to open icon: %s", g_strerror (saved_errno));
+      return NULL;
+    }
+
+  if (fstat (icon_fd, &buf) == -1)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Failed to stat icon: %s", g_strerror (saved_errno));
+      return NULL;
+    }
+
+  if (!S_ISREG (buf.st_mode) || buf.st_size > MAX_ICON_SIZE_BYTES)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "Icon is not a regular file or too large");
+      return NULL;
+    }
+
+  memfd = memfd_create ("xdp-launcher-icon", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd == -1)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "memfd_create: %s", g_strerror (saved_errno));
+      return NULL;
+    }
+
+  if (!copy_fd_contents (icon_fd, memfd, buf.st_size, error))
+    return NULL;
+
+  /* The client shares the file offset, so that it can read the icon
+   * from the start */
+  if (lseek (memfd, 0, SEEK_SET) == -1)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Failed to rewind icon: %s", g_strerror (saved_errno));
+      return NULL;
+    }
+
+  return xdp_sealed_fd_new_take_memfd (g_steal_fd (&memfd), error);
+}
+
+static gboolean
+handle_get_icon_fd (XdpDbusDynamicLauncher *object,
+                    GDBusMethodInvocation  *invocation,
+                    GUnixFDList            *in_fd_list,
+                    const gchar            *arg_desktop_file_id,
+                    GVariant               *arg_options)
+{
+  XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
+  g_autoptr(GError) error = NULL;
+  g_autofree char *icon_path = NULL;
+  g_autoptr(XdpSealedFd) sealed_icon = NULL;
+  g_autoptr(GUnixFDList) out_fd_list = NULL;
+  g_autoptr(GVariant) icon_v = NULL;
+  g_autoptr(GVariant) icon_handle = NULL;
+  const gchar *icon_format = NULL;
+  int icon_size = 0;
+
+  if (!lookup_launcher_icon (app_info, arg_desktop_file_id,
+                             &icon_path, &icon_format, &icon_size,
+                             &error))
+    goto error;
+
+  sealed_icon = load_icon_sealed_fd (icon_path, &error);
+  if (sealed_icon == NULL)
+    {
+      g_prefix_error (&error, _("Desktop file '%s' icon failed to load: "),
+                      arg_desktop_file_id);
+      goto error;
+    }
+
+  out_fd_list = g_unix_fd_list_new ();
+  icon_v = xdp_sealed_fd_to_handle (sealed_icon, out_fd_list, &error);
+  if (icon_v == NULL)
+    goto error;
+
+  /* Unpack the ("file-descriptor", <h>) icon into a plain handle */
+  g_variant_get (icon_v, "(&sv)", NULL, &icon_handle);
+
+  xdp_dbus_dynamic_launcher_complete_get_icon_fd (object, invocation,
+                                                  out_fd_list,
+                                                  icon_handle,
+                                                  icon_format, icon_size);
+  return G_DBUS_METHOD_INVOCATION_HANDLED;
+
+error:
+  g_dbus_method_invocation_return_gerror (invocation, error);
+  return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
 static gboolean
 handle_launch (XdpDbusDynamicLauncher *object,
                GDBusMethodInvocation  *invocation,
@@ -1071,6 +1283,7 @@ dynamic_launcher_iface_init (XdpDbusDynamicLauncherIface *iface)
   iface->handle_uninstall = handle_uninstall;
   iface->handle_get_desktop_entry = handle_get_desktop_entry;
   iface->handle_get_icon = handle_get_icon;
+  iface->handle_get_icon_fd = handle_get_icon_fd;
   iface->handle_launch = handle_launch;
 }
 
@@ -1114,7 +1327,7 @@ dynamic_launcher_new (XdpDbusImplDynamicLauncher *impl)
   g_dbus_proxy_set_default_timeout (G_DBUS_PROXY (dynamic_launcher->impl),
                                     G_MAXINT);
 
-  xdp_dbus_dynamic_launcher_set_version (XDP_DBUS_DYNAMIC_LAUNCHER (dynamic_launcher), 1);
+  xdp_dbus_dynamic_launcher_set_version (XDP_DBUS_DYNAMIC_LAUNCHER (dynamic_launcher), 2);
 
   g_object_bind_property (G_OBJECT (dynamic_launcher->impl), "supported-launcher-types",
                           G_OBJECT (dynamic_launcher), "supported-launcher-types",
@@ -1128,9 +1341,10 @@ dynamic_launcher_new (XdpDbusImplDynamicLauncher *impl)
   return dynamic_launcher;
 }
 
-void
-init_dynamic_launcher (XdpContext *context)
+DexFuture *
+init_dynamic_launcher (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(DynamicLauncher) dynamic_launcher = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1140,18 +1354,18 @@ init_dynamic_launcher (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, DYNAMIC_LAUNCHER_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_dynamic_launcher_proxy_new_sync (connection,
-                                                        G_DBUS_PROXY_FLAGS_NONE,
-                                                        impl_config->dbus_name,
-                                                        DESKTOP_DBUS_PATH,
-                                                        NULL,
-                                                        &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_dynamic_launcher_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create dynamic_launcher proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   dynamic_launcher = dynamic_launcher_new (impl);
@@ -1159,4 +1373,6 @@ init_dynamic_launcher (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&dynamic_launcher)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_dynamic_launcher (XdpContext *context);
+DexFuture * init_dynamic_launcher (gpointer user_data);
@@ -100,7 +100,7 @@ compose_email_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, compose_email_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "Email", task, send_response_in_thread_func);
 }
 
 static gboolean
@@ -335,9 +335,10 @@ email_new (XdpDbusImplEmail *impl)
   return email;
 }
 
-void
-init_email (XdpContext *context)
+DexFuture *
+init_email (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Email) email = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -347,19 +348,19 @@ init_email (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, EMAIL_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
-  impl = xdp_dbus_impl_email_proxy_new_sync (connection,
-                                             G_DBUS_PROXY_FLAGS_NONE,
-                                             impl_config->dbus_name,
-                                             DESKTOP_DBUS_PATH,
-                                             NULL,
-                                             &error);
+  impl = dex_await_object (xdp_dbus_impl_email_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
 
   if (impl == NULL)
     {
       g_warning ("Failed to create email proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   email = email_new (impl);
@@ -367,4 +368,6 @@ init_email (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&email)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_email (XdpContext *context);
+DexFuture * init_email (gpointer user_data);
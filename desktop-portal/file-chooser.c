@@ -95,36 +95,54 @@ send_response_in_thread_func (GTask        *task,
 
   if (g_variant_lookup (options, "uris", "^a&s", &uris))
     {
-      int i;
+      g_autoptr(GPtrArray) file_uris = g_ptr_array_new ();
+      g_autoptr(GPtrArray) doc_uris = NULL;
+      g_autoptr(GError) error = NULL;
+      size_t i;
 
       for (i = 0; uris && uris[i]; i++)
         {
-          g_autofree char *ruri = NULL;
-          g_autoptr(GError) error = NULL;
-
-          g_assert (uris[i] != NULL);
-
           if (!g_str_has_prefix (uris[i], "file://"))
             {
               g_warning ("Only URIs with the \"file://\" scheme are allowed");
               continue;
             }
 
-          if (xdp_app_info_is_host (request->app_info))
-            ruri = g_strdup (uris[i]);
-          else
-            ruri = xdp_register_document (uris[i],
-                                          xdp_app_info_get_id (request->app_info),
-                                          xdp_app_info_get_gappinfo (request->app_info),
-                                          flags,
-                                          &error);
+          g_ptr_array_add (file_uris, uris[i]);
+        }
+      g_ptr_array_add (file_uris, NULL);
+
+      /* Register all files with the document portal at once, rather than
+       * doing a round trip for each of them */
+      if (xdp_app_info_is_host (request->app_info))
+        {
+          /* file_uris only borrows the strings */
+          doc_uris = g_ptr_array_copy (file_uris, (GCopyFunc) g_strdup, NULL);
+          g_ptr_array_set_free_func (doc_uris, g_free);
+        }
+      else
+        doc_uris = xdp_register_documents ((const char * const *) file_uris->pdata,
+                                           xdp_app_info_get_id (request->app_info),
+                                           xdp_app_info_get_gappinfo (request->app_info),
+                                           flags,
+                                           &error);
+
+      if (doc_uris == NULL)
+        {
+          g_warning ("Failed to register documents: %s", error->message);
+          response = 2;
+          goto out;
+        }
+
+      for (i = 0; i < file_uris->len - 1; i++)
+        {
+          const char *uri = g_ptr_array_index (file_uris, i);
+          const char *ruri = g_ptr_array_index (doc_uris, i);
 
           if (ruri == NULL)
-            {
-              g_warning ("Failed to register %s: %s", uris[i], error->message);
-              continue;
-            }
-          g_debug ("convert uri %s -> %s\n", uris[i], ruri);
+            continue;
+
+          g_debug ("convert uri %s -> %s\n", uri, ruri);
           g_variant_builder_add (&ruris, "s", ruri);
         }
     }
@@ -171,7 +189,7 @@ open_file_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, open_file_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "FileChooser", task, send_response_in_thread_func);
 }
 
 static gboolean
@@ -584,7 +602,7 @@ save_file_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, save_file_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "FileChooser", task, send_response_in_thread_func);
 }
 
 static gboolean
@@ -750,7 +768,7 @@ save_files_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, save_files_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "FileChooser", task, send_response_in_thread_func);
 }
 
 static gboolean
@@ -870,9 +888,10 @@ file_chooser_new (XdpDbusImplFileChooser *impl,
   return file_chooser;
 }
 
-void
-init_file_chooser (XdpContext *context)
+DexFuture *
+init_file_chooser (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(FileChooser) file_chooser = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -883,19 +902,19 @@ init_file_chooser (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, FILE_CHOOSER_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
-  impl = xdp_dbus_impl_file_chooser_proxy_new_sync (connection,
-                                                    G_DBUS_PROXY_FLAGS_NONE,
-                                                    impl_config->dbus_name,
-                                                    DESKTOP_DBUS_PATH,
-                                                    NULL,
-                                                    &error);
+  impl = dex_await_object (xdp_dbus_impl_file_chooser_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
 
   if (impl == NULL)
     {
       g_warning ("Failed to create file chooser proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   lockdown_impl = xdp_context_get_lockdown_impl (context);
@@ -905,4 +924,6 @@ init_file_chooser (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&file_chooser)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -24,6 +24,7 @@
 #include "xdp-impl-dbus.h"
 #include "xdp-permissions.h"
 #include "xdp-utils.h"
+#include "xdp-worker-pool.h"
 
 /* well known names*/
 #define GAMEMODE_BACKEND_DBUS_NAME "com.feralinteractive.GameMode"
@@ -85,7 +86,7 @@ struct _GameMode
 {
   XdpDbusGameModeSkeleton parent_instance;
 
-  /*  */
+  XdpContext *context;
   GDBusProxy *client;
 };
 
@@ -367,6 +368,7 @@ handle_call_in_thread_fds (XdpDbusGameMode       *object,
   GameMode *gamemode = (GameMode *)object;
   XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
   CallData *call_data;
 
   if (fdlist == NULL || g_unix_fd_list_get_length (fdlist) != 2)
@@ -376,6 +378,14 @@ handle_call_in_thread_fds (XdpDbusGameMode       *object,
       return;
     }
 
+  if (!xdp_worker_pool_check_queue (xdp_context_get_worker_pool (gamemode->context),
+                                    xdp_app_info_get_id (app_info),
+                                    &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return;
+    }
+
   call_data = call_data_new (invocation, app_info, method, gamemode->client);
   call_data->fdlist = g_object_ref (fdlist);
 
@@ -383,7 +393,11 @@ handle_call_in_thread_fds (XdpDbusGameMode       *object,
   g_task_set_source_tag (task, handle_call_in_thread_fds);
 
   g_task_set_task_data (task, call_data, call_data_free);
-  g_task_run_in_thread (task, handle_call_thread);
+  xdp_worker_pool_run_task (xdp_context_get_worker_pool (gamemode->context),
+                            "GameMode",
+                            xdp_app_info_get_id (app_info),
+                            task,
+                            handle_call_thread);
 }
 
 static void
@@ -396,8 +410,17 @@ handle_call_in_thread (XdpDbusGameMode       *object,
   GameMode *gamemode = (GameMode *)object;
   XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
   CallData *call_data;
 
+  if (!xdp_worker_pool_check_queue (xdp_context_get_worker_pool (gamemode->context),
+                                    xdp_app_info_get_id (app_info),
+                                    &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return;
+    }
+
   call_data = call_data_new (invocation, app_info, method, gamemode->client);
 
   call_data->ids[0] = target;
@@ -413,7 +436,11 @@ handle_call_in_thread (XdpDbusGameMode       *object,
   g_task_set_source_tag (task, handle_call_in_thread);
 
   g_task_set_task_data (task, call_data, call_data_free);
-  g_task_run_in_thread (task, handle_call_thread);
+  xdp_worker_pool_run_task (xdp_context_get_worker_pool (gamemode->context),
+                            "GameMode",
+                            xdp_app_info_get_id (app_info),
+                            task,
+                            handle_call_thread);
 }
 
 /* dbus */
@@ -566,11 +593,13 @@ on_client_properties_changed (GDBusProxy  *proxy,
 }
 
 static GameMode *
-game_mode_new (GDBusProxy *client)
+game_mode_new (XdpContext *context,
+               GDBusProxy *client)
 {
   GameMode *gamemode;
 
   gamemode = g_object_new (game_mode_get_type (), NULL);
+  gamemode->context = context;
   gamemode->client = g_object_ref (client);
 
   xdp_dbus_game_mode_set_version (XDP_DBUS_GAME_MODE (gamemode), 4);
@@ -585,9 +614,10 @@ game_mode_new (GDBusProxy *client)
 }
 
 /* public API */
-void
-init_game_mode (XdpContext *context)
+DexFuture *
+init_game_mode (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(GameMode) gamemode = NULL;
   g_autoptr(GDBusProxy) client = NULL;
   GDBusProxyFlags flags;
@@ -607,12 +637,14 @@ init_game_mode (XdpContext *context)
   if (client == NULL)
     {
       g_warning ("Failed to create GameMode proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
-  gamemode = game_mode_new (client);
+  gamemode = game_mode_new (context, client);
 
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&gamemode)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_game_mode (XdpContext *context);
+DexFuture * init_game_mode (gpointer user_data);
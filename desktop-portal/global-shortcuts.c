@@ -47,11 +47,21 @@ G_DEFINE_TYPE_WITH_CODE (GlobalShortcuts, global_shortcuts, XDP_DBUS_TYPE_GLOBAL
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (GlobalShortcuts, g_object_unref)
 
+/* Flush batched shortcut events once this many are pending, so a steady
+ * stream of events can't hold them back indefinitely */
+#define MAX_BATCHED_SHORTCUT_EVENTS 64
+
 typedef struct _GlobalShortcutsSession
 {
   XdpSession parent;
 
   gboolean closed;
+
+  /* only accessed from the main thread */
+  gboolean batch_events;
+  GVariantBuilder *pending_events; /* a(sbta{sv}) */
+  unsigned int n_pending_events;
+  guint flush_events_id;
 } GlobalShortcutsSession;
 
 typedef struct _GlobalShortcutsSessionClass
@@ -89,6 +99,11 @@ global_shortcuts_session_close (XdpSession *session)
 static void
 global_shortcuts_session_finalize (GObject *object)
 {
+  GlobalShortcutsSession *global_shortcuts_session =
+    GLOBAL_SHORTCUTS_SESSION (object);
+
+  g_clear_pointer (&global_shortcuts_session->pending_events, g_variant_builder_unref);
+
   G_OBJECT_CLASS (global_shortcuts_session_parent_class)->finalize (object);
 }
 
@@ -138,7 +153,11 @@ global_shortcuts_session_new (GlobalShortcuts  *global_shortcuts,
                             NULL);
 
   if (session)
-    g_debug ("global shortcuts session owned by '%s' created", session->sender);
+    {
+      g_variant_lookup (options, "batch_events", "b",
+                        &GLOBAL_SHORTCUTS_SESSION (session)->batch_events);
+      g_debug ("global shortcuts session owned by '%s' created", session->sender);
+    }
 
   return GLOBAL_SHORTCUTS_SESSION (session);
 }
@@ -214,6 +233,7 @@ out:
 static XdpOptionKey global_shortcuts_create_session_options[] = {
   { "handle_token", G_VARIANT_TYPE_STRING, NULL },
   { "session_handle_token", G_VARIANT_TYPE_STRING, NULL },
+  { "batch_events", G_VARIANT_TYPE_BOOLEAN, NULL },
 };
 
 static gboolean
@@ -697,6 +717,107 @@ global_shortcuts_class_init (GlobalShortcutsClass *klass)
     g_quark_from_static_string ("-xdp-request-global-shortcuts-session");
 }
 
+static gboolean
+flush_shortcut_events (gpointer user_data)
+{
+  GlobalShortcutsSession *global_shortcuts_session = user_data;
+  XdpSession *session = XDP_SESSION (global_shortcuts_session);
+  GVariant *events;
+
+  global_shortcuts_session->flush_events_id = 0;
+
+  if (global_shortcuts_session->pending_events == NULL)
+    return G_SOURCE_REMOVE;
+
+  events = g_variant_builder_end (global_shortcuts_session->pending_events);
+  g_clear_pointer (&global_shortcuts_session->pending_events, g_variant_builder_unref);
+
+  g_debug ("Sending %u batched shortcut events for %s",
+           global_shortcuts_session->n_pending_events, session->id);
+  global_shortcuts_session->n_pending_events = 0;
+
+  if (!global_shortcuts_session->closed)
+    g_dbus_connection_emit_signal (session->connection,
+                                   session->sender,
+                                   DESKTOP_DBUS_PATH,
+                                   GLOBAL_SHORTCUTS_DBUS_IFACE,
+                                   "ShortcutEvents",
+                                   g_variant_new ("(o@a(sbta{sv}))",
+                                                  session->id, events),
+                                   NULL);
+  else
+    g_variant_unref (g_variant_ref_sink (events));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_shortcut_event (GlobalShortcutsSession *global_shortcuts_session,
+                      const char             *shortcut_id,
+                      gboolean                activated,
+                      guint64                 timestamp,
+                      GVariant               *options)
+{
+  if (global_shortcuts_session->pending_events == NULL)
+    global_shortcuts_session->pending_events =
+      g_variant_builder_new (G_VARIANT_TYPE ("a(sbta{sv})"));
+
+  g_variant_builder_add (global_shortcuts_session->pending_events,
+                         "(sbt@a{sv})",
+                         shortcut_id, activated, timestamp, options);
+  global_shortcuts_session->n_pending_events++;
+
+  if (global_shortcuts_session->n_pending_events >= MAX_BATCHED_SHORTCUT_EVENTS)
+    {
+      g_clear_handle_id (&global_shortcuts_session->flush_events_id, g_source_remove);
+      flush_shortcut_events (global_shortcuts_session);
+    }
+  else if (global_shortcuts_session->flush_events_id == 0)
+    {
+      /* Events the backend sent in one go are dispatched before idle
+       * sources run, so they end up in the same batch */
+      global_shortcuts_session->flush_events_id =
+        g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                         flush_shortcut_events,
+                         g_object_ref (global_shortcuts_session),
+                         g_object_unref);
+    }
+}
+
+static void
+dispatch_shortcut_event (XdpDbusImplGlobalShortcuts *impl,
+                         const char                 *session_id,
+                         const char                 *shortcut_id,
+                         gboolean                    activated,
+                         guint64                     timestamp,
+                         GVariant                   *options)
+{
+  GDBusConnection *connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (impl));
+  g_autoptr(XdpSession) session = xdp_session_lookup (session_id);
+  GlobalShortcutsSession *global_shortcuts_session =
+    GLOBAL_SHORTCUTS_SESSION (session);
+
+  if (!global_shortcuts_session || global_shortcuts_session->closed)
+    return;
+
+  if (global_shortcuts_session->batch_events)
+    {
+      queue_shortcut_event (global_shortcuts_session,
+                            shortcut_id, activated, timestamp, options);
+      return;
+    }
+
+  g_dbus_connection_emit_signal (connection,
+                                 session->sender,
+                                 DESKTOP_DBUS_PATH,
+                                 GLOBAL_SHORTCUTS_DBUS_IFACE,
+                                 activated ? "Activated" : "Deactivated",
+                                 g_variant_new ("(ost@a{sv})",
+                                                session_id, shortcut_id,
+                                                timestamp, options),
+                                 NULL);
+}
+
 static void
 activated_cb (XdpDbusImplGlobalShortcuts *impl,
               const char *session_id,
@@ -705,23 +826,9 @@ activated_cb (XdpDbusImplGlobalShortcuts *impl,
               GVariant *options,
               gpointer data)
 {
-  GDBusConnection *connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (impl));
-  g_autoptr(XdpSession) session = xdp_session_lookup (session_id);
-  GlobalShortcutsSession *global_shortcuts_session =
-    GLOBAL_SHORTCUTS_SESSION (session);
-
   g_debug ("Received activated %s for %s", session_id, shortcut_id);
 
-  if (global_shortcuts_session && !global_shortcuts_session->closed)
-    g_dbus_connection_emit_signal (connection,
-                                   session->sender,
-                                   DESKTOP_DBUS_PATH,
-                                   GLOBAL_SHORTCUTS_DBUS_IFACE,
-                                   "Activated",
-                                   g_variant_new ("(ost@a{sv})",
-                                                  session_id, shortcut_id,
-                                                  timestamp, options),
-                                   NULL);
+  dispatch_shortcut_event (impl, session_id, shortcut_id, TRUE, timestamp, options);
 }
 
 static void
@@ -732,23 +839,9 @@ deactivated_cb (XdpDbusImplGlobalShortcuts *impl,
                 GVariant *options,
                 gpointer data)
 {
-  GDBusConnection *connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (impl));
-  g_autoptr(XdpSession) session = xdp_session_lookup (session_id);
-  GlobalShortcutsSession *global_shortcuts_session =
-    GLOBAL_SHORTCUTS_SESSION (session);
-
   g_debug ("Received deactivated %s for %s", session_id, shortcut_id);
 
-  if (global_shortcuts_session && !global_shortcuts_session->closed)
-    g_dbus_connection_emit_signal (connection,
-                                   session->sender,
-                                   DESKTOP_DBUS_PATH,
-                                   GLOBAL_SHORTCUTS_DBUS_IFACE,
-                                   "Deactivated",
-                                   g_variant_new ("(ost@a{sv})",
-                                                  session_id, shortcut_id,
-                                                  timestamp, options),
-                                   NULL);
+  dispatch_shortcut_event (impl, session_id, shortcut_id, FALSE, timestamp, options);
 }
 
 static void
@@ -802,15 +895,17 @@ global_shortcuts_new (XdpContext                 *context,
 
   global_shortcuts->impl_version =
     MAX (xdp_dbus_impl_global_shortcuts_get_version (global_shortcuts->impl), 1);
+  /* Version 3 only added frontend features on top of version 2 */
   xdp_dbus_global_shortcuts_set_version (XDP_DBUS_GLOBAL_SHORTCUTS (global_shortcuts),
-                                         MIN (global_shortcuts->impl_version, 2));
+                                         global_shortcuts->impl_version >= 2 ? 3 : global_shortcuts->impl_version);
 
   return global_shortcuts;
 }
 
-void
-init_global_shortcuts (XdpContext *context)
+DexFuture *
+init_global_shortcuts (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(GlobalShortcuts) global_shortcuts = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -820,17 +915,18 @@ init_global_shortcuts (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, GLOBAL_SHORTCUTS_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_global_shortcuts_proxy_new_sync (connection,
-                                                        G_DBUS_PROXY_FLAGS_NONE,
-                                                        impl_config->dbus_name,
-                                                        DESKTOP_DBUS_PATH,
-                                                        NULL, &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_global_shortcuts_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create global_shortcuts proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   global_shortcuts = global_shortcuts_new (context, impl);
@@ -838,4 +934,6 @@ init_global_shortcuts (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&global_shortcuts)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
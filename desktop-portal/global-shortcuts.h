@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_global_shortcuts (XdpContext *context);
+DexFuture * init_global_shortcuts (gpointer user_data);
@@ -230,12 +230,18 @@ handle_inhibit (XdpDbusInhibit *object,
     }
 
   xdp_request_set_impl_request (request, impl_request);
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
 
   task = g_task_new (inhibit, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_inhibit);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_inhibit_in_thread_func);
+  xdp_request_run_in_worker (request, "Inhibit", task, handle_inhibit_in_thread_func);
 
   xdp_dbus_inhibit_complete_inhibit (object, invocation, request->id);
 
@@ -553,9 +559,10 @@ inhibit_new (XdpContext         *context,
   return inhibit;
 }
 
-void
-init_inhibit (XdpContext *context)
+DexFuture *
+init_inhibit (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Inhibit) inhibit = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -565,17 +572,18 @@ init_inhibit (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, INHIBIT_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_inhibit_proxy_new_sync (connection,
-                                               G_DBUS_PROXY_FLAGS_NONE,
-                                               impl_config->dbus_name,
-                                               DESKTOP_DBUS_PATH,
-                                               NULL, &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_inhibit_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create inhibit proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   inhibit = inhibit_new (context, impl);
@@ -583,4 +591,6 @@ init_inhibit (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&inhibit)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_inhibit (XdpContext *context);
+DexFuture * init_inhibit (gpointer user_data);
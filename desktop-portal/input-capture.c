@@ -1660,9 +1660,10 @@ input_capture_new (XdpContext              *context,
   return input_capture;
 }
 
-void
-init_input_capture (XdpContext *context)
+DexFuture *
+init_input_capture (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(InputCapture) input_capture = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1672,18 +1673,18 @@ init_input_capture (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, INPUT_CAPTURE_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_input_capture_proxy_new_sync (connection,
-                                                     G_DBUS_PROXY_FLAGS_NONE,
-                                                     impl_config->dbus_name,
-                                                     DESKTOP_DBUS_PATH,
-                                                     NULL,
-                                                     &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_input_capture_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create input capture proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   input_capture = input_capture_new (context, impl);
@@ -1691,4 +1692,6 @@ init_input_capture (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&input_capture)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
 /* This should be generated by G_DECLARE_DERIVABLE_TYPE but we can't use it here
@@ -33,4 +35,4 @@ void input_capture_session_clipboard_requested (InputCaptureSession *session);
 
 gboolean input_capture_session_can_access_clipboard (InputCaptureSession *session);
 
-void init_input_capture (XdpContext *context);
+DexFuture * init_input_capture (gpointer user_data);
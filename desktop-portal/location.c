@@ -6,6 +6,7 @@
 
 #include "location.h"
 
+#include <math.h>
 #include <string.h>
 
 #include <geoclue.h>
@@ -27,11 +28,19 @@
 #define GEO_CLUE2_MANAGER_IFACE "org.freedesktop.GeoClue2.Manager"
 #define GEO_CLUE2_LOCATION_IFACE "org.freedesktop.GeoClue2.Location"
 
+/* Mean earth radius in meters, as used by GeoClue */
+#define EARTH_RADIUS 6372795
+
 static GClueAccuracyLevel gclue_accuracy_level_from_string (const char *str);
 static const char *       gclue_accuracy_level_to_string   (GClueAccuracyLevel level);
 
 static GQuark quark_request_session;
 
+typedef struct _SharedClient SharedClient;
+
+static void shared_client_unref (SharedClient *shared);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SharedClient, shared_client_unref)
+
 /*** Location boilerplace ***/
 
 typedef struct
@@ -75,7 +84,13 @@ typedef struct
   guint time_threshold;
   guint accuracy;
 
-  GeoclueClient *client;
+  SharedClient *shared_client;
+
+  /* Last location sent to the app, only used on the main thread */
+  gint64 last_update_time;
+  gboolean has_last_position;
+  double last_latitude;
+  double last_longitude;
 } LocationSession;
 
 typedef struct
@@ -109,6 +124,8 @@ location_session_init (LocationSession *session)
   session->accuracy = GCLUE_ACCURACY_LEVEL_EXACT;
 }
 
+static void location_session_unsubscribe (LocationSession *loc_session);
+
 static void
 location_session_close (XdpSession *session)
 {
@@ -116,8 +133,7 @@ location_session_close (XdpSession *session)
 
   loc_session->state = LOCATION_SESSION_STATE_CLOSED;
 
-  if (loc_session->client)
-    geoclue_client_call_stop (loc_session->client, NULL, NULL, NULL);
+  location_session_unsubscribe (loc_session);
 
   g_debug ("location session '%s' closed", session->id);
 }
@@ -127,7 +143,7 @@ location_session_finalize (GObject *object)
 {
   LocationSession *loc_session = LOCATION_SESSION (object);
 
-  g_clear_object (&loc_session->client);
+  g_clear_pointer (&loc_session->shared_client, shared_client_unref);
 
   G_OBJECT_CLASS (location_session_parent_class)->finalize (object);
 }
@@ -168,124 +184,546 @@ location_session_new (Location               *location,
 
 /*** GeoClue integration ***/
 
+/* Sessions with the same accuracy level share one GeoClue client. The
+ * clients are started without thresholds, the distance and time
+ * thresholds of each session are applied when passing on the updates.
+ *
+ * Starting the clients and fetching the locations is all done
+ * asynchronously; the callbacks run on the main thread. */
+
+struct _SharedClient
+{
+  gatomicrefcount ref_count;
+
+  GClueAccuracyLevel accuracy;
+  GCancellable *cancellable;
+
+  /* All below protected by shared_clients */
+  GeoclueClient *client;
+  gboolean started;
+  gboolean released;
+  GList *sessions; /* LocationSession, started */
+  GList *pending_starts; /* PendingStart */
+  GVariant *location; /* a{sv}, the last location */
+};
+
+typedef struct
+{
+  LocationSession *session;
+  XdpRequest *request;
+} PendingStart;
+
+static GHashTable *shared_clients; /* accuracy -> SharedClient */
+G_LOCK_DEFINE (shared_clients);
+
+static SharedClient *
+shared_client_new (GClueAccuracyLevel accuracy)
+{
+  SharedClient *shared = g_new0 (SharedClient, 1);
+
+  g_atomic_ref_count_init (&shared->ref_count);
+  shared->accuracy = accuracy;
+  shared->cancellable = g_cancellable_new ();
+
+  return shared;
+}
+
+static SharedClient *
+shared_client_ref (SharedClient *shared)
+{
+  g_atomic_ref_count_inc (&shared->ref_count);
+  return shared;
+}
+
 static void
-on_location_updated (GeoclueClient *client,
-                     const char    *old_location,
-                     const char    *new_location,
-                     gpointer       data)
+shared_client_unref (SharedClient *shared)
 {
-  XdpSession *session = data;
-  g_autoptr(GVariant) ret = NULL;
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GVariant) dict = NULL;
+  if (!g_atomic_ref_count_dec (&shared->ref_count))
+    return;
 
-  g_debug ("GeoClue client ::LocationUpdated %s -> %s\n",  old_location, new_location);
+  g_assert (shared->sessions == NULL);
+  g_assert (shared->pending_starts == NULL);
 
-  if (g_strcmp0 (new_location, "/") == 0)
+  g_clear_object (&shared->cancellable);
+  g_clear_object (&shared->client);
+  g_clear_pointer (&shared->location, g_variant_unref);
+  g_free (shared);
+}
+
+static void
+pending_start_free (PendingStart *pending)
+{
+  g_clear_object (&pending->session);
+  g_clear_object (&pending->request);
+  g_free (pending);
+}
+
+/* Stops the client once no session uses it anymore. New sessions get a
+ * new client. */
+static void
+shared_client_release_locked (SharedClient *shared)
+{
+  gpointer key = GUINT_TO_POINTER (shared->accuracy);
+
+  if (shared->released)
     return;
 
-  ret = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (G_DBUS_PROXY (client)),
-                                     GEO_CLUE2_BUS_NAME,
-                                     new_location,
-                                     DBUS_DBUS_IFACE ".Properties",
-                                     "GetAll",
-                                     g_variant_new ("(s)", GEO_CLUE2_LOCATION_IFACE),
-                                     G_VARIANT_TYPE ("(a{sv})"),
-                                     0, -1, NULL, &error);
-  if (ret == NULL)
+  shared->released = TRUE;
+  g_cancellable_cancel (shared->cancellable);
+
+  if (shared->started)
+    geoclue_client_call_stop (shared->client, NULL, NULL, NULL);
+
+  g_debug ("GeoClue client for accuracy %s released",
+           gclue_accuracy_level_to_string (shared->accuracy));
+
+  if (g_hash_table_lookup (shared_clients, key) == shared)
+    g_hash_table_remove (shared_clients, key);
+}
+
+static void
+shared_client_release_if_unused_locked (SharedClient *shared)
+{
+  if (shared->sessions == NULL && shared->pending_starts == NULL)
+    shared_client_release_locked (shared);
+}
+
+static double
+distance_between (double latitude1,
+                  double longitude1,
+                  double latitude2,
+                  double longitude2)
+{
+  double lat1 = latitude1 * G_PI / 180.0;
+  double lat2 = latitude2 * G_PI / 180.0;
+  double dlat = lat2 - lat1;
+  double dlon = (longitude2 - longitude1) * G_PI / 180.0;
+  double a;
+
+  /* Haversine formula */
+  a = sin (dlat / 2) * sin (dlat / 2) +
+      cos (lat1) * cos (lat2) * sin (dlon / 2) * sin (dlon / 2);
+
+  return 2 * EARTH_RADIUS * asin (sqrt (a));
+}
+
+static void
+location_session_update (LocationSession *loc_session,
+                         GVariant        *location)
+{
+  XdpSession *session = XDP_SESSION (loc_session);
+  g_autoptr(GError) error = NULL;
+  gint64 now = g_get_monotonic_time ();
+  gboolean has_position;
+  double latitude = 0;
+  double longitude = 0;
+
+  has_position = g_variant_lookup (location, "Latitude", "d", &latitude) &&
+                 g_variant_lookup (location, "Longitude", "d", &longitude);
+
+  if (loc_session->last_update_time != 0)
     {
-      g_warning ("Failed to get location properties: %s", error->message);
-      return;
+      if (loc_session->time_threshold > 0 &&
+          now - loc_session->last_update_time <
+          (gint64) loc_session->time_threshold * G_USEC_PER_SEC)
+        return;
+
+      if (loc_session->distance_threshold > 0 &&
+          has_position && loc_session->has_last_position &&
+          distance_between (loc_session->last_latitude,
+                            loc_session->last_longitude,
+                            latitude, longitude) < loc_session->distance_threshold)
+        return;
     }
 
-  g_variant_get (ret, "(@a{sv})", &dict);
+  loc_session->last_update_time = now;
+  loc_session->has_last_position = has_position;
+  loc_session->last_latitude = latitude;
+  loc_session->last_longitude = longitude;
 
   if (!g_dbus_connection_emit_signal (session->connection,
                                       session->sender,
                                       DESKTOP_DBUS_PATH,
                                       LOCATION_DBUS_IFACE,
                                       "LocationUpdated",
-                                      g_variant_new ("(o@a{sv})", session->id, dict),
+                                      g_variant_new ("(o@a{sv})", session->id, location),
                                       &error))
     {
       g_warning ("Failed to emit LocationUpdated signal: %s", error->message);
     }
 }
 
+static void
+on_location_properties_ready (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      data)
+{
+  g_autoptr(SharedClient) shared = data;
+  g_autoptr(GPtrArray) sessions = NULL;
+  g_autoptr(GVariant) location = NULL;
+  g_autoptr(GVariant) ret = NULL;
+  g_autoptr(GError) error = NULL;
+
+  ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                       result, &error);
+  if (ret == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("Failed to get location properties: %s", error->message);
+      return;
+    }
+
+  g_variant_get (ret, "(@a{sv})", &location);
+
+  sessions = g_ptr_array_new_with_free_func (g_object_unref);
+
+  G_LOCK (shared_clients);
+  g_clear_pointer (&shared->location, g_variant_unref);
+  shared->location = g_variant_ref (location);
+  for (GList *l = shared->sessions; l != NULL; l = l->next)
+    g_ptr_array_add (sessions, g_object_ref (l->data));
+  G_UNLOCK (shared_clients);
+
+  for (guint i = 0; i < sessions->len; i++)
+    location_session_update (g_ptr_array_index (sessions, i), location);
+}
+
+static void
+on_location_updated (GeoclueClient *client,
+                     const char    *old_location,
+                     const char    *new_location,
+                     gpointer       data)
+{
+  SharedClient *shared = data;
+
+  g_debug ("GeoClue client ::LocationUpdated %s -> %s\n",  old_location, new_location);
+
+  if (g_strcmp0 (new_location, "/") == 0)
+    return;
+
+  /* Fetched once and passed on to all sessions of the client */
+  g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (client)),
+                          GEO_CLUE2_BUS_NAME,
+                          new_location,
+                          DBUS_DBUS_IFACE ".Properties",
+                          "GetAll",
+                          g_variant_new ("(s)", GEO_CLUE2_LOCATION_IFACE),
+                          G_VARIANT_TYPE ("(a{sv})"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          shared->cancellable,
+                          on_location_properties_ready,
+                          shared_client_ref (shared));
+}
+
+/* Called with the request and session locked */
+static void
+location_session_complete_start_locked (LocationSession *loc_session,
+                                        XdpRequest      *request,
+                                        gboolean         started)
+{
+  XdpSession *session = XDP_SESSION (loc_session);
+  g_autoptr(GVariant) location = NULL;
+  guint response = 2;
+
+  if (started && loc_session->state != LOCATION_SESSION_STATE_CLOSED)
+    {
+      SharedClient *shared = loc_session->shared_client;
+
+      loc_session->state = LOCATION_SESSION_STATE_STARTED;
+      response = 0;
+
+      G_LOCK (shared_clients);
+      shared->sessions = g_list_prepend (shared->sessions,
+                                         g_object_ref (loc_session));
+      if (shared->location)
+        location = g_variant_ref (shared->location);
+      G_UNLOCK (shared_clients);
+
+      g_debug ("location session '%s' started", session->id);
+    }
+
+  if (request->exported)
+    {
+      g_auto(GVariantBuilder) opt_builder =
+        G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+
+      g_debug ("sending response: %d", response);
+      xdp_dbus_request_emit_response (XDP_DBUS_REQUEST (request),
+                                      response,
+                                      g_variant_builder_end (&opt_builder));
+      xdp_request_unexport (request);
+    }
+
+  if (response != 0)
+    {
+      g_debug ("closing session");
+      xdp_session_close (session, FALSE);
+      return;
+    }
+
+  /* A client that is already running won't report the current location
+   * again, so send the last one the client got */
+  if (location)
+    location_session_update (loc_session, location);
+}
+
+static void
+pending_start_complete (PendingStart *pending,
+                        gboolean      started)
+{
+  REQUEST_AUTOLOCK (pending->request);
+  SESSION_AUTOLOCK (XDP_SESSION (pending->session));
+
+  location_session_complete_start_locked (pending->session,
+                                          pending->request,
+                                          started);
+}
+
+static void
+shared_client_complete_starts (SharedClient *shared,
+                               gboolean      started)
+{
+  GList *pending_starts;
+
+  G_LOCK (shared_clients);
+  if (started)
+    shared->started = TRUE;
+  else
+    shared_client_release_locked (shared);
+  pending_starts = g_steal_pointer (&shared->pending_starts);
+  G_UNLOCK (shared_clients);
+
+  for (GList *l = pending_starts; l != NULL; l = l->next)
+    pending_start_complete (l->data, started);
+  g_list_free_full (pending_starts, (GDestroyNotify) pending_start_free);
+
+  /* All sessions may have been closed while the client was starting */
+  G_LOCK (shared_clients);
+  shared_client_release_if_unused_locked (shared);
+  G_UNLOCK (shared_clients);
+}
+
+static void
+shared_client_fail (SharedClient *shared,
+                    const char   *message,
+                    GError       *error)
+{
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  g_warning ("%s: %s", message, error->message);
+  shared_client_complete_starts (shared, FALSE);
+}
+
+static void
+on_client_started (GObject      *source_object,
+                   GAsyncResult *result,
+                   gpointer      data)
+{
+  g_autoptr(SharedClient) shared = data;
+  g_autoptr(GError) error = NULL;
+
+  if (!geoclue_client_call_start_finish (GEOCLUE_CLIENT (source_object),
+                                         result, &error))
+    {
+      shared_client_fail (shared, "Starting GeoClue client failed", error);
+      return;
+    }
+
+  g_debug ("GeoClue client '%s' started",
+           g_dbus_proxy_get_object_path (G_DBUS_PROXY (source_object)));
+
+  shared_client_complete_starts (shared, TRUE);
+}
+
 static gboolean
-location_session_start (LocationSession *loc_session)
+complete_starts_idle (gpointer data)
 {
-  g_autoptr(GDBusConnection) system_bus = NULL;
+  SharedClient *shared = data;
+
+  shared_client_complete_starts (shared, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_client_proxy_ready (GObject      *source_object,
+                       GAsyncResult *result,
+                       gpointer      data)
+{
+  g_autoptr(SharedClient) shared = data;
+  g_autoptr(GError) error = NULL;
+  GeoclueClient *client;
+
+  client = geoclue_client_proxy_new_finish (result, &error);
+  if (client == NULL)
+    {
+      shared_client_fail (shared, "Failed to get GeoClue client", error);
+      return;
+    }
+
+  g_debug ("GeoClue client '%s', accuracy %s",
+           g_dbus_proxy_get_object_path (G_DBUS_PROXY (client)),
+           gclue_accuracy_level_to_string (shared->accuracy));
+
+  g_object_set (client,
+                "desktop-id", "xdg-desktop-portal",
+                "distance-threshold", 0,
+                "time-threshold", 0,
+                "requested-accuracy-level", shared->accuracy,
+                NULL);
+
+  /* The client is owned by shared, so it can't outlive it */
+  g_signal_connect (client, "location-updated",
+                    G_CALLBACK (on_location_updated),
+                    shared);
+
+  G_LOCK (shared_clients);
+  shared->client = client;
+  G_UNLOCK (shared_clients);
+
+  geoclue_client_call_start (client,
+                             shared->cancellable,
+                             on_client_started,
+                             g_steal_pointer (&shared));
+}
+
+static void
+on_get_client_ready (GObject      *source_object,
+                     GAsyncResult *result,
+                     gpointer      data)
+{
+  g_autoptr(SharedClient) shared = data;
+  GDBusConnection *system_bus = G_DBUS_CONNECTION (source_object);
   g_autoptr(GVariant) ret = NULL;
   g_autoptr(GError) error = NULL;
-  char *client_id;
-
-  /* FIXME: this is all ugly and sync */
-
-  system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
-  ret = g_dbus_connection_call_sync (system_bus,
-                                     GEO_CLUE2_BUS_NAME,
-                                     GEO_CLUE2_MANAGER_OBJECT_PATH,
-                                     GEO_CLUE2_MANAGER_IFACE,
-                                     "GetClient",
-                                     NULL,
-                                     G_VARIANT_TYPE ("(o)"),
-                                     0, -1, NULL, &error);
+  const char *client_id;
+
+  ret = g_dbus_connection_call_finish (system_bus, result, &error);
   if (ret == NULL)
     {
-      g_warning ("Failed to get GeoClue client: %s", error->message);
-      loc_session->state = LOCATION_SESSION_STATE_CLOSED;
-      return FALSE;
+      shared_client_fail (shared, "Failed to get GeoClue client", error);
+      return;
     }
 
   g_variant_get (ret, "(&o)", &client_id);
 
-  loc_session->client = geoclue_client_proxy_new_sync (system_bus,
-                                                       G_DBUS_PROXY_FLAGS_NONE,
-                                                       GEO_CLUE2_BUS_NAME,
-                                                       client_id,
-                                                       NULL,
-                                                       &error);
-  if (loc_session->client == NULL)
+  geoclue_client_proxy_new (system_bus,
+                            G_DBUS_PROXY_FLAGS_NONE,
+                            GEO_CLUE2_BUS_NAME,
+                            client_id,
+                            shared->cancellable,
+                            on_client_proxy_ready,
+                            g_steal_pointer (&shared));
+}
+
+static void
+on_system_bus_ready (GObject      *source_object,
+                     GAsyncResult *result,
+                     gpointer      data)
+{
+  g_autoptr(SharedClient) shared = data;
+  g_autoptr(GDBusConnection) system_bus = NULL;
+  g_autoptr(GError) error = NULL;
+
+  system_bus = g_bus_get_finish (result, &error);
+  if (system_bus == NULL)
     {
-      g_warning ("Failed to get GeoClue client: %s", error->message);
-      loc_session->state = LOCATION_SESSION_STATE_CLOSED;
-      return FALSE;
+      shared_client_fail (shared, "Failed to get the system bus", error);
+      return;
     }
 
-  g_debug ("location session '%s', GeoClue client '%s'", ((XdpSession*)loc_session)->id, client_id);
+  g_dbus_connection_call (system_bus,
+                          GEO_CLUE2_BUS_NAME,
+                          GEO_CLUE2_MANAGER_OBJECT_PATH,
+                          GEO_CLUE2_MANAGER_IFACE,
+                          "GetClient",
+                          NULL,
+                          G_VARIANT_TYPE ("(o)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          shared->cancellable,
+                          on_get_client_ready,
+                          g_steal_pointer (&shared));
+}
+
+/* Called with the request and session locked. The response is sent
+ * once the GeoClue client is running. */
+static void
+location_session_start (LocationSession *loc_session,
+                        XdpRequest      *request)
+{
+  gpointer key = GUINT_TO_POINTER (loc_session->accuracy);
+  g_autoptr(SharedClient) new_shared = NULL;
+  SharedClient *shared;
+  PendingStart *pending;
+
   g_debug ("location session '%s', distance-threshold %d, time-threshold %d, accuracy %s",
            XDP_SESSION (loc_session)->id,
            loc_session->distance_threshold,
            loc_session->time_threshold,
            gclue_accuracy_level_to_string (loc_session->accuracy));
-  
-  g_object_set (loc_session->client,
-                "desktop-id", "xdg-desktop-portal",
-                "distance-threshold", loc_session->distance_threshold,
-                "time-threshold", loc_session->time_threshold,
-                "requested-accuracy-level", loc_session->accuracy,
-                NULL);
-  
-  g_signal_connect_object (loc_session->client, "location-updated",
-                           G_CALLBACK (on_location_updated),
-                           loc_session,
-                           G_CONNECT_DEFAULT);
 
-  if (!geoclue_client_call_start_sync (loc_session->client, NULL, &error))
+  pending = g_new0 (PendingStart, 1);
+  pending->session = g_object_ref (loc_session);
+  pending->request = g_object_ref (request);
+
+  G_LOCK (shared_clients);
+
+  if (shared_clients == NULL)
+    shared_clients = g_hash_table_new_full (NULL, NULL,
+                                            NULL, (GDestroyNotify) shared_client_unref);
+
+  shared = g_hash_table_lookup (shared_clients, key);
+  if (shared == NULL)
     {
-      g_warning ("Starting GeoClue client failed: %s", error->message);
-      loc_session->state = LOCATION_SESSION_STATE_CLOSED;
-      g_clear_object (&loc_session->client);
-      return FALSE;
+      shared = shared_client_new (loc_session->accuracy);
+      g_hash_table_insert (shared_clients, key, shared);
+      new_shared = shared_client_ref (shared);
     }
 
-  g_debug ("GeoClue client '%s' started", client_id);
+  loc_session->shared_client = shared_client_ref (shared);
+  shared->pending_starts = g_list_append (shared->pending_starts, pending);
 
-  loc_session->state = LOCATION_SESSION_STATE_STARTED;
-  g_debug ("location session '%s' started", ((XdpSession*)loc_session)->id);
+  /* Keeps the client alive until the session is added to it */
+  if (shared->started)
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                     complete_starts_idle,
+                     shared_client_ref (shared),
+                     (GDestroyNotify) shared_client_unref);
 
-  return TRUE;
+  G_UNLOCK (shared_clients);
+
+  if (new_shared)
+    g_bus_get (G_BUS_TYPE_SYSTEM,
+               new_shared->cancellable,
+               on_system_bus_ready,
+               g_steal_pointer (&new_shared));
+}
+
+/* Called with the session locked */
+static void
+location_session_unsubscribe (LocationSession *loc_session)
+{
+  g_autoptr(SharedClient) shared = g_steal_pointer (&loc_session->shared_client);
+  GList *link;
+
+  if (shared == NULL)
+    return;
+
+  G_LOCK (shared_clients);
+
+  link = g_list_find (shared->sessions, loc_session);
+  if (link)
+    {
+      shared->sessions = g_list_delete_link (shared->sessions, link);
+      g_object_unref (loc_session);
+    }
+
+  shared_client_release_if_unused_locked (shared);
+
+  G_UNLOCK (shared_clients);
 }
 
 /*** Permission handling ***/
@@ -562,18 +1000,17 @@ handle_start_in_thread_func (GTask *task,
 
       body = _("Location access can be changed at any time from the privacy settings");
 
-      if (!xdp_dbus_impl_access_call_access_dialog_sync (location->access_impl,
-                                                         request->id,
-                                                         app_id,
-                                                         parent_window,
-                                                         title,
-                                                         subtitle,
-                                                         body,
-                                                         g_variant_builder_end (&access_opt_builder),
-                                                         &access_response,
-                                                         &access_results,
-                                                         NULL,
-                                                         &error))
+      if (!xdp_request_call_access_dialog_sync (request,
+                                                location->access_impl,
+                                                app_id,
+                                                parent_window,
+                                                title,
+                                                subtitle,
+                                                body,
+                                                g_variant_builder_end (&access_opt_builder),
+                                                &access_response,
+                                                &access_results,
+                                                &error))
         {
           g_warning ("Failed to show access dialog: %s", error->message);
           goto out;
@@ -603,10 +1040,8 @@ handle_start_in_thread_func (GTask *task,
       loc_session->accuracy = accuracy;
     }
 
-  if (location_session_start (loc_session))
-    response = 0;
-  else
-    response = 2;
+  location_session_start (loc_session, request);
+  return;
 
 out:
   if (request->exported)
@@ -640,6 +1075,7 @@ handle_start (XdpDbusLocation *object,
   XdpSession *session;
   LocationSession *loc_session;
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
 
   if (xdp_dbus_impl_lockdown_get_disable_location (location->lockdown_impl))
     {
@@ -685,6 +1121,12 @@ handle_start (XdpDbusLocation *object,
       return G_DBUS_METHOD_INVOCATION_HANDLED;
     }
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
 
   g_object_set_data_full (G_OBJECT (request), "parent-window", g_strdup (arg_parent_window), g_free);
@@ -701,7 +1143,7 @@ handle_start (XdpDbusLocation *object,
   task = g_task_new (location, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_start);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_start_in_thread_func);
+  xdp_request_run_in_worker (request, "Location", task, handle_start_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -758,9 +1200,10 @@ location_new (XdpContext          *context,
   return location;
 }
 
-void
-init_location (XdpContext *context)
+DexFuture *
+init_location (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Location) location = NULL;
   XdpDbusImplAccess *access_impl;
   XdpDbusImplLockdown *lockdown_impl;
@@ -769,7 +1212,7 @@ init_location (XdpContext *context)
   if (access_impl == NULL)
     {
       g_warning ("The location portal requires an access impl");
-      return;
+      return dex_future_new_false ();
     }
 
   lockdown_impl = xdp_context_get_lockdown_impl (context);
@@ -779,4 +1222,6 @@ init_location (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&location)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
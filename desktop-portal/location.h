@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_location (XdpContext *context);
+DexFuture * init_location (gpointer user_data);
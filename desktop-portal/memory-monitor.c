@@ -105,9 +105,10 @@ memory_monitor_new (void)
   return memory_monitor;
 }
 
-void
-init_memory_monitor (XdpContext *context)
+DexFuture *
+init_memory_monitor (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(MemoryMonitor) memory_monitor = NULL;
 
   memory_monitor = memory_monitor_new ();
@@ -115,4 +116,6 @@ init_memory_monitor (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&memory_monitor)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_memory_monitor (XdpContext *context);
+DexFuture * init_memory_monitor (gpointer user_data);
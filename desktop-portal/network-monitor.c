@@ -15,6 +15,10 @@
 #include "xdp-dbus.h"
 #include "xdp-utils.h"
 
+/* GNetworkMonitor emits bursts of changes while roaming between networks
+ * or when VPNs come and go, wait for them to settle before telling apps */
+#define CHANGED_DEBOUNCE_MS 300
+
 typedef struct _NetworkMonitor NetworkMonitor;
 typedef struct _NetworkMonitorClass NetworkMonitorClass;
 
@@ -22,7 +26,16 @@ struct _NetworkMonitor
 {
   XdpDbusNetworkMonitorSkeleton parent_instance;
 
+  XdpContext *context;
   GNetworkMonitor *monitor;
+
+  guint changed_timeout_id;
+  GVariant *last_status; /* a{sv} */
+
+  /* Peers allowed to see the network status that queried it before, and
+   * get StatusChanged */
+  GHashTable *status_peers; /* char *sender */
+  GMutex status_peers_lock;
 };
 
 struct _NetworkMonitorClass
@@ -40,6 +53,54 @@ G_DEFINE_TYPE_WITH_CODE (NetworkMonitor, network_monitor,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (NetworkMonitor, g_object_unref)
 
+static GVariant *
+get_status (NetworkMonitor *nm)
+{
+  g_auto(GVariantBuilder) status =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  gboolean b;
+  guint c;
+
+  b = g_network_monitor_get_network_available (nm->monitor);
+  g_variant_builder_add (&status, "{sv}",
+                         "available", g_variant_new_boolean (b));
+  b = g_network_monitor_get_network_metered (nm->monitor);
+  g_variant_builder_add (&status, "{sv}",
+                         "metered", g_variant_new_boolean (b));
+  c = g_network_monitor_get_connectivity (nm->monitor);
+  g_variant_builder_add (&status, "{sv}",
+                         "connectivity", g_variant_new_uint32 (c));
+
+  return g_variant_builder_end (&status);
+}
+
+static void
+add_status_peer (NetworkMonitor        *nm,
+                 GDBusMethodInvocation *invocation)
+{
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+
+  if (sender == NULL)
+    return;
+
+  G_MUTEX_AUTO_LOCK (&nm->status_peers_lock, locker);
+
+  if (!g_hash_table_contains (nm->status_peers, sender))
+    g_hash_table_add (nm->status_peers, g_strdup (sender));
+}
+
+static void
+on_peer_disconnect (XdpContext *context,
+                    const char *name,
+                    gpointer    user_data)
+{
+  NetworkMonitor *nm = user_data;
+
+  G_MUTEX_AUTO_LOCK (&nm->status_peers_lock, locker);
+
+  g_hash_table_remove (nm->status_peers, name);
+}
+
 static gboolean
 handle_get_available (XdpDbusNetworkMonitor *object,
                       GDBusMethodInvocation *invocation)
@@ -58,6 +119,8 @@ handle_get_available (XdpDbusNetworkMonitor *object,
       NetworkMonitor *nm = (NetworkMonitor *)object;
       gboolean available = g_network_monitor_get_network_available (nm->monitor);
 
+      add_status_peer (nm, invocation);
+
       g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", available));
     }
 
@@ -82,6 +145,8 @@ handle_get_metered (XdpDbusNetworkMonitor *object,
       NetworkMonitor *nm = (NetworkMonitor *)object;
       gboolean metered = g_network_monitor_get_network_metered (nm->monitor);
 
+      add_status_peer (nm, invocation);
+
       g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", metered));
     }
 
@@ -106,6 +171,8 @@ handle_get_connectivity (XdpDbusNetworkMonitor *object,
       NetworkMonitor *nm = (NetworkMonitor *)object;
       GNetworkConnectivity connectivity = g_network_monitor_get_connectivity (nm->monitor);
 
+      add_status_peer (nm, invocation);
+
       g_dbus_method_invocation_return_value (invocation, g_variant_new ("(u)", connectivity));
     }
 
@@ -128,21 +195,11 @@ handle_get_status (XdpDbusNetworkMonitor *object,
   else
     {
       NetworkMonitor *nm = (NetworkMonitor *)object;
-      g_auto(GVariantBuilder) status =
-        G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
-      gboolean b;
-      guint c;
-
-      b = g_network_monitor_get_network_available (nm->monitor);
-      g_variant_builder_add (&status, "{sv}",
-                             "available", g_variant_new_boolean (b));
-      b = g_network_monitor_get_network_metered (nm->monitor);
-      g_variant_builder_add (&status, "{sv}",
-                             "metered", g_variant_new_boolean (b));
-      c = g_network_monitor_get_connectivity (nm->monitor);
-      g_variant_builder_add (&status, "{sv}",
-                             "connectivity", g_variant_new_uint32 (c));
-      g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a{sv})", &status));
+
+      add_status_peer (nm, invocation);
+
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(@a{sv})", get_status (nm)));
     }
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
@@ -199,14 +256,82 @@ network_monitor_iface_init (XdpDbusNetworkMonitorIface *iface)
   iface->handle_can_reach = handle_can_reach;
 }
 
+static void
+emit_status_changed (NetworkMonitor *nm,
+                     GVariant       *status)
+{
+  GDBusConnection *connection = xdp_context_get_connection (nm->context);
+  GHashTableIter iter;
+  const char *sender;
+
+  G_MUTEX_AUTO_LOCK (&nm->status_peers_lock, locker);
+
+  /* The status carries what the getters refuse to tell apps without
+   * network access, so it is not broadcast */
+  g_hash_table_iter_init (&iter, nm->status_peers);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &sender, NULL))
+    {
+      g_dbus_connection_emit_signal (connection,
+                                     sender,
+                                     DESKTOP_DBUS_PATH,
+                                     NETWORK_MONITOR_DBUS_IFACE,
+                                     "StatusChanged",
+                                     g_variant_new ("(@a{sv})", status),
+                                     NULL);
+    }
+}
+
+static gboolean
+emit_changed_cb (gpointer user_data)
+{
+  NetworkMonitor *nm = user_data;
+  g_autoptr(GVariant) status = NULL;
+
+  nm->changed_timeout_id = 0;
+
+  /* Route changes, e.g. a VPN coming up, don't change the status but
+   * may change what CanReach returns */
+  xdp_dbus_network_monitor_emit_changed (XDP_DBUS_NETWORK_MONITOR (nm));
+
+  status = g_variant_ref_sink (get_status (nm));
+  if (nm->last_status && g_variant_equal (status, nm->last_status))
+    return G_SOURCE_REMOVE;
+
+  g_clear_pointer (&nm->last_status, g_variant_unref);
+  nm->last_status = g_variant_ref (status);
+
+  emit_status_changed (nm, status);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_changed (NetworkMonitor *nm)
+{
+  if (nm->changed_timeout_id == 0)
+    {
+      nm->changed_timeout_id = g_timeout_add (CHANGED_DEBOUNCE_MS,
+                                              emit_changed_cb,
+                                              nm);
+    }
+}
+
 static void
 on_network_changed (GObject  *object,
                     gboolean  network_available,
                     gpointer  user_data)
 {
-  NetworkMonitor *nm = user_data;
+  queue_changed (user_data);
+}
 
-  xdp_dbus_network_monitor_emit_changed (XDP_DBUS_NETWORK_MONITOR (nm));
+/* Metered and connectivity changes are only notified, without
+ * network-changed, by some monitor implementations */
+static void
+on_status_notify (GObject    *object,
+                  GParamSpec *pspec,
+                  gpointer    user_data)
+{
+  queue_changed (user_data);
 }
 
 static void
@@ -214,14 +339,28 @@ network_monitor_dispose (GObject *object)
 {
   NetworkMonitor *network_monitor = (NetworkMonitor *) object;
 
+  g_clear_handle_id (&network_monitor->changed_timeout_id, g_source_remove);
+  g_clear_pointer (&network_monitor->last_status, g_variant_unref);
   g_clear_object (&network_monitor->monitor);
+  g_clear_pointer (&network_monitor->status_peers, g_hash_table_unref);
 
   G_OBJECT_CLASS (network_monitor_parent_class)->dispose (object);
 }
 
+static void
+network_monitor_finalize (GObject *object)
+{
+  NetworkMonitor *network_monitor = (NetworkMonitor *) object;
+
+  g_mutex_clear (&network_monitor->status_peers_lock);
+
+  G_OBJECT_CLASS (network_monitor_parent_class)->finalize (object);
+}
+
 static void
 network_monitor_init (NetworkMonitor *nm)
 {
+  g_mutex_init (&nm->status_peers_lock);
 }
 
 static void
@@ -230,35 +369,55 @@ network_monitor_class_init (NetworkMonitorClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = network_monitor_dispose;
+  object_class->finalize = network_monitor_finalize;
 }
 
 static NetworkMonitor *
-network_monitor_new (void)
+network_monitor_new (XdpContext *context)
 {
   NetworkMonitor *network_monitor;
 
   network_monitor = g_object_new (network_monitor_get_type (), NULL);
 
-  network_monitor->monitor = g_network_monitor_get_default ();
+  network_monitor->context = context;
+  network_monitor->monitor = g_object_ref (g_network_monitor_get_default ());
+  network_monitor->last_status = g_variant_ref_sink (get_status (network_monitor));
+  network_monitor->status_peers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                         g_free, NULL);
 
   g_signal_connect_object (network_monitor->monitor, "network-changed",
                            G_CALLBACK (on_network_changed),
                            network_monitor,
                            G_CONNECT_DEFAULT);
+  g_signal_connect_object (network_monitor->monitor, "notify::network-metered",
+                           G_CALLBACK (on_status_notify),
+                           network_monitor,
+                           G_CONNECT_DEFAULT);
+  g_signal_connect_object (network_monitor->monitor, "notify::connectivity",
+                           G_CALLBACK (on_status_notify),
+                           network_monitor,
+                           G_CONNECT_DEFAULT);
+  g_signal_connect_object (context, "peer-disconnect",
+                           G_CALLBACK (on_peer_disconnect),
+                           network_monitor,
+                           G_CONNECT_DEFAULT);
 
-  xdp_dbus_network_monitor_set_version (XDP_DBUS_NETWORK_MONITOR (network_monitor), 3);
+  xdp_dbus_network_monitor_set_version (XDP_DBUS_NETWORK_MONITOR (network_monitor), 4);
 
   return network_monitor;
 }
 
-void
-init_network_monitor (XdpContext *context)
+DexFuture *
+init_network_monitor (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(NetworkMonitor) network_monitor = NULL;
 
-  network_monitor = network_monitor_new ();
+  network_monitor = network_monitor_new (context);
 
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&network_monitor)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_network_monitor (XdpContext *context);
+DexFuture * init_network_monitor (gpointer user_data);
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_notification (XdpContext *context);
+DexFuture * init_notification (gpointer user_data);
@@ -36,6 +36,10 @@
 
 #define FILE_MANAGER_SHOW_ITEMS "ShowItems"
 
+/* The caches are keyed by schemes and content types the callers pass in,
+ * so each one is dropped when it reaches this size */
+#define MAX_CACHE_ENTRIES 256
+
 #define DEFAULT_THRESHOLD 3
 
 typedef struct _OpenURI OpenURI;
@@ -49,6 +53,18 @@ struct _OpenURI
   XdpDbusImplAppChooser *impl;
   XdpDbusImplLockdown *lockdown_impl;
   GAppInfoMonitor *monitor;
+
+  /* Caches of the app info database and the used apps table, so repeated
+   * opens of the same type don't hit the file system or the bus. Filled
+   * lazily; the generations guard against racing with invalidation. */
+  GMutex cache_lock;
+  GHashTable *handlers; /* content type -> HandlerInfo */
+  GHashTable *apps_exist; /* app id -> gboolean */
+  GHashTable *schemes_supported; /* scheme -> gboolean */
+  guint handlers_generation;
+  GHashTable *used_apps_rows; /* content type -> UsedAppsRow */
+  guint used_apps_generation;
+  guint used_apps_watch_id;
 };
 
 struct _OpenURIClass
@@ -63,6 +79,19 @@ enum {
   LAST_PERM
 };
 
+typedef struct _HandlerInfo
+{
+  char *default_app;
+  GStrv choices;
+  guint n_choices;
+} HandlerInfo;
+
+typedef struct _UsedAppsRow
+{
+  GVariant *permissions; /* a{sas}, or NULL if there is no row */
+  GVariant *data; /* v, or NULL if there is no row */
+} UsedAppsRow;
+
 GType open_uri_get_type (void);
 static void open_uri_iface_init (XdpDbusOpenURIIface *iface);
 
@@ -72,6 +101,160 @@ G_DEFINE_TYPE_WITH_CODE (OpenURI, open_uri, XDP_DBUS_TYPE_OPEN_URI_SKELETON,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (OpenURI, g_object_unref)
 
+static void
+handler_info_free (HandlerInfo *info)
+{
+  g_free (info->default_app);
+  g_strfreev (info->choices);
+  g_free (info);
+}
+
+static UsedAppsRow *
+used_apps_row_new (GVariant *permissions,
+                   GVariant *data)
+{
+  UsedAppsRow *row = g_new0 (UsedAppsRow, 1);
+
+  row->permissions = permissions ? g_variant_ref (permissions) : NULL;
+  row->data = data ? g_variant_ref (data) : NULL;
+
+  return row;
+}
+
+static void
+cache_insert_locked (GHashTable *cache,
+                     char       *key,
+                     gpointer    value)
+{
+  if (g_hash_table_size (cache) >= MAX_CACHE_ENTRIES &&
+      !g_hash_table_contains (cache, key))
+    g_hash_table_remove_all (cache);
+
+  g_hash_table_insert (cache, key, value);
+}
+
+static void
+used_apps_row_free (UsedAppsRow *row)
+{
+  g_clear_pointer (&row->permissions, g_variant_unref);
+  g_clear_pointer (&row->data, g_variant_unref);
+  g_free (row);
+}
+
+static void
+lookup_used_apps_row (OpenURI     *open_uri,
+                      const char  *content_type,
+                      GVariant   **out_perms,
+                      GVariant   **out_data)
+{
+  g_autoptr(GError) error = NULL;
+  UsedAppsRow *row;
+  guint generation;
+
+  *out_perms = NULL;
+  *out_data = NULL;
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    row = g_hash_table_lookup (open_uri->used_apps_rows, content_type);
+    if (row)
+      {
+        *out_perms = row->permissions ? g_variant_ref (row->permissions) : NULL;
+        *out_data = row->data ? g_variant_ref (row->data) : NULL;
+        return;
+      }
+
+    generation = open_uri->used_apps_generation;
+  }
+
+  if (!xdp_dbus_impl_permission_store_call_lookup_sync (xdp_get_permission_store (),
+                                                        OPEN_URI_PERMISSION_TABLE,
+                                                        content_type,
+                                                        out_perms,
+                                                        out_data,
+                                                        NULL,
+                                                        &error))
+    {
+      g_dbus_error_strip_remote_error (error);
+      /* Not finding an entry for the content type in the permission store is perfectly ok */
+      if (!g_error_matches (error, XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_NOT_FOUND))
+        {
+          g_warning ("Unable to retrieve info for '%s' in the %s table of the permission store: %s",
+                     content_type, OPEN_URI_PERMISSION_TABLE, error->message);
+          return;
+        }
+    }
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (generation == open_uri->used_apps_generation)
+      cache_insert_locked (open_uri->used_apps_rows,
+                           g_strdup (content_type),
+                           used_apps_row_new (*out_perms, *out_data));
+  }
+}
+
+static void
+invalidate_used_apps_row (OpenURI    *open_uri,
+                          const char *content_type)
+{
+  G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+  open_uri->used_apps_generation++;
+  g_hash_table_remove (open_uri->used_apps_rows, content_type);
+}
+
+static void
+on_used_apps_changed (const char *table,
+                      const char *id,
+                      gboolean    deleted,
+                      GVariant   *data,
+                      GVariant   *permissions,
+                      gpointer    user_data)
+{
+  OpenURI *open_uri = user_data;
+  G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+  open_uri->used_apps_generation++;
+
+  if (deleted)
+    cache_insert_locked (open_uri->used_apps_rows,
+                         g_strdup (id),
+                         used_apps_row_new (NULL, NULL));
+  else
+    cache_insert_locked (open_uri->used_apps_rows,
+                         g_strdup (id),
+                         used_apps_row_new (permissions, data));
+}
+
+static void
+on_permission_store_owner_changed (GObject    *object,
+                                   GParamSpec *pspec,
+                                   OpenURI    *open_uri)
+{
+  G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+  /* We may have missed changes while the store was gone */
+  open_uri->used_apps_generation++;
+  g_hash_table_remove_all (open_uri->used_apps_rows);
+}
+
+static void
+on_app_info_database_changed (GAppInfoMonitor *monitor,
+                              OpenURI         *open_uri)
+{
+  G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+  g_debug ("App info database changed, dropping cached handlers");
+
+  open_uri->handlers_generation++;
+  g_hash_table_remove_all (open_uri->handlers);
+  g_hash_table_remove_all (open_uri->apps_exist);
+  g_hash_table_remove_all (open_uri->schemes_supported);
+}
+
 static void
 parse_permissions (const char **permissions,
                    char **app_id,
@@ -102,7 +285,8 @@ parse_permissions (const char **permissions,
 }
 
 static gboolean
-get_latest_choice_info (const char *app_id,
+get_latest_choice_info (OpenURI    *open_uri,
+                        const char *app_id,
                         const char *content_type,
                         gchar **latest_id,
                         gint *latest_count,
@@ -113,25 +297,10 @@ get_latest_choice_info (const char *app_id,
   int choice_count = 0;
   int choice_threshold = DEFAULT_THRESHOLD;
   gboolean ask = FALSE;
-  g_autoptr(GError) error = NULL;
   g_autoptr(GVariant) out_perms = NULL;
   g_autoptr(GVariant) out_data = NULL;
 
-  if (!xdp_dbus_impl_permission_store_call_lookup_sync (xdp_get_permission_store (),
-                                                        OPEN_URI_PERMISSION_TABLE,
-                                                        content_type,
-                                                        &out_perms,
-                                                        &out_data,
-                                                        NULL,
-                                                        &error))
-    {
-      g_dbus_error_strip_remote_error (error);
-      /* Not finding an entry for the content type in the permission store is perfectly ok */
-      if (!g_error_matches (error, XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_NOT_FOUND))
-        g_warning ("Unable to retrieve info for '%s' in the %s table of the permission store: %s",
-                   content_type, OPEN_URI_PERMISSION_TABLE, error->message);
-      g_clear_error (&error);
-    }
+  lookup_used_apps_row (open_uri, content_type, &out_perms, &out_data);
 
   if (out_data != NULL)
     {
@@ -256,7 +425,8 @@ launch_application_with_uri (const char *choice_id,
 }
 
 static void
-update_permissions_store (const char *app_id,
+update_permissions_store (OpenURI    *open_uri,
+                          const char *app_id,
                           const char *content_type,
                           const char *chosen_id)
 {
@@ -267,7 +437,7 @@ update_permissions_store (const char *app_id,
   g_auto(GStrv) in_permissions = NULL;
   gboolean ask;
 
-  if (get_latest_choice_info (app_id, content_type,
+  if (get_latest_choice_info (open_uri, app_id, content_type,
                               &latest_id, &latest_count, &latest_threshold, &ask) &&
       (g_strcmp0 (chosen_id, latest_id) == 0))
     {
@@ -309,6 +479,9 @@ update_permissions_store (const char *app_id,
       g_warning ("Error updating permission store: %s", error->message);
       g_clear_error (&error);
     }
+
+  /* Don't wait for the change notification to see our own write */
+  invalidate_used_apps_row (open_uri, content_type);
 }
 
 static void
@@ -318,6 +491,7 @@ send_response_in_thread_func (GTask *task,
                               GCancellable *cancellable)
 {
   XdpRequest *request = XDP_REQUEST (task_data);
+  OpenURI *open_uri;
   guint response;
   GVariant *options;
   const char *choice;
@@ -348,7 +522,13 @@ send_response_in_thread_func (GTask *task,
       g_variant_lookup (options, "activation_token", "&s", &activation_token);
 
       if (launch_application_with_uri (choice, uri, parent_window, writable, activation_token, NULL))
-        update_permissions_store (xdp_app_info_get_id (request->app_info), content_type, choice);
+        {
+          open_uri = (OpenURI *) g_object_get_data (G_OBJECT (request), "open-uri");
+          update_permissions_store (open_uri,
+                                    xdp_app_info_get_id (request->app_info),
+                                    content_type,
+                                    choice);
+        }
     }
 
 out:
@@ -392,7 +572,7 @@ app_chooser_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, app_chooser_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "OpenURI", task, send_response_in_thread_func);
 }
 
 static void
@@ -469,30 +649,27 @@ should_use_default_app (const char *scheme,
   return FALSE;
 }
 
-static void
-find_recommended_choices (const char *scheme,
-                          const char *content_type,
-                          char **default_app,
-                          GStrv *choices,
-                          guint *choices_len)
+static HandlerInfo *
+handler_info_new (const char *scheme,
+                  const char *content_type)
 {
+  HandlerInfo *handler_info;
   g_autoptr(GAppInfo) info = NULL;
   g_autolist(GAppInfo) infos = NULL;
   GList *l;
-  guint n_choices = 0;
-  GStrv result = NULL;
   int i;
 
+  handler_info = g_new0 (HandlerInfo, 1);
+
   info = g_app_info_get_default_for_type (content_type, FALSE);
 
   if (info != NULL)
     {
-      *default_app = get_handler_id (info);
-      g_debug ("Default handler %s for %s, %s", *default_app, scheme, content_type);
+      handler_info->default_app = get_handler_id (info);
+      g_debug ("Default handler %s for %s, %s", handler_info->default_app, scheme, content_type);
     }
   else
     {
-      *default_app = NULL;
       g_debug ("No default handler for %s, %s", scheme, content_type);
     }
 
@@ -501,21 +678,65 @@ find_recommended_choices (const char *scheme,
   if (!infos)
     infos = g_app_info_get_all_for_type (content_type);
 
-  n_choices = g_list_length (infos);
-  result = g_new (char *, n_choices + 1);
+  handler_info->n_choices = g_list_length (infos);
+  handler_info->choices = g_new (char *, handler_info->n_choices + 1);
   for (l = infos, i = 0; l; l = l->next)
     {
-      result[i++] = get_handler_id (G_APP_INFO (l->data));
+      handler_info->choices[i++] = get_handler_id (G_APP_INFO (l->data));
     }
-  result[i] = NULL;
+  handler_info->choices[i] = NULL;
 
   {
-    g_autofree char *a = g_strjoinv (", ", result);
+    g_autofree char *a = g_strjoinv (", ", handler_info->choices);
     g_debug ("Recommended handlers for %s, %s: %s", scheme, content_type, a);
   }
 
-  *choices = result;
-  *choices_len = n_choices;
+  return handler_info;
+}
+
+static void
+find_recommended_choices (OpenURI    *open_uri,
+                          const char *scheme,
+                          const char *content_type,
+                          char      **default_app,
+                          GStrv      *choices,
+                          guint      *choices_len)
+{
+  HandlerInfo *handler_info;
+  guint generation;
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    handler_info = g_hash_table_lookup (open_uri->handlers, content_type);
+    if (handler_info)
+      {
+        *default_app = g_strdup (handler_info->default_app);
+        *choices = g_strdupv (handler_info->choices);
+        *choices_len = handler_info->n_choices;
+        return;
+      }
+
+    generation = open_uri->handlers_generation;
+  }
+
+  handler_info = handler_info_new (scheme, content_type);
+
+  *default_app = g_strdup (handler_info->default_app);
+  *choices = g_strdupv (handler_info->choices);
+  *choices_len = handler_info->n_choices;
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (generation == open_uri->handlers_generation)
+      {
+        cache_insert_locked (open_uri->handlers, g_strdup (content_type), handler_info);
+        handler_info = NULL;
+      }
+  }
+
+  g_clear_pointer (&handler_info, handler_info_free);
 }
 
 static void
@@ -532,7 +753,7 @@ on_app_info_changed (GAppInfoMonitor *monitor,
   open_uri = (OpenURI *)g_object_get_data (G_OBJECT (request), "open-uri");
   scheme = (const char *)g_object_get_data (G_OBJECT (request), "scheme");
   content_type = (const char *)g_object_get_data (G_OBJECT (request), "content-type");
-  find_recommended_choices (scheme, content_type, &default_app, &choices, &n_choices);
+  find_recommended_choices (open_uri, scheme, content_type, &default_app, &choices, &n_choices);
 
   xdp_dbus_impl_app_chooser_call_update_choices (open_uri->impl,
                                                  request->id,
@@ -543,15 +764,37 @@ on_app_info_changed (GAppInfoMonitor *monitor,
 }
 
 static gboolean
-app_exists (const char *app_id)
+app_exists (OpenURI    *open_uri,
+            const char *app_id)
 {
   g_autoptr(GDesktopAppInfo) info = NULL;
   g_autofree gchar *with_desktop = NULL;
+  gpointer exists;
+  guint generation;
 
   g_return_val_if_fail (app_id != NULL, FALSE);
 
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (g_hash_table_lookup_extended (open_uri->apps_exist, app_id, NULL, &exists))
+      return GPOINTER_TO_INT (exists);
+
+    generation = open_uri->handlers_generation;
+  }
+
   with_desktop = g_strconcat (app_id, ".desktop", NULL);
   info = g_desktop_app_info_new (with_desktop);
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (generation == open_uri->handlers_generation)
+      cache_insert_locked (open_uri->apps_exist,
+                           g_strdup (app_id),
+                           GINT_TO_POINTER (info != NULL));
+  }
+
   return (info != NULL);
 }
 
@@ -760,16 +1003,16 @@ handle_open_in_thread_func (GTask *task,
   g_object_set_data_full (G_OBJECT (request), "content-type", g_strdup (content_type), g_free);
 
   /* collect all the information */
-  find_recommended_choices (scheme, content_type, &default_app, &choices, &n_choices);
+  find_recommended_choices (open_uri, scheme, content_type, &default_app, &choices, &n_choices);
   /* it's never NULL, but might be empty (only contain the NULL terminator) */
   g_assert (choices != NULL);
-  if (default_app != NULL && !app_exists (default_app))
+  if (default_app != NULL && !app_exists (open_uri, default_app))
     g_clear_pointer (&default_app, g_free);
   use_default_app = should_use_default_app (scheme, content_type);
-  get_latest_choice_info (app_id, content_type,
+  get_latest_choice_info (open_uri, app_id, content_type,
                           &latest_id, &latest_count, &latest_threshold,
                           &ask_for_content_type);
-  if (latest_id != NULL && !app_exists (latest_id))
+  if (latest_id != NULL && !app_exists (open_uri, latest_id))
     g_clear_pointer (&latest_id, g_free);
 
   skip_app_chooser = FALSE;
@@ -825,7 +1068,7 @@ handle_open_in_thread_func (GTask *task,
         app = latest_id;
       else if (default_app != NULL)
         app = default_app;
-      else if (n_choices > 0 && app_exists (choices[0]))
+      else if (n_choices > 0 && app_exists (open_uri, choices[0]))
         app = choices[0];
 
       if (app)
@@ -897,7 +1140,11 @@ handle_scheme_supported (XdpDbusOpenURI *object,
                          const gchar *arg_scheme,
                          GVariant *arg_options)
 {
+  OpenURI *open_uri = (OpenURI *) object;
   g_autoptr(GAppInfo) app_info = NULL;
+  gpointer cached;
+  gboolean supported;
+  guint generation;
 
   if (arg_scheme == NULL || *arg_scheme == '\0')
     {
@@ -908,10 +1155,33 @@ handle_scheme_supported (XdpDbusOpenURI *object,
       return G_DBUS_METHOD_INVOCATION_HANDLED;
     }
 
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (g_hash_table_lookup_extended (open_uri->schemes_supported, arg_scheme, NULL, &cached))
+      {
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(b)", GPOINTER_TO_INT (cached)));
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
+      }
+
+    generation = open_uri->handlers_generation;
+  }
+
   app_info = g_app_info_get_default_for_uri_scheme (arg_scheme);
+  supported = app_info != NULL;
+
+  {
+    G_MUTEX_AUTO_LOCK (&open_uri->cache_lock, locker);
+
+    if (generation == open_uri->handlers_generation)
+      cache_insert_locked (open_uri->schemes_supported,
+                           g_strdup (arg_scheme),
+                           GINT_TO_POINTER (supported));
+  }
 
-  g_debug ("Handler for scheme: %s%s found.", arg_scheme, app_info ? "" : " not");
-  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", app_info != NULL));
+  g_debug ("Handler for scheme: %s%s found.", arg_scheme, supported ? "" : " not");
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", supported));
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -926,6 +1196,7 @@ handle_open_uri (XdpDbusOpenURI *object,
   OpenURI *open_uri = (OpenURI *) object;
   XdpRequest *request = xdp_request_from_invocation (invocation);
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
   gboolean writable;
   gboolean ask;
   const char *activation_token = NULL;
@@ -957,13 +1228,19 @@ handle_open_uri (XdpDbusOpenURI *object,
   if (activation_token)
     g_object_set_data_full (G_OBJECT (request), "activation-token", g_strdup (activation_token), g_free);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_open_uri_complete_open_uri (object, invocation, request->id);
 
   task = g_task_new (open_uri, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_open_uri);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_open_in_thread_func);
+  xdp_request_run_in_worker (request, "OpenURI", task, handle_open_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -1018,13 +1295,19 @@ handle_open_file (XdpDbusOpenURI *object,
   if (activation_token)
     g_object_set_data_full (G_OBJECT (request), "activation-token", g_strdup (activation_token), g_free);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_open_uri_complete_open_file (object, invocation, NULL, request->id);
 
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_open_file);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_open_in_thread_func);
+  xdp_request_run_in_worker (request, "OpenURI", task, handle_open_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -1072,13 +1355,19 @@ handle_open_directory (XdpDbusOpenURI *object,
   if (activation_token)
     g_object_set_data_full (G_OBJECT (request), "activation-token", g_strdup (activation_token), g_free);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_open_uri_complete_open_directory (object, invocation, NULL, request->id);
 
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_open_directory);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_open_in_thread_func);
+  xdp_request_run_in_worker (request, "OpenURI", task, handle_open_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -1100,13 +1389,39 @@ open_uri_dispose (GObject *object)
   g_clear_object (&openuri->impl);
   g_clear_object (&openuri->lockdown_impl);
   g_clear_object (&openuri->monitor);
+  g_clear_handle_id (&openuri->used_apps_watch_id, xdp_permissions_unwatch_table);
 
   G_OBJECT_CLASS (open_uri_parent_class)->dispose (object);
 }
 
+static void
+open_uri_finalize (GObject *object)
+{
+  OpenURI *openuri = (OpenURI *) object;
+
+  g_clear_pointer (&openuri->handlers, g_hash_table_unref);
+  g_clear_pointer (&openuri->apps_exist, g_hash_table_unref);
+  g_clear_pointer (&openuri->schemes_supported, g_hash_table_unref);
+  g_clear_pointer (&openuri->used_apps_rows, g_hash_table_unref);
+  g_mutex_clear (&openuri->cache_lock);
+
+  G_OBJECT_CLASS (open_uri_parent_class)->finalize (object);
+}
+
 static void
 open_uri_init (OpenURI *openuri)
 {
+  g_mutex_init (&openuri->cache_lock);
+  openuri->handlers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free,
+                                             (GDestroyNotify) handler_info_free);
+  openuri->apps_exist = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, NULL);
+  openuri->schemes_supported = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, NULL);
+  openuri->used_apps_rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free,
+                                                   (GDestroyNotify) used_apps_row_free);
 }
 
 static void
@@ -1115,6 +1430,7 @@ open_uri_class_init (OpenURIClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = open_uri_dispose;
+  object_class->finalize = open_uri_finalize;
 }
 
 static OpenURI *
@@ -1128,6 +1444,18 @@ open_uri_new (XdpDbusImplAppChooser *app_chooser_impl,
   open_uri->lockdown_impl = g_object_ref (lockdown_impl);
   open_uri->monitor = g_app_info_monitor_get ();
 
+  /* Connected before any per-request handler, so those see fresh data */
+  g_signal_connect_object (open_uri->monitor, "changed",
+                           G_CALLBACK (on_app_info_database_changed),
+                           open_uri, G_CONNECT_DEFAULT);
+  open_uri->used_apps_watch_id =
+    xdp_permissions_watch_table (OPEN_URI_PERMISSION_TABLE,
+                                 on_used_apps_changed,
+                                 open_uri);
+  g_signal_connect_object (xdp_get_permission_store (), "notify::g-name-owner",
+                           G_CALLBACK (on_permission_store_owner_changed),
+                           open_uri, G_CONNECT_DEFAULT);
+
   g_dbus_proxy_set_default_timeout (G_DBUS_PROXY (open_uri->impl),
                                     G_MAXINT);
 
@@ -1136,9 +1464,10 @@ open_uri_new (XdpDbusImplAppChooser *app_chooser_impl,
   return open_uri;
 }
 
-void
-init_open_uri (XdpContext *context)
+DexFuture *
+init_open_uri (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(OpenURI) open_uri = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1149,17 +1478,18 @@ init_open_uri (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, APP_CHOOSER_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_app_chooser_proxy_new_sync (connection,
-                                                   G_DBUS_PROXY_FLAGS_NONE,
-                                                   impl_config->dbus_name,
-                                                   DESKTOP_DBUS_PATH,
-                                                   NULL, &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_app_chooser_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create app chooser proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   lockdown_impl = xdp_context_get_lockdown_impl (context);
@@ -1169,4 +1499,6 @@ init_open_uri (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&open_uri)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
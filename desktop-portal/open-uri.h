@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_open_uri (XdpContext *context);
+DexFuture * init_open_uri (gpointer user_data);
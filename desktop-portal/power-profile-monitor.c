@@ -109,9 +109,10 @@ power_profile_monitor_new (void)
   return power_profile_monitor;
 }
 
-void
-init_power_profile_monitor (XdpContext *context)
+DexFuture *
+init_power_profile_monitor (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(PowerProfileMonitor) power_profile_monitor = NULL;
 
   power_profile_monitor = power_profile_monitor_new ();
@@ -119,4 +120,6 @@ init_power_profile_monitor (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&power_profile_monitor)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
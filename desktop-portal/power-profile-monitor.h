@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_power_profile_monitor (XdpContext *context);
+DexFuture * init_power_profile_monitor (gpointer user_data);
@@ -353,9 +353,10 @@ print_new (XdpDbusImplPrint    *impl,
   return print;
 }
 
-void
-init_print (XdpContext *context)
+DexFuture *
+init_print (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Print) print = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -366,18 +367,18 @@ init_print (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, PRINT_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_print_proxy_new_sync (connection,
-                                             G_DBUS_PROXY_FLAGS_NONE,
-                                             impl_config->dbus_name,
-                                             DESKTOP_DBUS_PATH,
-                                             NULL,
-                                             &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_print_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create print proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   lockdown_impl = xdp_context_get_lockdown_impl (context);
@@ -387,4 +388,6 @@ init_print (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&print)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_print (XdpContext *context);
+DexFuture * init_print (gpointer user_data);
@@ -13,8 +13,22 @@
 #include "xdp-app-info.h"
 #include "xdp-context.h"
 #include "xdp-dbus.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
 
+/* Lookups are cached per origin, since PAC scripts are slow and sandboxed
+ * browsers and package managers resolve the same hosts over and over. */
+#define DEFAULT_LOOKUP_CACHE_TTL_S 60
+#define LOOKUP_CACHE_MAX_ENTRIES 256
+
+typedef struct _CacheEntry
+{
+  char *origin;
+  GStrv proxies;
+  gint64 expire_time;
+  GList link;
+} CacheEntry;
+
 typedef struct _ProxyResolver ProxyResolver;
 typedef struct _ProxyResolverClass ProxyResolverClass;
 
@@ -23,6 +37,14 @@ struct _ProxyResolver
   XdpDbusProxyResolverSkeleton parent_instance;
 
   GProxyResolver *resolver;
+  GNetworkMonitor *network_monitor;
+  GPtrArray *proxy_settings; /* GSettings */
+
+  GMutex cache_lock;
+  GHashTable *cache; /* origin -> CacheEntry */
+  GQueue cache_lru; /* CacheEntry, most recently used first */
+  unsigned int cache_generation;
+  gint64 cache_ttl_usec;
 };
 
 struct _ProxyResolverClass
@@ -30,6 +52,15 @@ struct _ProxyResolverClass
   XdpDbusProxyResolverSkeletonClass parent_class;
 };
 
+typedef struct _LookupData
+{
+  ProxyResolver *resolver;
+  GDBusMethodInvocation *invocation;
+  char *origin;
+  unsigned int cache_generation;
+  gint64 start_time;
+} LookupData;
+
 GType proxy_resolver_get_type (void);
 static void proxy_resolver_iface_init (XdpDbusProxyResolverIface *iface);
 
@@ -40,6 +71,161 @@ G_DEFINE_TYPE_WITH_CODE (ProxyResolver, proxy_resolver,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (ProxyResolver, g_object_unref)
 
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->origin);
+  g_strfreev (entry->proxies);
+  g_free (entry);
+}
+
+static void
+lookup_data_free (LookupData *data)
+{
+  g_clear_object (&data->resolver);
+  g_clear_object (&data->invocation);
+  g_clear_pointer (&data->origin, g_free);
+  g_free (data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (LookupData, lookup_data_free)
+
+/* Returns the scheme, host and port of @uri, or %NULL if it can't be
+ * parsed, in which case the lookup is not cached. */
+static char *
+get_origin (const char *uri)
+{
+  g_autofree char *scheme = NULL;
+  g_autofree char *host = NULL;
+  g_autofree char *scheme_lower = NULL;
+  g_autofree char *host_lower = NULL;
+  int port;
+
+  if (!g_uri_split_network (uri, G_URI_FLAGS_NONE,
+                            &scheme, &host, &port,
+                            NULL))
+    return NULL;
+
+  if (scheme == NULL || host == NULL)
+    return NULL;
+
+  scheme_lower = g_ascii_strdown (scheme, -1);
+  host_lower = g_ascii_strdown (host, -1);
+
+  return g_strdup_printf ("%s://%s:%d", scheme_lower, host_lower, port);
+}
+
+static void
+invalidate_cache (ProxyResolver *resolver)
+{
+  G_MUTEX_AUTO_LOCK (&resolver->cache_lock, locker);
+
+  g_debug ("Proxy configuration changed, dropping %u cached lookups",
+           g_hash_table_size (resolver->cache));
+
+  /* Lookups in flight started with the old configuration */
+  resolver->cache_generation++;
+
+  g_queue_init (&resolver->cache_lru);
+  g_hash_table_remove_all (resolver->cache);
+}
+
+static GStrv
+lookup_cached (ProxyResolver *resolver,
+               const char    *origin)
+{
+  CacheEntry *entry;
+
+  G_MUTEX_AUTO_LOCK (&resolver->cache_lock, locker);
+
+  entry = g_hash_table_lookup (resolver->cache, origin);
+  if (entry == NULL)
+    return NULL;
+
+  if (entry->expire_time <= g_get_monotonic_time ())
+    {
+      g_queue_unlink (&resolver->cache_lru, &entry->link);
+      g_hash_table_remove (resolver->cache, origin);
+      return NULL;
+    }
+
+  g_queue_unlink (&resolver->cache_lru, &entry->link);
+  g_queue_push_head_link (&resolver->cache_lru, &entry->link);
+
+  return g_strdupv (entry->proxies);
+}
+
+static void
+cache_lookup (ProxyResolver      *resolver,
+              const char         *origin,
+              unsigned int        cache_generation,
+              const char * const *proxies)
+{
+  CacheEntry *entry;
+
+  G_MUTEX_AUTO_LOCK (&resolver->cache_lock, locker);
+
+  if (cache_generation != resolver->cache_generation)
+    return;
+
+  entry = g_hash_table_lookup (resolver->cache, origin);
+  if (entry)
+    {
+      g_queue_unlink (&resolver->cache_lru, &entry->link);
+      g_hash_table_remove (resolver->cache, origin);
+    }
+
+  while (resolver->cache_lru.length >= LOOKUP_CACHE_MAX_ENTRIES)
+    {
+      CacheEntry *oldest = g_queue_peek_tail (&resolver->cache_lru);
+
+      g_queue_unlink (&resolver->cache_lru, &oldest->link);
+      g_hash_table_remove (resolver->cache, oldest->origin);
+    }
+
+  entry = g_new0 (CacheEntry, 1);
+  entry->origin = g_strdup (origin);
+  entry->proxies = g_strdupv ((GStrv) proxies);
+  entry->expire_time = g_get_monotonic_time () + resolver->cache_ttl_usec;
+  entry->link.data = entry;
+
+  g_hash_table_insert (resolver->cache, entry->origin, entry);
+  g_queue_push_head_link (&resolver->cache_lru, &entry->link);
+}
+
+static void
+on_lookup_finished (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  g_autoptr(LookupData) data = user_data;
+  g_auto(GStrv) proxies = NULL;
+  g_autoptr(GError) error = NULL;
+
+  proxies = g_proxy_resolver_lookup_finish (G_PROXY_RESOLVER (source_object),
+                                            result,
+                                            &error);
+
+  xdp_metrics_record_since ("proxy-resolver.resolve", data->start_time);
+  if (!proxies)
+    {
+      g_dbus_method_invocation_take_error (g_steal_pointer (&data->invocation),
+                                           g_steal_pointer (&error));
+      return;
+    }
+
+  if (data->origin)
+    {
+      cache_lookup (data->resolver,
+                    data->origin,
+                    data->cache_generation,
+                    (const char * const *) proxies);
+    }
+
+  g_dbus_method_invocation_return_value (g_steal_pointer (&data->invocation),
+                                         g_variant_new ("(^as)", proxies));
+}
+
 static gboolean
 proxy_resolver_handle_lookup (XdpDbusProxyResolver *object,
                               GDBusMethodInvocation *invocation,
@@ -57,30 +243,80 @@ proxy_resolver_handle_lookup (XdpDbusProxyResolver *object,
     }
   else
     {
-      g_auto (GStrv) proxies = NULL;
-      g_autoptr (GError) error = NULL;
-
-      proxies = g_proxy_resolver_lookup (resolver->resolver, arg_uri, NULL, &error);
-      if (!proxies)
-        g_dbus_method_invocation_take_error (invocation, g_steal_pointer (&error));
-      else
-        g_dbus_method_invocation_return_value (invocation,
-                                               g_variant_new ("(^as)", proxies));
+      g_autofree char *origin = get_origin (arg_uri);
+      g_auto(GStrv) proxies = NULL;
+      LookupData *data;
+
+      if (origin)
+        proxies = lookup_cached (resolver, origin);
+
+      if (proxies)
+        {
+          g_dbus_method_invocation_return_value (invocation,
+                                                 g_variant_new ("(^as)", proxies));
+          return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+
+      data = g_new0 (LookupData, 1);
+      data->resolver = g_object_ref (resolver);
+      data->invocation = g_object_ref (invocation);
+      data->origin = g_steal_pointer (&origin);
+      data->start_time = xdp_metrics_start ();
+
+      g_mutex_lock (&resolver->cache_lock);
+      data->cache_generation = resolver->cache_generation;
+      g_mutex_unlock (&resolver->cache_lock);
+
+      /* PAC scripts can take a long time, so don't block the thread */
+      g_proxy_resolver_lookup_async (resolver->resolver,
+                                     arg_uri,
+                                     NULL,
+                                     on_lookup_finished,
+                                     data);
     }
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+static void
+on_proxy_configuration_changed (ProxyResolver *resolver)
+{
+  invalidate_cache (resolver);
+}
+
 static void
 proxy_resolver_dispose (GObject *object)
 {
   ProxyResolver *resolver = (ProxyResolver *)object;
 
+  if (resolver->network_monitor)
+    {
+      g_signal_handlers_disconnect_by_data (resolver->network_monitor, resolver);
+      g_clear_object (&resolver->network_monitor);
+    }
+
+  g_clear_pointer (&resolver->proxy_settings, g_ptr_array_unref);
   g_clear_object (&resolver->resolver);
 
+  if (resolver->cache)
+    {
+      g_queue_init (&resolver->cache_lru);
+      g_clear_pointer (&resolver->cache, g_hash_table_unref);
+    }
+
   G_OBJECT_CLASS (proxy_resolver_parent_class)->dispose (object);
 }
 
+static void
+proxy_resolver_finalize (GObject *object)
+{
+  ProxyResolver *resolver = (ProxyResolver *)object;
+
+  g_mutex_clear (&resolver->cache_lock);
+
+  G_OBJECT_CLASS (proxy_resolver_parent_class)->finalize (object);
+}
+
 static void
 proxy_resolver_iface_init (XdpDbusProxyResolverIface *iface)
 {
@@ -90,6 +326,11 @@ proxy_resolver_iface_init (XdpDbusProxyResolverIface *iface)
 static void
 proxy_resolver_init (ProxyResolver *resolver)
 {
+  g_mutex_init (&resolver->cache_lock);
+  g_queue_init (&resolver->cache_lru);
+  resolver->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           NULL,
+                                           (GDestroyNotify) cache_entry_free);
 }
 
 static void
@@ -98,6 +339,56 @@ proxy_resolver_class_init (ProxyResolverClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = proxy_resolver_dispose;
+  object_class->finalize = proxy_resolver_finalize;
+}
+
+/* GProxyResolver has no change notification, so watch what the default
+ * resolvers read their configuration from. */
+static void
+watch_proxy_configuration (ProxyResolver *resolver)
+{
+  GSettingsSchemaSource *source = g_settings_schema_source_get_default ();
+  g_autoptr(GSettingsSchema) schema = NULL;
+  g_autoptr(GSettings) settings = NULL;
+  g_auto(GStrv) children = NULL;
+
+  resolver->network_monitor = g_object_ref (g_network_monitor_get_default ());
+  g_signal_connect_swapped (resolver->network_monitor, "network-changed",
+                            G_CALLBACK (on_proxy_configuration_changed),
+                            resolver);
+  /* Logging in to a captive portal or a VPN coming up doesn't necessarily
+   * change the routes, but can change the proxy a PAC script picks */
+  g_signal_connect_swapped (resolver->network_monitor, "notify::connectivity",
+                            G_CALLBACK (on_proxy_configuration_changed),
+                            resolver);
+
+  resolver->proxy_settings = g_ptr_array_new_with_free_func (g_object_unref);
+
+  if (source)
+    schema = g_settings_schema_source_lookup (source, "org.gnome.system.proxy", TRUE);
+  if (schema == NULL)
+    return;
+
+  settings = g_settings_new_full (schema, NULL, NULL);
+
+  /* The per-protocol settings are in child schemas */
+  children = g_settings_schema_list_children (schema);
+  for (size_t i = 0; children[i]; i++)
+    {
+      GSettings *child = g_settings_get_child (settings, children[i]);
+
+      g_signal_connect_object (child, "changed",
+                               G_CALLBACK (on_proxy_configuration_changed),
+                               resolver,
+                               G_CONNECT_SWAPPED);
+      g_ptr_array_add (resolver->proxy_settings, child);
+    }
+
+  g_signal_connect_object (settings, "changed",
+                           G_CALLBACK (on_proxy_configuration_changed),
+                           resolver,
+                           G_CONNECT_SWAPPED);
+  g_ptr_array_add (resolver->proxy_settings, g_steal_pointer (&settings));
 }
 
 static ProxyResolver *
@@ -106,16 +397,21 @@ proxy_resolver_new (void)
   ProxyResolver *proxy_resolver;
 
   proxy_resolver = g_object_new (proxy_resolver_get_type (), NULL);
-  proxy_resolver->resolver = g_proxy_resolver_get_default ();
+  proxy_resolver->resolver = g_object_ref (g_proxy_resolver_get_default ());
+  proxy_resolver->cache_ttl_usec =
+    (gint64) xdp_get_env_uint ("XDG_DESKTOP_PORTAL_PROXY_CACHE_TTL_S",
+                               DEFAULT_LOOKUP_CACHE_TTL_S) * G_USEC_PER_SEC;
+  watch_proxy_configuration (proxy_resolver);
 
   xdp_dbus_proxy_resolver_set_version (XDP_DBUS_PROXY_RESOLVER (proxy_resolver), 1);
 
   return proxy_resolver;
 }
 
-void
-init_proxy_resolver (XdpContext *context)
+DexFuture *
+init_proxy_resolver (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(ProxyResolver) proxy_resolver = NULL;
 
   proxy_resolver = proxy_resolver_new ();
@@ -123,4 +419,6 @@ init_proxy_resolver (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&proxy_resolver)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_proxy_resolver (XdpContext *context);
+DexFuture * init_proxy_resolver (gpointer user_data);
@@ -314,9 +314,10 @@ realtime_new (void)
   return realtime;
 }
 
-void
-init_realtime (XdpContext *context)
+DexFuture *
+init_realtime (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Realtime) realtime = NULL;
 
   realtime = realtime_new ();
@@ -324,4 +325,6 @@ init_realtime (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&realtime)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_realtime (XdpContext *context);
+DexFuture * init_realtime (gpointer user_data);
@@ -188,9 +188,10 @@ registry_new (XdpAppInfoRegistry *app_info_registry)
   return registry;
 }
 
-void
-init_registry (XdpContext *context)
+DexFuture *
+init_registry (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Registry) registry = NULL;
   XdpAppInfoRegistry *app_info_registry =
     xdp_context_get_app_info_registry (context);
@@ -206,4 +207,6 @@ init_registry (XdpContext *context)
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&registry)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_FIBER |
                                       XDP_CONTEXT_EXPORT_FLAGS_SKIP_AUTH);
+
+  return dex_future_new_true ();
 }
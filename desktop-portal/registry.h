@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_registry (XdpContext *context);
+DexFuture * init_registry (gpointer user_data);
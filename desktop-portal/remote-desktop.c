@@ -1497,6 +1497,394 @@ handle_notify_touch_up (XdpDbusRemoteDesktop *object,
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+typedef enum _InputEventType
+{
+  INPUT_EVENT_POINTER_MOTION,
+  INPUT_EVENT_POINTER_MOTION_ABSOLUTE,
+  INPUT_EVENT_POINTER_BUTTON,
+  INPUT_EVENT_POINTER_AXIS,
+  INPUT_EVENT_POINTER_AXIS_DISCRETE,
+  INPUT_EVENT_KEYBOARD_KEYCODE,
+  INPUT_EVENT_KEYBOARD_KEYSYM,
+  INPUT_EVENT_TOUCH_DOWN,
+  INPUT_EVENT_TOUCH_MOTION,
+  INPUT_EVENT_TOUCH_UP,
+} InputEventType;
+
+static const struct {
+  const char *name;
+  InputEventType type;
+  DeviceType device_type;
+} input_event_types[] = {
+  { "pointer-motion", INPUT_EVENT_POINTER_MOTION, DEVICE_TYPE_POINTER },
+  { "pointer-motion-absolute", INPUT_EVENT_POINTER_MOTION_ABSOLUTE, DEVICE_TYPE_POINTER },
+  { "pointer-button", INPUT_EVENT_POINTER_BUTTON, DEVICE_TYPE_POINTER },
+  { "pointer-axis", INPUT_EVENT_POINTER_AXIS, DEVICE_TYPE_POINTER },
+  { "pointer-axis-discrete", INPUT_EVENT_POINTER_AXIS_DISCRETE, DEVICE_TYPE_POINTER },
+  { "keyboard-keycode", INPUT_EVENT_KEYBOARD_KEYCODE, DEVICE_TYPE_KEYBOARD },
+  { "keyboard-keysym", INPUT_EVENT_KEYBOARD_KEYSYM, DEVICE_TYPE_KEYBOARD },
+  { "touch-down", INPUT_EVENT_TOUCH_DOWN, DEVICE_TYPE_TOUCHSCREEN },
+  { "touch-motion", INPUT_EVENT_TOUCH_MOTION, DEVICE_TYPE_TOUCHSCREEN },
+  { "touch-up", INPUT_EVENT_TOUCH_UP, DEVICE_TYPE_TOUCHSCREEN },
+};
+
+typedef struct _InputEvent
+{
+  InputEventType type;
+  uint64_t timestamp;
+
+  double x;
+  double y;
+  uint32_t stream;
+  uint32_t slot;
+  int32_t code;
+  uint32_t state;
+  gboolean finish;
+} InputEvent;
+
+static gboolean
+lookup_event_param (GVariant    *params,
+                    const char  *event_name,
+                    const char  *key,
+                    const char  *format,
+                    gpointer     out_value,
+                    GError     **error)
+{
+  if (!g_variant_lookup (params, key, format, out_value))
+    {
+      g_set_error (error,
+                   XDG_DESKTOP_PORTAL_ERROR,
+                   XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                   "Missing or invalid '%s' in %s event", key, event_name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+parse_input_event (XdpSession  *session,
+                   GVariant    *event_variant,
+                   InputEvent  *event,
+                   GError     **error)
+{
+  g_autoptr(GVariant) params = NULL;
+  const char *name;
+  gboolean found = FALSE;
+  DeviceType device_type = DEVICE_TYPE_NONE;
+  size_t i;
+
+  g_variant_get (event_variant, "(&st@a{sv})", &name, &event->timestamp, &params);
+
+  for (i = 0; i < G_N_ELEMENTS (input_event_types); i++)
+    {
+      if (g_strcmp0 (input_event_types[i].name, name) == 0)
+        {
+          event->type = input_event_types[i].type;
+          device_type = input_event_types[i].device_type;
+          found = TRUE;
+          break;
+        }
+    }
+
+  if (!found)
+    {
+      g_set_error (error,
+                   XDG_DESKTOP_PORTAL_ERROR,
+                   XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                   "Unknown input event type '%s'", name);
+      return FALSE;
+    }
+
+  if (!check_notify (session, device_type))
+    {
+      g_set_error (error,
+                   G_DBUS_ERROR,
+                   G_DBUS_ERROR_FAILED,
+                   "Session is not allowed to send %s events", name);
+      return FALSE;
+    }
+
+  switch (event->type)
+    {
+    case INPUT_EVENT_POINTER_MOTION:
+    case INPUT_EVENT_POINTER_AXIS:
+      if (!lookup_event_param (params, name, "dx", "d", &event->x, error) ||
+          !lookup_event_param (params, name, "dy", "d", &event->y, error))
+        return FALSE;
+      if (event->type == INPUT_EVENT_POINTER_AXIS)
+        g_variant_lookup (params, "finish", "b", &event->finish);
+      break;
+
+    case INPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+    case INPUT_EVENT_TOUCH_DOWN:
+    case INPUT_EVENT_TOUCH_MOTION:
+      if (!lookup_event_param (params, name, "stream", "u", &event->stream, error) ||
+          !lookup_event_param (params, name, "x", "d", &event->x, error) ||
+          !lookup_event_param (params, name, "y", "d", &event->y, error))
+        return FALSE;
+      if (event->type != INPUT_EVENT_POINTER_MOTION_ABSOLUTE &&
+          !lookup_event_param (params, name, "slot", "u", &event->slot, error))
+        return FALSE;
+      if (!check_position (session, event->stream, event->x, event->y))
+        {
+          g_set_error (error,
+                       G_DBUS_ERROR,
+                       G_DBUS_ERROR_FAILED,
+                       "Invalid position in %s event", name);
+          return FALSE;
+        }
+      break;
+
+    case INPUT_EVENT_POINTER_BUTTON:
+      if (!lookup_event_param (params, name, "button", "i", &event->code, error) ||
+          !lookup_event_param (params, name, "state", "u", &event->state, error))
+        return FALSE;
+      break;
+
+    case INPUT_EVENT_POINTER_AXIS_DISCRETE:
+      if (!lookup_event_param (params, name, "axis", "u", &event->state, error) ||
+          !lookup_event_param (params, name, "steps", "i", &event->code, error))
+        return FALSE;
+      break;
+
+    case INPUT_EVENT_KEYBOARD_KEYCODE:
+      if (!lookup_event_param (params, name, "keycode", "i", &event->code, error) ||
+          !lookup_event_param (params, name, "state", "u", &event->state, error))
+        return FALSE;
+      break;
+
+    case INPUT_EVENT_KEYBOARD_KEYSYM:
+      if (!lookup_event_param (params, name, "keysym", "i", &event->code, error) ||
+          !lookup_event_param (params, name, "state", "u", &event->state, error))
+        return FALSE;
+      break;
+
+    case INPUT_EVENT_TOUCH_UP:
+      if (!lookup_event_param (params, name, "slot", "u", &event->slot, error))
+        return FALSE;
+      break;
+    }
+
+  return TRUE;
+}
+
+static void
+forward_input_event (RemoteDesktop    *remote_desktop,
+                     XdpSession       *session,
+                     GVariant         *options,
+                     const InputEvent *event)
+{
+  XdpDbusImplRemoteDesktop *impl = remote_desktop->impl;
+
+  switch (event->type)
+    {
+    case INPUT_EVENT_POINTER_MOTION:
+      xdp_dbus_impl_remote_desktop_call_notify_pointer_motion (impl,
+                                                               session->id,
+                                                               options,
+                                                               event->x, event->y,
+                                                               NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+      xdp_dbus_impl_remote_desktop_call_notify_pointer_motion_absolute (impl,
+                                                                        session->id,
+                                                                        options,
+                                                                        event->stream,
+                                                                        event->x, event->y,
+                                                                        NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_POINTER_BUTTON:
+      xdp_dbus_impl_remote_desktop_call_notify_pointer_button (impl,
+                                                               session->id,
+                                                               options,
+                                                               event->code,
+                                                               event->state,
+                                                               NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_POINTER_AXIS:
+      {
+        g_auto(GVariantBuilder) axis_options_builder =
+          G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+
+        if (event->finish)
+          g_variant_builder_add (&axis_options_builder, "{sv}",
+                                 "finish", g_variant_new_boolean (TRUE));
+
+        xdp_dbus_impl_remote_desktop_call_notify_pointer_axis (impl,
+                                                               session->id,
+                                                               g_variant_builder_end (&axis_options_builder),
+                                                               event->x, event->y,
+                                                               NULL, NULL, NULL);
+      }
+      break;
+
+    case INPUT_EVENT_POINTER_AXIS_DISCRETE:
+      xdp_dbus_impl_remote_desktop_call_notify_pointer_axis_discrete (impl,
+                                                                      session->id,
+                                                                      options,
+                                                                      event->state,
+                                                                      event->code,
+                                                                      NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_KEYBOARD_KEYCODE:
+      xdp_dbus_impl_remote_desktop_call_notify_keyboard_keycode (impl,
+                                                                 session->id,
+                                                                 options,
+                                                                 event->code,
+                                                                 event->state,
+                                                                 NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_KEYBOARD_KEYSYM:
+      xdp_dbus_impl_remote_desktop_call_notify_keyboard_keysym (impl,
+                                                                session->id,
+                                                                options,
+                                                                event->code,
+                                                                event->state,
+                                                                NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_TOUCH_DOWN:
+      xdp_dbus_impl_remote_desktop_call_notify_touch_down (impl,
+                                                           session->id,
+                                                           options,
+                                                           event->stream,
+                                                           event->slot,
+                                                           event->x, event->y,
+                                                           NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_TOUCH_MOTION:
+      xdp_dbus_impl_remote_desktop_call_notify_touch_motion (impl,
+                                                             session->id,
+                                                             options,
+                                                             event->stream,
+                                                             event->slot,
+                                                             event->x, event->y,
+                                                             NULL, NULL, NULL);
+      break;
+
+    case INPUT_EVENT_TOUCH_UP:
+      xdp_dbus_impl_remote_desktop_call_notify_touch_up (impl,
+                                                         session->id,
+                                                         options,
+                                                         event->slot,
+                                                         NULL, NULL, NULL);
+      break;
+    }
+}
+
+static gboolean
+handle_notify_input_events (XdpDbusRemoteDesktop *object,
+                            GDBusMethodInvocation *invocation,
+                            const char *arg_session_handle,
+                            GVariant *arg_options,
+                            GVariant *arg_events)
+{
+  RemoteDesktop *remote_desktop = (RemoteDesktop *) object;
+  XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
+  XdpSession *session;
+  g_auto(GVariantBuilder) options_builder =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GVariant) options = NULL;
+  g_autoptr(GArray) events = NULL;
+  g_autoptr(GError) error = NULL;
+  uint64_t last_timestamp = 0;
+  size_t n_events;
+  size_t i;
+
+  session = xdp_session_from_app_info (arg_session_handle, app_info);
+  if (!session)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_ACCESS_DENIED,
+                                             "Invalid session");
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
+  SESSION_AUTOLOCK_UNREF (session);
+
+  if (!IS_REMOTE_DESKTOP_SESSION (session))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_ACCESS_DENIED,
+                                             "Invalid session");
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
+  if (!xdp_filter_options (arg_options, &options_builder,
+                           remote_desktop_notify_options,
+                           G_N_ELEMENTS (remote_desktop_notify_options),
+                           NULL, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+  options = g_variant_ref_sink (g_variant_builder_end (&options_builder));
+
+  /* Validate the whole batch before forwarding anything, so a bad event
+   * doesn't leave the remote side with half of a button press. */
+  n_events = g_variant_n_children (arg_events);
+  events = g_array_sized_new (FALSE, TRUE, sizeof (InputEvent), n_events);
+
+  for (i = 0; i < n_events; i++)
+    {
+      g_autoptr(GVariant) event_variant = NULL;
+      InputEvent event = { 0, };
+
+      event_variant = g_variant_get_child_value (arg_events, i);
+      if (!parse_input_event (session, event_variant, &event, &error))
+        {
+          g_dbus_method_invocation_return_gerror (invocation, error);
+          return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+
+      if (event.timestamp < last_timestamp)
+        {
+          g_dbus_method_invocation_return_error (invocation,
+                                                 XDG_DESKTOP_PORTAL_ERROR,
+                                                 XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                                 "Input event timestamps must not decrease");
+          return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+      last_timestamp = event.timestamp;
+
+      /* Successive relative motions are folded into a single one */
+      if (event.type == INPUT_EVENT_POINTER_MOTION && events->len > 0)
+        {
+          InputEvent *last = &g_array_index (events, InputEvent, events->len - 1);
+
+          if (last->type == INPUT_EVENT_POINTER_MOTION)
+            {
+              last->x += event.x;
+              last->y += event.y;
+              last->timestamp = event.timestamp;
+              continue;
+            }
+        }
+
+      g_array_append_val (events, event);
+    }
+
+  g_debug ("Forwarding %u of %zu input events for remote desktop session %s",
+           events->len, n_events, session->id);
+
+  for (i = 0; i < events->len; i++)
+    forward_input_event (remote_desktop, session, options,
+                         &g_array_index (events, InputEvent, i));
+
+  xdp_dbus_remote_desktop_complete_notify_input_events (object, invocation);
+
+  return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
 static XdpOptionKey remote_desktop_connect_to_eis_options[] = {
 };
 
@@ -1614,6 +2002,7 @@ remote_desktop_iface_init (XdpDbusRemoteDesktopIface *iface)
   iface->handle_notify_touch_down = handle_notify_touch_down;
   iface->handle_notify_touch_motion = handle_notify_touch_motion;
   iface->handle_notify_touch_up = handle_notify_touch_up;
+  iface->handle_notify_input_events = handle_notify_input_events;
 
   iface->handle_connect_to_eis = handle_connect_to_eis;
 }
@@ -1654,7 +2043,7 @@ remote_desktop_new (XdpContext               *context,
 
   g_dbus_proxy_set_default_timeout (G_DBUS_PROXY (remote_desktop->impl), G_MAXINT);
 
-  xdp_dbus_remote_desktop_set_version (XDP_DBUS_REMOTE_DESKTOP (remote_desktop), 2);
+  xdp_dbus_remote_desktop_set_version (XDP_DBUS_REMOTE_DESKTOP (remote_desktop), 3);
 
   g_object_bind_property (G_OBJECT (remote_desktop->impl), "available-device-types",
                           G_OBJECT (remote_desktop), "available-device-types",
@@ -1663,9 +2052,10 @@ remote_desktop_new (XdpContext               *context,
   return remote_desktop;
 }
 
-void
-init_remote_desktop (XdpContext *context)
+DexFuture *
+init_remote_desktop (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(RemoteDesktop) remote_desktop = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1675,18 +2065,18 @@ init_remote_desktop (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, REMOTE_DESKTOP_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_remote_desktop_proxy_new_sync (connection,
-                                                      G_DBUS_PROXY_FLAGS_NONE,
-                                                      impl_config->dbus_name,
-                                                      DESKTOP_DBUS_PATH,
-                                                      NULL,
-                                                      &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_remote_desktop_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create remote desktop proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   remote_desktop = remote_desktop_new (context, impl);
@@ -1694,4 +2084,6 @@ init_remote_desktop (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&remote_desktop)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <gio/gio.h>
+#include <libdex.h>
 
 #include "xdp-session.h"
 #include "xdp-types.h"
@@ -43,4 +44,4 @@ void remote_desktop_session_clipboard_requested (RemoteDesktopSession *session);
 gboolean
 remote_desktop_session_can_access_clipboard (RemoteDesktopSession *session);
 
-void init_remote_desktop (XdpContext *context);
+DexFuture * init_remote_desktop (gpointer user_data);
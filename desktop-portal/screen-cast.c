@@ -1128,9 +1128,10 @@ screen_cast_new (XdpContext            *context,
   return screen_cast;
 }
 
-void
-init_screen_cast (XdpContext *context)
+DexFuture *
+init_screen_cast (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(ScreenCast) screen_cast = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1140,18 +1141,18 @@ init_screen_cast (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, SCREEN_CAST_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
-
-  impl = xdp_dbus_impl_screen_cast_proxy_new_sync (connection,
-                                                   G_DBUS_PROXY_FLAGS_NONE,
-                                                   impl_config->dbus_name,
-                                                   DESKTOP_DBUS_PATH,
-                                                   NULL,
-                                                   &error);
+    return dex_future_new_true ();
+
+  impl = dex_await_object (xdp_dbus_impl_screen_cast_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create screen cast proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   screen_cast = screen_cast_new (context, impl);
@@ -1159,4 +1160,6 @@ init_screen_cast (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&screen_cast)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include <gio/gio.h>
+#include <libdex.h>
 
 #include "xdp-types.h"
 
@@ -26,4 +27,4 @@ void screen_cast_stream_get_size (ScreenCastStream *stream,
 
 GList * collect_screen_cast_stream_data (GVariantIter *streams_iter);
 
-void init_screen_cast (XdpContext *context);
+DexFuture * init_screen_cast (gpointer user_data);
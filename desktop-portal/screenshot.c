@@ -16,6 +16,7 @@
 
 #include <gio/gdesktopappinfo.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib/gi18n.h>
 
 #include "xdp-context.h"
@@ -79,73 +80,156 @@ send_response (XdpRequest *request,
     }
 }
 
+/* gdbus-codegen can't attach fds to signals, so the Response signal is
+ * built by hand. It is only sent to the caller.
+ */
 static void
-send_response_in_thread_func (GTask *task,
-                              gpointer source_object,
-                              gpointer task_data,
-                              GCancellable *cancellable)
+send_response_with_fds (XdpRequest  *request,
+                        guint        response,
+                        GVariant    *results,
+                        GUnixFDList *fd_list)
 {
-  XdpRequest *request = task_data;
-  g_auto(GVariantBuilder) results =
-    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
-  guint response;
-  GVariant *options;
+  g_autoptr(GDBusMessage) message = NULL;
   g_autoptr(GError) error = NULL;
-  const char *retval;
+  GDBusConnection *connection;
 
-  REQUEST_AUTOLOCK (request);
+  if (!request->exported)
+    {
+      g_variant_ref_sink (results);
+      g_variant_unref (results);
+      return;
+    }
 
-  response = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (request), "response"));
-  options = (GVariant *)g_object_get_data (G_OBJECT (request), "options");
+  connection = g_dbus_interface_skeleton_get_connection (G_DBUS_INTERFACE_SKELETON (request));
 
-  if (response != 0)
-    goto out;
+  message = g_dbus_message_new_signal (request->id,
+                                       "org.freedesktop.portal.Request",
+                                       "Response");
+  g_dbus_message_set_destination (message, request->sender);
+  g_dbus_message_set_body (message, g_variant_new ("(u@a{sv})", response, results));
+  g_dbus_message_set_unix_fd_list (message, fd_list);
 
-  retval = g_object_get_data (G_OBJECT (task), "retval");
-  if (g_strcmp0 (retval, "url") == 0)
+  g_debug ("sending response with %d fds: %d",
+           g_unix_fd_list_get_length (fd_list), response);
+
+  if (!g_dbus_connection_send_message (connection, message,
+                                       G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                       NULL, &error))
+    g_warning ("Failed to send screenshot response: %s", error->message);
+
+  xdp_request_unexport (request);
+}
+
+static void
+open_screenshot_in_thread (GTask        *task,
+                           gpointer      source_object,
+                           gpointer      task_data,
+                           GCancellable *cancellable)
+{
+  const char *path = task_data;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autofd int fd = -1;
+  GError *error = NULL;
+  struct stat st;
+
+  fd = open (path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+  if (fd == -1)
     {
-      const char *uri;
-      g_autofree char *ruri = NULL;
+      int errsv = errno;
 
-      if (!g_variant_lookup (options, "uri", "&s", &uri))
-        {
-          g_warning ("No URI was provided");
-          goto out;
-        }
+      g_task_return_new_error (task, G_IO_ERROR, g_io_error_from_errno (errsv),
+                               "Failed to open %s: %s", path, g_strerror (errsv));
+      return;
+    }
 
-      if (xdp_app_info_is_host (request->app_info))
-        ruri = g_strdup (uri);
-      else
-        ruri = xdp_register_document (uri,
-                                      xdp_app_info_get_id (request->app_info),
-                                      xdp_app_info_get_gappinfo (request->app_info),
-                                      XDP_DOCUMENT_FLAG_DELETABLE,
-                                      &error);
-
-      if (ruri == NULL)
-        g_warning ("Failed to register %s: %s", uri, error->message);
-      else
-        g_variant_builder_add (&results, "{&sv}", "uri", g_variant_new_string (ruri));
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_REGULAR_FILE,
+                               "Failed to open %s: Not a regular file", path);
+      return;
     }
-  else if (g_strcmp0 (retval, "color") == 0)
+
+  fd_list = g_unix_fd_list_new ();
+  if (g_unix_fd_list_append (fd_list, fd, &error) == -1)
     {
-      double red, green, blue;
+      g_task_return_error (task, error);
+      return;
+    }
 
-      if (!g_variant_lookup (options, "color", "(ddd)", &red, &green, &blue))
-        {
-          g_warning ("No color was provided");
-          goto out;
-        }
+  g_task_return_pointer (task, g_steal_pointer (&fd_list), g_object_unref);
+}
 
-      g_variant_builder_add (&results, "{&sv}", "color", g_variant_new ("(ddd)", red, green, blue));
+static void
+screenshot_fd_opened (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      data)
+{
+  g_autoptr(XdpRequest) request = data;
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autoptr(GError) error = NULL;
+
+  REQUEST_AUTOLOCK (request);
+
+  fd_list = g_task_propagate_pointer (G_TASK (result), &error);
+  if (fd_list == NULL)
+    {
+      g_warning ("Failed to send screenshot: %s", error->message);
+      send_response (request, 2, g_variant_builder_end (&results));
+      return;
     }
-  else
+
+  /* The screenshot is the only fd in the list */
+  g_variant_builder_add (&results, "{&sv}", "fd", g_variant_new_handle (0));
+  send_response_with_fds (request, 0, g_variant_builder_end (&results), fd_list);
+}
+
+static void
+send_screenshot_fd (XdpRequest *request,
+                    const char *uri)
+{
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
+  char *path;
+
+  path = g_filename_from_uri (uri, NULL, &error);
+  if (path == NULL)
     {
-      g_warning ("Don't know what to return");
+      g_warning ("Failed to open %s: %s", uri, error->message);
+      send_response (request, 2, g_variant_builder_end (&results));
+      return;
     }
 
-out:
-  send_response (request, response, g_variant_builder_end (&results));
+  /* Opening the file can block, e.g. on network file systems, so it is
+   * done in a worker rather than on the main thread */
+  task = g_task_new (NULL, NULL, screenshot_fd_opened, g_object_ref (request));
+  g_task_set_task_data (task, path, g_free);
+  xdp_request_run_in_worker (request, "Screenshot", task, open_screenshot_in_thread);
+}
+
+static void
+register_screenshot_done (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      data)
+{
+  g_autoptr(XdpRequest) request = data;
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  g_autoptr(GError) error = NULL;
+  g_autofree char *ruri = NULL;
+
+  REQUEST_AUTOLOCK (request);
+
+  ruri = xdp_register_document_finish (result, &error);
+  if (ruri == NULL)
+    g_warning ("Failed to register screenshot: %s", error->message);
+  else
+    g_variant_builder_add (&results, "{&sv}", "uri", g_variant_new_string (ruri));
+
+  send_response (request, 0, g_variant_builder_end (&results));
 }
 
 static void
@@ -154,10 +238,14 @@ screenshot_done (GObject *source,
                  gpointer data)
 {
   g_autoptr(XdpRequest) request = data;
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
   guint response = 2;
   g_autoptr(GVariant) options = NULL;
   g_autoptr(GError) error = NULL;
-  g_autoptr(GTask) task = NULL;
+  GVariant *request_options;
+  gboolean read_only_fd;
+  const char *uri;
 
   if (!xdp_dbus_impl_screenshot_call_screenshot_finish (XDP_DBUS_IMPL_SCREENSHOT (source),
                                                         &response,
@@ -169,15 +257,44 @@ screenshot_done (GObject *source,
       g_warning ("A backend call failed: %s", error->message);
     }
 
-  g_object_set_data (G_OBJECT (request), "response", GINT_TO_POINTER (response));
-  if (options)
-    g_object_set_data_full (G_OBJECT (request), "options", g_variant_ref (options), (GDestroyNotify)g_variant_unref);
+  REQUEST_AUTOLOCK (request);
 
-  task = g_task_new (NULL, NULL, NULL, NULL);
-  g_task_set_source_tag (task, screenshot_done);
-  g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_object_set_data (G_OBJECT (task), "retval", "url");
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  if (response != 0)
+    goto out;
+
+  if (!g_variant_lookup (options, "uri", "&s", &uri))
+    {
+      g_warning ("No URI was provided");
+      goto out;
+    }
+
+  request_options = (GVariant *) g_object_get_data (G_OBJECT (request), "options");
+  if (g_variant_lookup (request_options, "read_only_fd", "b", &read_only_fd) &&
+      read_only_fd)
+    {
+      send_screenshot_fd (request, uri);
+      return;
+    }
+
+  if (xdp_app_info_is_host (request->app_info))
+    {
+      g_variant_builder_add (&results, "{&sv}", "uri", g_variant_new_string (uri));
+      goto out;
+    }
+
+  /* The document portal is only talked to asynchronously, so taking many
+   * screenshots in a row doesn't tie up the worker threads. */
+  xdp_register_document_async (uri,
+                               xdp_app_info_get_id (request->app_info),
+                               xdp_app_info_get_gappinfo (request->app_info),
+                               XDP_DOCUMENT_FLAG_DELETABLE,
+                               NULL,
+                               register_screenshot_done,
+                               g_object_ref (request));
+  return;
+
+out:
+  send_response (request, response, g_variant_builder_end (&results));
 }
 
 static gboolean
@@ -225,7 +342,8 @@ validate_screenshot_target_filter (const char  *key,
 static XdpOptionKey screenshot_options_v3[] = {
   { "modal", G_VARIANT_TYPE_BOOLEAN, NULL },
   { "interactive", G_VARIANT_TYPE_BOOLEAN, NULL },
-  { "target", G_VARIANT_TYPE_UINT32, validate_screenshot_target_filter }
+  { "target", G_VARIANT_TYPE_UINT32, validate_screenshot_target_filter },
+  { "read_only_fd", G_VARIANT_TYPE_BOOLEAN, NULL },
 };
 
 static gboolean
@@ -312,18 +430,17 @@ check_non_interactive_permission_in_thread (Screenshot *screenshot,
   if (permission == XDP_PERMISSION_UNSET)
     body = _("This permission can be changed at any time from the privacy settings");
 
-  if (!xdp_dbus_impl_access_call_access_dialog_sync (screenshot->access_impl,
-                                                     request->id,
-                                                     app_id,
-                                                     parent_window,
-                                                     title,
-                                                     subtitle,
-                                                     body,
-                                                     g_variant_builder_end (&access_opt_builder),
-                                                     &access_response,
-                                                     &access_results,
-                                                     NULL,
-                                                     &error))
+  if (!xdp_request_call_access_dialog_sync (request,
+                                            screenshot->access_impl,
+                                            app_id,
+                                            parent_window,
+                                            title,
+                                            subtitle,
+                                            body,
+                                            g_variant_builder_end (&access_opt_builder),
+                                            &access_response,
+                                            &access_results,
+                                            &error))
     {
       g_warning ("Failed to show access dialog: %s", error->message);
       return FALSE;
@@ -407,7 +524,9 @@ handle_screenshot_in_thread_func (GTask *task,
   g_variant_iter_init (&options_iter, options);
   while (g_variant_iter_next (&options_iter, "{&sv}", &key, &value))
     {
-      g_variant_builder_add (&opt_builder, "{sv}", key, value);
+      /* Handled by the frontend only */
+      if (g_strcmp0 (key, "read_only_fd") != 0)
+        g_variant_builder_add (&opt_builder, "{sv}", key, value);
       g_clear_pointer (&value, g_variant_unref);
     }
 
@@ -460,13 +579,19 @@ handle_screenshot (XdpDbusScreenshot *object,
                           g_steal_pointer (&options),
                           (GDestroyNotify)g_variant_unref);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_screenshot_complete_screenshot (object, invocation, request->id);
 
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_screenshot);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_screenshot_in_thread_func);
+  xdp_request_run_in_worker (request, "Screenshot", task, handle_screenshot_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -477,10 +602,12 @@ pick_color_done (GObject *source,
                  gpointer data)
 {
   g_autoptr(XdpRequest) request = data;
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
   guint response = 2;
   g_autoptr(GVariant) options = NULL;
   g_autoptr(GError) error = NULL;
-  g_autoptr(GTask) task = NULL;
+  double red, green, blue;
 
   if (!xdp_dbus_impl_screenshot_call_pick_color_finish (XDP_DBUS_IMPL_SCREENSHOT (source),
                                                         &response,
@@ -492,15 +619,21 @@ pick_color_done (GObject *source,
       g_warning ("A backend call failed: %s", error->message);
     }
 
-  g_object_set_data (G_OBJECT (request), "response", GINT_TO_POINTER (response));
-  if (options)
-    g_object_set_data_full (G_OBJECT (request), "options", g_variant_ref (options), (GDestroyNotify)g_variant_unref);
+  REQUEST_AUTOLOCK (request);
 
-  task = g_task_new (NULL, NULL, NULL, NULL);
-  g_task_set_source_tag (task, pick_color_done);
-  g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_object_set_data (G_OBJECT (task), "retval", "color");
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  if (response != 0)
+    goto out;
+
+  if (!g_variant_lookup (options, "color", "(ddd)", &red, &green, &blue))
+    {
+      g_warning ("No color was provided");
+      goto out;
+    }
+
+  g_variant_builder_add (&results, "{&sv}", "color", g_variant_new ("(ddd)", red, green, blue));
+
+out:
+  send_response (request, response, g_variant_builder_end (&results));
 }
 
 static XdpOptionKey pick_color_options[] = {
@@ -603,8 +736,9 @@ screenshot_new (XdpDbusImplScreenshot *impl,
   screenshot->impl_version =
     MAX (xdp_dbus_impl_screenshot_get_version (screenshot->impl), 2);
 
+  /* Version 4 only added frontend features on top of version 3 */
   xdp_dbus_screenshot_set_version (XDP_DBUS_SCREENSHOT (screenshot),
-                                   MIN (screenshot->impl_version, 3));
+                                   screenshot->impl_version >= 3 ? 4 : screenshot->impl_version);
 
   if (screenshot->impl_version >= 3)
     {
@@ -616,9 +750,10 @@ screenshot_new (XdpDbusImplScreenshot *impl,
   return screenshot;
 }
 
-void
-init_screenshot (XdpContext *context)
+DexFuture *
+init_screenshot (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Screenshot) screenshot = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -629,25 +764,25 @@ init_screenshot (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, SCREENSHOT_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
   access_impl = xdp_context_get_access_impl (context);
   if (access_impl == NULL)
     {
       g_warning ("The screenshot portal requires an access impl");
-      return;
+      return dex_future_new_false ();
     }
 
-  impl = xdp_dbus_impl_screenshot_proxy_new_sync (connection,
-                                                  G_DBUS_PROXY_FLAGS_NONE,
-                                                  impl_config->dbus_name,
-                                                  DESKTOP_DBUS_PATH,
-                                                  NULL,
-                                                  &error);
+  impl = dex_await_object (xdp_dbus_impl_screenshot_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_NONE,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create screenshot proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   screenshot = screenshot_new (impl, access_impl);
@@ -655,4 +790,6 @@ init_screenshot (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&screenshot)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
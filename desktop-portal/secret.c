@@ -104,7 +104,7 @@ retrieve_secret_done (GObject *source,
   task = g_task_new (NULL, NULL, NULL, NULL);
   g_task_set_source_tag (task, retrieve_secret_done);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, send_response_in_thread_func);
+  xdp_request_run_in_worker (request, "Secret", task, send_response_in_thread_func);
 }
 
 static gboolean
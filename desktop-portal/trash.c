@@ -25,6 +25,7 @@
 #include "xdp-documents.h"
 #include "xdp-impl-dbus.h"
 #include "xdp-utils.h"
+#include "xdp-worker-pool.h"
 
 typedef struct _Trash Trash;
 typedef struct _TrashClass TrashClass;
@@ -32,6 +33,8 @@ typedef struct _TrashClass TrashClass;
 struct _Trash
 {
   XdpDbusTrashSkeleton parent_instance;
+
+  XdpContext *context;
 };
 
 struct _TrashClass
@@ -48,24 +51,43 @@ G_DEFINE_TYPE_WITH_CODE (Trash, trash, XDP_DBUS_TYPE_TRASH_SKELETON,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (Trash, g_object_unref)
 
-/* Check whether subsequently deleting the original file from the trash
- * (in the gvfsd-trash process) will succeed. If we think it won’t, return
- * an error, as the trash spec says trashing should not be allowed.
- * https://specifications.freedesktop.org/trash-spec/latest/#implementation-notes
- *
- * Check ownership to see if we can delete. gvfsd will automatically chmod
- * a file to allow it to be deleted, so checking the permissions bitfield isn’t
- * relevant.
- */
+/* At most this many directory fds are kept open while checking a tree.
+ * Ancestors of deeper directories get closed and are reopened when the walk
+ * returns to them. */
+#define CHECK_REMOVING_MAX_FDS 32
+
+typedef struct _DirFrame
+{
+  char *name; /* relative to the parent frame */
+  int fd; /* -1 if closed to stay within CHECK_REMOVING_MAX_FDS */
+  gboolean owns_fd;
+  guint32 dev_major;
+  guint32 dev_minor;
+  guint64 ino;
+  GPtrArray *subdirs; /* char *, not visited yet */
+} DirFrame;
+
+static void
+dir_frame_free (DirFrame *frame)
+{
+  if (frame->owns_fd)
+    glnx_close_fd (&frame->fd);
+  g_clear_pointer (&frame->subdirs, g_ptr_array_unref);
+  g_clear_pointer (&frame->name, g_free);
+  g_free (frame);
+}
+
+/* Reads all entries of the directory of @frame in one go, so that the walk
+ * never has to keep a directory stream open while descending. */
 static gboolean
-check_removing_recursively (int            fd,
-                            gboolean       user_owned,
-                            uid_t          uid,
-                            GError       **error)
+dir_frame_read_entries (DirFrame      *frame,
+                        gboolean       user_owned,
+                        GCancellable  *cancellable,
+                        GError       **error)
 {
   g_auto(GLnxDirFdIterator) dfd_iter = {0};
 
-  if (!glnx_dirfd_iterator_init_at (fd, ".", FALSE, &dfd_iter, error))
+  if (!glnx_dirfd_iterator_init_at (frame->fd, ".", FALSE, &dfd_iter, error))
     return FALSE;
 
   while (TRUE)
@@ -74,7 +96,7 @@ check_removing_recursively (int            fd,
 
       if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter,
                                                        &dent,
-                                                       NULL,
+                                                       cancellable,
                                                        error))
         return FALSE;
 
@@ -89,26 +111,177 @@ check_removing_recursively (int            fd,
         }
 
       if (dent->d_type == DT_DIR)
+        g_ptr_array_add (frame->subdirs, g_strdup (dent->d_name));
+    }
+}
+
+static int
+open_subdir (int                 parent_fd,
+             const char         *name,
+             struct glnx_statx  *stx,
+             GError            **error)
+{
+  return glnx_chase_and_statxat (parent_fd, name,
+                                 GLNX_CHASE_NOFOLLOW |
+                                 GLNX_CHASE_MUST_BE_DIRECTORY,
+                                 GLNX_STATX_UID | GLNX_STATX_INO,
+                                 stx,
+                                 error);
+}
+
+/* Closes the fds of the outermost frames above @index until the walk is
+ * within its fd budget again */
+static void
+enforce_fd_budget (GPtrArray    *stack,
+                   unsigned int  index,
+                   unsigned int *n_open_fds)
+{
+  for (unsigned int i = 0; i < index && *n_open_fds > CHECK_REMOVING_MAX_FDS; i++)
+    {
+      DirFrame *frame = g_ptr_array_index (stack, i);
+
+      if (frame->owns_fd && frame->fd >= 0)
         {
-          g_autofd int child = -1;
-          struct glnx_statx stx;
-
-          child = glnx_chase_and_statxat (fd, dent->d_name,
-                                          GLNX_CHASE_NOFOLLOW |
-                                          GLNX_CHASE_MUST_BE_DIRECTORY,
-                                          GLNX_STATX_UID,
-                                          &stx,
-                                          error);
-          if (child < 0)
-            return FALSE;
+          glnx_close_fd (&frame->fd);
+          (*n_open_fds)--;
+        }
+    }
+}
 
-          if (!check_removing_recursively (child,
-                                           uid == stx.stx_uid,
-                                           uid,
-                                           error))
-            return FALSE;
+/* Makes sure the frame at @index has an open fd, reopening it and its
+ * closed ancestors from the nearest open one. The reopened directories
+ * must still be the ones we read before. */
+static gboolean
+ensure_frame_fd (GPtrArray     *stack,
+                 unsigned int   index,
+                 unsigned int  *n_open_fds,
+                 GError       **error)
+{
+  unsigned int first_closed = index + 1;
+
+  while (first_closed > 0 &&
+         ((DirFrame *) g_ptr_array_index (stack, first_closed - 1))->fd < 0)
+    first_closed--;
+
+  /* The root frame is never closed */
+  g_assert (first_closed > 0);
+
+  for (unsigned int i = first_closed; i <= index; i++)
+    {
+      DirFrame *parent = g_ptr_array_index (stack, i - 1);
+      DirFrame *frame = g_ptr_array_index (stack, i);
+      struct glnx_statx stx;
+
+      frame->fd = open_subdir (parent->fd, frame->name, &stx, error);
+      if (frame->fd < 0)
+        return FALSE;
+
+      (*n_open_fds)++;
+
+      if (stx.stx_ino != frame->ino ||
+          stx.stx_dev_major != frame->dev_major ||
+          stx.stx_dev_minor != frame->dev_minor)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                       "Directory %s changed while checking it", frame->name);
+          return FALSE;
         }
+
+      enforce_fd_budget (stack, i, n_open_fds);
     }
+
+  return TRUE;
+}
+
+/* Check whether subsequently deleting the original file from the trash
+ * (in the gvfsd-trash process) will succeed. If we think it won’t, return
+ * an error, as the trash spec says trashing should not be allowed.
+ * https://specifications.freedesktop.org/trash-spec/latest/#implementation-notes
+ *
+ * Check ownership to see if we can delete. gvfsd will automatically chmod
+ * a file to allow it to be deleted, so checking the permissions bitfield isn’t
+ * relevant.
+ *
+ * The tree is walked depth-first without recursion, and with a bounded number
+ * of open fds, so that deep trees can neither exhaust the stack nor the fd
+ * limit. The walk stops at the first child that can't be removed.
+ */
+static gboolean
+check_removing_recursively (int            fd,
+                            uid_t          uid,
+                            GCancellable  *cancellable,
+                            GError       **error)
+{
+  g_autoptr(GPtrArray) stack = NULL;
+  unsigned int n_open_fds = 0;
+  DirFrame *root;
+
+  stack = g_ptr_array_new_with_free_func ((GDestroyNotify) dir_frame_free);
+
+  root = g_new0 (DirFrame, 1);
+  root->fd = fd;
+  root->owns_fd = FALSE;
+  root->subdirs = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (stack, root);
+
+  if (!dir_frame_read_entries (root, TRUE, cancellable, error))
+    return FALSE;
+
+  while (stack->len > 0)
+    {
+      unsigned int index = stack->len - 1;
+      DirFrame *frame = g_ptr_array_index (stack, index);
+      g_autofree char *name = NULL;
+      g_autofd int child_fd = -1;
+      struct glnx_statx stx;
+      DirFrame *child;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      if (frame->subdirs->len == 0)
+        {
+          if (frame->owns_fd && frame->fd >= 0)
+            n_open_fds--;
+          g_ptr_array_remove_index (stack, index);
+          continue;
+        }
+
+      name = g_ptr_array_steal_index_fast (frame->subdirs,
+                                           frame->subdirs->len - 1);
+
+      if (!ensure_frame_fd (stack, index, &n_open_fds, error))
+        return FALSE;
+
+      child_fd = open_subdir (frame->fd, name, &stx, error);
+      if (child_fd < 0)
+        return FALSE;
+
+      child = g_new0 (DirFrame, 1);
+      child->name = g_steal_pointer (&name);
+      child->fd = g_steal_fd (&child_fd);
+      child->owns_fd = TRUE;
+      child->dev_major = stx.stx_dev_major;
+      child->dev_minor = stx.stx_dev_minor;
+      child->ino = stx.stx_ino;
+      child->subdirs = g_ptr_array_new_with_free_func (g_free);
+      g_ptr_array_add (stack, child);
+      n_open_fds++;
+
+      if (!dir_frame_read_entries (child, uid == stx.stx_uid, cancellable, error))
+        return FALSE;
+
+      /* Leaves don't need their fd anymore */
+      if (child->subdirs->len == 0)
+        {
+          glnx_close_fd (&child->fd);
+          n_open_fds--;
+        }
+
+      enforce_fd_budget (stack, stack->len - 1, &n_open_fds);
+    }
+
+  return TRUE;
 }
 
 static gboolean
@@ -554,9 +727,10 @@ open_parent (int          fd,
 }
 
 static gboolean
-trash_file (int          target_fd_in,
-            XdpAppInfo  *app_info,
-            GError     **error)
+trash_file (int            target_fd_in,
+            XdpAppInfo    *app_info,
+            GCancellable  *cancellable,
+            GError       **error)
 {
   g_autofd int target_fd = -1;
   g_autofree char *target_path = NULL;
@@ -694,7 +868,7 @@ trash_file (int          target_fd_in,
         uid_t uid = geteuid ();
 
         if (stx.stx_uid == uid &&
-            !check_removing_recursively (target_fd, TRUE, uid, error))
+            !check_removing_recursively (target_fd, uid, cancellable, error))
           return FALSE;
       }
   }
@@ -786,16 +960,84 @@ trash_file (int          target_fd_in,
   return TRUE;
 }
 
+typedef struct _TrashData
+{
+  XdpContext *context;
+  char *sender;
+  GDBusMethodInvocation *invocation;
+  XdpAppInfo *app_info;
+  GCancellable *cancellable;
+  int fd;
+} TrashData;
+
+static void
+trash_data_free (gpointer data)
+{
+  TrashData *trash_data = data;
+
+  xdp_context_untrack_peer_object (trash_data->context,
+                                   trash_data->sender,
+                                   trash_data->cancellable);
+
+  g_clear_pointer (&trash_data->sender, g_free);
+  g_clear_object (&trash_data->invocation);
+  g_clear_object (&trash_data->app_info);
+  g_clear_object (&trash_data->cancellable);
+  glnx_close_fd (&trash_data->fd);
+  g_free (trash_data);
+}
+
+static void
+on_caller_disconnect (XdpContext *context,
+                      const char *peer,
+                      gpointer    object)
+{
+  g_debug ("%s disconnected, cancelling TrashFile", peer);
+  g_cancellable_cancel (G_CANCELLABLE (object));
+}
+
+static void
+handle_trash_file_in_thread_func (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  TrashData *trash_data = task_data;
+  XdpDbusTrash *object = XDP_DBUS_TRASH (source_object);
+  g_autoptr(GError) error = NULL;
+  guint result;
+
+  if (!trash_file (trash_data->fd,
+                   trash_data->app_info,
+                   trash_data->cancellable,
+                   &error))
+    {
+      g_debug ("Failed trashing file: %s", error->message);
+      result = 0;
+    }
+  else
+    {
+      result = 1;
+    }
+
+  xdp_dbus_trash_complete_trash_file (object,
+                                      g_steal_pointer (&trash_data->invocation),
+                                      NULL, result);
+}
+
 static gboolean
 handle_trash_file (XdpDbusTrash          *object,
                    GDBusMethodInvocation *invocation,
                    GUnixFDList           *fd_list,
                    GVariant              *arg_fd)
 {
+  Trash *trash = (Trash *) object;
   XdpAppInfo *app_info = xdp_invocation_get_app_info (invocation);
   g_autofd int fd = -1;
-  guint result;
   g_autoptr(GError) error = NULL;
+  g_autoptr(GTask) task = NULL;
+  XdpWorkerPool *worker_pool;
+  TrashData *trash_data;
 
   g_debug ("Handling TrashFile");
 
@@ -806,18 +1048,38 @@ handle_trash_file (XdpDbusTrash          *object,
       return G_DBUS_METHOD_INVOCATION_HANDLED;
     }
 
-  if (!trash_file (fd, app_info, &error))
-    {
-      g_debug ("Failed trashing file: %s", error->message);
-      result = 0;
-    }
-  else
+  worker_pool = xdp_context_get_worker_pool (trash->context);
+  if (!xdp_worker_pool_check_queue (worker_pool,
+                                    xdp_app_info_get_id (app_info),
+                                    &error))
     {
-      result = 1;
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
     }
 
-  xdp_dbus_trash_complete_trash_file (object, g_steal_pointer (&invocation),
-                                      NULL, result);
+  /* Checking large trees can take a while, stop if the caller goes away */
+  trash_data = g_new0 (TrashData, 1);
+  trash_data->context = trash->context;
+  trash_data->sender = g_strdup (g_dbus_method_invocation_get_sender (invocation));
+  trash_data->invocation = g_object_ref (invocation);
+  trash_data->app_info = g_object_ref (app_info);
+  trash_data->cancellable = g_cancellable_new ();
+  trash_data->fd = g_steal_fd (&fd);
+
+  xdp_context_track_peer_object (trash->context,
+                                 trash_data->sender,
+                                 trash_data->cancellable,
+                                 on_caller_disconnect);
+
+  task = g_task_new (object, NULL, NULL, NULL);
+  g_task_set_source_tag (task, handle_trash_file);
+  g_task_set_task_data (task, trash_data, trash_data_free);
+
+  xdp_worker_pool_run_task (worker_pool,
+                            "Trash",
+                            xdp_app_info_get_id (app_info),
+                            task,
+                            handle_trash_file_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -838,15 +1100,19 @@ trash_class_init (TrashClass *klass)
 {
 }
 
-void
-init_trash (XdpContext *context)
+DexFuture *
+init_trash (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Trash) trash = NULL;
 
   trash = g_object_new (trash_get_type (), NULL);
+  trash->context = context;
   xdp_dbus_trash_set_version (XDP_DBUS_TRASH (trash), 1);
 
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&trash)),
                                       XDP_CONTEXT_EXPORT_FLAGS_NONE);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_trash (XdpContext *context);
+DexFuture * init_trash (gpointer user_data);
@@ -1520,9 +1520,10 @@ usb_new (XdpContext     *context,
   return usb;
 }
 
-void
-init_usb (XdpContext *context)
+DexFuture *
+init_usb (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(XdpUsb) usb = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
@@ -1532,18 +1533,18 @@ init_usb (XdpContext *context)
 
   impl_config = xdp_portal_config_find (config, USB_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
-  impl = xdp_dbus_impl_usb_proxy_new_sync (connection,
-                                           G_DBUS_PROXY_FLAGS_NONE,
-                                           impl_config->dbus_name,
-                                           DESKTOP_DBUS_PATH,
-                                           NULL,
-                                           &error);
+  impl = dex_await_object (xdp_dbus_impl_usb_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create USB proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   usb = usb_new (context, impl);
@@ -1551,4 +1552,6 @@ init_usb (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&usb)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
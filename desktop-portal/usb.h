@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_usb (XdpContext *context);
+DexFuture * init_usb (gpointer user_data);
@@ -189,18 +189,17 @@ handle_set_wallpaper_in_thread_func (GTask *task,
 
       body = _("This permission can be changed at any time from the privacy settings");
 
-      if (!xdp_dbus_impl_access_call_access_dialog_sync (wallpaper->access_impl,
-                                                         request->id,
-                                                         app_id,
-                                                         parent_window,
-                                                         title,
-                                                         subtitle,
-                                                         body,
-                                                         g_variant_builder_end (&access_opt_builder),
-                                                         &access_response,
-                                                         &access_results,
-                                                         NULL,
-                                                         &error))
+      if (!xdp_request_call_access_dialog_sync (request,
+                                                wallpaper->access_impl,
+                                                app_id,
+                                                parent_window,
+                                                title,
+                                                subtitle,
+                                                body,
+                                                g_variant_builder_end (&access_opt_builder),
+                                                &access_response,
+                                                &access_results,
+                                                &error))
         {
           g_warning ("Failed to show access dialog: %s", error->message);
           send_response (request, 2);
@@ -286,6 +285,7 @@ handle_set_wallpaper_uri (XdpDbusWallpaper *object,
 {
   XdpRequest *request = xdp_request_from_invocation (invocation);
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GError) error = NULL;
 
   g_debug ("Handle SetWallpaperURI");
 
@@ -296,13 +296,19 @@ handle_set_wallpaper_uri (XdpDbusWallpaper *object,
                           g_variant_ref (arg_options),
                           (GDestroyNotify)g_variant_unref);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_wallpaper_complete_set_wallpaper_uri (object, invocation, request->id);
 
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_set_wallpaper_uri);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_set_wallpaper_in_thread_func);
+  xdp_request_run_in_worker (request, "Wallpaper", task, handle_set_wallpaper_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -336,13 +342,19 @@ handle_set_wallpaper_file (XdpDbusWallpaper *object,
                           g_variant_ref (arg_options),
                           (GDestroyNotify)g_variant_unref);
 
+  if (!xdp_request_check_worker_queue (request, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+    }
+
   xdp_request_export (request, g_dbus_method_invocation_get_connection (invocation));
   xdp_dbus_wallpaper_complete_set_wallpaper_file (object, invocation, NULL, request->id);
 
   task = g_task_new (object, NULL, NULL, NULL);
   g_task_set_source_tag (task, handle_set_wallpaper_file);
   g_task_set_task_data (task, g_object_ref (request), g_object_unref);
-  g_task_run_in_thread (task, handle_set_wallpaper_in_thread_func);
+  xdp_request_run_in_worker (request, "Wallpaper", task, handle_set_wallpaper_in_thread_func);
 
   return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -394,39 +406,39 @@ wallpaper_new (XdpDbusImplWallpaper *impl,
   return wallpaper;
 }
 
-void
-init_wallpaper (XdpContext *context)
+DexFuture *
+init_wallpaper (gpointer user_data)
 {
+  XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(Wallpaper) wallpaper = NULL;
   GDBusConnection *connection = xdp_context_get_connection (context);
   XdpPortalConfig *config = xdp_context_get_config (context);
   XdpImplConfig *impl_config;
-  XdpDbusImplWallpaper *impl;
+  g_autoptr(XdpDbusImplWallpaper) impl = NULL;
   XdpDbusImplAccess *access_impl;
-  g_autoptr(GVariant) version = NULL;
   g_autoptr(GError) error = NULL;
 
   impl_config = xdp_portal_config_find (config, WALLPAPER_DBUS_IMPL_IFACE);
   if (impl_config == NULL)
-    return;
+    return dex_future_new_true ();
 
   access_impl = xdp_context_get_access_impl (context);
   if (access_impl == NULL)
     {
       g_warning ("The wallpaper portal requires an access impl");
-      return;
+      return dex_future_new_false ();
     }
 
-  impl = xdp_dbus_impl_wallpaper_proxy_new_sync (connection,
-                                                 G_DBUS_PROXY_FLAGS_NONE,
-                                                 impl_config->dbus_name,
-                                                 DESKTOP_DBUS_PATH,
-                                                 NULL,
-                                                 &error);
+  impl = dex_await_object (xdp_dbus_impl_wallpaper_proxy_new_future (
+      connection,
+      G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION,
+      impl_config->dbus_name,
+      DESKTOP_DBUS_PATH),
+    &error);
   if (impl == NULL)
     {
       g_warning ("Failed to create wallpaper proxy: %s", error->message);
-      return;
+      return dex_future_new_false ();
     }
 
   wallpaper = wallpaper_new (impl, access_impl);
@@ -434,4 +446,6 @@ init_wallpaper (XdpContext *context)
   xdp_context_take_and_export_portal (context,
                                       G_DBUS_INTERFACE_SKELETON (g_steal_pointer (&wallpaper)),
                                       XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_THREAD);
+
+  return dex_future_new_true ();
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <libdex.h>
+
 #include "xdp-types.h"
 
-void init_wallpaper (XdpContext *context);
+DexFuture * init_wallpaper (gpointer user_data);
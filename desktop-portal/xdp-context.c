@@ -40,11 +40,23 @@
 #include "xdp-documents.h"
 #include "xdp-impl-dbus.h"
 #include "xdp-method-info.h"
+#include "xdp-metrics.h"
 #include "xdp-permissions.h"
 #include "xdp-portal-config.h"
 #include "xdp-request.h"
 #include "xdp-session-persistence.h"
 #include "xdp-utils.h"
+#include "xdp-worker-pool.h"
+
+/* How long startup waits for portal backends before giving up on them */
+#define PORTAL_INIT_TIMEOUT_SECONDS 5
+
+/* Defaults for the worker pool, overridable with
+ * XDG_DESKTOP_PORTAL_WORKERS, XDG_DESKTOP_PORTAL_MAX_RUNNING_PER_APP and
+ * XDG_DESKTOP_PORTAL_MAX_QUEUED_PER_APP */
+#define DEFAULT_MAX_WORKERS 8
+#define DEFAULT_MAX_RUNNING_PER_APP 2
+#define DEFAULT_MAX_QUEUED_PER_APP 64
 
 enum
 {
@@ -69,15 +81,32 @@ struct _XdpContext
   GHashTable *exported_portals; /* iface name -> GDBusInterfaceSkeleton */
   GHashTable *registered_object_paths; /* char *object_path set */
   GMutex registered_object_paths_lock;
+  GHashTable *peer_objects; /* sender -> (object -> PeerObject) */
+  GMutex peer_objects_lock;
+  XdpWorkerPool *worker_pool;
 
   GCancellable *cancellable;
-  GPtrArray *pending_inits; /* DexFuture */
+  GPtrArray *pending_inits; /* PendingInit */
+  GPtrArray *slow_inits; /* PendingInit */
 };
 
+typedef struct _PeerObject
+{
+  GWeakRef object;
+  XdpContextPeerDisconnectFunc func;
+} PeerObject;
+
 G_DEFINE_FINAL_TYPE (XdpContext,
                      xdp_context,
                      G_TYPE_OBJECT);
 
+static void
+peer_object_free (PeerObject *peer_object)
+{
+  g_weak_ref_clear (&peer_object->object);
+  g_free (peer_object);
+}
+
 static void
 xdp_context_dispose (GObject *object)
 {
@@ -118,6 +147,13 @@ xdp_context_dispose (GObject *object)
   while (g_main_context_iteration (NULL, FALSE))
     ;
 
+  g_clear_pointer (&context->slow_inits, g_ptr_array_unref);
+
+  /* Doesn't wait for the jobs still waiting on the user */
+  if (context->worker_pool)
+    xdp_worker_pool_shutdown (context->worker_pool);
+  g_clear_object (&context->worker_pool);
+
   g_clear_object (&context->portal_config);
   g_clear_object (&context->connection);
   g_clear_object (&context->lockdown_impl);
@@ -130,6 +166,12 @@ xdp_context_dispose (GObject *object)
       g_mutex_clear (&context->registered_object_paths_lock);
     }
 
+  if (context->peer_objects)
+    {
+      g_clear_pointer (&context->peer_objects, g_hash_table_unref);
+      g_mutex_clear (&context->peer_objects_lock);
+    }
+
   G_OBJECT_CLASS (xdp_context_parent_class)->dispose (object);
 }
 
@@ -169,6 +211,17 @@ xdp_context_new (gboolean opt_verbose)
   context->registered_object_paths =
     g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   g_mutex_init (&context->registered_object_paths_lock);
+  context->peer_objects =
+    g_hash_table_new_full (g_str_hash, g_str_equal,
+                           g_free, (GDestroyNotify) g_hash_table_unref);
+  g_mutex_init (&context->peer_objects_lock);
+  context->worker_pool =
+    xdp_worker_pool_new (MAX (xdp_get_env_uint ("XDG_DESKTOP_PORTAL_WORKERS",
+                                                DEFAULT_MAX_WORKERS), 1),
+                         MAX (xdp_get_env_uint ("XDG_DESKTOP_PORTAL_MAX_RUNNING_PER_APP",
+                                                DEFAULT_MAX_RUNNING_PER_APP), 1),
+                         xdp_get_env_uint ("XDG_DESKTOP_PORTAL_MAX_QUEUED_PER_APP",
+                                           DEFAULT_MAX_QUEUED_PER_APP));
 
   return context;
 }
@@ -209,6 +262,12 @@ xdp_context_get_access_impl (XdpContext *context)
   return context->access_impl;
 }
 
+XdpWorkerPool *
+xdp_context_get_worker_pool (XdpContext *context)
+{
+  return context->worker_pool;
+}
+
 static gboolean
 method_needs_request (GDBusMethodInvocation *invocation)
 {
@@ -236,11 +295,13 @@ authorize_callback_fiber (GDBusInterfaceSkeleton *interface,
   XdpContext *context = XDP_CONTEXT (user_data);
   g_autoptr(XdpAppInfo) app_info = NULL;
   g_autoptr(GError) error = NULL;
+  gint64 start_time = xdp_metrics_start ();
 
   app_info = dex_await_object (xdp_app_info_registry_ensure_future (
       context->app_info_registry,
       invocation),
     &error);
+  xdp_metrics_record_method (invocation, "app-info", start_time);
 
   if (app_info == NULL)
     {
@@ -253,6 +314,8 @@ authorize_callback_fiber (GDBusInterfaceSkeleton *interface,
 
   g_object_set_data (G_OBJECT (invocation), "xdp-app-info", app_info);
 
+  xdp_metrics_record_method (invocation, "authorize", start_time);
+
   return TRUE;
 }
 
@@ -265,10 +328,12 @@ authorize_callback (GDBusInterfaceSkeleton *interface,
   g_autoptr(DexFuture) future = NULL;
   g_autoptr(XdpAppInfo) app_info = NULL;
   g_autoptr(GError) error = NULL;
+  gint64 start_time = xdp_metrics_start ();
 
   future = xdp_app_info_registry_ensure_future (context->app_info_registry,
                                                 invocation);
   dex_thread_wait_for (dex_ref (future), NULL);
+  xdp_metrics_record_method (invocation, "app-info", start_time);
 
   app_info = dex_await_object (g_steal_pointer (&future), &error);
   if (app_info == NULL)
@@ -292,6 +357,8 @@ authorize_callback (GDBusInterfaceSkeleton *interface,
         }
     }
 
+  xdp_metrics_record_method (invocation, "authorize", start_time);
+
   return TRUE;
 }
 
@@ -366,46 +433,165 @@ on_peer_disconnect (const char *name,
                     gpointer    user_data)
 {
   XdpContext *context = XDP_CONTEXT (user_data);
+  g_autofree char *peer = NULL;
+  g_autoptr(GHashTable) objects = NULL;
 
   g_signal_emit (context, signals[PEER_DISCONNECT], 0, name);
 
+  /* Only the objects owned by the peer are visited, and without holding
+   * the lock, so that the handlers can untrack themselves. */
+  g_mutex_lock (&context->peer_objects_lock);
+  g_hash_table_steal_extended (context->peer_objects, name,
+                               (gpointer *) &peer, (gpointer *) &objects);
+  g_mutex_unlock (&context->peer_objects_lock);
+
+  if (objects)
+    {
+      GHashTableIter iter;
+      PeerObject *peer_object;
+
+      g_debug ("Cleaning up %u objects of %s",
+               g_hash_table_size (objects), name);
+
+      g_hash_table_iter_init (&iter, objects);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &peer_object))
+        {
+          g_autoptr(GObject) object = g_weak_ref_get (&peer_object->object);
+
+          if (object)
+            peer_object->func (context, name, object);
+        }
+    }
+
   dex_future_disown (xdp_app_info_registry_delete_future (context->app_info_registry,
                                                           name));
 }
 
+typedef struct _PortalInit
+{
+  XdpContext *context;
+  const char *name;
+  DexFiberFunc init_func;
+} PortalInit;
+
+typedef struct _PendingInit
+{
+  const char *name;
+  DexFuture *future;
+} PendingInit;
+
+static void
+pending_init_free (gpointer data)
+{
+  PendingInit *pending_init = data;
+
+  g_clear_pointer (&pending_init->future, dex_unref);
+  g_free (pending_init);
+}
+
+static DexFuture *
+portal_init_fiber (gpointer user_data)
+{
+  PortalInit *portal_init = user_data;
+  g_autoptr(GError) error = NULL;
+  gint64 start_time;
+  gboolean initialized;
+
+  start_time = g_get_monotonic_time ();
+
+  initialized = dex_await_boolean (portal_init->init_func (portal_init->context),
+                                   &error);
+
+  g_debug ("Initializing portal %s %s after %.3f ms%s%s",
+           portal_init->name,
+           initialized ? "finished" : "failed",
+           (g_get_monotonic_time () - start_time) / 1000.0,
+           error ? ": " : "",
+           error ? error->message : "");
+
+  return dex_future_new_for_boolean (initialized);
+}
+
 static void
 init_portal_in_fiber (XdpContext   *context,
+                      const char   *name,
                       DexFiberFunc  portal_init_func)
 {
-  g_autoptr(DexFuture) f = NULL;
+  PortalInit *portal_init;
+  PendingInit *pending_init;
   GCancellable *cancellable = context->cancellable;
 
-  f = dex_future_first (dex_scheduler_spawn (NULL, 0,
-                                             portal_init_func,
-                                             context, NULL),
-                        dex_cancellable_new_from_cancellable (cancellable),
-                        NULL);
+  portal_init = g_new0 (PortalInit, 1);
+  portal_init->context = context;
+  portal_init->name = name;
+  portal_init->init_func = portal_init_func;
+
+  pending_init = g_new0 (PendingInit, 1);
+  pending_init->name = name;
+  pending_init->future =
+    dex_future_first (dex_scheduler_spawn (NULL, 0,
+                                           portal_init_fiber,
+                                           portal_init, g_free),
+                      dex_cancellable_new_from_cancellable (cancellable),
+                      NULL);
 
   if (context->pending_inits == NULL)
-    context->pending_inits = g_ptr_array_new_with_free_func (dex_unref);
+    context->pending_inits = g_ptr_array_new_with_free_func (pending_init_free);
 
-  g_ptr_array_add (context->pending_inits, g_steal_pointer (&f));
+  g_ptr_array_add (context->pending_inits, pending_init);
 }
 
 static void
 await_pending_inits (XdpContext *context)
 {
   g_autoptr(GPtrArray) pending_inits = g_steal_pointer (&context->pending_inits);
+  g_autoptr(GPtrArray) futures = NULL;
   g_autoptr(DexFuture) all = NULL;
+  g_autoptr(DexFuture) deadline = NULL;
+  gint64 start_time;
+  size_t i;
 
   if (pending_inits == NULL)
     return;
 
-  all = dex_future_allv ((DexFuture *const *) pending_inits->pdata,
-                         pending_inits->len);
+  start_time = g_get_monotonic_time ();
 
-  while (dex_future_is_pending (all))
+  futures = g_ptr_array_new ();
+  for (i = 0; i < pending_inits->len; i++)
+    {
+      PendingInit *pending_init = g_ptr_array_index (pending_inits, i);
+
+      g_ptr_array_add (futures, pending_init->future);
+    }
+
+  all = dex_future_allv ((DexFuture *const *) futures->pdata, futures->len);
+  deadline = dex_future_first (dex_ref (all),
+                               dex_timeout_new_seconds (PORTAL_INIT_TIMEOUT_SECONDS),
+                               NULL);
+
+  while (dex_future_is_pending (deadline))
     g_main_context_iteration (g_main_context_get_thread_default (), TRUE);
+
+  if (!dex_future_is_pending (all))
+    {
+      g_debug ("Initialized %u portals in %.3f ms",
+               pending_inits->len,
+               (g_get_monotonic_time () - start_time) / 1000.0);
+      return;
+    }
+
+  /* Don't hold up startup on a slow backend. The remaining fibers keep
+   * running and export their portal once their backend shows up. */
+  for (i = 0; i < pending_inits->len; i++)
+    {
+      PendingInit *pending_init = g_ptr_array_index (pending_inits, i);
+
+      if (dex_future_is_pending (pending_init->future))
+        g_warning ("Initializing portal %s did not finish within %d seconds",
+                   pending_init->name, PORTAL_INIT_TIMEOUT_SECONDS);
+    }
+
+  context->slow_inits = g_steal_pointer (&pending_inits);
 }
 
 gboolean
@@ -428,6 +614,8 @@ xdp_context_register (XdpContext       *context,
                                           on_peer_disconnect,
                                           context);
 
+  xdp_metrics_export (connection);
+
   if (!xdp_init_permission_store (connection, error))
     {
       g_prefix_error_literal (error, "No permission store: ");
@@ -471,39 +659,39 @@ xdp_context_register (XdpContext       *context,
                                           G_MAXINT);
     }
 
-  init_portal_in_fiber (context, init_secret);
-  init_memory_monitor (context);
-  init_power_profile_monitor (context);
-  init_network_monitor (context);
-  init_proxy_resolver (context);
-  init_trash (context);
-  init_game_mode (context);
-  init_realtime (context);
-  init_portal_in_fiber (context, init_settings);
-  init_file_chooser (context);
-  init_open_uri (context);
-  init_print (context);
-  init_notification (context);
-  init_inhibit (context);
+  init_portal_in_fiber (context, "Secret", init_secret);
+  init_portal_in_fiber (context, "MemoryMonitor", init_memory_monitor);
+  init_portal_in_fiber (context, "PowerProfileMonitor", init_power_profile_monitor);
+  init_portal_in_fiber (context, "NetworkMonitor", init_network_monitor);
+  init_portal_in_fiber (context, "ProxyResolver", init_proxy_resolver);
+  init_portal_in_fiber (context, "Trash", init_trash);
+  init_portal_in_fiber (context, "GameMode", init_game_mode);
+  init_portal_in_fiber (context, "Realtime", init_realtime);
+  init_portal_in_fiber (context, "Settings", init_settings);
+  init_portal_in_fiber (context, "FileChooser", init_file_chooser);
+  init_portal_in_fiber (context, "OpenURI", init_open_uri);
+  init_portal_in_fiber (context, "Print", init_print);
+  init_portal_in_fiber (context, "Notification", init_notification);
+  init_portal_in_fiber (context, "Inhibit", init_inhibit);
 #if HAVE_GEOCLUE
-  init_location (context);
+  init_portal_in_fiber (context, "Location", init_location);
 #endif
-  init_camera (context);
-  init_screenshot (context);
-  init_background (context);
-  init_wallpaper (context);
-  init_account (context);
-  init_email (context);
-  init_global_shortcuts (context);
-  init_dynamic_launcher (context);
-  init_screen_cast (context);
-  init_remote_desktop (context);
-  init_clipboard (context);
-  init_input_capture (context);
+  init_portal_in_fiber (context, "Camera", init_camera);
+  init_portal_in_fiber (context, "Screenshot", init_screenshot);
+  init_portal_in_fiber (context, "Background", init_background);
+  init_portal_in_fiber (context, "Wallpaper", init_wallpaper);
+  init_portal_in_fiber (context, "Account", init_account);
+  init_portal_in_fiber (context, "Email", init_email);
+  init_portal_in_fiber (context, "GlobalShortcuts", init_global_shortcuts);
+  init_portal_in_fiber (context, "DynamicLauncher", init_dynamic_launcher);
+  init_portal_in_fiber (context, "ScreenCast", init_screen_cast);
+  init_portal_in_fiber (context, "RemoteDesktop", init_remote_desktop);
+  init_portal_in_fiber (context, "Clipboard", init_clipboard);
+  init_portal_in_fiber (context, "InputCapture", init_input_capture);
 #if HAVE_GUDEV
-  init_usb (context);
+  init_portal_in_fiber (context, "Usb", init_usb);
 #endif
-  init_registry (context);
+  init_portal_in_fiber (context, "Registry", init_registry);
 
   await_pending_inits (context);
 
@@ -532,3 +720,76 @@ xdp_context_unclaim_object_path (XdpContext *context,
 
   g_hash_table_remove (context->registered_object_paths, object_path);
 }
+
+/**
+ * xdp_context_track_peer_object:
+ * @context: a #XdpContext
+ * @peer: the unique bus name owning @object
+ * @object: the object to track
+ * @func: called when @peer disconnects
+ *
+ * Registers @object for cleanup when @peer leaves the bus. Only a weak
+ * reference to @object is kept, so @func is not called once @object is
+ * disposed, but it should still be untracked with
+ * xdp_context_untrack_peer_object() to free the bookkeeping.
+ *
+ * Unlike connecting to #XdpContext::peer-disconnect, this only runs
+ * @func for objects of the disconnecting peer.
+ */
+void
+xdp_context_track_peer_object (XdpContext                   *context,
+                               const char                   *peer,
+                               gpointer                      object,
+                               XdpContextPeerDisconnectFunc  func)
+{
+  GHashTable *objects;
+  PeerObject *peer_object;
+
+  g_return_if_fail (XDP_IS_CONTEXT (context));
+  g_return_if_fail (peer != NULL);
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  peer_object = g_new0 (PeerObject, 1);
+  g_weak_ref_init (&peer_object->object, object);
+  peer_object->func = func;
+
+  G_MUTEX_AUTO_LOCK (&context->peer_objects_lock, locker);
+
+  objects = g_hash_table_lookup (context->peer_objects, peer);
+  if (objects == NULL)
+    {
+      objects = g_hash_table_new_full (NULL, NULL,
+                                       NULL,
+                                       (GDestroyNotify) peer_object_free);
+      g_hash_table_insert (context->peer_objects, g_strdup (peer), objects);
+    }
+
+  g_hash_table_replace (objects, object, peer_object);
+}
+
+void
+xdp_context_untrack_peer_object (XdpContext *context,
+                                 const char *peer,
+                                 gpointer    object)
+{
+  GHashTable *objects;
+
+  g_return_if_fail (XDP_IS_CONTEXT (context));
+
+  if (peer == NULL)
+    return;
+
+  G_MUTEX_AUTO_LOCK (&context->peer_objects_lock, locker);
+
+  if (context->peer_objects == NULL)
+    return;
+
+  /* The peer's objects are already gone if it disconnected */
+  objects = g_hash_table_lookup (context->peer_objects, peer);
+  if (objects == NULL)
+    return;
+
+  g_hash_table_remove (objects, object);
+  if (g_hash_table_size (objects) == 0)
+    g_hash_table_remove (context->peer_objects, peer);
+}
@@ -16,6 +16,10 @@ typedef enum _XdpContextExportFlags
   XDP_CONTEXT_EXPORT_FLAGS_RUN_IN_FIBER = (1 << 2),
 } XdpContextExportFlags;
 
+typedef void (*XdpContextPeerDisconnectFunc) (XdpContext *context,
+                                              const char *peer,
+                                              gpointer    object);
+
 #define XDP_TYPE_CONTEXT (xdp_context_get_type())
 G_DECLARE_FINAL_TYPE (XdpContext,
                       xdp_context,
@@ -40,6 +44,8 @@ XdpDbusImplLockdown * xdp_context_get_lockdown_impl (XdpContext *context);
 
 XdpDbusImplAccess * xdp_context_get_access_impl (XdpContext *context);
 
+XdpWorkerPool * xdp_context_get_worker_pool (XdpContext *context);
+
 void xdp_context_take_and_export_portal (XdpContext             *context,
                                          GDBusInterfaceSkeleton *skeleton,
                                          XdpContextExportFlags   flags);
@@ -52,3 +58,12 @@ gboolean xdp_context_claim_object_path (XdpContext *context,
 
 void xdp_context_unclaim_object_path (XdpContext *context,
                                       const char *object_path);
+
+void xdp_context_track_peer_object (XdpContext                   *context,
+                                    const char                   *peer,
+                                    gpointer                      object,
+                                    XdpContextPeerDisconnectFunc  func);
+
+void xdp_context_untrack_peer_object (XdpContext *context,
+                                      const char *peer,
+                                      gpointer    object);
@@ -51,162 +51,711 @@ xdp_init_document_proxy (GDBusConnection  *connection,
   return TRUE;
 }
 
-char *
-xdp_register_document (const char        *uri,
-                       const char        *app_id,
-                       GDesktopAppInfo   *app_info,
-                       XdpDocumentFlags   flags,
-                       GError           **error)
+/* Files passed to a single AddFull call. This stays well below the
+ * limits message buses put on the number of fds in a message, and
+ * keeps the number of files that need a slower retry small when a
+ * call fails. */
+#define MAX_FDS_PER_CALL 16
+
+static void
+get_document_permissions (XdpDocumentFlags  flags,
+                          const char       *permissions[5])
+{
+  int i = 0;
+
+  permissions[i++] = "read";
+  if ((flags & XDP_DOCUMENT_FLAG_WRITABLE) || (flags & XDP_DOCUMENT_FLAG_FOR_SAVE))
+    permissions[i++] = "write";
+  permissions[i++] = "grant-permissions";
+  if (flags & XDP_DOCUMENT_FLAG_DELETABLE)
+    permissions[i++] = "delete";
+  permissions[i++] = NULL;
+}
+
+static DocumentAddFullFlags
+get_add_full_flags (XdpDocumentFlags flags)
 {
-  g_autofree char *doc_id = NULL;
-  g_auto(GStrv) doc_ids = NULL;
-  g_autofree char *path = NULL;
-  g_autofree char *basename = NULL;
-  g_autofree char *dirname = NULL;
-  g_autoptr(GUnixFDList) fd_list = NULL;
-  int fd, fd_in;
-  g_autoptr(GFile) file = NULL;
-  gboolean ret = FALSE;
-  const char *permissions[5];
-  g_autofree char *doc_path = NULL;
-  int i;
-  int version;
-  gboolean handled_permissions = FALSE;
   DocumentAddFullFlags full_flags;
-  g_autofree char *fuse_path = NULL;
 
-  g_return_val_if_fail (app_id != NULL && *app_id != '\0', NULL);
+  full_flags = DOCUMENT_ADD_FLAGS_REUSE_EXISTING | DOCUMENT_ADD_FLAGS_PERSISTENT | DOCUMENT_ADD_FLAGS_AS_NEEDED_BY_APP;
+  if (flags & XDP_DOCUMENT_FLAG_DIRECTORY)
+    full_flags |= DOCUMENT_ADD_FLAGS_DIRECTORY;
+
+  return full_flags;
+}
+
+static char *
+get_path_for_uri (const char  *uri,
+                  GError     **error)
+{
+  g_autoptr(GFile) file = g_file_new_for_uri (uri);
+  char *path;
 
-  file = g_file_new_for_uri (uri);
   path = g_file_get_path (file);
   if (path == NULL)
-    {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-                   "URI %s not supported by the document portal", uri);
-      return NULL;
-    }
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "URI %s not supported by the document portal", uri);
+
+  return path;
+}
+
+static char *
+build_document_uri (const char       *path,
+                    const char       *doc_id,
+                    GDesktopAppInfo  *app_info,
+                    GError          **error)
+{
+  g_autofree char *basename = NULL;
+  g_autofree char *fuse_path = NULL;
+  g_autofree char *doc_path = NULL;
+
+  if (g_strcmp0 (doc_id, "") == 0)
+    return g_filename_to_uri (path, NULL, error);
+
   basename = g_path_get_basename (path);
-  dirname = g_path_get_dirname (path);
+  fuse_path = xdp_desktop_app_info_get_doc_mountpoint (app_info);
+  doc_path = g_build_filename (fuse_path, doc_id, basename, NULL);
+
+  return g_filename_to_uri (doc_path, NULL, error);
+}
+
+static gboolean
+open_document (const char        *uri,
+               XdpDocumentFlags   flags,
+               char             **path_out,
+               GUnixFDList      **fd_list_out,
+               int               *fd_in_out,
+               GError           **error)
+{
+  g_autofree char *path = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autofd int fd = -1;
+  int fd_in;
+
+  path = get_path_for_uri (uri, error);
+  if (path == NULL)
+    return FALSE;
 
   if (flags & XDP_DOCUMENT_FLAG_FOR_SAVE)
-    fd = open (dirname, O_CLOEXEC);
+    {
+      g_autofree char *dirname = g_path_get_dirname (path);
+
+      fd = open (dirname, O_CLOEXEC);
+    }
   else
-    fd = open (path, O_CLOEXEC);
+    {
+      fd = open (path, O_CLOEXEC);
+    }
 
   if (fd == -1)
     {
       g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
                    "Failed to open %s", uri);
-      return NULL;
+      return FALSE;
     }
+
   fd_list = g_unix_fd_list_new ();
   fd_in = g_unix_fd_list_append (fd_list, fd, error);
-  close (fd);
-
   if (fd_in == -1)
-    return NULL;
+    return FALSE;
 
-  i = 0;
-  permissions[i++] = "read";
-  if ((flags & XDP_DOCUMENT_FLAG_WRITABLE) || (flags & XDP_DOCUMENT_FLAG_FOR_SAVE))
-    permissions[i++] = "write";
-  permissions[i++] = "grant-permissions";
-  if (flags & XDP_DOCUMENT_FLAG_DELETABLE)
-    permissions[i++] = "delete";
-  permissions[i++] = NULL;
+  *path_out = g_steal_pointer (&path);
+  *fd_list_out = g_steal_pointer (&fd_list);
+  *fd_in_out = fd_in;
+  return TRUE;
+}
+
+typedef struct
+{
+  char *uri;
+  XdpDocumentFlags flags;
+  char *path;
+  GUnixFDList *fd_list;
+  int fd_in;
+  char *app_id;
+  char *doc_id;
+  GDesktopAppInfo *app_info;
+  const char *permissions[5];
+} RegisterDocumentData;
+
+static void
+register_document_data_free (RegisterDocumentData *data)
+{
+  g_free (data->uri);
+  g_free (data->path);
+  g_clear_object (&data->fd_list);
+  g_free (data->app_id);
+  g_free (data->doc_id);
+  g_clear_object (&data->app_info);
+  g_free (data);
+}
+
+static GTask *
+register_document_task_new (const char          *uri,
+                            const char          *app_id,
+                            GDesktopAppInfo     *app_info,
+                            XdpDocumentFlags     flags,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  GTask *task;
+  RegisterDocumentData *data;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, xdp_register_document_async);
+
+  data = g_new0 (RegisterDocumentData, 1);
+  data->uri = g_strdup (uri);
+  data->flags = flags;
+  data->app_id = g_strdup (app_id);
+  g_set_object (&data->app_info, app_info);
+  get_document_permissions (flags, data->permissions);
+  g_task_set_task_data (task, data, (GDestroyNotify) register_document_data_free);
 
+  return task;
+}
+
+static void
+register_document_return_uri (GTask *task)
+{
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+  char *ruri;
+
+  ruri = build_document_uri (data->path, data->doc_id, data->app_info, &error);
+  if (ruri == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, ruri, g_free);
+}
+
+static void
+grant_permissions_done (GObject      *source_object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  GError *error = NULL;
+
+  if (!xdp_dbus_documents_call_grant_permissions_finish (XDP_DBUS_DOCUMENTS (source_object),
+                                                         result,
+                                                         &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  register_document_return_uri (task);
+}
+
+/* Older document portals need the permissions granted in a second call */
+static void
+register_document_grant_permissions (GTask *task)
+{
+  RegisterDocumentData *data = g_task_get_task_data (task);
+
+  xdp_dbus_documents_call_grant_permissions (documents,
+                                             data->doc_id,
+                                             data->app_id,
+                                             data->permissions,
+                                             g_task_get_cancellable (task),
+                                             grant_permissions_done,
+                                             g_object_ref (task));
+}
+
+static void
+add_full_done (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  g_auto(GStrv) doc_ids = NULL;
+  GError *error = NULL;
+
+  if (!xdp_dbus_documents_call_add_full_finish (XDP_DBUS_DOCUMENTS (source_object),
+                                                &doc_ids,
+                                                NULL,
+                                                NULL,
+                                                result,
+                                                &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  data->doc_id = g_strdup (doc_ids && doc_ids[0] ? doc_ids[0] : "");
+  register_document_return_uri (task);
+}
+
+static void
+add_named_full_done (GObject      *source_object,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+
+  if (!xdp_dbus_documents_call_add_named_full_finish (XDP_DBUS_DOCUMENTS (source_object),
+                                                      &data->doc_id,
+                                                      NULL,
+                                                      NULL,
+                                                      result,
+                                                      &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  register_document_return_uri (task);
+}
+
+static void
+add_done (GObject      *source_object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+
+  if (!xdp_dbus_documents_call_add_finish (XDP_DBUS_DOCUMENTS (source_object),
+                                           &data->doc_id,
+                                           NULL,
+                                           result,
+                                           &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  register_document_grant_permissions (task);
+}
+
+static void
+add_named_done (GObject      *source_object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  GError *error = NULL;
+
+  if (!xdp_dbus_documents_call_add_named_finish (XDP_DBUS_DOCUMENTS (source_object),
+                                                 &data->doc_id,
+                                                 NULL,
+                                                 result,
+                                                 &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  register_document_grant_permissions (task);
+}
+
+/* Adds the opened document with whatever the document portal version
+ * supports. Shared by the sync and async variants, the replies are
+ * dispatched to the thread-default main context. */
+static void
+register_document_add (GTask *task)
+{
+  RegisterDocumentData *data = g_task_get_task_data (task);
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  g_autofree char *basename = NULL;
+  DocumentAddFullFlags full_flags;
+  int version;
+
+  basename = g_path_get_basename (data->path);
   version = xdp_dbus_documents_get_version (documents);
-  full_flags = DOCUMENT_ADD_FLAGS_REUSE_EXISTING | DOCUMENT_ADD_FLAGS_PERSISTENT | DOCUMENT_ADD_FLAGS_AS_NEEDED_BY_APP;
-  if (flags & XDP_DOCUMENT_FLAG_DIRECTORY)
-    full_flags |= DOCUMENT_ADD_FLAGS_DIRECTORY;
+  full_flags = get_add_full_flags (data->flags);
 
-  if (flags & XDP_DOCUMENT_FLAG_FOR_SAVE)
+  if (data->flags & XDP_DOCUMENT_FLAG_FOR_SAVE)
     {
       if (version >= 3)
-        {
-          ret = xdp_dbus_documents_call_add_named_full_sync (documents,
-                                                             g_variant_new_handle (fd_in),
-                                                             basename,
-                                                             full_flags,
-                                                             app_id,
-                                                             permissions,
-                                                             fd_list,
-                                                             &doc_id,
-                                                             NULL,
-                                                             NULL,
-                                                             NULL,
-                                                             error);
-          handled_permissions = TRUE;
-        }
+        xdp_dbus_documents_call_add_named_full (documents,
+                                                g_variant_new_handle (data->fd_in),
+                                                basename,
+                                                full_flags,
+                                                data->app_id,
+                                                data->permissions,
+                                                data->fd_list,
+                                                cancellable,
+                                                add_named_full_done,
+                                                g_object_ref (task));
       else
-        ret = xdp_dbus_documents_call_add_named_sync (documents,
-                                                      g_variant_new_handle (fd_in),
-                                                      basename,
-                                                      TRUE,
-                                                      TRUE,
-                                                      fd_list,
-                                                      &doc_id,
-                                                      NULL,
-                                                      NULL,
-                                                      error);
+        xdp_dbus_documents_call_add_named (documents,
+                                           g_variant_new_handle (data->fd_in),
+                                           basename,
+                                           TRUE,
+                                           TRUE,
+                                           data->fd_list,
+                                           cancellable,
+                                           add_named_done,
+                                           g_object_ref (task));
     }
   else
     {
       if (version >= 2)
+        xdp_dbus_documents_call_add_full (documents,
+                                          g_variant_new_fixed_array (G_VARIANT_TYPE_HANDLE, &data->fd_in, 1, sizeof (gint32)),
+                                          full_flags,
+                                          data->app_id,
+                                          data->permissions,
+                                          data->fd_list,
+                                          cancellable,
+                                          add_full_done,
+                                          g_object_ref (task));
+      else
+        xdp_dbus_documents_call_add (documents,
+                                     g_variant_new_handle (data->fd_in),
+                                     TRUE,
+                                     TRUE,
+                                     data->fd_list,
+                                     cancellable,
+                                     add_done,
+                                     g_object_ref (task));
+    }
+}
+
+static gboolean
+register_document_open (GTask   *task,
+                        GError **error)
+{
+  RegisterDocumentData *data = g_task_get_task_data (task);
+
+  return open_document (data->uri, data->flags,
+                        &data->path, &data->fd_list, &data->fd_in,
+                        error);
+}
+
+static void
+open_document_in_thread (GTask        *open_task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+  GTask *task = task_data;
+  GError *error = NULL;
+
+  if (!register_document_open (task, &error))
+    g_task_return_error (open_task, error);
+  else
+    g_task_return_boolean (open_task, TRUE);
+}
+
+static void
+document_opened (GObject      *source_object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  GError *error = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  register_document_add (task);
+}
+
+static void
+store_result (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  GAsyncResult **result_out = user_data;
+
+  *result_out = g_object_ref (result);
+}
+
+/**
+ * xdp_register_document:
+ * @uri: the URI to register
+ * @app_id: the app to grant access to
+ * @app_info: the #GDesktopAppInfo of the app
+ * @flags: #XdpDocumentFlags
+ * @error: return location for a #GError
+ *
+ * Registers @uri with the document portal and grants @app_id access to
+ * it. Blocks on the document portal, so it must be called from a worker
+ * thread.
+ *
+ * Returns: (transfer full): the URI of the document for the app
+ */
+char *
+xdp_register_document (const char        *uri,
+                       const char        *app_id,
+                       GDesktopAppInfo   *app_info,
+                       XdpDocumentFlags   flags,
+                       GError           **error)
+{
+  g_autoptr(GMainContext) context = NULL;
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GAsyncResult) result = NULL;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (app_id != NULL && *app_id != '\0', NULL);
+
+  /* Runs the calls of xdp_register_document_async() on a private main
+   * context, but opens the file right here */
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+
+  task = register_document_task_new (uri, app_id, app_info, flags, NULL,
+                                     store_result, &result);
+
+  if (!register_document_open (task, &local_error))
+    g_task_return_error (task, local_error);
+  else
+    register_document_add (task);
+
+  while (result == NULL)
+    g_main_context_iteration (context, TRUE);
+
+  g_main_context_pop_thread_default (context);
+
+  return xdp_register_document_finish (result, error);
+}
+
+/**
+ * xdp_register_document_async:
+ * @uri: the URI to register
+ * @app_id: the app to grant access to
+ * @app_info: the #GDesktopAppInfo of the app
+ * @flags: #XdpDocumentFlags
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called when the document was registered
+ * @user_data: data for @callback
+ *
+ * Asynchronous version of xdp_register_document(). It does not block on
+ * the document portal nor on opening the file, so it can be called from
+ * the main thread.
+ */
+void
+xdp_register_document_async (const char          *uri,
+                             const char          *app_id,
+                             GDesktopAppInfo     *app_info,
+                             XdpDocumentFlags     flags,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GTask) open_task = NULL;
+
+  g_return_if_fail (app_id != NULL && *app_id != '\0');
+
+  task = register_document_task_new (uri, app_id, app_info, flags, cancellable,
+                                     callback, user_data);
+
+  /* Opening the file can block, e.g. on network file systems */
+  open_task = g_task_new (NULL, cancellable, document_opened, g_object_ref (task));
+  g_task_set_task_data (open_task, g_object_ref (task), g_object_unref);
+  g_task_run_in_thread (open_task, open_document_in_thread);
+}
+
+char *
+xdp_register_document_finish (GAsyncResult  *result,
+                              GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == xdp_register_document_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+register_documents_chunk (const char * const *uris,
+                          const char         *app_id,
+                          GDesktopAppInfo    *app_info,
+                          XdpDocumentFlags    flags,
+                          GUnixFDList        *fd_list,
+                          GArray             *handles,
+                          GPtrArray          *paths,
+                          GPtrArray          *result_indices,
+                          GPtrArray          *results)
+{
+  g_auto(GStrv) doc_ids = NULL;
+  g_autoptr(GError) error = NULL;
+  const char *permissions[5];
+  size_t i;
+
+  get_document_permissions (flags, permissions);
+
+  if (!xdp_dbus_documents_call_add_full_sync (documents,
+                                              g_variant_new_fixed_array (G_VARIANT_TYPE_HANDLE,
+                                                                         handles->data,
+                                                                         handles->len,
+                                                                         sizeof (gint32)),
+                                              get_add_full_flags (flags),
+                                              app_id,
+                                              permissions,
+                                              fd_list,
+                                              &doc_ids,
+                                              NULL,
+                                              NULL,
+                                              NULL,
+                                              &error) ||
+      g_strv_length (doc_ids) != handles->len)
+    {
+      /* A single file the document portal refuses fails the whole call,
+       * so register the files of this chunk one by one instead */
+      if (error)
+        g_warning ("Failed to register %u documents at once: %s",
+                   handles->len, error->message);
+      else
+        g_warning ("Document portal returned %u document ids for %u files",
+                   g_strv_length (doc_ids), handles->len);
+
+      for (i = 0; i < handles->len; i++)
         {
-          ret = xdp_dbus_documents_call_add_full_sync (documents,
-                                                       g_variant_new_fixed_array (G_VARIANT_TYPE_HANDLE, &fd_in, 1, sizeof (gint32)),
-                                                       full_flags,
-                                                       app_id,
-                                                       permissions,
-                                                       fd_list,
-                                                       &doc_ids,
-                                                       NULL,
-                                                       NULL,
-                                                       NULL,
-                                                       error);
-          handled_permissions = TRUE;
+          size_t index = GPOINTER_TO_SIZE (g_ptr_array_index (result_indices, i));
+          g_autoptr(GError) local_error = NULL;
+          char *ruri;
+
+          ruri = xdp_register_document (uris[index], app_id, app_info, flags, &local_error);
+          if (ruri == NULL)
+            g_warning ("Failed to register %s: %s", uris[index], local_error->message);
+
+          g_ptr_array_index (results, index) = ruri;
         }
-      else
-        ret = xdp_dbus_documents_call_add_sync (documents,
-                                                g_variant_new_handle (fd_in),
-                                                TRUE,
-                                                TRUE,
-                                                fd_list,
-                                                &doc_id,
-                                                NULL,
-                                                NULL,
-                                                error);
+
+      return;
     }
 
-  if (!ret)
-    return NULL;
+  for (i = 0; i < handles->len; i++)
+    {
+      const char *path = g_ptr_array_index (paths, i);
+      size_t index = GPOINTER_TO_SIZE (g_ptr_array_index (result_indices, i));
+      g_autoptr(GError) local_error = NULL;
+      char *ruri;
+
+      ruri = build_document_uri (path, doc_ids[i], app_info, &local_error);
+      if (ruri == NULL)
+        g_warning ("Failed to build document URI for %s: %s", path, local_error->message);
 
-  if (doc_ids && doc_ids[0]) {
-      doc_id = g_strdup (doc_ids[0]);
-  }
+      g_ptr_array_index (results, index) = ruri;
+    }
+}
 
-  if (!handled_permissions)
+/**
+ * xdp_register_documents:
+ * @uris: (array zero-terminated=1): the URIs to register
+ * @app_id: the app to grant access to
+ * @app_info: the #GDesktopAppInfo of the app
+ * @flags: #XdpDocumentFlags applying to all @uris
+ * @error: return location for a #GError
+ *
+ * Like xdp_register_document(), but registers all @uris with as few
+ * AddFull calls to the document portal as possible. URIs that cannot be
+ * opened or registered are skipped with a warning. If the document portal
+ * refuses a batch, its files are registered one at a time.
+ *
+ * Returns: (transfer full): an array with the same length as @uris, holding
+ *   the document URI for each of @uris, or %NULL for the ones that could
+ *   not be registered. %NULL if the files could not be passed on.
+ */
+GPtrArray *
+xdp_register_documents (const char * const *uris,
+                        const char         *app_id,
+                        GDesktopAppInfo    *app_info,
+                        XdpDocumentFlags    flags,
+                        GError            **error)
+{
+  g_autoptr(GPtrArray) results = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autoptr(GArray) handles = NULL;
+  g_autoptr(GPtrArray) paths = NULL;
+  g_autoptr(GPtrArray) result_indices = NULL;
+  size_t n_uris;
+  size_t i;
+
+  g_return_val_if_fail (app_id != NULL && *app_id != '\0', NULL);
+
+  n_uris = uris ? g_strv_length ((char **) uris) : 0;
+  results = g_ptr_array_new_full (n_uris, g_free);
+  g_ptr_array_set_size (results, n_uris);
+
+  /* Only AddFull takes more than one fd */
+  if ((flags & XDP_DOCUMENT_FLAG_FOR_SAVE) ||
+      xdp_dbus_documents_get_version (documents) < 2)
     {
-      if (!xdp_dbus_documents_call_grant_permissions_sync (documents,
-                                                           doc_id,
-                                                           app_id,
-                                                           permissions,
-                                                           NULL,
-                                                           error))
-        return NULL;
+      for (i = 0; i < n_uris; i++)
+        {
+          g_autoptr(GError) local_error = NULL;
+          char *ruri;
+
+          ruri = xdp_register_document (uris[i], app_id, app_info, flags, &local_error);
+          if (ruri == NULL)
+            g_warning ("Failed to register %s: %s", uris[i], local_error->message);
+
+          g_ptr_array_index (results, i) = ruri;
+        }
+
+      return g_steal_pointer (&results);
     }
 
-  if (g_strcmp0 (doc_id, "") == 0)
+  handles = g_array_new (FALSE, FALSE, sizeof (gint32));
+  paths = g_ptr_array_new_with_free_func (g_free);
+  result_indices = g_ptr_array_new ();
+
+  for (i = 0; i < n_uris; i++)
     {
-      doc_path = g_build_filename (path, NULL);
-      return g_filename_to_uri (doc_path, NULL, error);
+      g_autoptr(GError) local_error = NULL;
+      g_autofree char *path = NULL;
+      g_autofd int fd = -1;
+      gint32 fd_in;
+
+      path = get_path_for_uri (uris[i], &local_error);
+      if (path == NULL)
+        {
+          g_warning ("Failed to register %s: %s", uris[i], local_error->message);
+          continue;
+        }
+
+      fd = open (path, O_CLOEXEC);
+      if (fd == -1)
+        {
+          g_warning ("Failed to register %s: Failed to open: %s",
+                     uris[i], g_strerror (errno));
+          continue;
+        }
+
+      if (fd_list == NULL)
+        fd_list = g_unix_fd_list_new ();
+
+      fd_in = g_unix_fd_list_append (fd_list, fd, error);
+      if (fd_in == -1)
+        return NULL;
+
+      g_array_append_val (handles, fd_in);
+      g_ptr_array_add (paths, g_steal_pointer (&path));
+      g_ptr_array_add (result_indices, GSIZE_TO_POINTER (i));
+
+      if (handles->len == MAX_FDS_PER_CALL)
+        {
+          register_documents_chunk (uris, app_id, app_info, flags,
+                                    fd_list, handles, paths,
+                                    result_indices, results);
+
+          g_clear_object (&fd_list);
+          g_array_set_size (handles, 0);
+          g_ptr_array_set_size (paths, 0);
+          g_ptr_array_set_size (result_indices, 0);
+        }
     }
 
-  fuse_path = xdp_desktop_app_info_get_doc_mountpoint (app_info);
-  doc_path = g_build_filename (fuse_path, doc_id, basename, NULL);
+  if (handles->len > 0)
+    register_documents_chunk (uris, app_id, app_info, flags,
+                              fd_list, handles, paths,
+                              result_indices, results);
 
-  return g_filename_to_uri (doc_path, NULL, error);
+  return g_steal_pointer (&results);
 }
 
 char *
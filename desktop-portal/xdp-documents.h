@@ -26,6 +26,23 @@ char *xdp_register_document (const char        *uri,
                              XdpDocumentFlags   flags,
                              GError           **error);
 
+void xdp_register_document_async (const char          *uri,
+                                  const char          *app_id,
+                                  GDesktopAppInfo     *app_info,
+                                  XdpDocumentFlags     flags,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data);
+
+char *xdp_register_document_finish (GAsyncResult  *result,
+                                    GError       **error);
+
+GPtrArray *xdp_register_documents (const char * const *uris,
+                                   const char         *app_id,
+                                   GDesktopAppInfo    *app_info,
+                                   XdpDocumentFlags    flags,
+                                   GError            **error);
+
 char *xdp_get_real_path_for_doc_id (const char *doc_id);
 
 typedef enum {
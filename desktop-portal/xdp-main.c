@@ -13,6 +13,7 @@
 #include <libdex.h>
 
 #include "xdp-context.h"
+#include "xdp-metrics.h"
 
 typedef struct _XdpMain
 {
@@ -191,6 +192,8 @@ main (int argc, char *argv[])
 
   g_set_prgname (argv[0]);
 
+  xdp_metrics_init ();
+
   loop = g_main_loop_new (NULL, FALSE);
   context = xdp_context_new (opt_verbose);
 
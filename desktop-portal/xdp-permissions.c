@@ -8,10 +8,31 @@
 
 #include <string.h>
 
+#include "xdp-metrics.h"
+
 #define PERMISSION_STORE_DBUS_NAME "org.freedesktop.impl.portal.PermissionStore"
 #define PERMISSION_STORE_DBUS_PATH "/org/freedesktop/impl/portal/PermissionStore"
+#define PERMISSION_STORE_DBUS_IFACE "org.freedesktop.impl.portal.PermissionStore"
+
+typedef struct _TableWatch
+{
+  guint id;
+  char *table;
+  XdpPermissionsChangedFunc func;
+  gpointer user_data;
+
+  guint32 store_subscription;
+  gboolean subscribing;
+  GPtrArray *early_batches; /* GVariant (ua(ssbva{sas})) */
+  guint batch_signal_id;
+  guint changed_signal_id;
+  gulong owner_handler_id;
+  GCancellable *cancellable;
+} TableWatch;
 
 static XdpDbusImplPermissionStore *permission_store = NULL;
+static GHashTable *table_watches = NULL; /* id -> TableWatch */
+static guint next_table_watch_id = 1;
 
 char **
 xdp_get_permissions_sync (XdpAppInfo *app_info,
@@ -23,6 +44,7 @@ xdp_get_permissions_sync (XdpAppInfo *app_info,
   g_autoptr(GVariant) out_data = NULL;
   g_auto(GStrv) permissions = NULL;
   const char *app_id;
+  XDP_METRICS_SCOPE ("permission-store.Lookup");
 
   if (!xdp_dbus_impl_permission_store_call_lookup_sync (permission_store,
                                                         table,
@@ -145,6 +167,7 @@ xdp_set_permissions_sync (XdpAppInfo         *app_info,
                           const char * const *permissions)
 {
   g_autoptr(GError) error = NULL;
+  XDP_METRICS_SCOPE ("permission-store.SetPermission");
 
   if (!xdp_dbus_impl_permission_store_call_set_permission_sync (permission_store,
                                                                 table,
@@ -274,7 +297,7 @@ xdp_init_permission_store (GDBusConnection  *connection,
 {
   permission_store =
     xdp_dbus_impl_permission_store_proxy_new_sync (connection,
-                                                   G_DBUS_PROXY_FLAGS_NONE,
+                                                   G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
                                                    PERMISSION_STORE_DBUS_NAME,
                                                    PERMISSION_STORE_DBUS_PATH,
                                                    NULL, error);
@@ -286,3 +309,281 @@ xdp_get_permission_store (void)
 {
   return permission_store;
 }
+
+static void
+table_watch_free (TableWatch *watch)
+{
+  GDBusConnection *connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (permission_store));
+
+  g_cancellable_cancel (watch->cancellable);
+  g_clear_object (&watch->cancellable);
+  g_clear_signal_handler (&watch->owner_handler_id, permission_store);
+
+  if (watch->batch_signal_id)
+    g_dbus_connection_signal_unsubscribe (connection, watch->batch_signal_id);
+  if (watch->changed_signal_id)
+    g_dbus_connection_signal_unsubscribe (connection, watch->changed_signal_id);
+
+  if (watch->store_subscription)
+    xdp_dbus_impl_permission_store_call_unsubscribe (permission_store,
+                                                     watch->store_subscription,
+                                                     NULL, NULL, NULL);
+
+  g_ptr_array_unref (watch->early_batches);
+  g_free (watch->table);
+  g_free (watch);
+}
+
+static void
+table_watch_dispatch_batch (TableWatch *watch,
+                            GVariant   *parameters)
+{
+  g_autoptr(GVariantIter) iter = NULL;
+  guint32 subscription;
+  const char *table;
+  const char *id;
+  gboolean deleted;
+  GVariant *data;
+  GVariant *permissions;
+
+  g_variant_get (parameters, "(ua(ssbva{sas}))", &subscription, &iter);
+
+  while (g_variant_iter_next (iter, "(&s&sb@v@a{sas})",
+                              &table, &id, &deleted, &data, &permissions))
+    {
+      watch->func (table, id, deleted, data, permissions, watch->user_data);
+
+      g_variant_unref (data);
+      g_variant_unref (permissions);
+    }
+}
+
+static void
+table_watch_replay_early_batches (TableWatch *watch)
+{
+  g_autoptr(GPtrArray) batches = g_steal_pointer (&watch->early_batches);
+
+  watch->early_batches = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+
+  for (guint i = 0; i < batches->len; i++)
+    {
+      GVariant *parameters = g_ptr_array_index (batches, i);
+      guint32 subscription;
+
+      g_variant_get (parameters, "(ua(ssbva{sas}))", &subscription, NULL);
+
+      /* Batches of other subscriptions are dropped */
+      if (subscription == watch->store_subscription)
+        table_watch_dispatch_batch (watch, parameters);
+    }
+}
+
+static void
+on_changed_batch (GDBusConnection *connection,
+                  const char      *sender_name,
+                  const char      *object_path,
+                  const char      *interface_name,
+                  const char      *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+  TableWatch *watch = user_data;
+  guint32 subscription;
+
+  /* The store may send changes before we got the reply to Subscribe,
+   * keep them until we know our subscription id */
+  if (watch->subscribing)
+    {
+      g_ptr_array_add (watch->early_batches, g_variant_ref (parameters));
+      return;
+    }
+
+  g_variant_get (parameters, "(ua(ssbva{sas}))", &subscription, NULL);
+
+  if (watch->store_subscription == 0 || subscription != watch->store_subscription)
+    return;
+
+  table_watch_dispatch_batch (watch, parameters);
+}
+
+static void
+on_changed (GDBusConnection *connection,
+            const char      *sender_name,
+            const char      *object_path,
+            const char      *interface_name,
+            const char      *signal_name,
+            GVariant        *parameters,
+            gpointer         user_data)
+{
+  TableWatch *watch = user_data;
+  g_autoptr(GVariant) data = NULL;
+  g_autoptr(GVariant) permissions = NULL;
+  const char *table;
+  const char *id;
+  gboolean deleted;
+
+  g_variant_get (parameters, "(&s&sb@v@a{sas})",
+                 &table, &id, &deleted, &data, &permissions);
+
+  if (g_strcmp0 (table, watch->table) == 0)
+    watch->func (table, id, deleted, data, permissions, watch->user_data);
+}
+
+static void
+subscribe_cb (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  TableWatch *watch;
+  g_autoptr(GError) error = NULL;
+  guint32 subscription = 0;
+  guint watch_id = GPOINTER_TO_UINT (user_data);
+
+  if (!xdp_dbus_impl_permission_store_call_subscribe_finish (XDP_DBUS_IMPL_PERMISSION_STORE (source_object),
+                                                             &subscription,
+                                                             result,
+                                                             &error) &&
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  watch = g_hash_table_lookup (table_watches, GUINT_TO_POINTER (watch_id));
+  if (watch == NULL)
+    return;
+
+  watch->subscribing = FALSE;
+
+  if (error == NULL)
+    {
+      watch->store_subscription = subscription;
+      table_watch_replay_early_batches (watch);
+      return;
+    }
+
+  g_ptr_array_set_size (watch->early_batches, 0);
+
+  /* Permission stores before version 3 only have the Changed signal */
+  g_debug ("Failed to subscribe to table %s, watching all changes: %s",
+           watch->table, error->message);
+
+  if (watch->changed_signal_id == 0)
+    {
+      GDBusConnection *connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (permission_store));
+
+      watch->changed_signal_id =
+        g_dbus_connection_signal_subscribe (connection,
+                                            PERMISSION_STORE_DBUS_NAME,
+                                            PERMISSION_STORE_DBUS_IFACE,
+                                            "Changed",
+                                            PERMISSION_STORE_DBUS_PATH,
+                                            watch->table,
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            on_changed,
+                                            watch, NULL);
+    }
+}
+
+static void
+table_watch_subscribe (TableWatch *watch)
+{
+  g_auto(GVariantBuilder) options =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  const char * const no_filter[] = { NULL };
+
+  watch->store_subscription = 0;
+  watch->subscribing = TRUE;
+  g_ptr_array_set_size (watch->early_batches, 0);
+
+  g_cancellable_cancel (watch->cancellable);
+  g_clear_object (&watch->cancellable);
+  watch->cancellable = g_cancellable_new ();
+
+  xdp_dbus_impl_permission_store_call_subscribe (permission_store,
+                                                 watch->table,
+                                                 no_filter,
+                                                 no_filter,
+                                                 g_variant_builder_end (&options),
+                                                 watch->cancellable,
+                                                 subscribe_cb,
+                                                 GUINT_TO_POINTER (watch->id));
+}
+
+static void
+on_permission_store_owner_changed (GObject    *object,
+                                   GParamSpec *pspec,
+                                   TableWatch *watch)
+{
+  g_autofree char *owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (permission_store));
+
+  /* Subscriptions don't survive a restart of the store */
+  watch->store_subscription = 0;
+  watch->subscribing = FALSE;
+  g_ptr_array_set_size (watch->early_batches, 0);
+
+  if (owner != NULL)
+    table_watch_subscribe (watch);
+}
+
+/**
+ * xdp_permissions_watch_table:
+ * @table: the permission store table to watch
+ * @func: function called in the main context for each change in @table
+ * @user_data: data to pass to @func
+ *
+ * Gets notified about changes in @table only, instead of every change
+ * in the permission store.
+ *
+ * Returns: an id to pass to xdp_permissions_unwatch_table()
+ */
+guint
+xdp_permissions_watch_table (const char                *table,
+                             XdpPermissionsChangedFunc  func,
+                             gpointer                   user_data)
+{
+  GDBusConnection *connection;
+  TableWatch *watch;
+
+  g_return_val_if_fail (permission_store != NULL, 0);
+
+  connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (permission_store));
+
+  if (table_watches == NULL)
+    table_watches = g_hash_table_new_full (NULL, NULL, NULL,
+                                           (GDestroyNotify) table_watch_free);
+
+  watch = g_new0 (TableWatch, 1);
+  watch->id = next_table_watch_id++;
+  watch->table = g_strdup (table);
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->early_batches = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+
+  /* ChangedBatch is only sent to us, but GDBus still dispatches it
+   * through a signal subscription */
+  watch->batch_signal_id =
+    g_dbus_connection_signal_subscribe (connection,
+                                        PERMISSION_STORE_DBUS_NAME,
+                                        PERMISSION_STORE_DBUS_IFACE,
+                                        "ChangedBatch",
+                                        PERMISSION_STORE_DBUS_PATH,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_changed_batch,
+                                        watch, NULL);
+  watch->owner_handler_id =
+    g_signal_connect (permission_store, "notify::g-name-owner",
+                      G_CALLBACK (on_permission_store_owner_changed),
+                      watch);
+
+  g_hash_table_insert (table_watches, GUINT_TO_POINTER (watch->id), watch);
+
+  table_watch_subscribe (watch);
+
+  return watch->id;
+}
+
+void
+xdp_permissions_unwatch_table (guint watch_id)
+{
+  if (table_watches)
+    g_hash_table_remove (table_watches, GUINT_TO_POINTER (watch_id));
+}
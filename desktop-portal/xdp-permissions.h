@@ -10,6 +10,13 @@
 #include "xdp-app-info.h"
 #include "xdp-impl-dbus.h"
 
+typedef void (* XdpPermissionsChangedFunc) (const char *table,
+                                            const char *id,
+                                            gboolean    deleted,
+                                            GVariant   *data,
+                                            GVariant   *permissions,
+                                            gpointer    user_data);
+
 typedef enum _XdpPermission
 {
   XDP_PERMISSION_UNSET,
@@ -62,3 +69,9 @@ gboolean xdp_init_permission_store (GDBusConnection  *connection,
                                     GError          **err);
 
 XdpDbusImplPermissionStore *xdp_get_permission_store (void);
+
+guint xdp_permissions_watch_table (const char                *table,
+                                   XdpPermissionsChangedFunc  func,
+                                   gpointer                   user_data);
+
+void xdp_permissions_unwatch_table (guint watch_id);
@@ -9,6 +9,7 @@
 #include "xdp-app-info.h"
 #include "xdp-context.h"
 #include "xdp-impl-dbus.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
 
 typedef struct _XdpRequestDex
@@ -22,6 +23,7 @@ typedef struct _XdpRequestDex
   char *id;
   gboolean exported;
   gboolean responded;
+  gint64 start_time;
 } XdpRequestDex;
 
 static void xdp_request_skeleton_iface_init (XdpDbusRequestIface *iface);
@@ -39,6 +41,7 @@ xdp_request_dex_on_signal_response (XdpDbusRequest *object,
 {
   XdpRequestDex *request = XDP_REQUEST_DEX (object);
   GDBusConnection *connection;
+  gint64 emit_start = xdp_metrics_start ();
 
   connection = g_dbus_interface_skeleton_get_connection (request->skeleton);
   if (!connection)
@@ -53,6 +56,16 @@ xdp_request_dex_on_signal_response (XdpDbusRequest *object,
                                                 arg_response,
                                                 arg_results),
                                  NULL);
+
+  if (request->start_time != 0)
+    {
+      const char *interface = g_dbus_interface_skeleton_get_info (request->skeleton)->name;
+      g_autofree char *response = g_strconcat (interface, ":response", NULL);
+      g_autofree char *total = g_strconcat (interface, ":request", NULL);
+
+      xdp_metrics_record_since (response, emit_start);
+      xdp_metrics_record_since (total, request->start_time);
+    }
 }
 
 static gboolean
@@ -96,6 +109,13 @@ xdp_request_dex_dispose (GObject *object)
 {
   XdpRequestDex *request = XDP_REQUEST_DEX (object);
 
+  if (request->app_info)
+    {
+      xdp_context_untrack_peer_object (request->context,
+                                       xdp_app_info_get_sender (request->app_info),
+                                       request);
+    }
+
   if (request->exported)
     {
       if (!request->responded)
@@ -171,12 +191,9 @@ request_impl_proxy_create_data_free (RequestImplProxyCreateData *data)
 static void
 on_peer_disconnect (XdpContext *context,
                     const char *peer,
-                    gpointer    user_data)
+                    gpointer    object)
 {
-  XdpRequestDex *request = XDP_REQUEST_DEX (user_data);
-
-  if (g_strcmp0 (xdp_app_info_get_sender (request->app_info), peer) != 0)
-    return;
+  XdpRequestDex *request = XDP_REQUEST_DEX (object);
 
   if (!request->exported)
     return;
@@ -206,10 +223,11 @@ on_impl_request_proxy_created (DexFuture *future,
   request->impl_request = g_steal_pointer (&impl_request);
   request->skeleton = g_steal_pointer (&data->skeleton);
   request->id = g_steal_pointer (&data->id);
-  g_signal_connect_object (request->context, "peer-disconnect",
-                           G_CALLBACK (on_peer_disconnect),
-                           request,
-                           G_CONNECT_DEFAULT);
+  request->start_time = xdp_metrics_start ();
+  xdp_context_track_peer_object (request->context,
+                                 xdp_app_info_get_sender (request->app_info),
+                                 request,
+                                 on_peer_disconnect);
 
   dex_dbus_interface_skeleton_set_flags (DEX_DBUS_INTERFACE_SKELETON (request),
                                          DEX_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_FIBER);
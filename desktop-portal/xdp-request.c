@@ -11,7 +11,9 @@
 #include "xdp-context.h"
 #include "xdp-context.h"
 #include "xdp-method-info.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
+#include "xdp-worker-pool.h"
 
 static void xdp_request_skeleton_iface_init (XdpDbusRequestIface *iface);
 
@@ -31,6 +33,7 @@ xdp_request_on_signal_response (XdpDbusRequest *object,
   GList *l;
   g_autolist(GDBusConnection) connections = NULL;
   g_autoptr(GVariant) signal_variant = NULL;
+  gint64 emit_start = xdp_metrics_start ();
 
   connections = g_dbus_interface_skeleton_get_connections (G_DBUS_INTERFACE_SKELETON (skeleton));
 
@@ -48,6 +51,18 @@ xdp_request_on_signal_response (XdpDbusRequest *object,
                                      signal_variant,
                                      NULL);
     }
+
+  if (request->metrics_name)
+    {
+      g_autofree char *backend = g_strconcat (request->metrics_name, ":backend", NULL);
+      g_autofree char *response = g_strconcat (request->metrics_name, ":response", NULL);
+      g_autofree char *total = g_strconcat (request->metrics_name, ":request", NULL);
+
+      if (request->export_time != 0)
+        xdp_metrics_record (backend, emit_start - request->export_time);
+      xdp_metrics_record_since (response, emit_start);
+      xdp_metrics_record_since (total, request->start_time);
+    }
 }
 
 static gboolean
@@ -98,6 +113,7 @@ xdp_request_finalize (GObject *object)
 {
   XdpRequest *request = XDP_REQUEST (object);
 
+  xdp_context_untrack_peer_object (request->context, request->sender, request);
   xdp_context_unclaim_object_path (request->context, request->id);
 
   g_clear_object (&request->impl_request);
@@ -105,6 +121,7 @@ xdp_request_finalize (GObject *object)
   g_clear_pointer (&request->id, g_free);
   g_mutex_clear (&request->mutex);
   g_clear_object (&request->app_info);
+  g_clear_pointer (&request->metrics_name, g_free);
 
   G_OBJECT_CLASS (xdp_request_parent_class)->finalize (object);
 }
@@ -182,15 +199,12 @@ get_token (GDBusMethodInvocation *invocation)
 static void
 on_peer_disconnect (XdpContext *context,
                     const char *peer,
-                    gpointer    user_data)
+                    gpointer    object)
 {
-  XdpRequest *request = XDP_REQUEST (user_data);
+  XdpRequest *request = XDP_REQUEST (object);
 
   REQUEST_AUTOLOCK (request);
 
-  if (g_strcmp0 (request->sender, peer) != 0)
-    return;
-
   if (!request->exported)
     return;
 
@@ -228,6 +242,15 @@ xdp_request_init_invocation (GDBusMethodInvocation  *invocation,
   request->app_info = g_object_ref (app_info);
   request->context = context;
 
+  if (xdp_metrics_enabled ())
+    {
+      request->metrics_name =
+        g_strdup_printf ("%s.%s",
+                         g_dbus_method_invocation_get_interface_name (invocation),
+                         g_dbus_method_invocation_get_method_name (invocation));
+      request->start_time = xdp_metrics_start ();
+    }
+
   g_object_set_data (G_OBJECT (request), "fd", GINT_TO_POINTER (-1));
 
   sender = g_strdup (request->sender + 1);
@@ -252,10 +275,10 @@ xdp_request_init_invocation (GDBusMethodInvocation  *invocation,
                     G_CALLBACK (request_authorize_callback),
                     request->sender);
 
-  g_signal_connect_object (context, "peer-disconnect",
-                           G_CALLBACK (on_peer_disconnect),
-                           request,
-                           G_CONNECT_DEFAULT);
+  xdp_context_track_peer_object (context,
+                                 request->sender,
+                                 request,
+                                 on_peer_disconnect);
 
   g_object_set_data_full (G_OBJECT (invocation), "request", request, g_object_unref);
   return TRUE;
@@ -290,6 +313,7 @@ xdp_request_export (XdpRequest      *request,
 
   g_object_ref (request);
   request->exported = TRUE;
+  request->export_time = xdp_metrics_start ();
 }
 
 void
@@ -312,3 +336,67 @@ xdp_request_set_impl_request (XdpRequest         *request,
 {
   g_set_object (&request->impl_request, impl_request);
 }
+
+gboolean
+xdp_request_check_worker_queue (XdpRequest  *request,
+                                GError     **error)
+{
+  return xdp_worker_pool_check_queue (xdp_context_get_worker_pool (request->context),
+                                      xdp_app_info_get_id (request->app_info),
+                                      error);
+}
+
+/* Runs @task_func for @task in the context's worker pool, queued behind
+ * other jobs of the same app. The task data is expected to hold a ref on
+ * @request. */
+void
+xdp_request_run_in_worker (XdpRequest      *request,
+                           const char      *portal,
+                           GTask           *task,
+                           GTaskThreadFunc  task_func)
+{
+  xdp_worker_pool_run_task (xdp_context_get_worker_pool (request->context),
+                            portal,
+                            xdp_app_info_get_id (request->app_info),
+                            task,
+                            task_func);
+}
+
+/* Shows an access dialog for @request from a worker job. While the dialog
+ * is open, the job doesn't count against the worker limits, and the call
+ * gets cancelled when the portal shuts down. */
+gboolean
+xdp_request_call_access_dialog_sync (XdpRequest         *request,
+                                     XdpDbusImplAccess  *access_impl,
+                                     const char         *app_id,
+                                     const char         *parent_window,
+                                     const char         *title,
+                                     const char         *subtitle,
+                                     const char         *body,
+                                     GVariant           *options,
+                                     guint              *out_response,
+                                     GVariant          **out_results,
+                                     GError            **error)
+{
+  g_autoptr(GCancellable) cancellable = NULL;
+  gboolean ret;
+
+  cancellable = xdp_worker_pool_begin_blocking ();
+
+  ret = xdp_dbus_impl_access_call_access_dialog_sync (access_impl,
+                                                      request->id,
+                                                      app_id,
+                                                      parent_window,
+                                                      title,
+                                                      subtitle,
+                                                      body,
+                                                      options,
+                                                      out_response,
+                                                      out_results,
+                                                      cancellable,
+                                                      error);
+
+  xdp_worker_pool_end_blocking (cancellable);
+
+  return ret;
+}
@@ -21,6 +21,11 @@ typedef struct _XdpRequest
   XdpContext *context;
 
   XdpDbusImplRequest *impl_request;
+
+  /* only set when metrics are enabled */
+  char *metrics_name;
+  gint64 start_time;
+  gint64 export_time;
 } XdpRequest;
 
 struct _XdpRequestClass
@@ -53,3 +58,23 @@ const char *xdp_request_get_object_path (XdpRequest *request);
 
 void xdp_request_set_impl_request (XdpRequest         *request,
                                    XdpDbusImplRequest *impl_request);
+
+gboolean xdp_request_check_worker_queue (XdpRequest  *request,
+                                         GError     **error);
+
+void xdp_request_run_in_worker (XdpRequest      *request,
+                                const char      *portal,
+                                GTask           *task,
+                                GTaskThreadFunc  task_func);
+
+gboolean xdp_request_call_access_dialog_sync (XdpRequest         *request,
+                                              XdpDbusImplAccess  *access_impl,
+                                              const char         *app_id,
+                                              const char         *parent_window,
+                                              const char         *title,
+                                              const char         *subtitle,
+                                              const char         *body,
+                                              GVariant           *options,
+                                              guint              *out_response,
+                                              GVariant          **out_results,
+                                              GError            **error);
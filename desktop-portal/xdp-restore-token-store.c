@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+/*
+ * An in-memory store for restore data, scoped by the unique bus name of the
+ * peer that created it.
+ *
+ * Tokens are grouped per sender, so that all tokens of a peer can be dropped
+ * at once when it leaves the bus. The number of tokens is bounded: tokens
+ * that are never redeemed are evicted in least recently used order. A
+ * sender reaching its own limit only evicts its own tokens, so that a
+ * single peer can't push out the tokens of everyone else.
+ */
+
+#include "config.h"
+
+#include "xdp-restore-token-store.h"
+
+typedef struct _SenderTokens SenderTokens;
+
+typedef struct _TokenEntry
+{
+  SenderTokens *sender_tokens;
+  char *token;
+  GVariant *data;
+  GList link;
+  GList sender_link;
+} TokenEntry;
+
+struct _SenderTokens
+{
+  char *sender;
+  GHashTable *tokens; /* token -> TokenEntry */
+  GQueue lru; /* TokenEntry, most recently used first */
+};
+
+struct _XdpRestoreTokenStore
+{
+  GMutex mutex;
+  unsigned int max_tokens;
+  unsigned int max_tokens_per_sender;
+
+  /* all protected by mutex */
+  GHashTable *senders; /* sender -> SenderTokens */
+  GQueue lru; /* TokenEntry, most recently used first */
+};
+
+static void
+token_entry_free (TokenEntry *entry)
+{
+  g_free (entry->token);
+  g_variant_unref (entry->data);
+  g_free (entry);
+}
+
+static void
+sender_tokens_free (SenderTokens *sender_tokens)
+{
+  g_hash_table_unref (sender_tokens->tokens);
+  g_free (sender_tokens->sender);
+  g_free (sender_tokens);
+}
+
+/**
+ * xdp_restore_token_store_new:
+ * @max_tokens: the maximum number of tokens kept, or 0 for no limit
+ * @max_tokens_per_sender: the maximum number of tokens kept for a single
+ *   sender, or 0 for no limit
+ *
+ * Returns: (transfer full): a new #XdpRestoreTokenStore
+ */
+XdpRestoreTokenStore *
+xdp_restore_token_store_new (unsigned int max_tokens,
+                             unsigned int max_tokens_per_sender)
+{
+  XdpRestoreTokenStore *store;
+
+  store = g_new0 (XdpRestoreTokenStore, 1);
+  g_mutex_init (&store->mutex);
+  store->max_tokens = max_tokens;
+  store->max_tokens_per_sender = max_tokens_per_sender;
+  store->senders = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          NULL,
+                                          (GDestroyNotify) sender_tokens_free);
+  g_queue_init (&store->lru);
+
+  return store;
+}
+
+void
+xdp_restore_token_store_free (XdpRestoreTokenStore *store)
+{
+  /* The entries own their links */
+  g_queue_init (&store->lru);
+  g_hash_table_unref (store->senders);
+  g_mutex_clear (&store->mutex);
+  g_free (store);
+}
+
+static void
+remove_entry_locked (XdpRestoreTokenStore *store,
+                     TokenEntry           *entry)
+{
+  SenderTokens *sender_tokens = entry->sender_tokens;
+
+  g_queue_unlink (&store->lru, &entry->link);
+  g_queue_unlink (&sender_tokens->lru, &entry->sender_link);
+  g_hash_table_remove (sender_tokens->tokens, entry->token);
+
+  if (g_hash_table_size (sender_tokens->tokens) == 0)
+    g_hash_table_remove (store->senders, sender_tokens->sender);
+}
+
+static TokenEntry *
+lookup_entry_locked (XdpRestoreTokenStore *store,
+                     const char           *sender,
+                     const char           *token)
+{
+  SenderTokens *sender_tokens;
+
+  sender_tokens = g_hash_table_lookup (store->senders, sender);
+  if (sender_tokens == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (sender_tokens->tokens, token);
+}
+
+static void
+touch_entry_locked (XdpRestoreTokenStore *store,
+                    TokenEntry           *entry)
+{
+  SenderTokens *sender_tokens = entry->sender_tokens;
+
+  g_queue_unlink (&store->lru, &entry->link);
+  g_queue_push_head_link (&store->lru, &entry->link);
+
+  g_queue_unlink (&sender_tokens->lru, &entry->sender_link);
+  g_queue_push_head_link (&sender_tokens->lru, &entry->sender_link);
+}
+
+/**
+ * xdp_restore_token_store_insert:
+ * @store: a #XdpRestoreTokenStore
+ * @sender: the unique bus name the token belongs to
+ * @token: the restore token
+ * @data: (transfer floating): the restore data
+ *
+ * Stores @data for @token, replacing any previous data. If @sender has
+ * reached its limit, its least recently used token is evicted. Otherwise,
+ * if the store is full, the least recently used token of any sender is.
+ */
+void
+xdp_restore_token_store_insert (XdpRestoreTokenStore *store,
+                                const char           *sender,
+                                const char           *token,
+                                GVariant             *data)
+{
+  SenderTokens *sender_tokens;
+  TokenEntry *entry;
+
+  g_return_if_fail (sender != NULL);
+  g_return_if_fail (token != NULL);
+  g_return_if_fail (data != NULL);
+
+  G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+
+  entry = lookup_entry_locked (store, sender, token);
+  if (entry)
+    {
+      g_clear_pointer (&entry->data, g_variant_unref);
+      entry->data = g_variant_ref_sink (data);
+
+      touch_entry_locked (store, entry);
+      return;
+    }
+
+  sender_tokens = g_hash_table_lookup (store->senders, sender);
+  while (sender_tokens != NULL &&
+         store->max_tokens_per_sender > 0 &&
+         sender_tokens->lru.length >= store->max_tokens_per_sender)
+    {
+      TokenEntry *oldest = g_queue_peek_tail (&sender_tokens->lru);
+
+      g_debug ("Evicting unused restore token of %s, it has too many",
+               sender);
+      remove_entry_locked (store, oldest);
+
+      /* Dropped along with its last token */
+      sender_tokens = g_hash_table_lookup (store->senders, sender);
+    }
+
+  while (store->max_tokens > 0 && store->lru.length >= store->max_tokens)
+    {
+      TokenEntry *oldest = g_queue_peek_tail (&store->lru);
+
+      g_debug ("Evicting unused restore token of %s",
+               oldest->sender_tokens->sender);
+      remove_entry_locked (store, oldest);
+    }
+
+  sender_tokens = g_hash_table_lookup (store->senders, sender);
+  if (sender_tokens == NULL)
+    {
+      sender_tokens = g_new0 (SenderTokens, 1);
+      sender_tokens->sender = g_strdup (sender);
+      sender_tokens->tokens =
+        g_hash_table_new_full (g_str_hash, g_str_equal,
+                               NULL,
+                               (GDestroyNotify) token_entry_free);
+      g_queue_init (&sender_tokens->lru);
+      g_hash_table_insert (store->senders, sender_tokens->sender, sender_tokens);
+    }
+
+  entry = g_new0 (TokenEntry, 1);
+  entry->sender_tokens = sender_tokens;
+  entry->token = g_strdup (token);
+  entry->data = g_variant_ref_sink (data);
+  entry->link.data = entry;
+  entry->sender_link.data = entry;
+
+  g_hash_table_insert (sender_tokens->tokens, entry->token, entry);
+  g_queue_push_head_link (&store->lru, &entry->link);
+  g_queue_push_head_link (&sender_tokens->lru, &entry->sender_link);
+}
+
+/**
+ * xdp_restore_token_store_lookup:
+ * @store: a #XdpRestoreTokenStore
+ * @sender: the unique bus name the token belongs to
+ * @token: the restore token
+ *
+ * Returns: (transfer full) (nullable): the restore data of @token, if
+ *   @sender stored it
+ */
+GVariant *
+xdp_restore_token_store_lookup (XdpRestoreTokenStore *store,
+                                const char           *sender,
+                                const char           *token)
+{
+  TokenEntry *entry;
+
+  G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+
+  entry = lookup_entry_locked (store, sender, token);
+  if (entry == NULL)
+    return NULL;
+
+  touch_entry_locked (store, entry);
+
+  return g_variant_ref (entry->data);
+}
+
+gboolean
+xdp_restore_token_store_remove (XdpRestoreTokenStore *store,
+                                const char           *sender,
+                                const char           *token)
+{
+  TokenEntry *entry;
+
+  G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+
+  entry = lookup_entry_locked (store, sender, token);
+  if (entry == NULL)
+    return FALSE;
+
+  remove_entry_locked (store, entry);
+  return TRUE;
+}
+
+/**
+ * xdp_restore_token_store_remove_sender:
+ * @store: a #XdpRestoreTokenStore
+ * @sender: a unique bus name
+ *
+ * Drops all tokens of @sender. This only visits the tokens of @sender.
+ *
+ * Returns: the number of tokens removed
+ */
+unsigned int
+xdp_restore_token_store_remove_sender (XdpRestoreTokenStore *store,
+                                       const char           *sender)
+{
+  SenderTokens *sender_tokens;
+  GHashTableIter iter;
+  TokenEntry *entry;
+  unsigned int n_removed;
+
+  G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+
+  sender_tokens = g_hash_table_lookup (store->senders, sender);
+  if (sender_tokens == NULL)
+    return 0;
+
+  g_hash_table_iter_init (&iter, sender_tokens->tokens);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    g_queue_unlink (&store->lru, &entry->link);
+
+  n_removed = g_hash_table_size (sender_tokens->tokens);
+  g_hash_table_remove (store->senders, sender);
+
+  return n_removed;
+}
+
+unsigned int
+xdp_restore_token_store_get_size (XdpRestoreTokenStore *store)
+{
+  G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+
+  return store->lru.length;
+}
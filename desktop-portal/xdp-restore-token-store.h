@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct _XdpRestoreTokenStore XdpRestoreTokenStore;
+
+XdpRestoreTokenStore * xdp_restore_token_store_new (unsigned int max_tokens,
+                                                     unsigned int max_tokens_per_sender);
+
+void xdp_restore_token_store_free (XdpRestoreTokenStore *store);
+
+void xdp_restore_token_store_insert (XdpRestoreTokenStore *store,
+                                     const char           *sender,
+                                     const char           *token,
+                                     GVariant             *data);
+
+GVariant * xdp_restore_token_store_lookup (XdpRestoreTokenStore *store,
+                                           const char           *sender,
+                                           const char           *token);
+
+gboolean xdp_restore_token_store_remove (XdpRestoreTokenStore *store,
+                                         const char           *sender,
+                                         const char           *token);
+
+unsigned int xdp_restore_token_store_remove_sender (XdpRestoreTokenStore *store,
+                                                    const char           *sender);
+
+unsigned int xdp_restore_token_store_get_size (XdpRestoreTokenStore *store);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (XdpRestoreTokenStore, xdp_restore_token_store_free)
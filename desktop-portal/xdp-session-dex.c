@@ -109,6 +109,13 @@ xdp_session_dex_dispose (GObject *object)
 {
   XdpSessionDex *session = XDP_SESSION_DEX (object);
 
+  if (session->app_info)
+    {
+      xdp_context_untrack_peer_object (session->context,
+                                       xdp_app_info_get_sender (session->app_info),
+                                       session);
+    }
+
   if (session->exported)
     {
       g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (session));
@@ -149,12 +156,9 @@ xdp_session_dex_class_init (XdpSessionDexClass *klass)
 static void
 on_peer_disconnect (XdpContext *context,
                     const char *peer,
-                    gpointer    user_data)
+                    gpointer    object)
 {
-  XdpSessionDex *session = XDP_SESSION_DEX (user_data);
-
-  if (g_strcmp0 (xdp_app_info_get_sender (session->app_info), peer) != 0)
-    return;
+  XdpSessionDex *session = XDP_SESSION_DEX (object);
 
   if (!session->exported)
     return;
@@ -244,10 +248,10 @@ on_impl_session_proxy_created (DexFuture *future,
   session->id = g_steal_pointer (&data->id);
   session->exported = TRUE;
 
-  g_signal_connect_object (session->context, "peer-disconnect",
-                           G_CALLBACK (on_peer_disconnect),
-                           session,
-                           G_CONNECT_DEFAULT);
+  xdp_context_track_peer_object (session->context,
+                                 xdp_app_info_get_sender (session->app_info),
+                                 session,
+                                 on_peer_disconnect);
 
   g_signal_connect_object (session->impl_session, "closed",
                            G_CALLBACK (on_impl_closed),
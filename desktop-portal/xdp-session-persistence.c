@@ -7,9 +7,15 @@
 #include "xdp-session-persistence.h"
 
 #include "xdp-permissions.h"
+#include "xdp-restore-token-store.h"
 
-static GMutex transient_permissions_lock;
-static GHashTable *transient_permissions;
+/* Upper bound for restore tokens of transient sessions that were never
+ * redeemed, e.g. because the app kept running without restoring them.
+ * A single sender only ever evicts its own tokens. */
+#define MAX_TRANSIENT_RESTORE_TOKENS 1024
+#define MAX_TRANSIENT_RESTORE_TOKENS_PER_SENDER 64
+
+static XdpRestoreTokenStore *transient_permissions;
 
 #define RESTORE_DATA_TYPE "(suv)"
 
@@ -18,80 +24,61 @@ on_peer_disconnect (XdpContext *context,
                     const char *peer,
                     gpointer    user_data)
 {
-  g_autoptr(GMutexLocker) locker = NULL;
-  GHashTableIter iter;
-  const char *key;
-
-  locker = g_mutex_locker_new (&transient_permissions_lock);
+  xdp_restore_token_store_remove_sender (transient_permissions, peer);
+}
 
-  if (!transient_permissions)
-    return;
+static XdpRestoreTokenStore *
+get_transient_permissions (XdpSession *session)
+{
+  static gsize initialized = 0;
 
-  g_hash_table_iter_init (&iter, transient_permissions);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &key, NULL))
+  if (g_once_init_enter (&initialized))
     {
-      g_auto(GStrv) split = g_strsplit (key, "/", 2);
+      transient_permissions =
+        xdp_restore_token_store_new (MAX_TRANSIENT_RESTORE_TOKENS,
+                                     MAX_TRANSIENT_RESTORE_TOKENS_PER_SENDER);
 
-      if (split && split[0] && g_strcmp0 (split[0], peer) == 0)
-        g_hash_table_iter_remove (&iter);
+      g_signal_connect (session->context, "peer-disconnect",
+                        G_CALLBACK (on_peer_disconnect),
+                        NULL);
+
+      g_once_init_leave (&initialized, 1);
     }
+
+  return transient_permissions;
 }
 
 /*
- * Transient permissions are scoped by session->sender: the hash key is
- * "sender/token", so a token is only valid for the peer that created it.
+ * Transient permissions are scoped by session->sender: tokens are stored
+ * per sender, so a token is only valid for the peer that created it.
  */
 void
 xdp_session_persistence_set_transient_permissions (XdpSession *session,
                                                    const char *restore_token,
                                                    GVariant *restore_data)
 {
-  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&transient_permissions_lock);
-
-  if (!transient_permissions)
-    {
-      transient_permissions =
-        g_hash_table_new_full (g_str_hash, g_str_equal,
-                               g_free, (GDestroyNotify) g_variant_unref);
-
-      g_signal_connect (session->context, "peer-disconnect",
-                        G_CALLBACK (on_peer_disconnect),
-                        NULL);
-    }
-
-  g_hash_table_insert (transient_permissions,
-                       g_strdup_printf ("%s/%s", session->sender, restore_token),
-                       g_variant_ref (restore_data));
+  xdp_restore_token_store_insert (get_transient_permissions (session),
+                                  session->sender,
+                                  restore_token,
+                                  restore_data);
 }
 
 void
 xdp_session_persistence_delete_transient_permissions (XdpSession *session,
                                                       const char *restore_token)
 {
-  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&transient_permissions_lock);
-  g_autofree char *id = NULL;
-
-  if (!transient_permissions)
-    return;
-
-  id = g_strdup_printf ("%s/%s", session->sender, restore_token);
-  g_hash_table_remove (transient_permissions, id);
+  xdp_restore_token_store_remove (get_transient_permissions (session),
+                                  session->sender,
+                                  restore_token);
 }
 
 GVariant *
 xdp_session_persistence_get_transient_permissions (XdpSession *session,
                                                    const char *restore_token)
 {
-  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&transient_permissions_lock);
-  g_autofree char *id = NULL;
-  GVariant *permissions;
-
-  if (!transient_permissions)
-    return NULL;
-
-  id = g_strdup_printf ("%s/%s", session->sender, restore_token);
-  permissions = g_hash_table_lookup (transient_permissions, id);
-  return permissions ? g_variant_ref (permissions) : NULL;
+  return xdp_restore_token_store_lookup (get_transient_permissions (session),
+                                         session->sender,
+                                         restore_token);
 }
 
 /*
@@ -23,7 +23,9 @@ typedef enum
 
 static GParamSpec *obj_props[PROP_IMPL_DBUS_NAME + 1];
 
-G_LOCK_DEFINE (sessions);
+/* Looked up for every backend signal, but only changed when sessions are
+ * created or closed, so readers don't need to exclude each other */
+static GRWLock sessions_lock;
 static GHashTable *sessions;
 
 static void g_initable_iface_init (GInitableIface *iface);
@@ -48,17 +50,27 @@ lookup_session_token (GVariant *options)
   return token;
 }
 
+static XdpSession *
+lookup_session_ref (const char *session_handle)
+{
+  XdpSession *session;
+
+  g_rw_lock_reader_lock (&sessions_lock);
+  session = g_hash_table_lookup (sessions, session_handle);
+  if (session)
+    g_object_ref (session);
+  g_rw_lock_reader_unlock (&sessions_lock);
+
+  return session;
+}
+
 XdpSession *
 xdp_session_from_request (const char *session_handle,
                           XdpRequest *request)
 {
   g_autoptr(XdpSession) session = NULL;
 
-  G_LOCK (sessions);
-  session = g_hash_table_lookup (sessions, session_handle);
-  if (session)
-    g_object_ref (session);
-  G_UNLOCK (sessions);
+  session = lookup_session_ref (session_handle);
 
   if (!session)
     return NULL;
@@ -75,11 +87,7 @@ xdp_session_from_app_info (const char *session_handle,
 {
   g_autoptr(XdpSession) session = NULL;
 
-  G_LOCK (sessions);
-  session = g_hash_table_lookup (sessions, session_handle);
-  if (session)
-    g_object_ref (session);
-  G_UNLOCK (sessions);
+  session = lookup_session_ref (session_handle);
 
   if (!session)
     return NULL;
@@ -93,15 +101,7 @@ xdp_session_from_app_info (const char *session_handle,
 XdpSession *
 xdp_session_lookup (const char *session_handle)
 {
-  g_autoptr(XdpSession) session = NULL;
-
-  G_LOCK (sessions);
-  session = g_hash_table_lookup (sessions, session_handle);
-  if (session)
-    g_object_ref (session);
-  G_UNLOCK (sessions);
-
-  return g_steal_pointer (&session);
+  return lookup_session_ref (session_handle);
 }
 
 gboolean
@@ -131,17 +131,17 @@ xdp_session_unexport (XdpSession *session)
 void
 xdp_session_register (XdpSession *session)
 {
-  G_LOCK (sessions);
+  g_rw_lock_writer_lock (&sessions_lock);
   g_hash_table_insert (sessions, session->id, session);
-  G_UNLOCK (sessions);
+  g_rw_lock_writer_unlock (&sessions_lock);
 }
 
 static void
 xdp_session_unregister (XdpSession *session)
 {
-  G_LOCK (sessions);
+  g_rw_lock_writer_lock (&sessions_lock);
   g_hash_table_remove (sessions, session->id);
-  G_UNLOCK (sessions);
+  g_rw_lock_writer_unlock (&sessions_lock);
 }
 
 void
@@ -246,15 +246,12 @@ xdp_session_authorize_callback (GDBusInterfaceSkeleton *interface,
 static void
 on_peer_disconnect (XdpContext *context,
                     const char *peer,
-                    gpointer    user_data)
+                    gpointer    object)
 {
-  XdpSession *session = XDP_SESSION (user_data);
+  XdpSession *session = XDP_SESSION (object);
 
   SESSION_AUTOLOCK (session);
 
-  if (g_strcmp0 (session->sender, peer) != 0)
-    return;
-
   xdp_session_close (session, FALSE);
 }
 
@@ -337,10 +334,10 @@ xdp_session_initable_init (GInitable     *initable,
                     G_CALLBACK (xdp_session_authorize_callback),
                     session->sender);
 
-  g_signal_connect_object (session->context, "peer-disconnect",
-                           G_CALLBACK (on_peer_disconnect),
-                           session,
-                           G_CONNECT_DEFAULT);
+  xdp_context_track_peer_object (session->context,
+                                 session->sender,
+                                 session,
+                                 on_peer_disconnect);
 
   return TRUE;
 }
@@ -430,6 +427,9 @@ xdp_session_finalize (GObject *object)
 
   g_assert (!session->id || !g_hash_table_lookup (sessions, session->id));
 
+  if (session->context)
+    xdp_context_untrack_peer_object (session->context, session->sender, session);
+
   g_free (session->sender);
   g_clear_object (&session->connection);
 
@@ -0,0 +1,629 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+/*
+ * A bounded thread pool for the blocking parts of portal method calls.
+ *
+ * Jobs are queued per app id and the queues are served round-robin, so an
+ * app flooding a portal with calls only delays its own calls and not those
+ * of other apps. An app also only gets a few workers at a time; its other
+ * jobs stay queued until one of them finishes. Callers that still hold a
+ * D-Bus invocation are expected to call xdp_worker_pool_check_queue()
+ * first, so that excess calls get rejected early instead of piling up.
+ *
+ * Jobs that wait for a dialog the user may leave open indefinitely wrap
+ * the wait in xdp_worker_pool_begin_blocking() and
+ * xdp_worker_pool_end_blocking(). While waiting, they don't count against
+ * the pool's or the app's limits, and they get cancelled on shutdown.
+ */
+
+#include "config.h"
+
+#include "xdp-worker-pool.h"
+
+#include "xdp-metrics.h"
+#include "xdp-utils.h"
+
+/* Jobs waiting longer than this are logged */
+#define SLOW_QUEUE_WAIT_USEC (100 * G_TIME_SPAN_MILLISECOND)
+
+/* Further jobs of an app waiting on the user keep counting against
+ * its running limit, so an app can't open dialogs without bounds */
+#define MAX_BLOCKING_PER_APP 16
+
+typedef struct _Job
+{
+  const char *portal;
+  GTask *task;
+  GTaskThreadFunc task_func;
+  gint64 queued_time;
+} Job;
+
+typedef struct _AppQueue
+{
+  char *app_id;
+  GQueue jobs; /* Job */
+  unsigned int n_running;
+  unsigned int n_blocking;
+  gboolean scheduled;
+} AppQueue;
+
+typedef struct _Worker
+{
+  XdpWorkerPool *pool; /* owned */
+
+  /* protected by the pool's mutex */
+  AppQueue *app_queue; /* of the running job */
+  GCancellable *cancellable; /* set while the job waits on the user */
+  gboolean released; /* the job doesn't count against the limits */
+} Worker;
+
+typedef struct _PortalStats
+{
+  guint64 n_jobs;
+  guint64 total_wait_usec;
+  guint64 max_wait_usec;
+} PortalStats;
+
+struct _XdpWorkerPool
+{
+  GObject parent_instance;
+
+  unsigned int max_workers;
+  unsigned int max_running_per_app;
+  unsigned int max_queued_per_app;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean shutdown;
+
+  /* all protected by mutex */
+  GPtrArray *workers; /* Worker */
+  unsigned int n_idle_workers;
+  unsigned int n_blocking_workers;
+  unsigned int next_worker_id;
+  GHashTable *app_queues; /* app id -> AppQueue, with jobs queued, running or blocking */
+  GQueue scheduled_queues; /* AppQueue below the running limit, round-robin order */
+  GHashTable *portal_stats; /* portal name -> PortalStats */
+};
+
+G_DEFINE_FINAL_TYPE (XdpWorkerPool,
+                     xdp_worker_pool,
+                     G_TYPE_OBJECT);
+
+static GPrivate current_worker;
+
+static void
+job_free (Job *job)
+{
+  g_clear_object (&job->task);
+  g_free (job);
+}
+
+static void
+job_cancel (Job *job)
+{
+  g_task_return_new_error (job->task,
+                           G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           "The portal is shutting down");
+  job_free (job);
+}
+
+static void
+app_queue_free (AppQueue *app_queue)
+{
+  g_queue_clear_full (&app_queue->jobs, (GDestroyNotify) job_cancel);
+  g_free (app_queue->app_id);
+  g_free (app_queue);
+}
+
+static void
+maybe_schedule_locked (XdpWorkerPool *pool,
+                       AppQueue      *app_queue)
+{
+  if (app_queue->scheduled ||
+      g_queue_is_empty (&app_queue->jobs) ||
+      app_queue->n_running >= pool->max_running_per_app)
+    return;
+
+  app_queue->scheduled = TRUE;
+  g_queue_push_tail (&pool->scheduled_queues, app_queue);
+}
+
+static Job *
+pop_job_locked (XdpWorkerPool  *pool,
+                AppQueue      **app_queue_out)
+{
+  AppQueue *app_queue;
+  Job *job;
+
+  app_queue = g_queue_pop_head (&pool->scheduled_queues);
+  if (app_queue == NULL)
+    return NULL;
+
+  job = g_queue_pop_head (&app_queue->jobs);
+  g_assert (job != NULL);
+
+  app_queue->scheduled = FALSE;
+  app_queue->n_running++;
+  maybe_schedule_locked (pool, app_queue);
+
+  *app_queue_out = app_queue;
+  return job;
+}
+
+static void
+finish_job_locked (XdpWorkerPool *pool,
+                   AppQueue      *app_queue)
+{
+  g_assert (app_queue->n_running > 0);
+  app_queue->n_running--;
+
+  if (app_queue->n_running == 0 &&
+      app_queue->n_blocking == 0 &&
+      g_queue_is_empty (&app_queue->jobs))
+    {
+      g_hash_table_remove (pool->app_queues, app_queue->app_id);
+      return;
+    }
+
+  /* The calling worker picks up the next job itself */
+  maybe_schedule_locked (pool, app_queue);
+}
+
+static void
+record_wait_locked (XdpWorkerPool *pool,
+                    Job           *job,
+                    guint64        wait_usec)
+{
+  PortalStats *stats;
+
+  stats = g_hash_table_lookup (pool->portal_stats, job->portal);
+  if (stats == NULL)
+    {
+      stats = g_new0 (PortalStats, 1);
+      g_hash_table_insert (pool->portal_stats, (gpointer) job->portal, stats);
+    }
+
+  stats->n_jobs++;
+  stats->total_wait_usec += wait_usec;
+  stats->max_wait_usec = MAX (stats->max_wait_usec, wait_usec);
+}
+
+static gpointer
+worker_thread_func (gpointer user_data)
+{
+  Worker *worker = user_data;
+  XdpWorkerPool *pool = worker->pool;
+
+  g_private_set (&current_worker, worker);
+
+  while (TRUE)
+    {
+      Job *job;
+      guint64 wait_usec;
+
+      g_mutex_lock (&pool->mutex);
+
+      /* Jobs that stopped waiting on the user count against the limit
+       * again, leaving the pool with more workers than allowed */
+      if (pool->workers->len - pool->n_blocking_workers > pool->max_workers)
+        break;
+
+      pool->n_idle_workers++;
+      while (!pool->shutdown && g_queue_is_empty (&pool->scheduled_queues))
+        g_cond_wait (&pool->cond, &pool->mutex);
+      pool->n_idle_workers--;
+
+      if (pool->shutdown)
+        break;
+
+      job = pop_job_locked (pool, &worker->app_queue);
+      wait_usec = g_get_monotonic_time () - job->queued_time;
+      record_wait_locked (pool, job, wait_usec);
+
+      g_mutex_unlock (&pool->mutex);
+
+      if (wait_usec > SLOW_QUEUE_WAIT_USEC)
+        g_debug ("%s job waited %.1f ms in the worker queue",
+                 job->portal, wait_usec / 1000.0);
+
+      if (xdp_metrics_enabled ())
+        {
+          g_autofree char *name = g_strconcat ("worker-queue.", job->portal, NULL);
+
+          xdp_metrics_record (name, wait_usec);
+        }
+
+      job->task_func (job->task,
+                      g_task_get_source_object (job->task),
+                      g_task_get_task_data (job->task),
+                      g_task_get_cancellable (job->task));
+
+      job_free (job);
+
+      g_mutex_lock (&pool->mutex);
+      g_warn_if_fail (worker->cancellable == NULL);
+      finish_job_locked (pool, worker->app_queue);
+      worker->app_queue = NULL;
+      g_mutex_unlock (&pool->mutex);
+    }
+
+  g_ptr_array_remove_fast (pool->workers, worker);
+  g_mutex_unlock (&pool->mutex);
+
+  g_private_set (&current_worker, NULL);
+  g_free (worker);
+
+  /* Might be the last reference after xdp_worker_pool_shutdown() */
+  g_object_unref (pool);
+
+  return NULL;
+}
+
+static void
+wake_worker_locked (XdpWorkerPool *pool)
+{
+  if (pool->n_idle_workers == 0 &&
+      pool->workers->len - pool->n_blocking_workers < pool->max_workers)
+    {
+      g_autofree char *name = NULL;
+      Worker *worker;
+
+      /* Workers keep the pool alive, so a worker that is still waiting
+       * on the user after xdp_worker_pool_shutdown() never needs to be
+       * joined */
+      worker = g_new0 (Worker, 1);
+      worker->pool = g_object_ref (pool);
+      g_ptr_array_add (pool->workers, worker);
+
+      name = g_strdup_printf ("xdp-worker-%u", pool->next_worker_id++);
+      g_thread_unref (g_thread_new (name, worker_thread_func, worker));
+    }
+  else
+    {
+      g_cond_signal (&pool->cond);
+    }
+}
+
+static void
+xdp_worker_pool_dispose (GObject *object)
+{
+  XdpWorkerPool *pool = XDP_WORKER_POOL (object);
+
+  /* Every worker holds a reference, so they are all gone by now */
+  g_clear_pointer (&pool->workers, g_ptr_array_unref);
+  g_queue_clear (&pool->scheduled_queues);
+  g_clear_pointer (&pool->app_queues, g_hash_table_unref);
+  g_clear_pointer (&pool->portal_stats, g_hash_table_unref);
+
+  G_OBJECT_CLASS (xdp_worker_pool_parent_class)->dispose (object);
+}
+
+static void
+xdp_worker_pool_finalize (GObject *object)
+{
+  XdpWorkerPool *pool = XDP_WORKER_POOL (object);
+
+  g_mutex_clear (&pool->mutex);
+  g_cond_clear (&pool->cond);
+
+  G_OBJECT_CLASS (xdp_worker_pool_parent_class)->finalize (object);
+}
+
+static void
+xdp_worker_pool_class_init (XdpWorkerPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = xdp_worker_pool_dispose;
+  object_class->finalize = xdp_worker_pool_finalize;
+}
+
+static void
+xdp_worker_pool_init (XdpWorkerPool *pool)
+{
+  g_mutex_init (&pool->mutex);
+  g_cond_init (&pool->cond);
+  g_queue_init (&pool->scheduled_queues);
+}
+
+XdpWorkerPool *
+xdp_worker_pool_new (unsigned int max_workers,
+                     unsigned int max_running_per_app,
+                     unsigned int max_queued_per_app)
+{
+  XdpWorkerPool *pool;
+
+  g_return_val_if_fail (max_workers > 0, NULL);
+  g_return_val_if_fail (max_running_per_app > 0, NULL);
+
+  pool = g_object_new (XDP_TYPE_WORKER_POOL, NULL);
+  pool->max_workers = max_workers;
+  pool->max_running_per_app = max_running_per_app;
+  pool->max_queued_per_app = max_queued_per_app;
+  pool->workers = g_ptr_array_new ();
+  pool->app_queues = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            NULL,
+                                            (GDestroyNotify) app_queue_free);
+  pool->portal_stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              NULL, g_free);
+
+  return pool;
+}
+
+/**
+ * xdp_worker_pool_check_queue:
+ * @pool: a #XdpWorkerPool
+ * @app_id: the app id to check
+ * @error: return location for a #GError
+ *
+ * Checks whether @app_id may queue another job. Method handlers should
+ * call this before doing anything visible to the caller, and return
+ * the error to the caller if it fails.
+ *
+ * Returns: %TRUE if the app is below its queue depth limit
+ */
+gboolean
+xdp_worker_pool_check_queue (XdpWorkerPool  *pool,
+                             const char     *app_id,
+                             GError        **error)
+{
+  AppQueue *app_queue;
+
+  g_return_val_if_fail (XDP_IS_WORKER_POOL (pool), FALSE);
+
+  if (pool->max_queued_per_app == 0)
+    return TRUE;
+
+  G_MUTEX_AUTO_LOCK (&pool->mutex, locker);
+
+  app_queue = g_hash_table_lookup (pool->app_queues, app_id ? app_id : "");
+  if (app_queue && app_queue->jobs.length >= pool->max_queued_per_app)
+    {
+      g_debug ("Rejecting call from '%s': %u jobs already queued",
+               app_id, app_queue->jobs.length);
+      g_set_error (error,
+                   XDG_DESKTOP_PORTAL_ERROR,
+                   XDG_DESKTOP_PORTAL_ERROR_FAILED,
+                   "Too many pending calls");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * xdp_worker_pool_run_task:
+ * @pool: a #XdpWorkerPool
+ * @portal: static string used to account queue wait times
+ * @app_id: the app id the job is run on behalf of
+ * @task: the #GTask to run
+ * @task_func: the function to run in a worker thread
+ *
+ * Like g_task_run_in_thread(), but runs @task_func in one of the
+ * pool's workers. Jobs are never rejected here; see
+ * xdp_worker_pool_check_queue().
+ */
+void
+xdp_worker_pool_run_task (XdpWorkerPool   *pool,
+                          const char      *portal,
+                          const char      *app_id,
+                          GTask           *task,
+                          GTaskThreadFunc  task_func)
+{
+  AppQueue *app_queue;
+  Job *job;
+
+  g_return_if_fail (XDP_IS_WORKER_POOL (pool));
+  g_return_if_fail (G_IS_TASK (task));
+
+  if (app_id == NULL)
+    app_id = "";
+
+  job = g_new0 (Job, 1);
+  job->portal = portal;
+  job->task = g_object_ref (task);
+  job->task_func = task_func;
+  job->queued_time = g_get_monotonic_time ();
+
+  g_mutex_lock (&pool->mutex);
+
+  if (pool->shutdown)
+    {
+      g_mutex_unlock (&pool->mutex);
+      job_cancel (job);
+      return;
+    }
+
+  app_queue = g_hash_table_lookup (pool->app_queues, app_id);
+  if (app_queue == NULL)
+    {
+      app_queue = g_new0 (AppQueue, 1);
+      app_queue->app_id = g_strdup (app_id);
+      g_queue_init (&app_queue->jobs);
+      g_hash_table_insert (pool->app_queues, app_queue->app_id, app_queue);
+    }
+
+  g_queue_push_tail (&app_queue->jobs, job);
+  maybe_schedule_locked (pool, app_queue);
+
+  /* Unless the app has enough jobs running already */
+  if (app_queue->scheduled)
+    wake_worker_locked (pool);
+
+  g_mutex_unlock (&pool->mutex);
+}
+
+/**
+ * xdp_worker_pool_begin_blocking:
+ *
+ * Called by a job before it waits for something that can take
+ * indefinitely, usually a dialog. Until xdp_worker_pool_end_blocking()
+ * is called, the job doesn't count against the number of workers or
+ * the running limit of its app, so other jobs can go ahead.
+ *
+ * Returns: (transfer full) (nullable): a #GCancellable to pass to the
+ *   blocking call, which gets cancelled when the pool shuts down, or
+ *   %NULL when not called from a job
+ */
+GCancellable *
+xdp_worker_pool_begin_blocking (void)
+{
+  Worker *worker = g_private_get (&current_worker);
+  XdpWorkerPool *pool;
+  AppQueue *app_queue;
+
+  if (worker == NULL)
+    return NULL;
+
+  pool = worker->pool;
+
+  G_MUTEX_AUTO_LOCK (&pool->mutex, locker);
+
+  g_return_val_if_fail (worker->cancellable == NULL, NULL);
+
+  worker->cancellable = g_cancellable_new ();
+  if (pool->shutdown)
+    g_cancellable_cancel (worker->cancellable);
+
+  app_queue = worker->app_queue;
+  if (app_queue->n_blocking < MAX_BLOCKING_PER_APP)
+    {
+      worker->released = TRUE;
+      app_queue->n_running--;
+      app_queue->n_blocking++;
+      pool->n_blocking_workers++;
+
+      maybe_schedule_locked (pool, app_queue);
+      if (!g_queue_is_empty (&pool->scheduled_queues))
+        wake_worker_locked (pool);
+    }
+
+  return g_object_ref (worker->cancellable);
+}
+
+/**
+ * xdp_worker_pool_end_blocking:
+ * @cancellable: (nullable): the #GCancellable returned by
+ *   xdp_worker_pool_begin_blocking()
+ *
+ * Makes the calling job count against the limits again.
+ */
+void
+xdp_worker_pool_end_blocking (GCancellable *cancellable)
+{
+  Worker *worker = g_private_get (&current_worker);
+  XdpWorkerPool *pool;
+
+  if (cancellable == NULL)
+    return;
+
+  g_return_if_fail (worker != NULL && worker->cancellable == cancellable);
+
+  pool = worker->pool;
+
+  G_MUTEX_AUTO_LOCK (&pool->mutex, locker);
+
+  if (worker->released)
+    {
+      worker->released = FALSE;
+      worker->app_queue->n_running++;
+      worker->app_queue->n_blocking--;
+      pool->n_blocking_workers--;
+    }
+
+  g_clear_object (&worker->cancellable);
+}
+
+/**
+ * xdp_worker_pool_shutdown:
+ * @pool: a #XdpWorkerPool
+ *
+ * Fails all queued jobs, and cancels the jobs waiting on the user
+ * instead of waiting for them to finish. The workers exit once their
+ * job is done, and drop their reference on @pool.
+ */
+void
+xdp_worker_pool_shutdown (XdpWorkerPool *pool)
+{
+  g_autoptr(GPtrArray) jobs = NULL;
+  g_autoptr(GPtrArray) cancellables = NULL;
+  GHashTableIter iter;
+  AppQueue *app_queue;
+  Job *job;
+
+  g_return_if_fail (XDP_IS_WORKER_POOL (pool));
+
+  jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) job_cancel);
+  cancellables = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_mutex_lock (&pool->mutex);
+
+  pool->shutdown = TRUE;
+
+  g_queue_clear (&pool->scheduled_queues);
+
+  g_hash_table_iter_init (&iter, pool->app_queues);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app_queue))
+    {
+      while ((job = g_queue_pop_head (&app_queue->jobs)) != NULL)
+        g_ptr_array_add (jobs, job);
+
+      app_queue->scheduled = FALSE;
+
+      if (app_queue->n_running == 0 && app_queue->n_blocking == 0)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  for (guint i = 0; i < pool->workers->len; i++)
+    {
+      Worker *worker = g_ptr_array_index (pool->workers, i);
+
+      if (worker->cancellable)
+        g_ptr_array_add (cancellables, g_object_ref (worker->cancellable));
+    }
+
+  g_cond_broadcast (&pool->cond);
+
+  g_mutex_unlock (&pool->mutex);
+
+  /* Outside of the lock, as both can call back into other code */
+  for (guint i = 0; i < cancellables->len; i++)
+    g_cancellable_cancel (g_ptr_array_index (cancellables, i));
+
+  g_clear_pointer (&jobs, g_ptr_array_unref);
+}
+
+/**
+ * xdp_worker_pool_get_stats:
+ * @pool: a #XdpWorkerPool
+ *
+ * Returns: (transfer floating): a `a{s(ttt)}` variant mapping portal
+ *   names to the number of jobs run, and their total and maximum queue
+ *   wait time in microseconds
+ */
+GVariant *
+xdp_worker_pool_get_stats (XdpWorkerPool *pool)
+{
+  g_auto(GVariantBuilder) builder =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a{s(ttt)}"));
+  GHashTableIter iter;
+  const char *portal;
+  PortalStats *stats;
+
+  G_MUTEX_AUTO_LOCK (&pool->mutex, locker);
+
+  g_hash_table_iter_init (&iter, pool->portal_stats);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &portal, (gpointer *) &stats))
+    {
+      g_variant_builder_add (&builder, "{s(ttt)}",
+                             portal,
+                             stats->n_jobs,
+                             stats->total_wait_usec,
+                             stats->max_wait_usec);
+    }
+
+  return g_variant_builder_end (&builder);
+}
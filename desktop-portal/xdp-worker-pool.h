@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+#include "xdp-types.h"
+
+#define XDP_TYPE_WORKER_POOL (xdp_worker_pool_get_type())
+G_DECLARE_FINAL_TYPE (XdpWorkerPool,
+                      xdp_worker_pool,
+                      XDP, WORKER_POOL,
+                      GObject);
+
+XdpWorkerPool * xdp_worker_pool_new (unsigned int max_workers,
+                                     unsigned int max_running_per_app,
+                                     unsigned int max_queued_per_app);
+
+gboolean xdp_worker_pool_check_queue (XdpWorkerPool  *pool,
+                                      const char     *app_id,
+                                      GError        **error);
+
+void xdp_worker_pool_run_task (XdpWorkerPool   *pool,
+                               const char      *portal,
+                               const char      *app_id,
+                               GTask           *task,
+                               GTaskThreadFunc  task_func);
+
+GCancellable * xdp_worker_pool_begin_blocking (void);
+
+void xdp_worker_pool_end_blocking (GCancellable *cancellable);
+
+void xdp_worker_pool_shutdown (XdpWorkerPool *pool);
+
+GVariant * xdp_worker_pool_get_stats (XdpWorkerPool *pool);
@@ -24,6 +24,7 @@
 #include <glib/gprintf.h>
 
 #include "document-store.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
 
 #if HAVE_SYS_STATFS_H
@@ -136,6 +137,24 @@ typedef struct {
   dev_t dev;
 } DevIno;
 
+/* The inode hash tables are split into independently locked shards,
+ * so that FUSE worker threads looking up unrelated inodes don't all
+ * contend on one lock. Each key always maps to the same shard, so
+ * everything that needs to be atomic for one key can be done while
+ * holding its shard lock. */
+#define N_INODE_TABLE_SHARDS 16
+
+typedef struct {
+  GMutex lock;
+  GHashTable *table;
+} XdpInodeShard;
+
+typedef struct {
+  GHashFunc hash_func;
+  guint n_shards;
+  XdpInodeShard shards[];
+} XdpInodeTable;
+
 typedef enum {
  XDP_DOMAIN_ROOT,
  XDP_DOMAIN_BY_APP,
@@ -161,7 +180,7 @@ struct _XdpDomain {
    * by_app: by app
    * document: by physical
    */
-  GHashTable *inodes; /* Protected by domain_inodes */
+  XdpInodeTable *inodes;
 
   /* Below only used for XDP_DOMAIN_DOCUMENT */
 
@@ -180,12 +199,15 @@ struct _XdpDomain {
 static void xdp_domain_unref (XdpDomain *domain);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (XdpDomain, xdp_domain_unref)
 
-G_LOCK_DEFINE (domain_inodes);
-
 typedef struct {
   gint ref_count; /* atomic */
   DevIno backing_devino;
   int fd; /* O_PATH fd */
+
+  /* Below is mutable, protected by mutex */
+  GMutex views_mutex;
+  GPtrArray *views; /* The main file inodes of non-directory documents,
+                       not owned */
 } XdpPhysicalInode;
 
 static XdpPhysicalInode *xdp_physical_inode_ref   (XdpPhysicalInode *inode);
@@ -226,6 +248,7 @@ struct _XdpInode {
 typedef struct {
   int fd;
   GList *link;
+  gint written; /* atomic */
 } XdpFile;
 
 
@@ -246,20 +269,29 @@ typedef struct {
   char name[0];
 } XdpInvalidateData;
 
+typedef enum {
+  XDP_FUSE_MODE_DEFAULT,
+  XDP_FUSE_MODE_CLONE_FD,
+  XDP_FUSE_MODE_IO_URING,
+} XdpFuseMode;
+
 typedef struct {
   gboolean use_splice;
+  XdpFuseMode mode;
+  gboolean writeback_cache;
 } XdpFuseOptions;
 
 static GList *invalidate_list;
+static GArray *invalidate_inodes; /* guint64, protected by invalidate_list */
 G_LOCK_DEFINE (invalidate_list);
 
 static XdpInode *xdp_inode_ref (XdpInode *inode);
 static void xdp_inode_unref (XdpInode *inode);
 
 /* Lookup by inode for verification */
-static GHashTable *all_inodes; /* guint64 -> XdpInode */
+static XdpInodeTable *all_inodes; /* guint64 -> XdpInode */
 static guint64 next_virtual_inode = FUSE_ROOT_ID; /* root is the first inode created, so it gets this */
-G_LOCK_DEFINE (all_inodes);
+G_LOCK_DEFINE (next_virtual_inode);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (XdpInode, xdp_inode_unref)
 
@@ -432,6 +464,82 @@ renameat2_flags_to_string (int flags)
 #endif
 }
 
+static XdpInodeTable *
+xdp_inode_table_new (guint      n_shards,
+                     GHashFunc  hash_func,
+                     GEqualFunc equal_func)
+{
+  XdpInodeTable *table;
+  guint i;
+
+  table = g_malloc0 (sizeof (XdpInodeTable) + n_shards * sizeof (XdpInodeShard));
+  table->hash_func = hash_func;
+  table->n_shards = n_shards;
+
+  for (i = 0; i < n_shards; i++)
+    {
+      g_mutex_init (&table->shards[i].lock);
+      table->shards[i].table = g_hash_table_new (hash_func, equal_func);
+    }
+
+  return table;
+}
+
+static void
+xdp_inode_table_free (XdpInodeTable *table)
+{
+  guint i;
+
+  for (i = 0; i < table->n_shards; i++)
+    {
+      g_mutex_clear (&table->shards[i].lock);
+      g_hash_table_unref (table->shards[i].table);
+    }
+
+  g_free (table);
+}
+
+static XdpInodeShard *
+xdp_inode_table_lock_shard (XdpInodeTable *table,
+                            gconstpointer  key)
+{
+  XdpInodeShard *shard;
+  guint hash;
+
+  /* Mix the bits, direct hashes of pointers have aligned low bits */
+  hash = table->hash_func (key);
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3b;
+  hash ^= hash >> 16;
+
+  shard = &table->shards[hash % table->n_shards];
+  g_mutex_lock (&shard->lock);
+
+  return shard;
+}
+
+static void
+xdp_inode_shard_unlock (XdpInodeShard *shard)
+{
+  g_mutex_unlock (&shard->lock);
+}
+
+static guint
+xdp_inode_table_size (XdpInodeTable *table)
+{
+  guint size = 0;
+  guint i;
+
+  for (i = 0; i < table->n_shards; i++)
+    {
+      g_mutex_lock (&table->shards[i].lock);
+      size += g_hash_table_size (table->shards[i].table);
+      g_mutex_unlock (&table->shards[i].lock);
+    }
+
+  return size;
+}
+
 static guint
 devino_hash  (gconstpointer  key)
 {
@@ -450,8 +558,7 @@ devino_equal (gconstpointer  _a,
 }
 
 /* Lookup by physical backing devino */
-static GHashTable *physical_inodes;
-G_LOCK_DEFINE (physical_inodes);
+static XdpInodeTable *physical_inodes;
 
 
 /* Takes ownership of the o_path fd if passed in */
@@ -460,10 +567,11 @@ ensure_physical_inode (dev_t dev, ino_t ino, int o_path_fd)
 {
   DevIno devino = {ino, dev};
   XdpPhysicalInode *inode = NULL;
+  XdpInodeShard *shard;
 
-  G_LOCK (physical_inodes);
+  shard = xdp_inode_table_lock_shard (physical_inodes, &devino);
 
-  inode = g_hash_table_lookup (physical_inodes, &devino);
+  inode = g_hash_table_lookup (shard->table, &devino);
   if (inode != NULL)
     {
       inode = xdp_physical_inode_ref (inode);
@@ -476,10 +584,11 @@ ensure_physical_inode (dev_t dev, ino_t ino, int o_path_fd)
       inode->ref_count = 1;
       inode->fd = o_path_fd;
       inode->backing_devino = devino;
-      g_hash_table_insert (physical_inodes, &inode->backing_devino, inode);
+      g_mutex_init (&inode->views_mutex);
+      g_hash_table_insert (shard->table, &inode->backing_devino, inode);
     }
 
-  G_UNLOCK (physical_inodes);
+  xdp_inode_shard_unlock (shard);
 
   return inode;
 }
@@ -494,6 +603,7 @@ xdp_physical_inode_ref (XdpPhysicalInode *inode)
 static void
 xdp_physical_inode_unref (XdpPhysicalInode *inode)
 {
+  XdpInodeShard *shard;
   gint old_ref;
 
   /* here we want to atomically do: if (ref_count>1) { ref_count--; return; } */
@@ -513,18 +623,20 @@ retry_atomic_decrement1:
         }
 
       /* Might be revived from physical_inodes hash by this time, so protect by lock */
-      G_LOCK (physical_inodes);
+      shard = xdp_inode_table_lock_shard (physical_inodes, &inode->backing_devino);
 
       if (!g_atomic_int_compare_and_exchange ((int *) &inode->ref_count, old_ref, old_ref - 1))
         {
-          G_UNLOCK (physical_inodes);
+          xdp_inode_shard_unlock (shard);
           goto retry_atomic_decrement1;
         }
-      g_hash_table_remove (physical_inodes, &inode->backing_devino);
+      g_hash_table_remove (shard->table, &inode->backing_devino);
 
-      G_UNLOCK (physical_inodes);
+      xdp_inode_shard_unlock (shard);
 
       close (inode->fd);
+      g_clear_pointer (&inode->views, g_ptr_array_unref);
+      g_mutex_clear (&inode->views_mutex);
       g_free (inode);
     }
 }
@@ -547,8 +659,8 @@ xdp_domain_unref (XdpDomain *domain)
       g_free (domain->doc_file);
       g_clear_pointer (&domain->doc_dir_handle, g_bytes_unref);
       if (domain->inodes)
-        g_assert (g_hash_table_size (domain->inodes) == 0);
-      g_clear_pointer (&domain->inodes, g_hash_table_unref);
+        g_assert (xdp_inode_table_size (domain->inodes) == 0);
+      g_clear_pointer (&domain->inodes, xdp_inode_table_free);
       g_clear_pointer (&domain->parent, xdp_domain_unref);
       g_clear_pointer (&domain->parent_inode, xdp_inode_unref);
       g_clear_pointer (&domain->tempfiles, g_hash_table_unref);
@@ -580,7 +692,7 @@ static XdpDomain *
 xdp_domain_new_root (void)
 {
   XdpDomain *domain = _xdp_domain_new (XDP_DOMAIN_ROOT);
-  domain->inodes = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->inodes = xdp_inode_table_new (N_INODE_TABLE_SHARDS, g_str_hash, g_str_equal);
   return domain;
 }
 
@@ -591,7 +703,7 @@ xdp_domain_new_by_app (XdpInode *root_inode)
   XdpDomain *domain = _xdp_domain_new (XDP_DOMAIN_BY_APP);
   domain->parent = xdp_domain_ref (root_domain);
   domain->parent_inode = xdp_inode_ref (root_inode);
-  domain->inodes = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->inodes = xdp_inode_table_new (N_INODE_TABLE_SHARDS, g_str_hash, g_str_equal);
   return domain;
 }
 
@@ -604,7 +716,7 @@ xdp_domain_new_app (XdpInode   *parent_inode,
   domain->parent = xdp_domain_ref (parent);
   domain->parent_inode = xdp_inode_ref (parent_inode);
   domain->app_id = g_strdup (app_id);
-  domain->inodes = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->inodes = xdp_inode_table_new (N_INODE_TABLE_SHARDS, g_str_hash, g_str_equal);
   return domain;
 }
 
@@ -625,13 +737,16 @@ xdp_domain_new_document (XdpDomain         *parent,
   domain->parent = xdp_domain_ref (parent);
   domain->doc_id = g_strdup (doc_id);
   domain->app_id = g_strdup (parent->app_id);
-  domain->inodes = g_hash_table_new (g_direct_hash, g_direct_equal);
 
   domain->doc_flags = document_entry_get_flags (doc_entry);
   domain->doc_dir_device = document_entry_get_device (doc_entry);
   domain->doc_dir_inode =  document_entry_get_inode (doc_entry);
   domain->doc_dir_handle = document_entry_dup_handle (doc_entry);
 
+  /* Only directory documents can have more than a few inodes */
+  domain->inodes = xdp_inode_table_new (xdp_document_domain_is_dir (domain) ? N_INODE_TABLE_SHARDS : 1,
+                                        g_direct_hash, g_direct_equal);
+
   db_path = document_entry_get_path (doc_entry);
   if (xdp_document_domain_is_dir (domain))
     {
@@ -682,20 +797,31 @@ xdp_document_domain_can_write (XdpDomain *domain)
 static char **
 xdp_domain_get_inode_keys_as_string (XdpDomain *domain)
 {
-  char **res;
-  guint length, i;
+  GPtrArray *res;
+  guint i;
 
   g_assert (domain->type == XDP_DOMAIN_BY_APP);
 
-  G_LOCK (domain_inodes);
+  res = g_ptr_array_new ();
+
+  for (i = 0; i < domain->inodes->n_shards; i++)
+    {
+      XdpInodeShard *shard = &domain->inodes->shards[i];
+      GHashTableIter iter;
+      gpointer key;
+
+      g_mutex_lock (&shard->lock);
+
+      g_hash_table_iter_init (&iter, shard->table);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (res, g_strdup (key));
 
-  res = (char **)g_hash_table_get_keys_as_array (domain->inodes, &length);
-  for (i = 0; i < length; i++)
-    res[i] = g_strdup (res[i]);
+      g_mutex_unlock (&shard->lock);
+    }
 
-  G_UNLOCK (domain_inodes);
+  g_ptr_array_add (res, NULL);
 
-  return res;
+  return (char **) g_ptr_array_free (res, FALSE);
 }
 
 static XdpTempfile *
@@ -796,18 +922,34 @@ xdp_inode_new (XdpDomain        *domain,
 
     }
 
-  G_LOCK (all_inodes);
   if (physical)
-    try_ino = persistent_ino;
+    {
+      try_ino = persistent_ino;
+    }
   else
-    try_ino = next_virtual_inode++;
+    {
+      G_LOCK (next_virtual_inode);
+      try_ino = next_virtual_inode++;
+      G_UNLOCK (next_virtual_inode);
+    }
 
-  if (g_hash_table_contains (all_inodes, &try_ino))
-    try_ino++;
+  /* On collisions, use the next free number. Neighbouring numbers live in
+   * different shards, so check and insert under the lock of each candidate. */
+  while (TRUE)
+    {
+      XdpInodeShard *shard = xdp_inode_table_lock_shard (all_inodes, &try_ino);
+
+      if (!g_hash_table_contains (shard->table, &try_ino))
+        {
+          inode->ino = try_ino;
+          g_hash_table_insert (shard->table, &inode->ino, inode);
+          xdp_inode_shard_unlock (shard);
+          break;
+        }
 
-  inode->ino = try_ino;
-  g_hash_table_insert (all_inodes, &inode->ino, inode);
-  G_UNLOCK (all_inodes);
+      xdp_inode_shard_unlock (shard);
+      try_ino++;
+    }
 
   return inode;
 }
@@ -822,11 +964,12 @@ xdp_inode_to_ino (XdpInode *inode)
 static XdpInode *
 xdp_inode_from_ino (ino_t ino)
 {
+  XdpInodeShard *shard;
   XdpInode *inode;
 
-  G_LOCK (all_inodes);
-  inode = g_hash_table_lookup (all_inodes, &ino);
-  G_UNLOCK (all_inodes);
+  shard = xdp_inode_table_lock_shard (all_inodes, &ino);
+  inode = g_hash_table_lookup (shard->table, &ino);
+  xdp_inode_shard_unlock (shard);
 
   g_assert (inode != NULL);
 
@@ -841,11 +984,43 @@ xdp_inode_ref (XdpInode *inode)
   return inode;
 }
 
+/* Returns the table of the domain @inode is looked up in, and its key
+ * there, or %NULL for inodes that are only reachable by number */
+static XdpInodeTable *
+xdp_inode_get_lookup_table (XdpInode      *inode,
+                            gconstpointer *key_out)
+{
+  XdpDomain *domain = inode->domain;
+
+  if (domain->type == XDP_DOMAIN_APP)
+    {
+      *key_out = domain->app_id;
+      return domain->parent->inodes;
+    }
+  else if (domain->type == XDP_DOMAIN_DOCUMENT)
+    {
+      if (inode->physical)
+        {
+          *key_out = inode->physical;
+          return domain->inodes;
+        }
+
+      *key_out = domain->doc_id;
+      return domain->parent->inodes;
+    }
+
+  *key_out = NULL;
+  return NULL;
+}
+
 static void
 xdp_inode_unref (XdpInode *inode)
 {
   gint old_ref;
-  XdpDomain *domain;
+  XdpInodeTable *lookup_table;
+  XdpInodeShard *shard = NULL;
+  XdpInodeShard *ino_shard;
+  gconstpointer key;
 
   /* here we want to atomically do: if (ref_count>1) { ref_count--; return; } */
 retry_atomic_decrement1:
@@ -864,44 +1039,46 @@ retry_atomic_decrement1:
         }
 
       /* Might be revived from domain->inodes hash by this time, so protect by lock */
-      G_LOCK (domain_inodes);
+      lookup_table = xdp_inode_get_lookup_table (inode, &key);
+      if (lookup_table)
+        shard = xdp_inode_table_lock_shard (lookup_table, key);
 
       if (!g_atomic_int_compare_and_exchange ((int *) &inode->ref_count, old_ref, old_ref - 1))
         {
-          G_UNLOCK (domain_inodes);
+          g_clear_pointer (&shard, xdp_inode_shard_unlock);
           goto retry_atomic_decrement1;
         }
 
-      domain = inode->domain;
-
-      if (domain->type == XDP_DOMAIN_APP)
-        g_hash_table_remove (domain->parent->inodes, domain->app_id);
-      else if (domain->type == XDP_DOMAIN_DOCUMENT)
-        {
-          if (inode->physical)
-            {
-              g_hash_table_remove (domain->inodes, inode->physical);
-            }
-          else
-            g_hash_table_remove (domain->parent->inodes, domain->doc_id);
-        }
+      if (shard)
+        g_hash_table_remove (shard->table, key);
 
-      /* Run this under domain_inodes lock to avoid race condition in ensure_docdir_inode + xdp_inode_new
-       * where we don't want a domain->inode lookup to fail, but then an all_inode lookup to succeed
-       * when looking for an ino collision
+      /* Run this under the domain->inodes shard lock to avoid race condition in ensure_docdir_inode +
+       * xdp_inode_new where we don't want a domain->inode lookup to fail, but then an all_inode lookup
+       * to succeed when looking for an ino collision. A persistent ino only depends on the lookup key,
+       * so the shard of that key is enough.
        *
        * Note: After the domain->inodes removal and here we don't allow resurrection, but we may
        * still race with an all_inodes lookup (e.g. in xdp_fuse_lookup_id_for_inode), which *is*
        * allowed and it can read the inode fields (while the lock is held) as they are still valid.
        **/
-      G_LOCK (all_inodes);
-      g_hash_table_remove (all_inodes, &inode->ino);
-      G_UNLOCK (all_inodes);
+      ino_shard = xdp_inode_table_lock_shard (all_inodes, &inode->ino);
+      g_hash_table_remove (ino_shard->table, &inode->ino);
+      xdp_inode_shard_unlock (ino_shard);
 
-      G_UNLOCK (domain_inodes);
+      g_clear_pointer (&shard, xdp_inode_shard_unlock);
 
       /* By now we have no refs outstanding and no way to get at the inode, so free it */
 
+      if (inode->physical)
+        {
+          XdpPhysicalInode *physical = inode->physical;
+
+          g_mutex_lock (&physical->views_mutex);
+          if (physical->views)
+            g_ptr_array_remove_fast (physical->views, inode);
+          g_mutex_unlock (&physical->views_mutex);
+        }
+
       g_clear_pointer (&inode->domain_root_inode, xdp_inode_unref);
       g_clear_pointer (&inode->physical, xdp_physical_inode_unref);
       xdp_domain_unref (inode->domain);
@@ -1448,6 +1625,7 @@ xdp_fuse_getattr (fuse_req_t             req,
                   fuse_ino_t             ino,
                   struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.getattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   XdpDomain *domain = inode->domain;
   double attr_valid_time = 0.0;/* Time in secs for attribute validation */
@@ -1491,6 +1669,7 @@ xdp_fuse_setattr (fuse_req_t             req,
                   int                    to_set,
                   struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.setattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   g_autofree char *to_set_string = setattr_flags_to_string (to_set);
   struct stat buf;
@@ -1665,6 +1844,7 @@ ensure_docdir_inode (XdpInode                 *parent,
   g_autoptr(XdpPhysicalInode) physical = NULL;
   g_autoptr(XdpInode) inode = NULL;
   g_autofd int o_path_fd = -1;
+  XdpInodeShard *shard;
   struct stat buf;
   int res;
 
@@ -1681,8 +1861,8 @@ ensure_docdir_inode (XdpInode                 *parent,
 
   physical = ensure_physical_inode (buf.st_dev, buf.st_ino, g_steal_fd (&o_path_fd)); /* passed ownership of fd */
 
-  G_LOCK (domain_inodes);
-  inode = g_hash_table_lookup (domain->inodes, physical);
+  shard = xdp_inode_table_lock_shard (domain->inodes, physical);
+  inode = g_hash_table_lookup (shard->table, physical);
   if (inode != NULL)
     inode = xdp_inode_ref (inode);
   else
@@ -1692,9 +1872,20 @@ ensure_docdir_inode (XdpInode                 *parent,
         inode->domain_root_inode = xdp_inode_ref (parent->domain_root_inode);
       else
         inode->domain_root_inode = xdp_inode_ref (parent);
-      g_hash_table_insert (domain->inodes, physical, inode);
+      g_hash_table_insert (shard->table, physical, inode);
+
+      /* Only the main file of a non-directory document has a known
+       * name and parent in each view */
+      if (!xdp_document_domain_is_dir (domain))
+        {
+          g_mutex_lock (&physical->views_mutex);
+          if (physical->views == NULL)
+            physical->views = g_ptr_array_new ();
+          g_ptr_array_add (physical->views, inode);
+          g_mutex_unlock (&physical->views_mutex);
+        }
     }
-  G_UNLOCK (domain_inodes);
+  xdp_inode_shard_unlock (shard);
 
   if (e)
     {
@@ -1730,21 +1921,22 @@ ensure_by_app_inode (XdpInode   *by_app_inode,
 {
   XdpDomain *by_app_domain = by_app_inode->domain;
   g_autoptr(XdpInode) inode = NULL;
+  XdpInodeShard *shard;
 
   if (!xdp_is_valid_app_id (app_id))
     return NULL;
 
-  G_LOCK (domain_inodes);
-  inode = g_hash_table_lookup (by_app_domain->inodes, app_id);
+  shard = xdp_inode_table_lock_shard (by_app_domain->inodes, app_id);
+  inode = g_hash_table_lookup (shard->table, app_id);
   if (inode != NULL)
     inode = xdp_inode_ref (inode);
   else
     {
       g_autoptr(XdpDomain) app_domain = xdp_domain_new_app (by_app_inode, app_id);
       inode = xdp_inode_new (app_domain, NULL);
-      g_hash_table_insert (by_app_domain->inodes, app_domain->app_id, inode);
+      g_hash_table_insert (shard->table, app_domain->app_id, inode);
     }
-  G_UNLOCK (domain_inodes);
+  xdp_inode_shard_unlock (shard);
 
   return g_steal_pointer (&inode);
 }
@@ -1756,6 +1948,7 @@ ensure_doc_inode (XdpInode   *parent,
   g_autoptr(PermissionDbEntry) doc_entry = NULL;
   g_autoptr(XdpInode) inode = NULL;
   XdpDomain *parent_domain = parent->domain;
+  XdpInodeShard *shard;
 
   doc_entry = xdp_lookup_doc (doc_id);
 
@@ -1764,8 +1957,8 @@ ensure_doc_inode (XdpInode   *parent,
        !app_can_see_doc (doc_entry, parent_domain->app_id)))
     return NULL;
 
-  G_LOCK (domain_inodes);
-  inode = g_hash_table_lookup (parent_domain->inodes, doc_id);
+  shard = xdp_inode_table_lock_shard (parent_domain->inodes, doc_id);
+  inode = g_hash_table_lookup (shard->table, doc_id);
   if (inode != NULL)
     inode = xdp_inode_ref (inode);
   else
@@ -1773,9 +1966,9 @@ ensure_doc_inode (XdpInode   *parent,
       g_autoptr(XdpDomain) doc_domain = xdp_domain_new_document (parent_domain, doc_id, doc_entry);
       doc_domain->parent_inode = xdp_inode_ref (parent);
       inode = xdp_inode_new (doc_domain, NULL);
-      g_hash_table_insert (parent_domain->inodes, doc_domain->doc_id, inode);
+      g_hash_table_insert (shard->table, doc_domain->doc_id, inode);
     }
-  G_UNLOCK (domain_inodes);
+  xdp_inode_shard_unlock (shard);
 
   return g_steal_pointer (&inode);
 }
@@ -1784,9 +1977,11 @@ static void
 invalidate_dentry_cb (gpointer user_data)
 {
   GList *to_invalidate = NULL;
+  g_autoptr(GArray) inodes_to_invalidate = NULL;
   {
     XDP_AUTOLOCK (invalidate_list);
     to_invalidate = g_steal_pointer (&invalidate_list);
+    inodes_to_invalidate = g_steal_pointer (&invalidate_inodes);
   }
   to_invalidate = g_list_reverse (to_invalidate);
 
@@ -1800,9 +1995,24 @@ invalidate_dentry_cb (gpointer user_data)
       g_free (data);
     }
 
+  /* With the writeback cache this also writes back any dirty pages of
+   * the inode first, which is why it can't be done from the operation
+   * handlers themselves. */
+  for (guint i = 0; session && inodes_to_invalidate && i < inodes_to_invalidate->len; i++)
+    fuse_lowlevel_notify_inval_inode (session,
+                                      g_array_index (inodes_to_invalidate, guint64, i),
+                                      0, 0);
+
   g_list_free (to_invalidate);
 }
 
+static void
+schedule_invalidate_locked (void)
+{
+  if (invalidate_list == NULL && invalidate_inodes == NULL)
+    g_timeout_add_once (10, invalidate_dentry_cb, NULL);
+}
+
 /* Queue an inval_dentry, thereby freeing unused inodes in the dcache
  * which will free up a bunch of O_PATH fds in the fuse implementation.
  */
@@ -1824,17 +2034,64 @@ queue_invalidate_dentry (XdpInode   *parent,
   data->parent_ino = parent->ino;
   memcpy (data->name, name, name_buf_size);
 
-  if (invalidate_list == NULL)
-    g_timeout_add_once (10, invalidate_dentry_cb, NULL);
+  schedule_invalidate_locked ();
 
   invalidate_list = g_list_append (invalidate_list, data);
 }
 
+/* Queue an inval_inode for the attributes and cached data of inode */
+static void
+queue_invalidate_inode (XdpInode *inode)
+{
+  XDP_AUTOLOCK (invalidate_list);
+
+  for (guint i = 0; invalidate_inodes && i < invalidate_inodes->len; i++)
+    {
+      if (g_array_index (invalidate_inodes, guint64, i) == inode->ino)
+        return;
+    }
+
+  schedule_invalidate_locked ();
+
+  if (invalidate_inodes == NULL)
+    invalidate_inodes = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_array_append_val (invalidate_inodes, inode->ino);
+}
+
+/* With the writeback cache the kernel owns the size and mtime of
+ * regular files it has in its inode cache, so changes written through
+ * one view of a document are not picked up by the other views (the
+ * root and the per-app directories). Drop their dentries, so that the
+ * next lookup gets a fresh kernel inode with the new attributes. */
+static void
+queue_invalidate_other_views (XdpInode *inode)
+{
+  XdpPhysicalInode *physical = inode->physical;
+
+  /* The views unregister themselves under the mutex before they are
+   * freed, so they stay valid while it is held */
+  g_mutex_lock (&physical->views_mutex);
+
+  for (guint i = 0; physical->views && i < physical->views->len; i++)
+    {
+      XdpInode *other = g_ptr_array_index (physical->views, i);
+
+      if (other == inode)
+        continue;
+
+      queue_invalidate_dentry (other->domain_root_inode,
+                               other->domain->doc_file);
+    }
+
+  g_mutex_unlock (&physical->views_mutex);
+}
+
 static void
 xdp_fuse_lookup (fuse_req_t  req,
                  fuse_ino_t  parent_ino,
                  const char *name)
 {
+  XDP_METRICS_SCOPE ("fuse.lookup");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   XdpDomain *parent_domain = parent->domain;
   g_autoptr(XdpInode) inode = NULL;
@@ -1924,12 +2181,30 @@ xdp_file_free (XdpFile *file)
   g_free (file);
 }
 
+/* With the writeback cache the kernel may need to read in pages of
+ * files that were opened write-only, and it handles O_APPEND itself by
+ * sending the writes with the right offsets. */
+static int
+get_writeback_open_flags (XdpFuseOptions *fuse_opts,
+                          int             open_flags)
+{
+  if (!fuse_opts->writeback_cache)
+    return open_flags;
+
+  if ((open_flags & O_ACCMODE) == O_WRONLY)
+    open_flags = (open_flags & ~O_ACCMODE) | O_RDWR;
+
+  return open_flags & ~O_APPEND;
+}
+
 static void
 xdp_fuse_open (fuse_req_t             req,
                fuse_ino_t             ino,
                struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.open");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
+  XdpFuseOptions *fuse_opts = fuse_req_userdata (req);
   int open_flags = fi->flags;
   g_autofree char *open_flags_string = open_flags_to_string (open_flags);
   int fd;
@@ -1972,7 +2247,16 @@ xdp_fuse_open (fuse_req_t             req,
       g_set_str (&path, resolved_path);
     }
 
-  fd = open (path, open_flags, 0);
+  fd = open (path, get_writeback_open_flags (fuse_opts, open_flags), 0);
+  /* The writeback cache needs to read in partial pages before writing
+   * them out. If the file is write-only for us, bypass the page cache
+   * for this open instead. */
+  if (fd == -1 && errno == EACCES && (open_flags & O_ACCMODE) == O_WRONLY &&
+      fuse_opts->writeback_cache)
+    {
+      fd = open (path, open_flags & ~O_APPEND, 0);
+      fi->direct_io = 1;
+    }
   if (fd == -1)
     return xdp_reply_err (op, req, errno);
 
@@ -1993,7 +2277,9 @@ xdp_fuse_create (fuse_req_t             req,
                  mode_t                 mode,
                  struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.create");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
+  XdpFuseOptions *fuse_opts = fuse_req_userdata (req);
   int open_flags = fi->flags;
   g_autofree char *open_flags_string = open_flags_to_string (open_flags);
   struct fuse_entry_param e;
@@ -2012,7 +2298,9 @@ xdp_fuse_create (fuse_req_t             req,
                                   CHECK_IS_PHYSICAL_IF_DIR))
     return;
 
-  fd = xdp_document_inode_open_child_fd (parent, filename, open_flags, mode);
+  fd = xdp_document_inode_open_child_fd (parent, filename,
+                                         get_writeback_open_flags (fuse_opts, open_flags),
+                                         mode);
   if (fd < 0)
     return xdp_reply_err (op, req, -fd);
 
@@ -2045,6 +2333,7 @@ xdp_fuse_read (fuse_req_t             req,
                off_t                  off,
                struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.read");
   struct fuse_bufvec buf = FUSE_BUFVEC_INIT(size);
   XdpFile *file = (XdpFile *)fi->fh;
   enum fuse_buf_copy_flags reply_flags = FUSE_BUF_SPLICE_MOVE;
@@ -2071,6 +2360,7 @@ xdp_fuse_write (fuse_req_t             req,
                 off_t                  off,
                 struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.write");
   XdpFile *file = (XdpFile *)fi->fh;
   ssize_t res;
   const char *op = "WRITE";
@@ -2080,7 +2370,10 @@ xdp_fuse_write (fuse_req_t             req,
   res = pwrite (file->fd, buf, size, off);
 
   if (res >= 0)
-    fuse_reply_write (req, res);
+    {
+      g_atomic_int_set (&file->written, TRUE);
+      fuse_reply_write (req, res);
+    }
   else
     xdp_reply_err (op, req, errno);
 }
@@ -2092,6 +2385,7 @@ xdp_fuse_write_buf (fuse_req_t             req,
                     off_t                  off,
                     struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.write_buf");
   XdpFile *file = (XdpFile *)fi->fh;
   struct fuse_bufvec dst = FUSE_BUFVEC_INIT(fuse_buf_size(bufv));
   ssize_t res;
@@ -2110,7 +2404,10 @@ xdp_fuse_write_buf (fuse_req_t             req,
 
   res = fuse_buf_copy (&dst, bufv, copy_flags);
   if (res >= 0)
-    fuse_reply_write (req, res);
+    {
+      g_atomic_int_set (&file->written, TRUE);
+      fuse_reply_write (req, res);
+    }
   else
     xdp_reply_err (op, req, errno);
 }
@@ -2121,6 +2418,7 @@ xdp_fuse_fsync (fuse_req_t             req,
                 int                    datasync,
                 struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.fsync");
   XdpFile *file = (XdpFile *)fi->fh;
   int res;
   const char *op = "FSYNC";
@@ -2145,6 +2443,7 @@ xdp_fuse_fallocate (fuse_req_t             req,
                     off_t                  length,
                     struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.fallocate");
   XdpFile *file = (XdpFile *)fi->fh;
   int res;
   const char *op = "FALLOCATE";
@@ -2168,6 +2467,7 @@ xdp_fuse_flush (fuse_req_t             req,
                 fuse_ino_t             ino,
                 struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.flush");
   const char *op = "FLUSH";
 
   g_debug ("FLUSH %" G_GINT64_MODIFIER "x", ino);
@@ -2179,11 +2479,22 @@ xdp_fuse_release (fuse_req_t             req,
                   fuse_ino_t             ino,
                   struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.release");
   XdpFile *file = (XdpFile *)fi->fh;
+  XdpFuseOptions *fuse_opts = fuse_req_userdata (req);
   const char *op = "RELEASE";
 
   g_debug ("RELEASE %" G_GINT64_MODIFIER "x", ino);
 
+  /* The kernel has written back all dirty pages before the release */
+  if (fuse_opts->writeback_cache && g_atomic_int_get (&file->written))
+    {
+      g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
+
+      if (inode->physical)
+        queue_invalidate_other_views (inode);
+    }
+
   xdp_file_free (file);
 
   xdp_reply_ok (op, req);
@@ -2204,6 +2515,7 @@ xdp_fuse_forget (fuse_req_t req,
                  fuse_ino_t ino,
                  uint64_t   nlookup)
 {
+  XDP_METRICS_SCOPE ("fuse.forget");
   forget_one (ino, nlookup);
   fuse_reply_none (req);
 }
@@ -2213,6 +2525,7 @@ xdp_fuse_forget_multi (fuse_req_t               req,
                        size_t                   count,
                        struct fuse_forget_data *forgets)
 {
+  XDP_METRICS_SCOPE ("fuse.forget_multi");
   size_t i;
 
   g_debug ("FORGET_MULTI %" G_GSIZE_FORMAT, count);
@@ -2325,6 +2638,7 @@ xdp_fuse_opendir (fuse_req_t             req,
                   fuse_ino_t             ino,
                   struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.opendir");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   XdpDomain *domain = inode->domain;
   /* gobject-linter-ignore-next-line: use_auto_cleanup */
@@ -2428,6 +2742,7 @@ xdp_fuse_readdir (fuse_req_t             req,
                   off_t                  off,
                   struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.readdir");
   XdpDir *d = (XdpDir *)fi->fh;
   const char *op = "READDIR";
 
@@ -2518,6 +2833,7 @@ xdp_fuse_releasedir (fuse_req_t             req,
                      fuse_ino_t             ino,
                      struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.releasedir");
   XdpDir *d = (XdpDir *)fi->fh;
   const char *op = "RELEASEDIR";
 
@@ -2534,6 +2850,7 @@ xdp_fuse_fsyncdir (fuse_req_t             req,
                    int                    datasync,
                    struct fuse_file_info *fi)
 {
+  XDP_METRICS_SCOPE ("fuse.fsyncdir");
   XdpDir *dir = (XdpDir *)fi->fh;
   int fd, res;
   const char *op = "FSYNCDIR";
@@ -2563,6 +2880,7 @@ xdp_fuse_mkdir (fuse_req_t  req,
                 const char *name,
                 mode_t      mode)
 {
+  XDP_METRICS_SCOPE ("fuse.mkdir");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   struct fuse_entry_param e;
   int res;
@@ -2599,6 +2917,7 @@ xdp_fuse_unlink (fuse_req_t  req,
                  fuse_ino_t  parent_ino,
                  const char *filename)
 {
+  XDP_METRICS_SCOPE ("fuse.unlink");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   XdpDomain *parent_domain = parent->domain;
   int res = -1;
@@ -2680,8 +2999,10 @@ xdp_fuse_rename (fuse_req_t    req,
                  const char   *newname,
                  unsigned int  flags)
 {
+  XDP_METRICS_SCOPE ("fuse.rename");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   g_autoptr(XdpInode) newparent = xdp_inode_from_ino (newparent_ino);
+  XdpFuseOptions *fuse_opts = fuse_req_userdata (req);
   g_autofree char *rename_flags_string = renameat2_flags_to_string (flags);
   XdpDomain *domain;
   int res, errsv;
@@ -2785,6 +3106,12 @@ xdp_fuse_rename (fuse_req_t    req,
                 g_hash_table_replace (domain->tempfiles, tempfile->name, tempfile);
               else
                 {
+                  /* Pages of the tempfile that are still dirty in the
+                   * writeback cache would otherwise only reach the
+                   * document when the kernel gets around to it */
+                  if (fuse_opts->writeback_cache && tempfile->inode)
+                    queue_invalidate_inode (tempfile->inode);
+
                   /* Steal the old tempname so we don't unlink it */
                   g_free (g_steal_pointer (&tempfile->tempname));
                   xdp_tempfile_unref (tempfile);
@@ -2838,6 +3165,7 @@ xdp_fuse_access (fuse_req_t req,
                  fuse_ino_t ino,
                  int        mask)
 {
+  XDP_METRICS_SCOPE ("fuse.access");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   g_autofree char *path = NULL;
   int res;
@@ -2886,6 +3214,7 @@ xdp_fuse_rmdir (fuse_req_t  req,
                 fuse_ino_t  parent_ino,
                 const char *filename)
 {
+  XDP_METRICS_SCOPE ("fuse.rmdir");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   g_autofd int close_fd = -1;
   int dirfd;
@@ -2915,6 +3244,7 @@ static void
 xdp_fuse_readlink (fuse_req_t req,
                    fuse_ino_t ino)
 {
+  XDP_METRICS_SCOPE ("fuse.readlink");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   char linkname[PATH_MAX + 1];
   const char *op = "READLINK";
@@ -2944,6 +3274,7 @@ xdp_fuse_symlink (fuse_req_t  req,
                   fuse_ino_t  parent_ino,
                   const char *name)
 {
+  XDP_METRICS_SCOPE ("fuse.symlink");
   g_autoptr(XdpInode) parent = xdp_inode_from_ino (parent_ino);
   g_autofd int close_fd = -1;
   struct fuse_entry_param e;
@@ -2981,6 +3312,7 @@ xdp_fuse_link (fuse_req_t  req,
                fuse_ino_t  newparent_ino,
                const char *newname)
 {
+  XDP_METRICS_SCOPE ("fuse.link");
   g_autoptr(XdpInode) newparent = xdp_inode_from_ino (newparent_ino);
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   g_autofree char *proc_path = NULL;
@@ -3025,6 +3357,7 @@ static void
 xdp_fuse_statfs (fuse_req_t req,
                  fuse_ino_t ino)
 {
+  XDP_METRICS_SCOPE ("fuse.statfs");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   struct statvfs buf;
   int res;
@@ -3158,6 +3491,7 @@ xdp_fuse_setxattr (fuse_req_t  req,
                    size_t      size,
                    int         flags)
 {
+  XDP_METRICS_SCOPE ("fuse.setxattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   ssize_t res;
   g_autofree char *path = NULL;
@@ -3199,6 +3533,7 @@ xdp_fuse_getxattr (fuse_req_t  req,
                    const char *name,
                    size_t      size)
 {
+  XDP_METRICS_SCOPE ("fuse.getxattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   ssize_t res;
   g_autofree char *buf = NULL;
@@ -3267,6 +3602,7 @@ xdp_fuse_listxattr (fuse_req_t req,
                     fuse_ino_t ino,
                     size_t     size)
 {
+  XDP_METRICS_SCOPE ("fuse.listxattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   g_autofree char *path = NULL;
   g_autofree char *buf = NULL;
@@ -3315,6 +3651,7 @@ xdp_fuse_removexattr (fuse_req_t  req,
                       fuse_ino_t  ino,
                       const char *name)
 {
+  XDP_METRICS_SCOPE ("fuse.removexattr");
   g_autoptr(XdpInode) inode = xdp_inode_from_ino (ino);
   g_autofree char *path = NULL;
   ssize_t res;
@@ -3356,6 +3693,7 @@ xdp_fuse_getlk (fuse_req_t             req,
                 struct fuse_file_info *fi,
                 struct flock          *lock)
 {
+  XDP_METRICS_SCOPE ("fuse.getlk");
   const char *op = "GETLK";
   XdpFile *file = (XdpFile *)fi->fh;
   int res;
@@ -3376,6 +3714,7 @@ xdp_fuse_setlk (fuse_req_t             req,
                 struct flock          *lock,
                 int                    sleep)
 {
+  XDP_METRICS_SCOPE ("fuse.setlk");
   const char *op = "SETLK";
   XdpFile *file = (XdpFile *)fi->fh;
   int res;
@@ -3395,6 +3734,7 @@ xdp_fuse_flock (fuse_req_t             req,
                 struct fuse_file_info *fi,
                 int                    lock_op)
 {
+  XDP_METRICS_SCOPE ("fuse.flock");
   const char *op = "FLOCK";
 
   g_debug ("FLOCK %" G_GINT64_MODIFIER "x", ino);
@@ -3402,6 +3742,42 @@ xdp_fuse_flock (fuse_req_t             req,
   xdp_reply_err (op, req, ENOSYS);
 }
 
+static const char *
+xdp_fuse_mode_to_string (XdpFuseMode mode)
+{
+  switch (mode)
+    {
+    case XDP_FUSE_MODE_DEFAULT:
+      return "default";
+    case XDP_FUSE_MODE_CLONE_FD:
+      return "clone-fd";
+    case XDP_FUSE_MODE_IO_URING:
+      return "io-uring";
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* XDG_DOCUMENT_PORTAL_FUSE_MODE=clone-fd gives every FUSE worker thread
+ * its own /dev/fuse fd instead of sharing one. io-uring additionally
+ * asks for FUSE over io_uring, which needs support in the kernel and in
+ * libfuse. Each mode falls back to the previous one when unavailable. */
+static XdpFuseMode
+xdp_fuse_get_requested_mode (void)
+{
+  const char *value = g_getenv ("XDG_DOCUMENT_PORTAL_FUSE_MODE");
+
+  if (value == NULL || *value == '\0' || g_str_equal (value, "default"))
+    return XDP_FUSE_MODE_DEFAULT;
+  else if (g_str_equal (value, "clone-fd"))
+    return XDP_FUSE_MODE_CLONE_FD;
+  else if (g_str_equal (value, "io-uring"))
+    return XDP_FUSE_MODE_IO_URING;
+
+  g_warning ("Unknown FUSE mode '%s', using the default", value);
+  return XDP_FUSE_MODE_DEFAULT;
+}
+
 static void
 xdp_fuse_init_cb (void                  *userdata,
                   struct fuse_conn_info *conn)
@@ -3410,6 +3786,28 @@ xdp_fuse_init_cb (void                  *userdata,
 
   g_debug ("INIT");
 
+#if HAVE_FUSE_IO_URING
+  if (fuse_opts->mode == XDP_FUSE_MODE_IO_URING &&
+      !fuse_get_feature_flag (conn, FUSE_CAP_OVER_IO_URING))
+    {
+      g_debug ("The kernel does not offer FUSE over io_uring");
+      fuse_opts->mode = XDP_FUSE_MODE_CLONE_FD;
+    }
+#endif
+
+  g_debug ("FUSE mode: %s", xdp_fuse_mode_to_string (fuse_opts->mode));
+
+  if (fuse_opts->writeback_cache)
+    {
+      if (conn->capable & FUSE_CAP_WRITEBACK_CACHE)
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+      else
+        fuse_opts->writeback_cache = FALSE;
+
+      g_debug ("Writeback cache: %s",
+               fuse_opts->writeback_cache ? "enabled" : "not supported by the kernel");
+    }
+
   /* atomic_o_trunc: We handle O_TRUNC in create() */
   conn->want |= FUSE_CAP_ATOMIC_O_TRUNC;
 
@@ -3545,9 +3943,36 @@ xdp_fuse_thread (gpointer data)
 #if HAVE_SPLICE
   fuse_opts->use_splice = TRUE;
 #endif
+  fuse_opts->mode = xdp_fuse_get_requested_mode ();
+  fuse_opts->writeback_cache =
+    g_strcmp0 (g_getenv ("XDG_DOCUMENT_PORTAL_FUSE_WRITEBACK_CACHE"), "1") == 0;
+
+  se = NULL;
+
+  if (fuse_opts->mode == XDP_FUSE_MODE_IO_URING)
+    {
+#if HAVE_FUSE_IO_URING
+      g_auto(XdpAutoFuseArgs) io_uring_args = FUSE_ARGS_INIT (0, NULL);
+      int i;
+
+      for (i = 0; i < args.argc; i++)
+        fuse_opt_add_arg (&io_uring_args, args.argv[i]);
+      fuse_opt_add_arg (&io_uring_args, "-oio_uring");
+
+      se = fuse_session_new (&io_uring_args, &xdp_fuse_oper,
+                             sizeof (xdp_fuse_oper), fuse_opts);
+      if (se == NULL)
+        g_debug ("Can't create a FUSE session using io_uring");
+#else
+      g_debug ("libfuse is too old for FUSE over io_uring");
+#endif
+      if (se == NULL)
+        fuse_opts->mode = XDP_FUSE_MODE_CLONE_FD;
+    }
 
-  se = fuse_session_new (&args, &xdp_fuse_oper,
-                         sizeof (xdp_fuse_oper), fuse_opts);
+  if (se == NULL)
+    se = fuse_session_new (&args, &xdp_fuse_oper,
+                           sizeof (xdp_fuse_oper), fuse_opts);
   if (se == NULL)
     {
       g_set_error (&thread_data->error, XDG_DESKTOP_PORTAL_ERROR,
@@ -3571,10 +3996,22 @@ xdp_fuse_thread (gpointer data)
   thread_data = NULL;
   g_clear_pointer (&locker, g_mutex_locker_free);
 
-  loop_config.clone_fd = opts.clone_fd;
+  /* libfuse itself falls back to the shared fd if cloning fails */
+  loop_config.clone_fd = opts.clone_fd || fuse_opts->mode != XDP_FUSE_MODE_DEFAULT;
   loop_config.max_idle_threads = opts.max_idle_threads;
+  if (loop_config.clone_fd)
+    {
+      /* Keep a worker, and with it a cloned fd, around per CPU */
+      loop_config.max_idle_threads = MAX (loop_config.max_idle_threads,
+                                          g_get_num_processors ());
+    }
   thread_data = NULL;
 
+  g_debug ("Starting FUSE loop, requested mode: %s, clone_fd: %d, max idle threads: %u",
+           xdp_fuse_mode_to_string (fuse_opts->mode),
+           loop_config.clone_fd,
+           loop_config.max_idle_threads);
+
   session_locker = g_mutex_locker_new (&G_LOCK_NAME (session));
   g_clear_pointer (&session_locker, g_mutex_locker_free);
   xdp_fuse_mainloop (session, &loop_config);
@@ -3602,7 +4039,7 @@ xdp_fuse_init (GError **error)
   my_uid = getuid ();
   my_gid = getgid ();
 
-  all_inodes = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, NULL);
+  all_inodes = xdp_inode_table_new (N_INODE_TABLE_SHARDS, g_int64_hash, g_int64_equal);
   g_assert (open_files == NULL);
 
   root_domain = xdp_domain_new_root ();
@@ -3611,7 +4048,7 @@ xdp_fuse_init (GError **error)
   by_app_inode = xdp_inode_new (by_app_domain, NULL);
 
   physical_inodes =
-    g_hash_table_new_full (devino_hash, devino_equal, NULL, NULL);
+    xdp_inode_table_new (N_INODE_TABLE_SHARDS, devino_hash, devino_equal);
 
     /* Bump nr of filedescriptor limit to max */
   if (getrlimit (RLIMIT_NOFILE , &rl) == 0 &&
@@ -3707,22 +4144,31 @@ typedef struct {
   char *filename;
 } Invalidate;
 
-/* Called with domain_inodes lock held, don't block */
+/* Takes the shard lock of doc_id, don't block */
 static void
 invalidate_doc_inode (XdpInode   *parent_inode,
                       const char *doc_id,
                       GArray     *invalidates)
 {
-  XdpInode *doc_inode = g_hash_table_lookup (parent_inode->domain->inodes, doc_id);
+  XdpInodeShard *shard;
+  XdpInode *doc_inode;
   Invalidate inval;
 
+  shard = xdp_inode_table_lock_shard (parent_inode->domain->inodes, doc_id);
+  doc_inode = g_hash_table_lookup (shard->table, doc_id);
+
   if (doc_inode == NULL)
-    return;
+    {
+      xdp_inode_shard_unlock (shard);
+      return;
+    }
 
   inval.ino = xdp_inode_to_ino (doc_inode);
   inval.filename = NULL;
   g_array_append_val (invalidates, inval);
 
+  xdp_inode_shard_unlock (shard);
+
   inval.ino = xdp_inode_to_ino (parent_inode);
   inval.filename = g_strdup (doc_id);
   g_array_append_val (invalidates, inval);
@@ -3750,25 +4196,38 @@ xdp_fuse_invalidate_doc_app (const char *doc_id,
 
   invalidates = g_array_new (FALSE, FALSE, sizeof (Invalidate));
 
-  G_LOCK (domain_inodes);
+  /* The app inodes can't go away while we hold the shard lock of the
+   * by-app domain they are in */
   if (opt_app_id != NULL)
     {
-      XdpInode *app_inode = g_hash_table_lookup (by_app_inode->domain->inodes, opt_app_id);
+      XdpInodeShard *shard;
+      XdpInode *app_inode;
+
+      shard = xdp_inode_table_lock_shard (by_app_inode->domain->inodes, opt_app_id);
+      app_inode = g_hash_table_lookup (shard->table, opt_app_id);
       if (app_inode)
         invalidate_doc_inode (app_inode, doc_id, invalidates);
+      xdp_inode_shard_unlock (shard);
     }
   else
     {
-      GHashTableIter iter;
-      gpointer key, value;
+      XdpInodeTable *by_app_inodes = by_app_inode->domain->inodes;
 
       invalidate_doc_inode (root_inode, doc_id, invalidates);
-      g_hash_table_iter_init (&iter, by_app_inode->domain->inodes);
-      while (g_hash_table_iter_next (&iter, &key, &value))
-        invalidate_doc_inode ((XdpInode *)value, doc_id, invalidates);
-    }
 
-  G_UNLOCK (domain_inodes);
+      for (i = 0; i < by_app_inodes->n_shards; i++)
+        {
+          XdpInodeShard *shard = &by_app_inodes->shards[i];
+          GHashTableIter iter;
+          gpointer key, value;
+
+          g_mutex_lock (&shard->lock);
+          g_hash_table_iter_init (&iter, shard->table);
+          while (g_hash_table_iter_next (&iter, &key, &value))
+            invalidate_doc_inode ((XdpInode *)value, doc_id, invalidates);
+          g_mutex_unlock (&shard->lock);
+        }
+    }
 
   for (i = 0; i < invalidates->len; i++)
     {
@@ -3798,9 +4257,9 @@ xdp_fuse_lookup_id_for_inode (ino_t      ino,
   if (real_path_out)
     *real_path_out = NULL;
 
-  G_LOCK (all_inodes);
   {
-    XdpInode *inode = g_hash_table_lookup (all_inodes, &ino);
+    XdpInodeShard *shard = xdp_inode_table_lock_shard (all_inodes, &ino);
+    XdpInode *inode = g_hash_table_lookup (shard->table, &ino);
     if (inode)
       {
         /* We're not allowed to resurrect the inode here, but we can get the data while in the lock */
@@ -3808,8 +4267,8 @@ xdp_fuse_lookup_id_for_inode (ino_t      ino,
         if (inode->physical)
           physical = xdp_physical_inode_ref (inode->physical);
       }
+    xdp_inode_shard_unlock (shard);
   }
-  G_UNLOCK (all_inodes);
 
   if (domain == NULL)
     return NULL;
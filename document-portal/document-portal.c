@@ -29,6 +29,7 @@
 #include "permission-store-dbus.h"
 #include "xdp-app-info-registry.h"
 #include "xdp-app-info.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
 
 #define TABLE_NAME "documents"
@@ -538,6 +539,229 @@ validate_fd (int fd,
   return FALSE;
 }
 
+/* Batches smaller than this are validated in the calling thread */
+#define VALIDATE_FDS_MIN_PARALLEL 4
+#define VALIDATE_FDS_MAX_THREADS 8
+/* Below the default D-Bus method call timeout of 25 s, so callers get our
+ * error rather than a timeout */
+#define VALIDATE_FDS_TIMEOUT_USEC (20 * G_TIME_SPAN_SECOND)
+
+typedef struct _ValidateFdBatch
+{
+  GMutex mutex;
+  GCond cond;
+  int n_pending;
+  int cancelled;
+
+  XdpAppInfo *app_info;
+  gboolean want_handles;
+  int n_fds;
+  int *fds;
+  ValidateFdType *ensure_types;
+  ValidateFdResult *results;
+} ValidateFdBatch;
+
+typedef struct _ValidateFdJob
+{
+  ValidateFdBatch *batch;
+  int index;
+} ValidateFdJob;
+
+void
+validate_fd_result_clear (ValidateFdResult *result)
+{
+  g_clear_pointer (&result->real_dir_handle, g_bytes_unref);
+  g_clear_pointer (&result->path, g_free);
+}
+
+static void
+validate_fd_batch_clear (ValidateFdBatch *batch)
+{
+  int i;
+
+  for (i = 0; i < batch->n_fds; i++)
+    {
+      validate_fd_result_clear (&batch->results[i]);
+      g_clear_fd (&batch->fds[i], NULL);
+    }
+
+  g_clear_pointer (&batch->results, g_free);
+  g_clear_pointer (&batch->ensure_types, g_free);
+  g_clear_pointer (&batch->fds, g_free);
+  g_clear_object (&batch->app_info);
+  g_mutex_clear (&batch->mutex);
+  g_cond_clear (&batch->cond);
+}
+
+static void
+validate_fd_batch_unref (ValidateFdBatch *batch)
+{
+  g_atomic_rc_box_release_full (batch, (GDestroyNotify) validate_fd_batch_clear);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ValidateFdBatch, validate_fd_batch_unref)
+
+static void
+validate_fd_job_func (gpointer data,
+                      gpointer user_data)
+{
+  g_autofree ValidateFdJob *job = data;
+  g_autoptr(ValidateFdBatch) batch = job->batch;
+  ValidateFdResult *result = &batch->results[job->index];
+
+  if (!g_atomic_int_get (&batch->cancelled))
+    {
+      result->valid = validate_fd (batch->fds[job->index],
+                                   batch->app_info,
+                                   batch->ensure_types[job->index],
+                                   &result->st_buf,
+                                   &result->real_dir_st_buf,
+                                   batch->want_handles ? &result->real_dir_handle : NULL,
+                                   &result->path,
+                                   &result->writable,
+                                   NULL);
+    }
+
+  g_mutex_lock (&batch->mutex);
+  if (--batch->n_pending == 0)
+    g_cond_signal (&batch->cond);
+  g_mutex_unlock (&batch->mutex);
+}
+
+static GThreadPool *
+get_validate_fd_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter_pointer (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (validate_fd_job_func, NULL,
+                                    VALIDATE_FDS_MAX_THREADS, FALSE,
+                                    NULL);
+      g_once_init_leave_pointer (&pool, new_pool);
+    }
+
+  return pool;
+}
+
+/*
+ * validate_fds:
+ *
+ * Runs validate_fd() on all of @fds, concurrently for larger batches, and
+ * stores the outcome for @fds[i] in @results[i]. An invalid fd only makes
+ * the corresponding result invalid, so callers can report errors in
+ * argument order.
+ *
+ * The fds are duplicated for the workers, and the batch is abandoned if it
+ * doesn't finish within VALIDATE_FDS_TIMEOUT_USEC, for instance when a
+ * network file system stops responding. In that case, or if the fds can't
+ * be duplicated, %FALSE is returned and @error is set.
+ */
+gboolean
+validate_fds (const int            *fds,
+              const ValidateFdType *ensure_types,
+              int                   n_fds,
+              XdpAppInfo           *app_info,
+              gboolean              want_handles,
+              ValidateFdResult     *results,
+              GError              **error)
+{
+  g_autoptr(ValidateFdBatch) batch = NULL;
+  GThreadPool *pool;
+  gint64 deadline;
+  gboolean timed_out = FALSE;
+  int i;
+
+  if (n_fds < VALIDATE_FDS_MIN_PARALLEL)
+    {
+      for (i = 0; i < n_fds; i++)
+        {
+          ValidateFdResult *result = &results[i];
+
+          result->valid = validate_fd (fds[i], app_info, ensure_types[i],
+                                       &result->st_buf,
+                                       &result->real_dir_st_buf,
+                                       want_handles ? &result->real_dir_handle : NULL,
+                                       &result->path,
+                                       &result->writable,
+                                       NULL);
+        }
+
+      return TRUE;
+    }
+
+  batch = g_atomic_rc_box_new0 (ValidateFdBatch);
+  g_mutex_init (&batch->mutex);
+  g_cond_init (&batch->cond);
+  batch->app_info = g_object_ref (app_info);
+  batch->want_handles = want_handles;
+  batch->n_fds = n_fds;
+  batch->fds = g_new (int, n_fds);
+  batch->ensure_types = g_memdup2 (ensure_types, sizeof (ValidateFdType) * n_fds);
+  batch->results = g_new0 (ValidateFdResult, n_fds);
+
+  for (i = 0; i < n_fds; i++)
+    batch->fds[i] = -1;
+
+  /* The workers may outlive this call, and with it the caller's fds */
+  for (i = 0; i < n_fds; i++)
+    {
+      if (fds[i] == -1)
+        continue;
+
+      batch->fds[i] = fcntl (fds[i], F_DUPFD_CLOEXEC, 3);
+      if (batch->fds[i] == -1)
+        {
+          int saved_errno = errno;
+
+          g_set_error (error,
+                       G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                       "Failed to duplicate fd: %s", g_strerror (saved_errno));
+          return FALSE;
+        }
+    }
+
+  pool = get_validate_fd_pool ();
+  batch->n_pending = n_fds;
+
+  for (i = 0; i < n_fds; i++)
+    {
+      ValidateFdJob *job = g_new0 (ValidateFdJob, 1);
+
+      job->batch = g_atomic_rc_box_acquire (batch);
+      job->index = i;
+      g_thread_pool_push (pool, job, NULL);
+    }
+
+  deadline = g_get_monotonic_time () + VALIDATE_FDS_TIMEOUT_USEC;
+
+  g_mutex_lock (&batch->mutex);
+  while (batch->n_pending > 0 && !timed_out)
+    timed_out = !g_cond_wait_until (&batch->cond, &batch->mutex, deadline);
+  timed_out = batch->n_pending > 0;
+  g_mutex_unlock (&batch->mutex);
+
+  if (timed_out)
+    {
+      g_atomic_int_set (&batch->cancelled, TRUE);
+      g_set_error (error,
+                   XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_FAILED,
+                   "Timed out validating file descriptors");
+      return FALSE;
+    }
+
+  for (i = 0; i < n_fds; i++)
+    {
+      results[i] = batch->results[i];
+      batch->results[i].real_dir_handle = NULL;
+      batch->results[i].path = NULL;
+    }
+
+  return TRUE;
+}
+
 static char *
 verify_existing_document (struct stat *st_buf,
                           gboolean     reuse_existing,
@@ -882,6 +1106,8 @@ document_add_full (int                      *fd,
   g_autoptr(GPtrArray) ids = g_ptr_array_new_with_free_func (g_free);
   g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
   g_autoptr(GPtrArray) handles = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  g_autoptr(GArray) results = NULL;
+  g_autofree ValidateFdType *ensure_types = NULL;
   g_autofree struct stat *real_dir_st_bufs = NULL;
   struct stat st_buf;
   g_autofree gboolean *writable = NULL;
@@ -893,8 +1119,26 @@ document_add_full (int                      *fd,
   real_dir_st_bufs = g_new0 (struct stat, n_args);
   writable = g_new0 (gboolean, n_args);
 
+  ensure_types = g_new (ValidateFdType, n_args);
+  for (i = 0; i < n_args; i++)
+    {
+      if (documents_flags[i] & DOCUMENT_ADD_FLAGS_DIRECTORY)
+        ensure_types[i] = VALIDATE_FD_FILE_TYPE_DIR;
+      else
+        ensure_types[i] = VALIDATE_FD_FILE_TYPE_REGULAR;
+    }
+
+  results = g_array_sized_new (FALSE, TRUE, sizeof (ValidateFdResult), n_args);
+  g_array_set_clear_func (results, (GDestroyNotify) validate_fd_result_clear);
+  g_array_set_size (results, n_args);
+
+  if (!validate_fds (fd, ensure_types, n_args, app_info, TRUE,
+                     (ValidateFdResult *) results->data, error))
+    return NULL;
+
   for (i = 0; i < n_args; i++)
     {
+      ValidateFdResult *result = &g_array_index (results, ValidateFdResult, i);
       DocumentAddFullFlags flags;
       g_autofree char *path = NULL;
       gboolean reuse_existing, allow_write, is_dir;
@@ -904,12 +1148,19 @@ document_add_full (int                      *fd,
       is_dir = (flags & DOCUMENT_ADD_FLAGS_DIRECTORY) != 0;
       allow_write = (target_perms & DOCUMENT_PERMISSION_FLAGS_WRITE) != 0;
 
-      if (!validate_fd (fd[i], app_info,
-                        is_dir ? VALIDATE_FD_FILE_TYPE_DIR : VALIDATE_FD_FILE_TYPE_REGULAR,
-                        &st_buf, &real_dir_st_bufs[i],
-                        (GBytes **)&g_ptr_array_index (handles, i),
-                        &path, &writable[i], error))
-        return NULL;
+      if (!result->valid)
+        {
+          g_set_error (error,
+                       XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                       "Invalid fd passed");
+          return NULL;
+        }
+
+      st_buf = result->st_buf;
+      real_dir_st_bufs[i] = result->real_dir_st_buf;
+      writable[i] = result->writable;
+      g_ptr_array_index (handles, i) = g_steal_pointer (&result->real_dir_handle);
+      path = g_steal_pointer (&result->path);
 
       if (parent_dev != NULL && parent_ino != NULL)
         {
@@ -1668,6 +1919,8 @@ on_bus_acquired (GDBusConnection *connection,
 
   xdp_connection_track_peer_disconnect (connection, on_peer_disconnect, NULL);
 
+  xdp_metrics_export (connection);
+
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (dbus_api),
                                          connection,
                                          "/org/freedesktop/portal/documents",
@@ -1879,6 +2132,8 @@ main (int    argc,
 
   g_set_prgname (argv[0]);
 
+  xdp_metrics_init ();
+
   loop = g_main_loop_new (NULL, FALSE);
 
   path = g_build_filename (g_get_user_data_dir (), "flatpak/db", TABLE_NAME, NULL);
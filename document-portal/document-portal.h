@@ -27,6 +27,26 @@ gboolean validate_fd (int           fd,
                       gboolean     *writable_out,
                       GError      **error);
 
+typedef struct _ValidateFdResult
+{
+  gboolean valid;
+  struct stat st_buf;
+  struct stat real_dir_st_buf;
+  GBytes *real_dir_handle;
+  char *path;
+  gboolean writable;
+} ValidateFdResult;
+
+void validate_fd_result_clear (ValidateFdResult *result);
+
+gboolean validate_fds (const int            *fds,
+                       const ValidateFdType *ensure_types,
+                       int                   n_fds,
+                       XdpAppInfo           *app_info,
+                       gboolean              want_handles,
+                       ValidateFdResult     *results,
+                       GError              **error);
+
 char ** document_add_full (int                      *fd,
                            dev_t                    *parent_dev,
                            ino_t                    *parent_ino,
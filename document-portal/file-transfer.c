@@ -352,9 +352,14 @@ add_files (GDBusMethodInvocation *invocation,
   GDBusMessage *message;
   GUnixFDList *fd_list;
   g_autoptr(GVariantIter) iter = NULL;
+  g_autoptr(GArray) batch_fds = NULL;
+  g_autoptr(GArray) results = NULL;
+  g_autofree ValidateFdType *ensure_types = NULL;
+  g_autoptr(GError) error = NULL;
   int fd_id;
   const int *fds;
   int n_fds;
+  guint i;
 
   g_variant_get (parameters, "(&sah@a{sv})", &key, &iter, &options);
 
@@ -397,13 +402,10 @@ add_files (GDBusMethodInvocation *invocation,
            xdp_app_info_get_id (transfer->app_info),
            transfer->sender);
 
+  batch_fds = g_array_new (FALSE, FALSE, sizeof (int));
   while (g_variant_iter_next (iter, "h", &fd_id))
     {
       int fd = -1;
-      g_autofree char *path = NULL;
-      gboolean fd_is_writable;
-      struct stat st_buf;
-      struct stat parent_st_buf;
 
       if (fd_id < n_fds)
         fd = fds[fd_id];
@@ -417,8 +419,30 @@ add_files (GDBusMethodInvocation *invocation,
           return;
         }
 
-      if (!validate_fd (fd, app_info, VALIDATE_FD_FILE_TYPE_ANY, &st_buf, &parent_st_buf, NULL, &path, &fd_is_writable, NULL) ||
-          (transfer->writable && !fd_is_writable))
+      g_array_append_val (batch_fds, fd);
+    }
+
+  ensure_types = g_new (ValidateFdType, batch_fds->len);
+  for (i = 0; i < batch_fds->len; i++)
+    ensure_types[i] = VALIDATE_FD_FILE_TYPE_ANY;
+
+  results = g_array_sized_new (FALSE, TRUE, sizeof (ValidateFdResult), batch_fds->len);
+  g_array_set_clear_func (results, (GDestroyNotify) validate_fd_result_clear);
+  g_array_set_size (results, batch_fds->len);
+
+  if (!validate_fds ((const int *) batch_fds->data, ensure_types, batch_fds->len,
+                     app_info, FALSE,
+                     (ValidateFdResult *) results->data, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return;
+    }
+
+  for (i = 0; i < results->len; i++)
+    {
+      ValidateFdResult *result = &g_array_index (results, ValidateFdResult, i);
+
+      if (!result->valid || (transfer->writable && !result->writable))
         {
           g_dbus_method_invocation_return_error (invocation,
                                                  XDG_DESKTOP_PORTAL_ERROR,
@@ -426,8 +450,14 @@ add_files (GDBusMethodInvocation *invocation,
                                                  "Can't export file");
           return;
         }
+    }
+
+  for (i = 0; i < results->len; i++)
+    {
+      ValidateFdResult *result = &g_array_index (results, ValidateFdResult, i);
 
-      file_transfer_add_file (transfer, path, &st_buf, &parent_st_buf);
+      file_transfer_add_file (transfer, result->path,
+                              &result->st_buf, &result->real_dir_st_buf);
     }
 
   g_dbus_method_invocation_return_value (invocation, NULL);
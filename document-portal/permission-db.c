@@ -592,6 +592,55 @@ permission_db_is_dirty (PermissionDb *self)
   return self->dirty;
 }
 
+static gsize
+app_changes_get_size (GHashTable *app_changes)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize size = 0;
+
+  g_hash_table_iter_init (&iter, app_changes);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GPtrArray *ids = value;
+      size_t i;
+
+      size += strlen (key) + 1 + sizeof (GPtrArray);
+      for (i = 0; i < ids->len; i++)
+        size += sizeof (gpointer) + strlen (g_ptr_array_index (ids, i)) + 1;
+    }
+
+  return size;
+}
+
+/* An estimate of the memory used by the db: the serialized contents plus
+ * the changes kept on top of them */
+gsize
+permission_db_get_size (PermissionDb *self)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize size = 0;
+
+  g_return_val_if_fail (PERMISSION_IS_DB (self), 0);
+
+  if (self->gvdb_contents)
+    size += g_bytes_get_size (self->gvdb_contents);
+
+  g_hash_table_iter_init (&iter, self->main_updates);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      size += strlen (key) + 1;
+      if (value != NULL)
+        size += g_variant_get_size ((GVariant *) value);
+    }
+
+  size += app_changes_get_size (self->app_additions);
+  size += app_changes_get_size (self->app_removals);
+
+  return size;
+}
+
 /* add, replace, or NULL entry to remove */
 void
 permission_db_set_entry (PermissionDb      *self,
@@ -42,6 +42,7 @@ GString *      permission_db_print_string (PermissionDb *self,
 char *         permission_db_print (PermissionDb *self);
 
 gboolean       permission_db_is_dirty (PermissionDb *self);
+gsize          permission_db_get_size (PermissionDb *self);
 void           permission_db_set_entry (PermissionDb      *self,
                                         const char     *id,
                                         PermissionDbEntry *entry);
@@ -13,12 +13,14 @@
 
 #include "permission-store-dbus.h"
 #include "xdg-permission-store.h"
+#include "xdp-metrics.h"
 
 static void
 on_bus_acquired (GDBusConnection *connection,
                  const gchar     *name,
                  gpointer         user_data)
 {
+  xdp_metrics_export (connection);
   xdg_permission_store_start (connection);
 }
 
@@ -121,6 +123,8 @@ main (int    argc,
 
   g_set_prgname (argv[0]);
 
+  xdp_metrics_init ();
+
   owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
                              "org.freedesktop.impl.portal.PermissionStore",
                              G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT | (opt_replace ? G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
@@ -12,10 +12,46 @@
 
 #include "permission-db.h"
 #include "permission-store-dbus.h"
+#include "xdp-metrics.h"
 #include "xdp-utils.h"
 
+#define PERMISSION_STORE_DBUS_PATH "/org/freedesktop/impl/portal/PermissionStore"
+#define PERMISSION_STORE_DBUS_IFACE "org.freedesktop.impl.portal.PermissionStore"
+
+#define MAX_SUBSCRIPTION_DELAY_MS 1000
+#define MAX_SUBSCRIPTIONS_PER_SENDER 64
+
+/* Tables without pending writes are unloaded after being idle this long,
+ * or earlier when the resident tables exceed the memory budget */
+#define DEFAULT_TABLE_UNLOAD_CHECK_INTERVAL_S 30
+#define DEFAULT_TABLE_IDLE_TIMEOUT_S (5 * 60)
+#define DEFAULT_TABLE_MIN_RESIDENT_S 10
+#define DEFAULT_TABLE_MEMORY_BUDGET_KB 4096
+
 GHashTable *tables = NULL;
 
+typedef struct
+{
+  guint      id;
+  char      *sender;
+  char      *table;
+  GStrv      ids; /* NULL for all */
+  GStrv      apps; /* NULL for all */
+  guint      delay_ms;
+  GQueue     pending; /* GVariant (ssbva{sas}) */
+  GHashTable *pending_ids; /* id -> GList link in pending */
+  guint      flush_source_id;
+} Subscription;
+
+static GDBusConnection *store_connection = NULL;
+static gsize table_memory_budget = DEFAULT_TABLE_MEMORY_BUDGET_KB * 1024;
+static guint table_unload_check_interval_s = DEFAULT_TABLE_UNLOAD_CHECK_INTERVAL_S;
+static gint64 table_idle_timeout_usec = DEFAULT_TABLE_IDLE_TIMEOUT_S * G_USEC_PER_SEC;
+static gint64 table_min_resident_usec = DEFAULT_TABLE_MIN_RESIDENT_S * G_USEC_PER_SEC;
+static guint unload_tables_source_id = 0;
+static GHashTable *subscriptions = NULL; /* id -> Subscription */
+static guint next_subscription_id = 1;
+
 typedef struct
 {
   char      *name;
@@ -23,10 +59,202 @@ typedef struct
   GList     *outstanding_writes;
   GList     *current_writes;
   gboolean   writing;
+  gboolean   unsaved;
+  gint64     writeout_start;
+  gint64     last_access;
 } Table;
 
 static void start_writeout (Table *table);
 
+static void
+subscription_free (Subscription *subscription)
+{
+  g_clear_handle_id (&subscription->flush_source_id, g_source_remove);
+  g_queue_clear_full (&subscription->pending, (GDestroyNotify) g_variant_unref);
+  g_clear_pointer (&subscription->pending_ids, g_hash_table_unref);
+  g_free (subscription->sender);
+  g_free (subscription->table);
+  g_strfreev (subscription->ids);
+  g_strfreev (subscription->apps);
+  g_free (subscription);
+}
+
+static gboolean
+flush_subscription (gpointer user_data)
+{
+  Subscription *subscription = user_data;
+  g_autoptr(GError) error = NULL;
+  GVariantBuilder builder;
+  GVariant *change;
+
+  subscription->flush_source_id = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssbva{sas})"));
+  while ((change = g_queue_pop_head (&subscription->pending)))
+    {
+      g_variant_builder_add_value (&builder, change);
+      g_variant_unref (change);
+    }
+  g_hash_table_remove_all (subscription->pending_ids);
+
+  if (!g_dbus_connection_emit_signal (store_connection,
+                                      subscription->sender,
+                                      PERMISSION_STORE_DBUS_PATH,
+                                      PERMISSION_STORE_DBUS_IFACE,
+                                      "ChangedBatch",
+                                      g_variant_new ("(ua(ssbva{sas}))",
+                                                     subscription->id,
+                                                     &builder),
+                                      &error))
+    g_debug ("Failed to send changes to %s: %s", subscription->sender, error->message);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+entry_has_any_app (PermissionDbEntry  *entry,
+                   const char * const *apps)
+{
+  g_autofree const char **entry_apps = NULL;
+  size_t i;
+
+  if (entry == NULL)
+    return FALSE;
+
+  entry_apps = permission_db_entry_list_apps (entry);
+  for (i = 0; entry_apps[i] != NULL; i++)
+    {
+      if (g_strv_contains (apps, entry_apps[i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static GVariant *
+get_filtered_app_permissions (PermissionDbEntry  *entry,
+                              const char * const *apps)
+{
+  GVariantBuilder builder;
+  size_t i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sas}"));
+
+  for (i = 0; entry != NULL && apps[i] != NULL; i++)
+    {
+      g_autofree const char **permissions = permission_db_entry_list_permissions (entry, apps[i]);
+
+      if (permissions[0] == NULL)
+        continue;
+
+      g_variant_builder_add_value (&builder,
+                                   g_variant_new ("{s@as}",
+                                                  apps[i],
+                                                  g_variant_new_strv (permissions, -1)));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Queues a change for all subscriptions it matches. @old_entry and
+ * @new_entry are used for filtering by app; @new_entry is NULL for
+ * deleted entries. */
+static void
+queue_subscribed_change (const char        *table_name,
+                         const char        *id,
+                         gboolean           deleted,
+                         GVariant          *data,
+                         GVariant          *permissions,
+                         PermissionDbEntry *old_entry,
+                         PermissionDbEntry *new_entry)
+{
+  GHashTableIter iter;
+  Subscription *subscription;
+
+  if (subscriptions == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, subscriptions);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &subscription))
+    {
+      GVariant *change;
+      GList *link;
+
+      if (g_strcmp0 (subscription->table, table_name) != 0)
+        continue;
+
+      if (subscription->ids &&
+          !g_strv_contains ((const char * const *) subscription->ids, id))
+        continue;
+
+      if (subscription->apps)
+        {
+          const char * const *apps = (const char * const *) subscription->apps;
+
+          if (!entry_has_any_app (old_entry, apps) &&
+              !entry_has_any_app (new_entry, apps))
+            continue;
+
+          change = g_variant_new ("(ssb@v@a{sas})",
+                                  table_name, id, deleted,
+                                  g_variant_new_variant (data),
+                                  get_filtered_app_permissions (new_entry, apps));
+        }
+      else
+        {
+          change = g_variant_new ("(ssb@v@a{sas})",
+                                  table_name, id, deleted,
+                                  g_variant_new_variant (data),
+                                  permissions);
+        }
+
+      g_variant_ref_sink (change);
+
+      /* Only report the last state of each resource */
+      link = g_hash_table_lookup (subscription->pending_ids, id);
+      if (link)
+        {
+          g_variant_unref (link->data);
+          g_queue_delete_link (&subscription->pending, link);
+        }
+
+      g_queue_push_tail (&subscription->pending, change);
+      g_hash_table_insert (subscription->pending_ids,
+                           g_strdup (id),
+                           g_queue_peek_tail_link (&subscription->pending));
+
+      if (subscription->flush_source_id == 0)
+        {
+          if (subscription->delay_ms > 0)
+            subscription->flush_source_id =
+              g_timeout_add (subscription->delay_ms, flush_subscription, subscription);
+          else
+            /* Not lower than the priority of the write completing, so
+             * subscribers hear about the change before the writer's reply */
+            subscription->flush_source_id =
+              g_idle_add_full (G_PRIORITY_DEFAULT, flush_subscription, subscription, NULL);
+        }
+    }
+}
+
+static void
+on_peer_disconnect (const char *name,
+                    gpointer    user_data)
+{
+  GHashTableIter iter;
+  Subscription *subscription;
+
+  g_hash_table_iter_init (&iter, subscriptions);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &subscription))
+    {
+      if (g_strcmp0 (subscription->sender, name) == 0)
+        {
+          g_debug ("Removing subscription %u of %s", subscription->id, name);
+          g_hash_table_iter_remove (&iter);
+        }
+    }
+}
+
 static void
 table_free (Table *table)
 {
@@ -35,6 +263,90 @@ table_free (Table *table)
   g_free (table);
 }
 
+static gboolean
+table_can_unload (Table *table)
+{
+  return !table->writing &&
+         !table->unsaved &&
+         table->outstanding_writes == NULL &&
+         table->current_writes == NULL &&
+         !permission_db_is_dirty (table->db);
+}
+
+static int
+compare_table_last_access (gconstpointer a,
+                           gconstpointer b)
+{
+  const Table *table_a = *(const Table **) a;
+  const Table *table_b = *(const Table **) b;
+
+  if (table_a->last_access < table_b->last_access)
+    return -1;
+  if (table_a->last_access > table_b->last_access)
+    return 1;
+  return 0;
+}
+
+/* Unloads tables that haven't been used for a while, least recently used
+ * first. They get loaded from disk again on the next access, so only
+ * tables whose changes have all been written out are considered. */
+static gboolean
+unload_idle_tables (gpointer user_data)
+{
+  g_autoptr(GPtrArray) resident = NULL;
+  gint64 now = g_get_monotonic_time ();
+  gsize total_size = 0;
+  size_t i;
+
+  resident = g_hash_table_get_values_as_ptr_array (tables);
+  g_ptr_array_sort (resident, compare_table_last_access);
+
+  for (i = 0; i < resident->len; i++)
+    total_size += permission_db_get_size (((Table *) g_ptr_array_index (resident, i))->db);
+
+  for (i = 0; i < resident->len; i++)
+    {
+      Table *table = g_ptr_array_index (resident, i);
+      gint64 idle_time = now - table->last_access;
+      gsize size;
+
+      if (!table_can_unload (table))
+        continue;
+
+      if (idle_time < table_idle_timeout_usec &&
+          (total_size <= table_memory_budget || idle_time < table_min_resident_usec))
+        continue;
+
+      size = permission_db_get_size (table->db);
+      total_size -= size;
+
+      g_debug ("Unloading table %s (%" G_GSIZE_FORMAT " bytes, idle for %" G_GINT64_FORMAT " s)",
+               table->name, size, idle_time / G_USEC_PER_SEC);
+
+      g_ptr_array_index (resident, i) = NULL;
+      g_hash_table_remove (tables, table->name);
+    }
+
+  g_debug ("%u tables resident, %" G_GSIZE_FORMAT " bytes (budget %" G_GSIZE_FORMAT " bytes)",
+           g_hash_table_size (tables), total_size, table_memory_budget);
+
+  for (i = 0; i < resident->len; i++)
+    {
+      Table *table = g_ptr_array_index (resident, i);
+
+      if (table != NULL)
+        g_debug ("  %s: %" G_GSIZE_FORMAT " bytes", table->name, permission_db_get_size (table->db));
+    }
+
+  if (g_hash_table_size (tables) == 0)
+    {
+      unload_tables_source_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
 static Table *
 lookup_table (const char            *name,
               GDBusMethodInvocation *invocation)
@@ -48,7 +360,10 @@ lookup_table (const char            *name,
 
   table = g_hash_table_lookup (tables, name);
   if (table != NULL)
-    return table;
+    {
+      table->last_access = g_get_monotonic_time ();
+      return table;
+    }
 
   dir = g_build_filename (g_get_user_data_dir (), "flatpak/db", NULL);
   g_mkdir_with_parents (dir, 0755);
@@ -66,9 +381,17 @@ lookup_table (const char            *name,
   table = g_new0 (Table, 1);
   table->name = g_strdup (name);
   table->db = db;
+  table->last_access = g_get_monotonic_time ();
 
   g_hash_table_insert (tables, table->name, table);
 
+  g_debug ("Loaded table %s (%" G_GSIZE_FORMAT " bytes)",
+           name, permission_db_get_size (db));
+
+  if (unload_tables_source_id == 0)
+    unload_tables_source_id = g_timeout_add_seconds (table_unload_check_interval_s,
+                                                     unload_idle_tables, NULL);
+
   return table;
 }
 
@@ -85,6 +408,8 @@ writeout_done (GObject      *source_object,
 
   ok = permission_db_save_content_finish (table->db, res, &error);
 
+  xdp_metrics_record_since ("permission-db.writeout", table->writeout_start);
+
   for (l = table->current_writes; l != NULL; l = l->next)
     {
       GDBusMethodInvocation *invocation = l->data;
@@ -100,6 +425,8 @@ writeout_done (GObject      *source_object,
 
   g_clear_list (&table->current_writes, NULL);
   table->writing = FALSE;
+  /* Keep the table loaded, the changes only exist in memory */
+  table->unsaved = !ok;
 
   if (table->outstanding_writes != NULL)
     start_writeout (table);
@@ -111,6 +438,7 @@ start_writeout (Table *table)
   g_assert (table->current_writes == NULL);
   table->current_writes = g_steal_pointer (&table->outstanding_writes);
   table->writing = TRUE;
+  table->writeout_start = xdp_metrics_start ();
 
   permission_db_update (table->db);
 
@@ -204,6 +532,50 @@ handle_lookup (XdgPermissionStore     *object,
   return TRUE;
 }
 
+static gboolean
+handle_lookup_many (XdgPermissionStore     *object,
+                    GDBusMethodInvocation  *invocation,
+                    GVariant               *entries)
+{
+  g_auto(GVariantBuilder) results =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a(ssa{sas}v)"));
+  GVariantIter iter;
+  const char *table_name;
+  const char *id;
+
+  /* Nothing can change the tables while this runs, so all results come
+   * from the same state of the store */
+  g_variant_iter_init (&iter, entries);
+  while (g_variant_iter_next (&iter, "(&s&s)", &table_name, &id))
+    {
+      g_autoptr(GVariant) data = NULL;
+      g_autoptr(GVariant) permissions = NULL;
+      g_autoptr(PermissionDbEntry) entry = NULL;
+      Table *table;
+
+      table = lookup_table (table_name, invocation);
+      if (table == NULL)
+        return TRUE;
+
+      entry = permission_db_lookup (table->db, id);
+      if (entry == NULL)
+        continue;
+
+      data = permission_db_entry_get_data (entry);
+      permissions = get_app_permissions (entry);
+
+      g_variant_builder_add (&results, "(ss@a{sas}@v)",
+                             table_name, id,
+                             permissions,
+                             g_variant_new_variant (data));
+    }
+
+  xdg_permission_store_complete_lookup_many (object, invocation,
+                                             g_variant_builder_end (&results));
+
+  return TRUE;
+}
+
 static void
 emit_deleted (XdgPermissionStore     *object,
               const gchar            *table_name,
@@ -221,6 +593,7 @@ emit_deleted (XdgPermissionStore     *object,
                                      TRUE,
                                      g_variant_new_variant (data),
                                      permissions);
+  queue_subscribed_change (table_name, id, TRUE, data, permissions, entry, NULL);
 }
 
 
@@ -228,6 +601,7 @@ static void
 emit_changed (XdgPermissionStore     *object,
               const gchar            *table_name,
               const gchar            *id,
+              PermissionDbEntry         *old_entry,
               PermissionDbEntry         *entry)
 {
   g_autoptr(GVariant) data = NULL;
@@ -241,6 +615,7 @@ emit_changed (XdgPermissionStore     *object,
                                      FALSE,
                                      g_variant_new_variant (data),
                                      permissions);
+  queue_subscribed_change (table_name, id, FALSE, data, permissions, old_entry, entry);
 }
 
 static gboolean
@@ -301,7 +676,7 @@ handle_delete_permission (XdgPermissionStore     *object,
 
   new_entry = permission_db_entry_remove_app_permissions (entry, app);
   permission_db_set_entry (table->db, id, new_entry);
-  emit_changed (object, table_name, id, new_entry);
+  emit_changed (object, table_name, id, entry, new_entry);
 
   ensure_writeout (table, invocation);
 
@@ -391,7 +766,7 @@ handle_set (XdgPermissionStore     *object,
     }
 
   permission_db_set_entry (table->db, id, new_entry);
-  emit_changed (object, table_name, id, new_entry);
+  emit_changed (object, table_name, id, old_entry, new_entry);
 
   ensure_writeout (table, invocation);
 
@@ -434,7 +809,7 @@ handle_set_permission (XdgPermissionStore     *object,
 
   new_entry = permission_db_entry_set_app_permissions (entry, app, (const char **) permissions);
   permission_db_set_entry (table->db, id, new_entry);
-  emit_changed (object, table_name, id, new_entry);
+  emit_changed (object, table_name, id, entry, new_entry);
 
   ensure_writeout (table, invocation);
 
@@ -482,13 +857,127 @@ handle_set_value (XdgPermissionStore     *object,
     }
 
   permission_db_set_entry (table->db, id, new_entry);
-  emit_changed (object, table_name, id, new_entry);
+  emit_changed (object, table_name, id, entry, new_entry);
 
   ensure_writeout (table, invocation);
 
   return TRUE;
 }
 
+static GStrv
+strv_or_null (const char * const *strv)
+{
+  if (strv == NULL || strv[0] == NULL)
+    return NULL;
+
+  return g_strdupv ((char **) strv);
+}
+
+static guint
+count_subscriptions (const char *sender)
+{
+  GHashTableIter iter;
+  Subscription *subscription;
+  guint n = 0;
+
+  g_hash_table_iter_init (&iter, subscriptions);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &subscription))
+    {
+      if (g_strcmp0 (subscription->sender, sender) == 0)
+        n++;
+    }
+
+  return n;
+}
+
+static gboolean
+handle_subscribe (XdgPermissionStore     *object,
+                  GDBusMethodInvocation  *invocation,
+                  const char             *table_name,
+                  const char * const     *ids,
+                  const char * const     *apps,
+                  GVariant               *options)
+{
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+  Subscription *subscription;
+  guint delay_ms = 0;
+
+  if (table_name[0] == '\0')
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                             "No table given");
+      return TRUE;
+    }
+
+  g_variant_lookup (options, "delay", "u", &delay_ms);
+  if (delay_ms > MAX_SUBSCRIPTION_DELAY_MS)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_INVALID_ARGUMENT,
+                                             "Delay %u is larger than %u",
+                                             delay_ms, MAX_SUBSCRIPTION_DELAY_MS);
+      return TRUE;
+    }
+
+  /* Every subscription keeps a queue of changes, don't let a single
+   * peer pile them up */
+  if (count_subscriptions (sender) >= MAX_SUBSCRIPTIONS_PER_SENDER)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_NOT_ALLOWED,
+                                             "Too many subscriptions, at most %u are allowed",
+                                             MAX_SUBSCRIPTIONS_PER_SENDER);
+      return TRUE;
+    }
+
+  subscription = g_new0 (Subscription, 1);
+  subscription->id = next_subscription_id++;
+  subscription->sender = g_strdup (sender);
+  subscription->table = g_strdup (table_name);
+  subscription->ids = strv_or_null (ids);
+  subscription->apps = strv_or_null (apps);
+  subscription->delay_ms = delay_ms;
+  g_queue_init (&subscription->pending);
+  subscription->pending_ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, NULL);
+
+  g_hash_table_insert (subscriptions,
+                       GUINT_TO_POINTER (subscription->id),
+                       subscription);
+
+  g_debug ("%s subscribed to table %s (subscription %u)",
+           subscription->sender, table_name, subscription->id);
+
+  xdg_permission_store_complete_subscribe (object, invocation, subscription->id);
+
+  return TRUE;
+}
+
+static gboolean
+handle_unsubscribe (XdgPermissionStore     *object,
+                    GDBusMethodInvocation  *invocation,
+                    guint                   subscription_id)
+{
+  Subscription *subscription;
+
+  subscription = g_hash_table_lookup (subscriptions, GUINT_TO_POINTER (subscription_id));
+  if (subscription == NULL ||
+      g_strcmp0 (subscription->sender, g_dbus_method_invocation_get_sender (invocation)) != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR, XDG_DESKTOP_PORTAL_ERROR_NOT_FOUND,
+                                             "No subscription %u", subscription_id);
+      return TRUE;
+    }
+
+  g_hash_table_remove (subscriptions, GUINT_TO_POINTER (subscription_id));
+
+  xdg_permission_store_complete_unsubscribe (object, invocation);
+
+  return TRUE;
+}
+
 void
 xdg_permission_store_start (GDBusConnection *connection)
 {
@@ -497,25 +986,47 @@ xdg_permission_store_start (GDBusConnection *connection)
 
   g_debug ("Starting permission store");
 
+  table_memory_budget =
+    (gsize) xdp_get_env_uint ("XDG_PERMISSION_STORE_MEMORY_BUDGET_KB",
+                              DEFAULT_TABLE_MEMORY_BUDGET_KB) * 1024;
+  table_unload_check_interval_s =
+    MAX (xdp_get_env_uint ("XDG_PERMISSION_STORE_UNLOAD_CHECK_INTERVAL_S",
+                           DEFAULT_TABLE_UNLOAD_CHECK_INTERVAL_S), 1);
+  table_idle_timeout_usec =
+    (gint64) xdp_get_env_uint ("XDG_PERMISSION_STORE_IDLE_TIMEOUT_S",
+                               DEFAULT_TABLE_IDLE_TIMEOUT_S) * G_USEC_PER_SEC;
+  table_min_resident_usec =
+    (gint64) xdp_get_env_uint ("XDG_PERMISSION_STORE_MIN_RESIDENT_S",
+                               DEFAULT_TABLE_MIN_RESIDENT_S) * G_USEC_PER_SEC;
+
+  /* The key is owned by the Table */
   tables = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                  g_free, (GDestroyNotify) table_free);
+                                  NULL, (GDestroyNotify) table_free);
+  subscriptions = g_hash_table_new_full (NULL, NULL,
+                                         NULL, (GDestroyNotify) subscription_free);
+  store_connection = connection;
+
+  xdp_connection_track_peer_disconnect (connection, on_peer_disconnect, NULL);
 
   store = xdg_permission_store_skeleton_new ();
 
-  xdg_permission_store_set_version (XDG_PERMISSION_STORE (store), 2);
+  xdg_permission_store_set_version (XDG_PERMISSION_STORE (store), 4);
 
   g_signal_connect (store, "handle-list", G_CALLBACK (handle_list), NULL);
   g_signal_connect (store, "handle-lookup", G_CALLBACK (handle_lookup), NULL);
+  g_signal_connect (store, "handle-lookup-many", G_CALLBACK (handle_lookup_many), NULL);
   g_signal_connect (store, "handle-set", G_CALLBACK (handle_set), NULL);
   g_signal_connect (store, "handle-set-permission", G_CALLBACK (handle_set_permission), NULL);
   g_signal_connect (store, "handle-set-value", G_CALLBACK (handle_set_value), NULL);
   g_signal_connect (store, "handle-delete", G_CALLBACK (handle_delete), NULL);
   g_signal_connect (store, "handle-delete-permission", G_CALLBACK (handle_delete_permission), NULL);
   g_signal_connect (store, "handle-get-permission", G_CALLBACK (handle_get_permission), NULL);
+  g_signal_connect (store, "handle-subscribe", G_CALLBACK (handle_subscribe), NULL);
+  g_signal_connect (store, "handle-unsubscribe", G_CALLBACK (handle_unsubscribe), NULL);
 
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (store),
                                          connection,
-                                         "/org/freedesktop/impl/portal/PermissionStore",
+                                         PERMISSION_STORE_DBUS_PATH,
                                          &error))
     g_warning ("error: %s", error->message);
 }
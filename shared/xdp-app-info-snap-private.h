@@ -23,5 +23,9 @@ XdpAppInfo * xdp_app_info_snap_new (const char  *sender,
                                     GError     **error);
 
 XDP_EXPORT_TEST
-int _xdp_app_info_snap_parse_cgroup_file (FILE     *f,
-                                          gboolean *is_snap);
+int _xdp_app_info_snap_parse_cgroup_file (FILE      *f,
+                                          gboolean  *is_snap,
+                                          char     **security_tag);
+
+XDP_EXPORT_TEST
+char * _xdp_app_info_snap_parse_security_tag (const char *cgroup);
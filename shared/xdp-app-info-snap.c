@@ -8,6 +8,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #if HAVE_SYS_VFS_H
 #include <sys/vfs.h>
@@ -20,6 +21,30 @@
 #define SNAP_METADATA_KEY_DESKTOP_FILE "DesktopFile"
 #define SNAP_METADATA_KEY_NETWORK "HasNetworkStatus"
 
+/* snapd saves its state, including the interface connections, here
+ * whenever anything about the installed snaps changes */
+#define SNAP_STATE_FILE "/var/lib/snapd/state.json"
+#define SNAP_DESKTOP_DIR "/var/lib/snapd/desktop/applications"
+
+#define UUID_STRING_LEN 36
+
+static const char *snap_mount_dirs[] = {
+  "/snap",
+  "/var/lib/snapd/snap",
+};
+
+typedef struct
+{
+  char *fingerprint;
+  char *instance_name;
+  char *desktop_id;
+  gboolean has_network;
+} SnapInfo;
+
+/* Results of `snap routine portal-info`, by security tag */
+static GHashTable *snap_info_cache;
+G_LOCK_DEFINE_STATIC (snap_info_cache);
+
 struct _XdpAppInfoSnap
 {
   XdpAppInfo parent;
@@ -117,9 +142,74 @@ xdp_app_info_snap_init (XdpAppInfoSnap *app_info_snap)
 {
 }
 
+static void
+snap_info_free (SnapInfo *info)
+{
+  g_clear_pointer (&info->fingerprint, g_free);
+  g_clear_pointer (&info->instance_name, g_free);
+  g_clear_pointer (&info->desktop_id, g_free);
+  g_free (info);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SnapInfo, snap_info_free)
+
+static SnapInfo *
+snap_info_copy (SnapInfo *info)
+{
+  SnapInfo *copy = g_new0 (SnapInfo, 1);
+
+  copy->fingerprint = g_strdup (info->fingerprint);
+  copy->instance_name = g_strdup (info->instance_name);
+  copy->desktop_id = g_strdup (info->desktop_id);
+  copy->has_network = info->has_network;
+
+  return copy;
+}
+
+/*
+ * Returns the security tag (snap.<instance>.<app>, or
+ * snap.<instance>.hook.<hook>) of the systemd unit in a cgroup path,
+ * or %NULL if there is none.
+ */
+char *
+_xdp_app_info_snap_parse_security_tag (const char *cgroup)
+{
+  g_autofree char *tag = NULL;
+  const char *unit;
+  size_t len;
+
+  unit = strrchr (cgroup, '/');
+  unit = unit ? unit + 1 : cgroup;
+
+  if (!g_str_has_prefix (unit, "snap."))
+    return NULL;
+
+  if (g_str_has_suffix (unit, ".service"))
+    tag = g_strndup (unit, strlen (unit) - strlen (".service"));
+  else if (g_str_has_suffix (unit, ".scope"))
+    tag = g_strndup (unit, strlen (unit) - strlen (".scope"));
+  else
+    return NULL;
+
+  /* Scopes of apps end in a UUID, which older versions of snapd
+   * separate with a dot instead of a dash */
+  len = strlen (tag);
+  if (len > UUID_STRING_LEN + 1 &&
+      (tag[len - UUID_STRING_LEN - 1] == '-' || tag[len - UUID_STRING_LEN - 1] == '.') &&
+      g_uuid_string_is_valid (tag + len - UUID_STRING_LEN))
+    tag[len - UUID_STRING_LEN - 1] = '\0';
+
+  /* There has to be an app name after the instance name */
+  if (strchr (tag + strlen ("snap."), '.') == NULL)
+    return NULL;
+
+  return g_steal_pointer (&tag);
+}
+
 int
-_xdp_app_info_snap_parse_cgroup_file (FILE     *f,
-                                      gboolean *is_snap)
+_xdp_app_info_snap_parse_cgroup_file (FILE      *f,
+                                      gboolean  *is_snap,
+                                      char     **security_tag)
 {
   ssize_t n;
   g_autofree char *id = NULL;
@@ -131,6 +221,9 @@ _xdp_app_info_snap_parse_cgroup_file (FILE     *f,
   g_return_val_if_fail(is_snap != NULL, -1);
 
   *is_snap = FALSE;
+  if (security_tag)
+    *security_tag = NULL;
+
   do
     {
       n = getdelim (&id, &id_len, ':', f);
@@ -148,7 +241,16 @@ _xdp_app_info_snap_parse_cgroup_file (FILE     *f,
           strstr (cgroup, "/snap.") != NULL)
         {
           *is_snap = TRUE;
-          break;
+
+          if (security_tag == NULL)
+            break;
+
+          /* The freezer cgroup only names the snap, so keep looking
+           * for the unit of the app */
+          g_strchomp (cgroup);
+          *security_tag = _xdp_app_info_snap_parse_security_tag (cgroup);
+          if (*security_tag != NULL)
+            break;
         }
     }
   while (n >= 0);
@@ -160,6 +262,7 @@ _xdp_app_info_snap_parse_cgroup_file (FILE     *f,
 
 static gboolean
 pid_is_snap (pid_t    pid,
+             char   **security_tag,
              GError **error)
 {
   g_autofree char *cgroup_path = NULL;;
@@ -187,7 +290,7 @@ pid_is_snap (pid_t    pid,
 
   fd = -1; /* fd is now owned by f */
 
-  if (_xdp_app_info_snap_parse_cgroup_file (f, &is_snap) == -1)
+  if (_xdp_app_info_snap_parse_cgroup_file (f, &is_snap, security_tag) == -1)
     err = errno;
 
   fclose (f);
@@ -262,6 +365,196 @@ xdp_app_info_snap_new_testing (const char  *sender,
   return XDP_APP_INFO (g_steal_pointer (&app_info_snap));
 }
 
+/*
+ * Identifies the installed revision of the snap and the state of its
+ * interface connections. Returns %NULL if that is not possible, and the
+ * info about the snap must not be cached.
+ */
+static char *
+get_snap_fingerprint (const char *security_tag)
+{
+  const char *instance_start = security_tag + strlen ("snap.");
+  g_autofree char *instance_name = NULL;
+  g_autofree char *revision = NULL;
+  struct stat st;
+  size_t i;
+
+  instance_name = g_strndup (instance_start,
+                             strchr (instance_start, '.') - instance_start);
+
+  for (i = 0; i < G_N_ELEMENTS (snap_mount_dirs) && revision == NULL; i++)
+    {
+      g_autofree char *current = NULL;
+
+      current = g_build_filename (snap_mount_dirs[i], instance_name, "current", NULL);
+      revision = g_file_read_link (current, NULL);
+    }
+
+  if (revision == NULL)
+    return NULL;
+
+  if (stat (SNAP_STATE_FILE, &st) != 0)
+    return NULL;
+
+  return g_strdup_printf ("%s:%" G_GINT64_FORMAT ".%09ld:%" G_GUINT64_FORMAT,
+                          revision,
+                          (gint64) st.st_mtim.tv_sec,
+                          (long) st.st_mtim.tv_nsec,
+                          (guint64) st.st_ino);
+}
+
+static SnapInfo *
+snap_info_new_from_cli (int      pid,
+                        GError **error)
+{
+  g_autoptr(SnapInfo) info = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree char *pid_str = NULL;
+  g_autofree char *output = NULL;
+  g_autoptr(GKeyFile) metadata = NULL;
+
+  pid_str = g_strdup_printf ("%u", (guint) pid);
+  output = xdp_spawn (error, "snap", "routine", "portal-info", pid_str, NULL);
+  if (output == NULL)
+    return NULL;
+
+  metadata = g_key_file_new ();
+  if (!g_key_file_load_from_data (metadata, output, -1, G_KEY_FILE_NONE, &local_error))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Can't read snap info for pid %u: %s", pid, local_error->message);
+      return NULL;
+    }
+
+  info = g_new0 (SnapInfo, 1);
+
+  info->instance_name = g_key_file_get_string (metadata,
+                                               SNAP_METADATA_GROUP_INFO,
+                                               SNAP_METADATA_KEY_INSTANCE_NAME,
+                                               error);
+  if (info->instance_name == NULL)
+    return NULL;
+
+  info->desktop_id = g_key_file_get_string (metadata,
+                                            SNAP_METADATA_GROUP_INFO,
+                                            SNAP_METADATA_KEY_DESKTOP_FILE,
+                                            error);
+  if (info->desktop_id == NULL)
+    return NULL;
+
+  info->has_network = g_key_file_get_boolean (metadata,
+                                              SNAP_METADATA_GROUP_INFO,
+                                              SNAP_METADATA_KEY_NETWORK,
+                                              NULL);
+
+  return g_steal_pointer (&info);
+}
+
+/*
+ * Resolves the snap info from the files snapd installs. The network
+ * status connection is only known to snapd, so this only succeeds for
+ * snaps that don't have a network-status plug at all. Returns %NULL if
+ * the snap CLI has to be asked.
+ */
+static SnapInfo *
+snap_info_new_from_disk (const char *security_tag)
+{
+  g_autoptr(SnapInfo) info = NULL;
+  g_autofree char *snap_yaml = NULL;
+  g_autofree char *desktop_path = NULL;
+  g_autofree char *desktop_prefix = NULL;
+  const char *instance_start = security_tag + strlen ("snap.");
+  const char *app_start;
+  size_t i;
+
+  app_start = strchr (instance_start, '.') + 1;
+
+  info = g_new0 (SnapInfo, 1);
+  info->instance_name = g_strndup (instance_start, app_start - 1 - instance_start);
+
+  /* Parallel installs are named <snap>_<key>, snapd uses <snap>+<key>
+   * for their desktop files */
+  desktop_prefix = g_strdelimit (g_strdup (info->instance_name), "_", '+');
+  info->desktop_id = g_strdup_printf ("%s_%s.desktop", desktop_prefix, app_start);
+
+  desktop_path = g_build_filename (SNAP_DESKTOP_DIR, info->desktop_id, NULL);
+  if (!g_file_test (desktop_path, G_FILE_TEST_EXISTS))
+    return NULL;
+
+  for (i = 0; i < G_N_ELEMENTS (snap_mount_dirs) && snap_yaml == NULL; i++)
+    {
+      g_autofree char *path = NULL;
+
+      path = g_build_filename (snap_mount_dirs[i], info->instance_name,
+                               "current", "meta", "snap.yaml", NULL);
+      g_file_get_contents (path, &snap_yaml, NULL, NULL);
+    }
+
+  /* Plugs always name their interface, whatever the plug is called */
+  if (snap_yaml == NULL || strstr (snap_yaml, "network-status") != NULL)
+    return NULL;
+
+  info->has_network = FALSE;
+
+  return g_steal_pointer (&info);
+}
+
+/*
+ * Asking the snap CLI means spawning a process, which in turn talks to
+ * snapd. The answer only depends on the app and on the installed snaps,
+ * so it is cached per app until the revision of the snap or the snapd
+ * state changes. Apps without a security tag in their cgroup can't be
+ * cached and always go through the CLI.
+ */
+static SnapInfo *
+get_snap_info (const char  *security_tag,
+               int          pid,
+               GError     **error)
+{
+  g_autofree char *fingerprint = NULL;
+  SnapInfo *info;
+
+  if (security_tag)
+    fingerprint = get_snap_fingerprint (security_tag);
+
+  if (fingerprint == NULL)
+    return snap_info_new_from_cli (pid, error);
+
+  G_LOCK (snap_info_cache);
+
+  if (snap_info_cache == NULL)
+    snap_info_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, (GDestroyNotify) snap_info_free);
+
+  info = g_hash_table_lookup (snap_info_cache, security_tag);
+  if (info && g_str_equal (info->fingerprint, fingerprint))
+    {
+      info = snap_info_copy (info);
+      G_UNLOCK (snap_info_cache);
+
+      g_debug ("Using cached snap info for %s", security_tag);
+      return info;
+    }
+
+  G_UNLOCK (snap_info_cache);
+
+  info = snap_info_new_from_disk (security_tag);
+  if (info == NULL)
+    info = snap_info_new_from_cli (pid, error);
+  if (info == NULL)
+    return NULL;
+
+  info->fingerprint = g_steal_pointer (&fingerprint);
+
+  G_LOCK (snap_info_cache);
+  g_hash_table_replace (snap_info_cache,
+                        g_strdup (security_tag),
+                        snap_info_copy (info));
+  G_UNLOCK (snap_info_cache);
+
+  return info;
+}
+
 /*
  * @pidfd: (inout) (not nullable): Pointer to process ID file descriptor.
  *  This function may take ownership of the fd. If it does, it will
@@ -274,16 +567,10 @@ xdp_app_info_snap_new (const char  *sender,
                        GError     **error)
 {
   g_autoptr (XdpAppInfoSnap) app_info_snap = NULL;
-
-  g_autoptr(GError) local_error = NULL;
-  g_autofree char *pid_str = NULL;
-  g_autofree char *output = NULL;
-  g_autoptr(GKeyFile) metadata = NULL;
-  g_autofree char *snap_name = NULL;
+  g_autoptr(SnapInfo) info = NULL;
+  g_autofree char *security_tag = NULL;
   g_autofree char *snap_id = NULL;
-  g_autofree char *desktop_id = NULL;
   XdpAppInfoFlags flags = 0;
-  gboolean has_network;
   const char *test_app_info_kind;
 
   test_app_info_kind = g_getenv ("XDG_DESKTOP_PORTAL_TEST_APP_INFO_KIND");
@@ -301,48 +588,20 @@ xdp_app_info_snap_new (const char  *sender,
     }
 
   /* Check the process's cgroup membership to fail quickly for non-snaps */
-  if (!pid_is_snap (pid, error))
+  if (!pid_is_snap (pid, &security_tag, error))
     {
       g_set_error (error, XDP_APP_INFO_ERROR, XDP_APP_INFO_ERROR_WRONG_APP_KIND,
                    "Not a snap (cgroup doesn't contain a snap id)");
       return NULL;
     }
 
-  pid_str = g_strdup_printf ("%u", (guint) pid);
-  output = xdp_spawn (error, "snap", "routine", "portal-info", pid_str, NULL);
-  if (output == NULL)
+  info = get_snap_info (security_tag, pid, error);
+  if (info == NULL)
     return NULL;
 
-  metadata = g_key_file_new ();
-  if (!g_key_file_load_from_data (metadata, output, -1, G_KEY_FILE_NONE, &local_error))
-    {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "Can't read snap info for pid %u: %s", pid, local_error->message);
-      return FALSE;
-    }
+  snap_id = g_strconcat ("snap.", info->instance_name, NULL);
 
-  snap_name = g_key_file_get_string (metadata,
-                                     SNAP_METADATA_GROUP_INFO,
-                                     SNAP_METADATA_KEY_INSTANCE_NAME,
-                                     error);
-  if (snap_name == NULL)
-    return NULL;
-
-  snap_id = g_strconcat ("snap.", snap_name, NULL);
-
-  desktop_id = g_key_file_get_string (metadata,
-                                      SNAP_METADATA_GROUP_INFO,
-                                      SNAP_METADATA_KEY_DESKTOP_FILE,
-                                      error);
-  if (desktop_id == NULL)
-    return NULL;
-
-  has_network = g_key_file_get_boolean (metadata,
-                                        SNAP_METADATA_GROUP_INFO,
-                                        SNAP_METADATA_KEY_NETWORK,
-                                        NULL);
-
-  if (has_network)
+  if (info->has_network)
     flags |= XDP_APP_INFO_FLAG_HAS_NETWORK;
 
   app_info_snap = g_initable_new (XDP_TYPE_APP_INFO_SNAP,
@@ -352,7 +611,7 @@ xdp_app_info_snap_new (const char  *sender,
                                   "id", snap_id,
                                   "pidfd", g_steal_fd (pidfd),
                                   "flags", flags,
-                                  "desktop-file", desktop_id,
+                                  "desktop-file", info->desktop_id,
                                   "sender", sender,
                                   NULL);
 
@@ -0,0 +1,577 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+/*
+ * Opt-in latency instrumentation shared by all portal daemons.
+ *
+ * Setting XDG_DESKTOP_PORTAL_METRICS=1 in the environment of a daemon makes
+ * it record latency histograms and in-flight gauges for every incoming
+ * method call, plus whatever the daemon records explicitly (authorization
+ * phases, FUSE operations, database writeouts, ...). The numbers can be
+ * fetched with the org.freedesktop.portal.Debug interface on
+ * /org/freedesktop/portal/debug, which only answers host callers, or
+ * printed to stderr by sending the process SIGUSR1.
+ *
+ * When disabled, every entry point returns after checking a single
+ * boolean, and no D-Bus filter or object gets installed.
+ */
+
+#include "config.h"
+
+#include "xdp-metrics.h"
+
+#include "xdp-app-info.h"
+#include "xdp-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib-unix.h>
+
+/* Bucket 0 counts durations of 0 µs, bucket i durations in
+ * [2^(i-1), 2^i) µs, the last one everything from ~4 s up */
+#define N_BUCKETS 24
+
+typedef struct _Metric
+{
+  guint64 count;
+  gint64 in_flight;
+  guint64 total_usec;
+  guint64 max_usec;
+  guint64 buckets[N_BUCKETS];
+} Metric;
+
+typedef struct _PendingCall
+{
+  char *name;
+  gint64 start_time;
+} PendingCall;
+
+static gboolean metrics_enabled = FALSE;
+
+G_LOCK_DEFINE_STATIC (metrics);
+static GHashTable *metrics = NULL; /* name -> Metric */
+static GHashTable *pending_calls = NULL; /* "sender:serial" -> PendingCall */
+
+static const char debug_introspection_xml[] =
+  "<node>"
+  "  <interface name='" XDP_METRICS_DBUS_IFACE "'>"
+  "    <method name='GetMetrics'>"
+  "      <arg type='a{s(txttat)}' name='metrics' direction='out'/>"
+  "    </method>"
+  "    <method name='DumpMetrics'>"
+  "      <arg type='s' name='dump' direction='out'/>"
+  "    </method>"
+  "    <method name='ResetMetrics'/>"
+  "  </interface>"
+  "</node>";
+
+static void
+pending_call_free (PendingCall *call)
+{
+  g_free (call->name);
+  g_free (call);
+}
+
+static Metric *
+lookup_metric_locked (const char *name)
+{
+  Metric *metric;
+
+  metric = g_hash_table_lookup (metrics, name);
+  if (metric == NULL)
+    {
+      metric = g_new0 (Metric, 1);
+      g_hash_table_insert (metrics, g_strdup (name), metric);
+    }
+
+  return metric;
+}
+
+static gboolean
+dump_on_signal (gpointer user_data)
+{
+  g_autofree char *dump = xdp_metrics_dump ();
+
+  fprintf (stderr, "%s: metrics\n%s", g_get_prgname (), dump);
+  fflush (stderr);
+
+  return G_SOURCE_CONTINUE;
+}
+
+void
+xdp_metrics_init (void)
+{
+  const char *value = g_getenv ("XDG_DESKTOP_PORTAL_METRICS");
+
+  if (value == NULL || g_str_equal (value, "") || g_str_equal (value, "0"))
+    return;
+
+  G_LOCK (metrics);
+  metrics = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  pending_calls = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify) pending_call_free);
+  G_UNLOCK (metrics);
+
+  g_unix_signal_add (SIGUSR1, dump_on_signal, NULL);
+
+  metrics_enabled = TRUE;
+
+  g_debug ("Metrics enabled");
+}
+
+gboolean
+xdp_metrics_enabled (void)
+{
+  return metrics_enabled;
+}
+
+gint64
+xdp_metrics_start (void)
+{
+  if (G_LIKELY (!metrics_enabled))
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+void
+xdp_metrics_record (const char *name,
+                    gint64      duration_usec)
+{
+  Metric *metric;
+  guint64 usec;
+  unsigned int bucket;
+
+  if (G_LIKELY (!metrics_enabled))
+    return;
+
+  usec = MAX (duration_usec, 0);
+  bucket = usec == 0 ? 0 : MIN (g_bit_storage (usec), N_BUCKETS - 1);
+
+  G_LOCK (metrics);
+
+  metric = lookup_metric_locked (name);
+  metric->count++;
+  metric->total_usec += usec;
+  metric->max_usec = MAX (metric->max_usec, usec);
+  metric->buckets[bucket]++;
+
+  G_UNLOCK (metrics);
+}
+
+void
+xdp_metrics_record_since (const char *name,
+                          gint64      start_time)
+{
+  if (G_LIKELY (!metrics_enabled) || start_time == 0)
+    return;
+
+  xdp_metrics_record (name, g_get_monotonic_time () - start_time);
+}
+
+void
+xdp_metrics_record_method (GDBusMethodInvocation *invocation,
+                           const char            *phase,
+                           gint64                 start_time)
+{
+  g_autofree char *name = NULL;
+
+  if (G_LIKELY (!metrics_enabled) || start_time == 0)
+    return;
+
+  name = g_strdup_printf ("%s.%s:%s",
+                          g_dbus_method_invocation_get_interface_name (invocation),
+                          g_dbus_method_invocation_get_method_name (invocation),
+                          phase);
+  xdp_metrics_record_since (name, start_time);
+}
+
+void
+xdp_metrics_add_in_flight (const char *name,
+                           int         delta)
+{
+  if (G_LIKELY (!metrics_enabled))
+    return;
+
+  G_LOCK (metrics);
+  lookup_metric_locked (name)->in_flight += delta;
+  G_UNLOCK (metrics);
+}
+
+XdpMetricsScope
+xdp_metrics_scope_begin (const char *name)
+{
+  XdpMetricsScope scope = { name, 0 };
+
+  if (G_LIKELY (!metrics_enabled))
+    return scope;
+
+  xdp_metrics_add_in_flight (name, 1);
+  scope.start_time = g_get_monotonic_time ();
+
+  return scope;
+}
+
+void
+xdp_metrics_scope_end (XdpMetricsScope *scope)
+{
+  if (scope->start_time == 0)
+    return;
+
+  xdp_metrics_add_in_flight (scope->name, -1);
+  xdp_metrics_record_since (scope->name, scope->start_time);
+  scope->start_time = 0;
+}
+
+static GDBusMessage *
+filter_message (GDBusConnection *connection,
+                GDBusMessage    *message,
+                gboolean         incoming,
+                gpointer         user_data)
+{
+  g_autofree char *key = NULL;
+  PendingCall *call;
+
+  switch (g_dbus_message_get_message_type (message))
+    {
+    case G_DBUS_MESSAGE_TYPE_METHOD_CALL:
+      /* Calls not expecting a reply never get one to end them */
+      if (!incoming ||
+          (g_dbus_message_get_flags (message) &
+           G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED) != 0)
+        break;
+
+      call = g_new0 (PendingCall, 1);
+      call->name = g_strdup_printf ("%s.%s",
+                                    g_dbus_message_get_interface (message),
+                                    g_dbus_message_get_member (message));
+      call->start_time = g_get_monotonic_time ();
+      key = g_strdup_printf ("%s:%u",
+                             g_dbus_message_get_sender (message),
+                             g_dbus_message_get_serial (message));
+
+      xdp_metrics_add_in_flight (call->name, 1);
+
+      G_LOCK (metrics);
+      g_hash_table_replace (pending_calls, g_steal_pointer (&key), call);
+      G_UNLOCK (metrics);
+      break;
+
+    case G_DBUS_MESSAGE_TYPE_METHOD_RETURN:
+    case G_DBUS_MESSAGE_TYPE_ERROR:
+      {
+        g_autofree char *stolen_key = NULL;
+
+        if (incoming)
+          break;
+
+        key = g_strdup_printf ("%s:%u",
+                               g_dbus_message_get_destination (message),
+                               g_dbus_message_get_reply_serial (message));
+
+        G_LOCK (metrics);
+        if (!g_hash_table_steal_extended (pending_calls, key,
+                                          (gpointer *) &stolen_key,
+                                          (gpointer *) &call))
+          call = NULL;
+        G_UNLOCK (metrics);
+
+        if (call)
+          {
+            xdp_metrics_add_in_flight (call->name, -1);
+            xdp_metrics_record_since (call->name, call->start_time);
+            pending_call_free (call);
+          }
+      }
+      break;
+
+    case G_DBUS_MESSAGE_TYPE_SIGNAL:
+    case G_DBUS_MESSAGE_TYPE_INVALID:
+    default:
+      break;
+    }
+
+  return message;
+}
+
+/* Forgets the calls a peer left without waiting for their replies */
+static void
+on_peer_disconnect (const char *name,
+                    gpointer    user_data)
+{
+  g_autoptr(GPtrArray) calls = NULL;
+  GHashTableIter iter;
+  const char *key;
+  PendingCall *call;
+  size_t name_len = strlen (name);
+
+  calls = g_ptr_array_new_with_free_func ((GDestroyNotify) pending_call_free);
+
+  G_LOCK (metrics);
+
+  g_hash_table_iter_init (&iter, pending_calls);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &call))
+    {
+      if (strncmp (key, name, name_len) == 0 && key[name_len] == ':')
+        {
+          g_hash_table_iter_steal (&iter);
+          g_free ((char *) key);
+          g_ptr_array_add (calls, call);
+        }
+    }
+
+  G_UNLOCK (metrics);
+
+  for (unsigned int i = 0; i < calls->len; i++)
+    {
+      call = g_ptr_array_index (calls, i);
+      xdp_metrics_add_in_flight (call->name, -1);
+    }
+}
+
+static DexFuture *
+debug_method_call_with_app_info (DexFuture *completed,
+                                 gpointer   user_data)
+{
+  GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (user_data);
+  const char *method_name = g_dbus_method_invocation_get_method_name (invocation);
+  g_autoptr(XdpAppInfo) app_info = NULL;
+  g_autoptr(GError) error = NULL;
+
+  app_info = dex_await_object (dex_ref (completed), &error);
+  if (app_info == NULL)
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      return dex_future_new_true ();
+    }
+
+  /* The metrics cover the calls of all apps */
+  if (!xdp_app_info_is_host (app_info))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             XDG_DESKTOP_PORTAL_ERROR,
+                                             XDG_DESKTOP_PORTAL_ERROR_NOT_ALLOWED,
+                                             "Not allowed inside a sandbox");
+      return dex_future_new_true ();
+    }
+
+  if (g_str_equal (method_name, "GetMetrics"))
+    {
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(@a{s(txttat)})",
+                                                            xdp_metrics_snapshot ()));
+    }
+  else if (g_str_equal (method_name, "DumpMetrics"))
+    {
+      g_autofree char *dump = xdp_metrics_dump ();
+
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(s)", dump));
+    }
+  else if (g_str_equal (method_name, "ResetMetrics"))
+    {
+      xdp_metrics_reset ();
+      g_dbus_method_invocation_return_value (invocation, NULL);
+    }
+  else
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_METHOD,
+                                             "Unknown method %s", method_name);
+    }
+
+  return dex_future_new_true ();
+}
+
+static void
+debug_method_call (GDBusConnection       *connection,
+                   const char            *sender,
+                   const char            *object_path,
+                   const char            *interface_name,
+                   const char            *method_name,
+                   GVariant              *parameters,
+                   GDBusMethodInvocation *invocation,
+                   gpointer               user_data)
+{
+  g_autoptr(DexFuture) future = NULL;
+
+  future = xdp_app_info_new_for_invocation (invocation);
+  future = dex_future_finally (future,
+                               debug_method_call_with_app_info,
+                               g_object_ref (invocation),
+                               g_object_unref);
+  dex_future_disown (g_steal_pointer (&future));
+}
+
+static const GDBusInterfaceVTable debug_vtable = {
+  .method_call = debug_method_call,
+};
+
+/**
+ * xdp_metrics_export:
+ * @connection: the #GDBusConnection the daemon serves on
+ *
+ * Starts recording method call latencies on @connection and exports the
+ * debug interface on it. Does nothing unless metrics are enabled.
+ */
+void
+xdp_metrics_export (GDBusConnection *connection)
+{
+  g_autoptr(GDBusNodeInfo) node_info = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (G_LIKELY (!metrics_enabled))
+    return;
+
+  /* Checking the callers of the debug interface needs libdex, which
+   * not every daemon sets up */
+  dex_init ();
+
+  g_dbus_connection_add_filter (connection, filter_message, NULL, NULL);
+  xdp_connection_track_peer_disconnect (connection, on_peer_disconnect, NULL);
+
+  node_info = g_dbus_node_info_new_for_xml (debug_introspection_xml, &error);
+  g_assert_no_error (error);
+
+  if (g_dbus_connection_register_object (connection,
+                                         XDP_METRICS_DBUS_PATH,
+                                         node_info->interfaces[0],
+                                         &debug_vtable,
+                                         NULL, NULL,
+                                         &error) == 0)
+    g_warning ("Failed to export metrics: %s", error->message);
+}
+
+/**
+ * xdp_metrics_snapshot:
+ *
+ * Returns: (transfer floating): a `a{s(txttat)}` variant mapping metric
+ *   names to their count, in-flight gauge, total and maximum duration in
+ *   microseconds, and the log2 histogram of the durations
+ */
+GVariant *
+xdp_metrics_snapshot (void)
+{
+  g_auto(GVariantBuilder) builder =
+    G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a{s(txttat)}"));
+  GHashTableIter iter;
+  const char *name;
+  Metric *metric;
+
+  if (!metrics_enabled)
+    return g_variant_builder_end (&builder);
+
+  G_LOCK (metrics);
+
+  g_hash_table_iter_init (&iter, metrics);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &metric))
+    {
+      g_variant_builder_add (&builder, "{s(txtt@at)}",
+                             name,
+                             metric->count,
+                             metric->in_flight,
+                             metric->total_usec,
+                             metric->max_usec,
+                             g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                        metric->buckets,
+                                                        N_BUCKETS,
+                                                        sizeof (guint64)));
+    }
+
+  G_UNLOCK (metrics);
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Upper bound of the bucket containing the given percentile */
+static guint64
+estimate_percentile (const Metric *metric,
+                     double        percentile)
+{
+  guint64 target = (guint64) (metric->count * percentile + 0.5);
+  guint64 seen = 0;
+  unsigned int i;
+
+  for (i = 0; i < N_BUCKETS; i++)
+    {
+      seen += metric->buckets[i];
+      if (seen >= MAX (target, 1))
+        return MIN (i == 0 ? 0 : G_GUINT64_CONSTANT (1) << i, metric->max_usec);
+    }
+
+  return metric->max_usec;
+}
+
+static int
+compare_names (gconstpointer a,
+               gconstpointer b)
+{
+  return g_strcmp0 (*(const char **) a, *(const char **) b);
+}
+
+char *
+xdp_metrics_dump (void)
+{
+  g_autoptr(GString) dump = g_string_new ("");
+  g_autofree gpointer *names = NULL;
+  unsigned int n_names;
+  unsigned int i;
+
+  if (!metrics_enabled)
+    return g_strdup ("");
+
+  G_LOCK (metrics);
+
+  names = g_hash_table_get_keys_as_array (metrics, &n_names);
+  qsort (names, n_names, sizeof (gpointer), compare_names);
+
+  for (i = 0; i < n_names; i++)
+    {
+      const Metric *metric = g_hash_table_lookup (metrics, names[i]);
+
+      g_string_append_printf (dump,
+                              "%s count=%" G_GUINT64_FORMAT
+                              " in_flight=%" G_GINT64_FORMAT
+                              " avg=%.3fms p50<=%.3fms p99<=%.3fms max=%.3fms\n",
+                              (const char *) names[i],
+                              metric->count,
+                              metric->in_flight,
+                              metric->count ? metric->total_usec / 1000.0 / metric->count : 0.0,
+                              metric->count ? estimate_percentile (metric, 0.50) / 1000.0 : 0.0,
+                              metric->count ? estimate_percentile (metric, 0.99) / 1000.0 : 0.0,
+                              metric->max_usec / 1000.0);
+    }
+
+  G_UNLOCK (metrics);
+
+  return g_string_free (g_steal_pointer (&dump), FALSE);
+}
+
+void
+xdp_metrics_reset (void)
+{
+  GHashTableIter iter;
+  Metric *metric;
+
+  if (!metrics_enabled)
+    return;
+
+  G_LOCK (metrics);
+
+  /* Keep the gauges, calls in flight will still finish */
+  g_hash_table_iter_init (&iter, metrics);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &metric))
+    {
+      gint64 in_flight = metric->in_flight;
+
+      memset (metric, 0, sizeof (Metric));
+      metric->in_flight = in_flight;
+    }
+
+  G_UNLOCK (metrics);
+}
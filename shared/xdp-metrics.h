@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#define XDP_METRICS_DBUS_IFACE "org.freedesktop.portal.Debug"
+#define XDP_METRICS_DBUS_PATH "/org/freedesktop/portal/debug"
+
+typedef struct _XdpMetricsScope
+{
+  const char *name;
+  gint64 start_time;
+} XdpMetricsScope;
+
+void xdp_metrics_init (void);
+
+gboolean xdp_metrics_enabled (void);
+
+void xdp_metrics_export (GDBusConnection *connection);
+
+void xdp_metrics_record (const char *name,
+                         gint64      duration_usec);
+
+void xdp_metrics_record_since (const char *name,
+                               gint64      start_time);
+
+void xdp_metrics_record_method (GDBusMethodInvocation *invocation,
+                                const char            *phase,
+                                gint64                 start_time);
+
+void xdp_metrics_add_in_flight (const char *name,
+                                int         delta);
+
+gint64 xdp_metrics_start (void);
+
+XdpMetricsScope xdp_metrics_scope_begin (const char *name);
+
+void xdp_metrics_scope_end (XdpMetricsScope *scope);
+
+GVariant * xdp_metrics_snapshot (void);
+
+char * xdp_metrics_dump (void);
+
+void xdp_metrics_reset (void);
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (XdpMetricsScope, xdp_metrics_scope_end)
+
+/* Records the time until the end of the current scope under @name, and
+ * tracks it as in flight meanwhile. Does nothing unless metrics are
+ * enabled. */
+#define XDP_METRICS_SCOPE(name) \
+  g_auto(XdpMetricsScope) G_PASTE (xdp_metrics_scope_, __LINE__) = \
+    xdp_metrics_scope_begin (name)
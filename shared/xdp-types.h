@@ -18,6 +18,7 @@ typedef struct _XdpAppInfoRegistry XdpAppInfoRegistry;
 typedef struct _XdpPortalConfig XdpPortalConfig;
 typedef struct _XdpDbusImplLockdown XdpDbusImplLockdown;
 typedef struct _XdpDbusImplAccess XdpDbusImplAccess;
+typedef struct _XdpWorkerPool XdpWorkerPool;
 
 #define XDG_PORTAL_APPLICATIONS_DIR "xdg-desktop-portal" G_DIR_SEPARATOR_S "applications"
 #define XDG_PORTAL_ICONS_DIR "xdg-desktop-portal" G_DIR_SEPARATOR_S "icons"
@@ -82,6 +83,8 @@ typedef struct _XdpDbusImplAccess XdpDbusImplAccess;
 #define LOCATION_PERMISSION_TABLE "location"
 #define LOCATION_PERMISSION_ID "location"
 
+#define NETWORK_MONITOR_DBUS_IFACE DESKTOP_DBUS_IFACE ".NetworkMonitor"
+
 #define NOTIFICATION_DBUS_IFACE DESKTOP_DBUS_IFACE ".Notification"
 #define NOTIFICATION_DBUS_IMPL_IFACE DESKTOP_DBUS_IMPL_IFACE ".Notification"
 #define NOTIFICATION_PERMISSION_TABLE "notifications"
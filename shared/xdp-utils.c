@@ -1561,3 +1561,24 @@ xdp_desktop_app_info_get_doc_mountpoint (GDesktopAppInfo *info)
 
   return g_build_filename (g_get_user_runtime_dir (), "doc", NULL);
 }
+
+/* Returns the value of the environment variable @name parsed as an unsigned
+ * integer, or @default_value if it is unset or invalid */
+unsigned int
+xdp_get_env_uint (const char   *name,
+                  unsigned int  default_value)
+{
+  const char *value = g_getenv (name);
+  guint64 parsed;
+
+  if (value == NULL)
+    return default_value;
+
+  if (!g_ascii_string_to_unsigned (value, 10, 0, G_MAXUINT, &parsed, NULL))
+    {
+      g_warning ("Ignoring invalid value '%s' for %s", value, name);
+      return default_value;
+    }
+
+  return parsed;
+}
@@ -222,5 +222,8 @@ char * xdp_desktop_app_info_get_app_id (GDesktopAppInfo *info);
 /* Returns the document fuse mountpoint */
 char * xdp_desktop_app_info_get_doc_mountpoint (GDesktopAppInfo *info);
 
+unsigned int xdp_get_env_uint (const char   *name,
+                               unsigned int  default_value);
+
 #define XDP_EXPORT_TEST XDP_EXPORT
 #define XDP_EXPORT __attribute__((visibility("default"))) extern
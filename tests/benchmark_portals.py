@@ -0,0 +1,410 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+#
+# This file is formatted with Python Black
+
+"""
+Latency and throughput benchmarks for the portal frontends.
+
+The benchmarks use the same fixtures and dbusmock backends as the integration
+tests, so they run without a desktop session. Each benchmark keeps a fixed
+number of calls in flight and reports the latency percentiles and the call
+rate as one JSON object per line. See tests/README.md for how to run them.
+"""
+
+import json
+import math
+import os
+import time
+from pathlib import Path
+from typing import Callable
+
+import dbus
+import pytest
+from gi.repository import Gio, GLib
+
+import tests.xdp_utils as xdp
+
+BENCHMARK_CALLS = int(os.getenv("XDP_BENCHMARK_CALLS", "200"))
+BENCHMARK_CONCURRENCY = [
+    int(c) for c in os.getenv("XDP_BENCHMARK_CONCURRENCY", "1,8").split(",")
+]
+
+# A call is considered stuck after this long and fails the benchmark
+CALL_TIMEOUT_MS = 30000
+
+BENCH_APP_ID = "org.example.Benchmark"
+
+bench_handler_desktop = b"""[Desktop Entry]
+Version=1.0
+Name=Bench Handler
+Exec=true %u
+Type=Application
+MimeType=x-scheme-handler/https;
+"""
+
+bench_defaults_list = b"""[Default Applications]
+x-scheme-handler/https=bench-handler.desktop
+"""
+
+bench_mimeinfo_cache = b"""[MIME Cache]
+x-scheme-handler/https=bench-handler.desktop;
+"""
+
+
+@pytest.fixture
+def xdp_app_info() -> xdp.AppInfo:
+    return xdp.AppInfoHost(app_id=BENCH_APP_ID)
+
+
+@pytest.fixture
+def xdp_overwrite_env() -> dict[str, str]:
+    # The notification benchmark adds far more notifications than an app
+    # may add at once
+    return {"XDG_DESKTOP_PORTAL_NOTIFICATION_BURST": "0"}
+
+
+@pytest.fixture
+def xdg_data_home_files():
+    return {
+        "applications/bench-handler.desktop": bench_handler_desktop,
+        "applications/defaults.list": bench_defaults_list,
+        "applications/mimeinfo.cache": bench_mimeinfo_cache,
+    }
+
+
+@pytest.fixture
+def required_templates():
+    return {
+        "settings": {
+            "settings": {
+                "org.freedesktop.appearance": dbus.Dictionary(
+                    {"color-scheme": dbus.UInt32(1)},
+                    signature="sv",
+                ),
+            },
+        },
+        "notification": {},
+        "appchooser": {},
+        "lockdown": {},
+    }
+
+
+class BenchmarkResult:
+    def __init__(
+        self, name: str, concurrency: int, latencies_ns: list[int], wall_ns: int
+    ):
+        self.name = name
+        self.concurrency = concurrency
+        self.latencies_ns = sorted(latencies_ns)
+        self.wall_ns = wall_ns
+
+    def percentile_ms(self, p: float) -> float:
+        # nearest-rank percentile
+        rank = max(1, math.ceil(len(self.latencies_ns) * p / 100))
+        return self.latencies_ns[rank - 1] / 1e6
+
+    def to_dict(self) -> dict:
+        return {
+            "benchmark": self.name,
+            "concurrency": self.concurrency,
+            "calls": len(self.latencies_ns),
+            "p50_ms": round(self.percentile_ms(50), 3),
+            "p99_ms": round(self.percentile_ms(99), 3),
+            "max_ms": round(self.latencies_ns[-1] / 1e6, 3),
+            "calls_per_second": round(
+                len(self.latencies_ns) / (self.wall_ns / 1e9), 1
+            ),
+        }
+
+
+def report(capsys, result: BenchmarkResult) -> None:
+    line = json.dumps(result.to_dict())
+
+    output = os.getenv("XDP_BENCHMARK_OUTPUT")
+    if output:
+        with open(output, "a") as f:
+            f.write(line + "\n")
+
+    with capsys.disabled():
+        print(line)
+
+
+def run_benchmark(
+    name: str,
+    concurrency: int,
+    start_call: Callable[[int, Callable[[GLib.Error | None], None]], None],
+    calls: int = BENCHMARK_CALLS,
+) -> BenchmarkResult:
+    """
+    Runs calls invocations of start_call, keeping concurrency of them in
+    flight. start_call gets the index of the call and a callback which it
+    has to invoke when the call finished, with an error or None.
+    """
+    mainloop = GLib.MainLoop()
+    latencies_ns: list[int] = []
+    errors: list[GLib.Error] = []
+    started = 0
+    in_flight = 0
+
+    def start_next():
+        nonlocal started, in_flight
+
+        index = started
+        start_ns = time.monotonic_ns()
+        started += 1
+        in_flight += 1
+
+        def done(error: GLib.Error | None):
+            nonlocal in_flight
+
+            in_flight -= 1
+            latencies_ns.append(time.monotonic_ns() - start_ns)
+            if error:
+                errors.append(error)
+
+            if started < calls and not errors:
+                start_next()
+            elif in_flight == 0:
+                mainloop.quit()
+
+        start_call(index, done)
+
+    def on_timeout():
+        nonlocal timeout_id
+
+        timeout_id = 0
+        errors.append(GLib.Error(f"{name} did not finish in time"))
+        mainloop.quit()
+        return GLib.SOURCE_REMOVE
+
+    timeout_id = GLib.timeout_add(CALL_TIMEOUT_MS + calls * 100, on_timeout)
+
+    wall_start_ns = time.monotonic_ns()
+    for _ in range(min(concurrency, calls)):
+        start_next()
+    mainloop.run()
+    wall_ns = time.monotonic_ns() - wall_start_ns
+
+    if timeout_id:
+        GLib.source_remove(timeout_id)
+
+    assert not errors, f"{name} failed: {errors[0].message}"
+
+    return BenchmarkResult(name, concurrency, latencies_ns, wall_ns)
+
+
+class BenchIface(xdp.GDBusIface):
+    def call_timed(
+        self,
+        method_name: str,
+        args_variant: GLib.Variant,
+        done: Callable[[GLib.Error | None], None],
+        fds: list[int] | None = None,
+    ) -> None:
+        fdlist = Gio.UnixFDList.new()
+        for fd in fds or []:
+            fdlist.append(fd)
+
+        def internal_cb(proxy, res, _):
+            try:
+                proxy.call_with_unix_fd_list_finish(res)
+            except GLib.Error as e:
+                done(e)
+                return
+            done(None)
+
+        self._proxy.call_with_unix_fd_list(
+            method_name,
+            args_variant,
+            Gio.DBusCallFlags.NONE,
+            CALL_TIMEOUT_MS,
+            fdlist,
+            None,
+            internal_cb,
+            None,
+        )
+
+    def call_request_timed(
+        self,
+        method_name: str,
+        make_args: Callable[[str], GLib.Variant],
+        token: str,
+        done: Callable[[GLib.Error | None], None],
+    ) -> None:
+        """
+        Calls a method returning a Request object and finishes when the
+        Response signal was received, like a real client would.
+        """
+        connection = self._proxy.get_connection()
+        sender = connection.get_unique_name()[1:].replace(".", "_")
+        handle = f"/org/freedesktop/portal/desktop/request/{sender}/{token}"
+        subscription_id = 0
+
+        def on_response(connection, sender_name, path, iface, signal, params):
+            connection.signal_unsubscribe(subscription_id)
+            response, _ = params.unpack()
+            if response != 0:
+                done(GLib.Error(f"{method_name} responded with {response}"))
+            else:
+                done(None)
+
+        subscription_id = connection.signal_subscribe(
+            "org.freedesktop.portal.Desktop",
+            "org.freedesktop.portal.Request",
+            "Response",
+            handle,
+            None,
+            Gio.DBusSignalFlags.NONE,
+            on_response,
+        )
+
+        # only errors are reported here, the response completes the call
+        def call_done(error):
+            if error:
+                connection.signal_unsubscribe(subscription_id)
+                done(error)
+
+        self.call_timed(method_name, make_args(token), call_done)
+
+
+def portal_iface(name: str) -> BenchIface:
+    return BenchIface(
+        "org.freedesktop.portal.Desktop",
+        "/org/freedesktop/portal/desktop",
+        f"org.freedesktop.portal.{name}",
+    )
+
+
+def permission_store_iface() -> BenchIface:
+    return BenchIface(
+        "org.freedesktop.impl.portal.PermissionStore",
+        "/org/freedesktop/impl/portal/PermissionStore",
+        "org.freedesktop.impl.portal.PermissionStore",
+    )
+
+
+@pytest.mark.parametrize("concurrency", BENCHMARK_CONCURRENCY)
+class TestPortalBenchmarks:
+    def test_settings_read(self, portals, dbus_con, capsys, concurrency):
+        settings = portal_iface("Settings")
+
+        def start_call(index, done):
+            settings.call_timed(
+                "ReadOne",
+                GLib.Variant("(ss)", ("org.freedesktop.appearance", "color-scheme")),
+                done,
+            )
+
+        report(capsys, run_benchmark("Settings.ReadOne", concurrency, start_call))
+
+    def test_openuri(self, portals, dbus_con, capsys, concurrency):
+        openuri = portal_iface("OpenURI")
+
+        def start_call(index, done):
+            openuri.call_request_timed(
+                "OpenURI",
+                lambda token: GLib.Variant(
+                    "(ssa{sv})",
+                    (
+                        "",
+                        f"https://example.org/{index}",
+                        {"handle_token": GLib.Variant("s", token)},
+                    ),
+                ),
+                f"bench{concurrency}_{index}",
+                done,
+            )
+
+        report(capsys, run_benchmark("OpenURI.OpenURI", concurrency, start_call))
+
+    def test_notification_add(self, portals, dbus_con, capsys, concurrency):
+        notification = portal_iface("Notification")
+
+        def start_call(index, done):
+            notification.call_timed(
+                "AddNotification",
+                GLib.Variant(
+                    "(sa{sv})",
+                    (
+                        f"bench{index}",
+                        {
+                            "title": GLib.Variant("s", f"Benchmark {index}"),
+                            "body": GLib.Variant("s", "Benchmark notification"),
+                        },
+                    ),
+                ),
+                done,
+            )
+
+        report(
+            capsys,
+            run_benchmark("Notification.AddNotification", concurrency, start_call),
+        )
+
+    def test_documents_add(self, xdg_document_portal, dbus_con, capsys, concurrency):
+        documents = BenchIface(
+            "org.freedesktop.portal.Documents",
+            "/org/freedesktop/portal/documents",
+            "org.freedesktop.portal.Documents",
+        )
+
+        files_dir = Path(os.environ["TMPDIR"]) / f"bench-documents-{concurrency}"
+        files_dir.mkdir()
+
+        def start_call(index, done):
+            file_path = files_dir / f"file{index}"
+            file_path.write_bytes(b"benchmark")
+
+            fd = os.open(file_path.as_posix(), os.O_PATH | os.O_CLOEXEC)
+            try:
+                documents.call_timed(
+                    "Add",
+                    GLib.Variant("(hbb)", (0, True, False)),
+                    done,
+                    fds=[fd],
+                )
+            finally:
+                os.close(fd)
+
+        report(capsys, run_benchmark("Documents.Add", concurrency, start_call))
+
+    def test_permission_store_set(self, portals, dbus_con, capsys, concurrency):
+        permission_store = permission_store_iface()
+
+        def start_call(index, done):
+            permission_store.call_timed(
+                "SetPermission",
+                GLib.Variant(
+                    "(sbssas)",
+                    ("bench", True, f"id{index}", BENCH_APP_ID, ["yes"]),
+                ),
+                done,
+            )
+
+        report(
+            capsys,
+            run_benchmark("PermissionStore.SetPermission", concurrency, start_call),
+        )
+
+    def test_permission_store_lookup(self, portals, dbus_con, capsys, concurrency):
+        permission_store = permission_store_iface()
+        n_ids = 50
+
+        for i in range(n_ids):
+            permission_store._call(
+                "SetPermission",
+                GLib.Variant("(sbssas)", ("bench", True, f"id{i}", BENCH_APP_ID, [])),
+            )
+
+        def start_call(index, done):
+            permission_store.call_timed(
+                "Lookup",
+                GLib.Variant("(ss)", ("bench", f"id{index % n_ids}")),
+                done,
+            )
+
+        report(
+            capsys,
+            run_benchmark("PermissionStore.Lookup", concurrency, start_call),
+        )
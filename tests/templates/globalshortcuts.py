@@ -175,3 +175,20 @@ def Trigger(self, session_handle, shortcut_id):
         "osta{sv}",
         [session_handle, shortcut_id, now_since_epoch, {}],
     )
+
+
+@dbus.service.method(
+    MOCK_IFACE,
+    in_signature="osu",
+    out_signature="",
+)
+def TriggerBurst(self, session_handle, shortcut_id, count):
+    now_since_epoch = int(time.time() * 1000000)
+    for i in range(count):
+        for signal in ("Activated", "Deactivated"):
+            self.EmitSignal(
+                MAIN_IFACE,
+                signal,
+                "osta{sv}",
+                [session_handle, shortcut_id, now_since_epoch + i, {}],
+            )
@@ -0,0 +1,44 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+#
+# This file is formatted with Python Black
+# mypy: disable-error-code="misc"
+
+import dbus
+
+from tests.templates.xdp_utils import init_logger
+
+BUS_NAME = "org.freedesktop.NetworkManager"
+MAIN_OBJ = "/org/freedesktop/NetworkManager"
+MAIN_IFACE = "org.freedesktop.NetworkManager"
+SYSTEM_BUS = True
+
+# NMConnectivityState and NMMetered
+NM_CONNECTIVITY_FULL = 4
+NM_METERED_NO = 2
+
+# NM_STATE_CONNECTED_GLOBAL
+NM_STATE = 70
+
+
+logger = init_logger(__name__)
+
+
+def load(mock, parameters=None):
+    parameters = parameters or {}
+
+    logger.debug(f"Loading parameters: {parameters}")
+
+    mock.AddProperties(
+        MAIN_IFACE,
+        dbus.Dictionary(
+            {
+                "Connectivity": dbus.UInt32(
+                    parameters.get("Connectivity", NM_CONNECTIVITY_FULL)
+                ),
+                "Metered": dbus.UInt32(parameters.get("Metered", NM_METERED_NO)),
+                "State": dbus.UInt32(NM_STATE),
+                "PrimaryConnection": dbus.ObjectPath("/"),
+            },
+        ),
+    )
@@ -32,6 +32,7 @@ class RemotedesktopParameters:
     force_close: int
     force_clipboard_enabled: bool
     fail_connect_to_eis: bool
+    devices: int
 
 
 def load(mock, parameters=None):
@@ -47,6 +48,7 @@ def load(mock, parameters=None):
         force_close=parameters.get("force-close", 0),
         force_clipboard_enabled=parameters.get("force-clipboard-enabled", False),
         fail_connect_to_eis=parameters.get("fail-connect-to-eis", False),
+        devices=parameters.get("devices", 0),
     )
 
     mock.AddProperties(
@@ -148,6 +150,8 @@ def Start(
     response = Response(params.response, {})
     if params.force_clipboard_enabled:
         response.results["clipboard_enabled"] = True
+    if params.devices:
+        response.results["devices"] = dbus.UInt32(params.devices)
 
     if params.expect_close:
         request.wait_for_close()
@@ -180,6 +184,43 @@ def ConnectToEIS(self, session_handle, app_id, options):
         raise
 
 
+@dbus.service.method(
+    MAIN_IFACE,
+    in_signature="oa{sv}dd",
+    out_signature="",
+)
+def NotifyPointerMotion(self, session_handle, options, dx, dy):
+    logger.debug(f"NotifyPointerMotion({session_handle}, {options}, {dx}, {dy})")
+
+    assert session_handle in self.sessions
+
+
+@dbus.service.method(
+    MAIN_IFACE,
+    in_signature="oa{sv}iu",
+    out_signature="",
+)
+def NotifyPointerButton(self, session_handle, options, button, state):
+    logger.debug(
+        f"NotifyPointerButton({session_handle}, {options}, {button}, {state})"
+    )
+
+    assert session_handle in self.sessions
+
+
+@dbus.service.method(
+    MAIN_IFACE,
+    in_signature="oa{sv}iu",
+    out_signature="",
+)
+def NotifyKeyboardKeycode(self, session_handle, options, keycode, state):
+    logger.debug(
+        f"NotifyKeyboardKeycode({session_handle}, {options}, {keycode}, {state})"
+    )
+
+    assert session_handle in self.sessions
+
+
 @dbus.service.method(MOCK_IFACE, in_signature="s", out_signature="s")
 def GetSessionAppId(self, session_handle):
     logger.debug(f"GetSessionAppId({session_handle})")
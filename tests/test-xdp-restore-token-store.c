@@ -0,0 +1,292 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later
+ * SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "xdp-restore-token-store.h"
+
+static char *
+make_sender (unsigned int i)
+{
+  return g_strdup_printf (":1.%u", i);
+}
+
+static char *
+make_token (unsigned int i)
+{
+  return g_strdup_printf ("token%u", i);
+}
+
+static void
+test_restore_token_store_basic (void)
+{
+  g_autoptr(XdpRestoreTokenStore) store = NULL;
+  g_autoptr(GVariant) data = NULL;
+
+  store = xdp_restore_token_store_new (0, 0);
+
+  xdp_restore_token_store_insert (store, ":1.1", "token",
+                                  g_variant_new_uint32 (1));
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, 1);
+
+  data = xdp_restore_token_store_lookup (store, ":1.1", "token");
+  g_assert_nonnull (data);
+  g_assert_cmpuint (g_variant_get_uint32 (data), ==, 1);
+  g_clear_pointer (&data, g_variant_unref);
+
+  /* Tokens are only valid for the sender that created them */
+  data = xdp_restore_token_store_lookup (store, ":1.2", "token");
+  g_assert_null (data);
+  g_assert_false (xdp_restore_token_store_remove (store, ":1.2", "token"));
+
+  /* Replacing keeps a single entry */
+  xdp_restore_token_store_insert (store, ":1.1", "token",
+                                  g_variant_new_uint32 (2));
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, 1);
+
+  data = xdp_restore_token_store_lookup (store, ":1.1", "token");
+  g_assert_cmpuint (g_variant_get_uint32 (data), ==, 2);
+  g_clear_pointer (&data, g_variant_unref);
+
+  g_assert_true (xdp_restore_token_store_remove (store, ":1.1", "token"));
+  g_assert_false (xdp_restore_token_store_remove (store, ":1.1", "token"));
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, 0);
+}
+
+static void
+test_restore_token_store_many_senders (void)
+{
+  g_autoptr(XdpRestoreTokenStore) store = NULL;
+  const unsigned int n_senders = 500;
+  const unsigned int n_tokens = 50;
+
+  store = xdp_restore_token_store_new (0, 0);
+
+  for (unsigned int s = 0; s < n_senders; s++)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      for (unsigned int t = 0; t < n_tokens; t++)
+        {
+          g_autofree char *token = make_token (t);
+
+          xdp_restore_token_store_insert (store, sender, token,
+                                          g_variant_new_uint32 (s * n_tokens + t));
+        }
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==,
+                    n_senders * n_tokens);
+
+  /* Every other sender disconnects */
+  for (unsigned int s = 0; s < n_senders; s += 2)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, sender),
+                        ==, n_tokens);
+      g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, sender),
+                        ==, 0);
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==,
+                    n_senders / 2 * n_tokens);
+
+  for (unsigned int s = 0; s < n_senders; s++)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      for (unsigned int t = 0; t < n_tokens; t++)
+        {
+          g_autofree char *token = make_token (t);
+          g_autoptr(GVariant) data = NULL;
+
+          data = xdp_restore_token_store_lookup (store, sender, token);
+          if (s % 2 == 0)
+            {
+              g_assert_null (data);
+            }
+          else
+            {
+              g_assert_nonnull (data);
+              g_assert_cmpuint (g_variant_get_uint32 (data), ==,
+                                s * n_tokens + t);
+            }
+        }
+    }
+
+  /* Removing the last token of a sender drops the sender too */
+  for (unsigned int t = 0; t < n_tokens; t++)
+    {
+      g_autofree char *token = make_token (t);
+
+      g_assert_true (xdp_restore_token_store_remove (store, ":1.1", token));
+    }
+  g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, ":1.1"), ==, 0);
+}
+
+static void
+test_restore_token_store_lru (void)
+{
+  g_autoptr(XdpRestoreTokenStore) store = NULL;
+  g_autoptr(GVariant) data = NULL;
+  const unsigned int max_tokens = 100;
+
+  store = xdp_restore_token_store_new (max_tokens, 0);
+
+  for (unsigned int i = 0; i < max_tokens; i++)
+    {
+      g_autofree char *sender = make_sender (i % 10);
+      g_autofree char *token = make_token (i);
+
+      xdp_restore_token_store_insert (store, sender, token,
+                                      g_variant_new_uint32 (i));
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, max_tokens);
+
+  /* Using the oldest token keeps it around */
+  data = xdp_restore_token_store_lookup (store, ":1.0", "token0");
+  g_assert_nonnull (data);
+  g_clear_pointer (&data, g_variant_unref);
+
+  xdp_restore_token_store_insert (store, ":1.100", "new",
+                                  g_variant_new_uint32 (0));
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, max_tokens);
+
+  data = xdp_restore_token_store_lookup (store, ":1.0", "token0");
+  g_assert_nonnull (data);
+  g_clear_pointer (&data, g_variant_unref);
+
+  /* The least recently used one got evicted instead */
+  data = xdp_restore_token_store_lookup (store, ":1.1", "token1");
+  g_assert_null (data);
+
+  data = xdp_restore_token_store_lookup (store, ":1.100", "new");
+  g_assert_nonnull (data);
+  g_clear_pointer (&data, g_variant_unref);
+
+  /* Evicting the only token of a sender drops the sender */
+  for (unsigned int i = 0; i < max_tokens; i++)
+    {
+      g_autofree char *token = make_token (i);
+
+      xdp_restore_token_store_insert (store, ":1.200", token,
+                                      g_variant_new_uint32 (i));
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, max_tokens);
+  g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, ":1.100"), ==, 0);
+  g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, ":1.200"), ==,
+                    max_tokens);
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, 0);
+}
+
+static void
+test_restore_token_store_per_sender (void)
+{
+  g_autoptr(XdpRestoreTokenStore) store = NULL;
+  const unsigned int max_tokens = 100;
+  const unsigned int max_tokens_per_sender = 10;
+
+  store = xdp_restore_token_store_new (max_tokens, max_tokens_per_sender);
+
+  for (unsigned int s = 1; s < 5; s++)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      for (unsigned int t = 0; t < max_tokens_per_sender; t++)
+        {
+          g_autofree char *token = make_token (t);
+
+          xdp_restore_token_store_insert (store, sender, token,
+                                          g_variant_new_uint32 (t));
+        }
+    }
+
+  /* A sender creating lots of tokens only evicts its own, oldest first */
+  for (unsigned int t = 0; t < max_tokens * 2; t++)
+    {
+      g_autofree char *token = make_token (t);
+
+      xdp_restore_token_store_insert (store, ":1.0", token,
+                                      g_variant_new_uint32 (t));
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==,
+                    5 * max_tokens_per_sender);
+
+  for (unsigned int t = 0; t < max_tokens * 2; t++)
+    {
+      g_autofree char *token = make_token (t);
+      g_autoptr(GVariant) data = NULL;
+
+      data = xdp_restore_token_store_lookup (store, ":1.0", token);
+      if (t < max_tokens * 2 - max_tokens_per_sender)
+        g_assert_null (data);
+      else
+        g_assert_nonnull (data);
+    }
+
+  for (unsigned int s = 1; s < 5; s++)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      for (unsigned int t = 0; t < max_tokens_per_sender; t++)
+        {
+          g_autofree char *token = make_token (t);
+          g_autoptr(GVariant) data = NULL;
+
+          data = xdp_restore_token_store_lookup (store, sender, token);
+          g_assert_nonnull (data);
+        }
+    }
+
+  /* Using a token keeps it around */
+  {
+    g_autoptr(GVariant) data = NULL;
+    g_autofree char *oldest = make_token (max_tokens * 2 - max_tokens_per_sender);
+
+    data = xdp_restore_token_store_lookup (store, ":1.0", oldest);
+    g_assert_nonnull (data);
+    g_clear_pointer (&data, g_variant_unref);
+
+    xdp_restore_token_store_insert (store, ":1.0", "new",
+                                    g_variant_new_uint32 (0));
+
+    data = xdp_restore_token_store_lookup (store, ":1.0", oldest);
+    g_assert_nonnull (data);
+  }
+
+  /* The overall limit still applies across senders */
+  for (unsigned int s = 5; s < 15; s++)
+    {
+      g_autofree char *sender = make_sender (s);
+
+      for (unsigned int t = 0; t < max_tokens_per_sender; t++)
+        {
+          g_autofree char *token = make_token (t);
+
+          xdp_restore_token_store_insert (store, sender, token,
+                                          g_variant_new_uint32 (t));
+        }
+    }
+
+  g_assert_cmpuint (xdp_restore_token_store_get_size (store), ==, max_tokens);
+  g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, ":1.1"), ==, 0);
+  g_assert_cmpuint (xdp_restore_token_store_remove_sender (store, ":1.14"), ==,
+                    max_tokens_per_sender);
+}
+
+int main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/restore-token-store/basic", test_restore_token_store_basic);
+  g_test_add_func ("/restore-token-store/many-senders", test_restore_token_store_many_senders);
+  g_test_add_func ("/restore-token-store/lru", test_restore_token_store_lru);
+  g_test_add_func ("/restore-token-store/per-sender", test_restore_token_store_per_sender);
+  return g_test_run ();
+}
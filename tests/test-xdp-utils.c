@@ -12,6 +12,7 @@
 #include "xdp-utils.h"
 
 #define snap_parse_cgroup _xdp_app_info_snap_parse_cgroup_file
+#define snap_parse_security_tag _xdp_app_info_snap_parse_security_tag
 #define host_parse_app_id _xdp_app_info_host_parse_app_id_from_unit_name
 
 static void
@@ -24,7 +25,7 @@ test_parse_cgroup_unified (void)
 
   f = fmemopen(data, sizeof(data), "r");
 
-  res = snap_parse_cgroup (f, &is_snap);
+  res = snap_parse_cgroup (f, &is_snap, NULL);
   g_assert_cmpint (res, ==, 0);
   g_assert_true (is_snap);
   fclose(f);
@@ -53,7 +54,7 @@ test_parse_cgroup_freezer (void)
 
   f = fmemopen(data, sizeof(data), "r");
 
-  res = snap_parse_cgroup (f, &is_snap);
+  res = snap_parse_cgroup (f, &is_snap, NULL);
   g_assert_cmpint (res, ==, 0);
   g_assert_true (is_snap);
   fclose(f);
@@ -69,7 +70,7 @@ test_parse_cgroup_systemd (void)
 
   f = fmemopen(data, sizeof(data), "r");
 
-  res = snap_parse_cgroup (f, &is_snap);
+  res = snap_parse_cgroup (f, &is_snap, NULL);
   g_assert_cmpint (res, ==, 0);
   g_assert_true (is_snap);
   fclose(f);
@@ -99,12 +100,53 @@ test_parse_cgroup_not_snap (void)
 
   f = fmemopen(data, sizeof(data), "r");
 
-  res = snap_parse_cgroup (f, &is_snap);
+  res = snap_parse_cgroup (f, &is_snap, NULL);
   g_assert_cmpint (res, ==, 0);
   g_assert_false (is_snap);
   fclose(f);
 }
 
+static void
+test_parse_cgroup_security_tag (void)
+{
+  char data[] =
+    "3:freezer:/snap.portal-test\n"
+    "1:name=systemd:/user.slice/user-1000.slice/user@1000.service/app.slice/snap.portal-test.portal-test-7f1cc38b-3dda-4d1e-9b5a-4c0c95b8a6e1.scope\n"
+    "0::/user.slice/user-1000.slice/user@1000.service/app.slice/snap.portal-test.portal-test-7f1cc38b-3dda-4d1e-9b5a-4c0c95b8a6e1.scope\n";
+  g_autofree char *security_tag = NULL;
+  g_autofree char *tag = NULL;
+  FILE *f;
+  int res;
+  gboolean is_snap = FALSE;
+
+  f = fmemopen(data, sizeof(data), "r");
+
+  res = snap_parse_cgroup (f, &is_snap, &security_tag);
+  g_assert_cmpint (res, ==, 0);
+  g_assert_true (is_snap);
+  g_assert_cmpstr (security_tag, ==, "snap.portal-test.portal-test");
+  fclose(f);
+
+  tag = snap_parse_security_tag ("/system.slice/snap.foo_bar.daemon.service");
+  g_assert_cmpstr (tag, ==, "snap.foo_bar.daemon");
+  g_clear_pointer (&tag, g_free);
+
+  tag = snap_parse_security_tag ("/app.slice/snap.foo.foo.7f1cc38b-3dda-4d1e-9b5a-4c0c95b8a6e1.scope");
+  g_assert_cmpstr (tag, ==, "snap.foo.foo");
+  g_clear_pointer (&tag, g_free);
+
+  tag = snap_parse_security_tag ("/app.slice/snap.foo.hook.configure-7f1cc38b-3dda-4d1e-9b5a-4c0c95b8a6e1.scope");
+  g_assert_cmpstr (tag, ==, "snap.foo.hook.configure");
+  g_clear_pointer (&tag, g_free);
+
+  /* No app name */
+  tag = snap_parse_security_tag ("/apps.slice/snap.something.scope");
+  g_assert_null (tag);
+
+  tag = snap_parse_security_tag ("/snap.portal-test");
+  g_assert_null (tag);
+}
+
 static void
 test_alternate_doc_path (void)
 {
@@ -201,6 +243,7 @@ int main (int argc, char **argv)
   g_test_add_func ("/parse-cgroup/freezer", test_parse_cgroup_freezer);
   g_test_add_func ("/parse-cgroup/systemd", test_parse_cgroup_systemd);
   g_test_add_func ("/parse-cgroup/not-snap", test_parse_cgroup_not_snap);
+  g_test_add_func ("/parse-cgroup/security-tag", test_parse_cgroup_security_tag);
   g_test_add_func ("/alternate-doc-path", test_alternate_doc_path);
 #if HAVE_LIBSYSTEMD
   g_test_add_func ("/app-id-via-systemd-unit", test_app_id_via_systemd_unit);
@@ -95,6 +95,42 @@ class TestCamera:
         _, args = method_calls[-1]
         assert args[1] == app_id
 
+    @pytest.mark.parametrize("template_params", ({"access": {"expect-close": True}},))
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env",
+        (
+            {
+                "XDG_DESKTOP_PORTAL_WORKERS": "1",
+                "XDG_DESKTOP_PORTAL_MAX_RUNNING_PER_APP": "1",
+            },
+        ),
+    )
+    def test_access_open_dialogs(self, portals, dbus_con, xdp_app_info):
+        camera_intf = xdp.get_portal_iface(dbus_con, "Camera")
+        mock_intf = xdp.get_mock_iface(dbus_con)
+        n_dialogs = 3
+
+        # Jobs waiting on a dialog don't take up the only worker, nor the
+        # only running slot of the app
+        requests = []
+        for _ in range(n_dialogs):
+            request = xdp.Request(dbus_con, camera_intf)
+            camera_intf.AccessCamera(
+                {"handle_token": request.handle_token},
+                reply_handler=lambda _: None,
+                error_handler=lambda _: None,
+            )
+            requests.append(request)
+
+        xdp.wait_for(
+            lambda: len(mock_intf.GetMethodCalls("AccessDialog")) == n_dialogs
+        )
+
+        for request in requests:
+            request.close()
+
+        xdp.wait_for(lambda: all(request.closed for request in requests))
+
     @pytest.mark.parametrize(
         "template_params", ({"lockdown": {"disable-camera": True}},)
     )
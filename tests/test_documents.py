@@ -195,6 +195,51 @@ class TestDocuments:
             with pytest.raises(PermissionError):
                 other_app_path.write_bytes(b"new-content")
 
+    def test_create_many_docs(self, xdg_document_portal, dbus_con):
+        documents_intf = xdp.get_document_portal_iface(dbus_con)
+        mountpoint = xdp_doc.get_mountpoint(documents_intf)
+
+        # The bus limits the number of fds per message, so use several calls
+        n_calls = 4
+        n_fds_per_call = 16
+
+        for call in range(n_calls):
+            files = {
+                f"many-{call}-{i}": f"content-{call}-{i}".encode()
+                for i in range(n_fds_per_call)
+            }
+
+            file_paths = []
+            for file_name, file_content in files.items():
+                file_path = Path(os.environ["TMPDIR"]) / file_name
+                xdp_doc.write_bytes_atomic(file_path, file_content)
+                file_paths.append(file_path)
+
+            doc_ids, extra = xdp_doc.export_files(
+                documents_intf, file_paths, ["read"], app_id="org.other.App"
+            )
+
+            # The ids are returned in the order of the fds
+            assert len(doc_ids) == n_fds_per_call
+            assert len(set(doc_ids)) == n_fds_per_call
+            for doc_id, (file_name, file_content) in zip(doc_ids, files.items()):
+                assert (mountpoint / doc_id / file_name).read_bytes() == file_content
+
+        # A single invalid fd fails the whole batch
+        file_paths = [
+            Path(os.environ["TMPDIR"]) / f"many-0-{i}" for i in range(n_fds_per_call)
+        ]
+        file_paths[n_fds_per_call // 2] = Path(os.environ["TMPDIR"])
+
+        with pytest.raises(dbus.exceptions.DBusException) as excinfo:
+            xdp_doc.export_files(
+                documents_intf, file_paths, ["read"], app_id="org.other.App"
+            )
+        assert (
+            excinfo.value.get_dbus_name()
+            == "org.freedesktop.portal.Error.InvalidArgument"
+        )
+
     def test_add_named(self, xdg_document_portal, dbus_con):
         documents_intf = xdp.get_document_portal_iface(dbus_con)
         mountpoint = xdp_doc.get_mountpoint(documents_intf)
@@ -3,6 +3,7 @@
 #
 # This file is formatted with Python Black
 
+import fcntl
 import os
 import stat
 from pathlib import Path
@@ -41,7 +42,7 @@ class TestDynamicLauncher:
     def test_version(self, portals, dbus_con):
         """tests the version of the interface"""
 
-        xdp.check_version(dbus_con, "DynamicLauncher", 1)
+        xdp.check_version(dbus_con, "DynamicLauncher", 2)
 
     def test_basic(self, portals, dbus_con, xdp_app_info):
         app_id = xdp_app_info.app_id
@@ -101,3 +102,59 @@ class TestDynamicLauncher:
 
         file = Path(os.environ["XDG_DATA_HOME"]) / "applications" / desktop_file_name
         assert file.exists()
+
+    def test_get_icon_fd(self, portals, dbus_con, xdp_app_info):
+        """test that GetIconFd returns the installed icon in a sealed fd"""
+        if isinstance(xdp_app_info, (xdp.AppInfoSnap, xdp.AppInfoLinyaps)):
+            pytest.skip("Install is unsupported on snap and linyaps")
+
+        app_id = xdp_app_info.app_id
+        dynlauncher_intf = xdp.get_portal_iface(dbus_con, "DynamicLauncher")
+        icon_bytes = SVG_IMAGE_DATA.encode("utf-8")
+
+        request = xdp.Request(dbus_con, dynlauncher_intf)
+        response = request.call(
+            "PrepareInstall",
+            parent_window="",
+            name="App Name",
+            icon_v=dbus.Struct(
+                ("bytes", dbus.ByteArray(icon_bytes, variant_level=1)),
+                signature="sv",
+                variant_level=1,
+            ),
+            options={},
+        )
+        assert response
+        assert response.response == 0
+
+        desktop_file_name = app_id + ".ExampleApp.desktop"
+        dynlauncher_intf.Install(
+            response.results["token"],
+            desktop_file_name,
+            DESKTOP_FILE,
+            {},
+        )
+
+        icon_v, icon_format, icon_size = dynlauncher_intf.GetIcon(desktop_file_name)
+        assert icon_format == "svg"
+
+        fd_object, icon_format, icon_size = dynlauncher_intf.GetIconFd(
+            desktop_file_name, {}
+        )
+        assert icon_format == "svg"
+        assert icon_size == 4096
+
+        fd = fd_object.take()
+        try:
+            seals = fcntl.fcntl(fd, fcntl.F_GET_SEALS)
+            assert seals & fcntl.F_SEAL_WRITE
+            assert seals & fcntl.F_SEAL_SHRINK
+            assert seals & fcntl.F_SEAL_GROW
+
+            with os.fdopen(os.dup(fd), "rb") as f:
+                assert f.read() == bytes(icon_v[1])
+        finally:
+            os.close(fd)
+
+        with pytest.raises(dbus.exceptions.DBusException):
+            dynlauncher_intf.GetIconFd(app_id + ".Missing.desktop", {})
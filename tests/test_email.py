@@ -293,3 +293,66 @@ class TestEmail:
         assert args[2] == ""  # parent window
         assert args[3]["addresses"] == addresses
         assert args[3]["subject"] == subject
+
+    @pytest.mark.parametrize("template_params", ({"email": {"expect-close": True}},))
+    def test_peer_disconnect_stress(self, portals, dbus_con):
+        """
+        Test that only the requests of a disconnecting peer are closed, while
+        thousands of idle requests of another peer stay around, and that the
+        portal keeps responding.
+        """
+
+        n_idle_requests = 2000
+        n_peers = 20
+
+        closed_handles = set()
+
+        def cb_request_closed(handle):
+            closed_handles.add(str(handle))
+
+        dbus_con.add_signal_receiver(
+            cb_request_closed,
+            "RequestClosed",
+            dbus_interface="org.freedesktop.impl.portal.Mock",
+        )
+
+        def compose_emails(bus, count):
+            email_intf = xdp.get_portal_iface(bus, "Email")
+            handles = []
+            errors = []
+
+            for i in range(count):
+                email_intf.ComposeEmail(
+                    "",
+                    {"handle_token": f"stress{i}"},
+                    reply_handler=lambda handle: handles.append(str(handle)),
+                    error_handler=errors.append,
+                )
+                # Stay below the per-app queue limit of the portal
+                if i % 32 == 31:
+                    xdp.wait_for(lambda: len(handles) + len(errors) == i + 1)
+
+            xdp.wait_for(lambda: len(handles) + len(errors) == count)
+            assert not errors
+            return handles
+
+        idle_con = dbus.bus.BusConnection(dbus.bus.BusConnection.TYPE_SESSION)
+        idle_con.set_exit_on_disconnect(False)
+        idle_handles = compose_emails(idle_con, n_idle_requests)
+
+        peer_handles = []
+        for _ in range(n_peers):
+            peer_con = dbus.bus.BusConnection(dbus.bus.BusConnection.TYPE_SESSION)
+            peer_con.set_exit_on_disconnect(False)
+            peer_handles += compose_emails(peer_con, 1)
+            peer_con.close()
+
+        xdp.wait_for(lambda: len(closed_handles) == n_peers)
+        assert closed_handles == set(peer_handles)
+
+        xdp.check_version(dbus_con, "Email", 4)
+
+        idle_con.close()
+
+        xdp.wait_for(lambda: len(closed_handles) == n_peers + n_idle_requests)
+        assert closed_handles >= set(idle_handles)
@@ -18,16 +18,25 @@ FILECHOOSER_RESULTS = {
 
 
 @pytest.fixture
-def required_templates():
-    test_file1 = Path(os.environ["XDG_DATA_HOME"]) / "test1.txt"
-    test_file1.write_text("test1")
-    test_file2 = Path(os.environ["XDG_DATA_HOME"]) / "test2.txt"
-    test_file2.write_text("test2")
+def filechooser_files():
+    """
+    The files in XDG_DATA_HOME the file chooser returns. Names ending in a
+    slash are created as directories.
+    """
+    return ["test1.txt", "test2.txt"]
 
-    FILECHOOSER_RESULTS["uris"] = [
-        f"file://{test_file1.absolute().as_posix()}",
-        f"file://{test_file2.absolute().as_posix()}",
-    ]
+
+@pytest.fixture
+def required_templates(filechooser_files):
+    FILECHOOSER_RESULTS["uris"] = []
+    for name in filechooser_files:
+        path = Path(os.environ["XDG_DATA_HOME"]) / name
+        if name.endswith("/"):
+            path.mkdir()
+        else:
+            path.write_text(path.stem)
+
+        FILECHOOSER_RESULTS["uris"].append(f"file://{path.absolute().as_posix()}")
 
     return {
         "filechooser": {
@@ -77,6 +86,39 @@ class TestFilechooser:
         assert args[4]["accept_label"] == accept_label
         assert args[4]["multiple"] == multiple
 
+    @pytest.mark.parametrize(
+        "filechooser_files",
+        (
+            ["test1.txt", "a-directory/", "test2.txt"],
+            [f"test{i}.txt" for i in range(18)]
+            + ["a-directory/"]
+            + [f"test{i}.txt" for i in range(18, 20)],
+        ),
+    )
+    @pytest.mark.parametrize("xdp_app_info", (xdp.AppInfoFlatpak(),))
+    def test_open_file_skip_failed(self, portals, dbus_con, filechooser_files):
+        filechooser_intf = xdp.get_portal_iface(dbus_con, "FileChooser")
+
+        request = xdp.Request(dbus_con, filechooser_intf)
+        response = request.call(
+            "OpenFile",
+            parent_window="",
+            title="Test",
+            options={"multiple": True},
+        )
+
+        # The directory makes the document portal refuse the batch of files
+        # it is in, but only the directory is left out of the results
+        expected_uris = [
+            uri
+            for name, uri in zip(filechooser_files, FILECHOOSER_RESULTS["uris"])
+            if not name.endswith("/")
+        ]
+        assert response
+        assert response.response == 0
+        assert len(response.results["uris"]) == len(expected_uris)
+        assert xdp.uris_same_files(expected_uris, response.results["uris"])
+
     @pytest.mark.parametrize("template_params", ({"filechooser": {"response": 1}},))
     def test_open_file_cancel(self, portals, dbus_con, xdp_app_info):
         app_id = xdp_app_info.app_id
@@ -18,7 +18,7 @@ def required_templates():
 
 class TestGlobalShortcuts:
     def test_version(self, portals, dbus_con):
-        xdp.check_version(dbus_con, "GlobalShortcuts", 2)
+        xdp.check_version(dbus_con, "GlobalShortcuts", 3)
 
     def test_create_close_session(self, portals, dbus_con, xdp_app_info):
         app_id = xdp_app_info.app_id
@@ -264,6 +264,58 @@ class TestGlobalShortcuts:
         session.close()
         xdp.wait_for(lambda: session.closed)
 
+    def test_trigger_batched(self, portals, dbus_con):
+        globalshortcuts_intf = xdp.get_portal_iface(dbus_con, "GlobalShortcuts")
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        request = xdp.Request(dbus_con, globalshortcuts_intf)
+        options = {
+            "session_handle_token": "session_token0",
+            "batch_events": True,
+        }
+        response = request.call(
+            "CreateSession",
+            options=options,
+        )
+
+        assert response
+        assert response.response == 0
+
+        session = xdp.Session.from_response(dbus_con, response)
+
+        events = []
+        n_signals = 0
+        n_unbatched = 0
+
+        def cb_shortcut_events(session_handle, batch):
+            nonlocal n_signals
+            assert session_handle == session.handle
+            n_signals += 1
+            events.extend(batch)
+
+        def cb_unbatched(*args):
+            nonlocal n_unbatched
+            n_unbatched += 1
+
+        globalshortcuts_intf.connect_to_signal("ShortcutEvents", cb_shortcut_events)
+        globalshortcuts_intf.connect_to_signal("Activated", cb_unbatched)
+        globalshortcuts_intf.connect_to_signal("Deactivated", cb_unbatched)
+
+        count = 100
+        mock_intf.TriggerBurst(session.handle, "binding1", count)
+
+        xdp.wait_for(lambda: len(events) == 2 * count)
+        assert n_unbatched == 0
+        assert n_signals < 2 * count
+
+        for i, (shortcut_id, activated, timestamp, _) in enumerate(events):
+            assert shortcut_id == "binding1"
+            assert activated == (i % 2 == 0)
+            assert timestamp >= events[0][2]
+
+        session.close()
+        xdp.wait_for(lambda: session.closed)
+
     def test_configure_shortcuts(self, portals, dbus_con):
         globalshortcuts_intf = xdp.get_portal_iface(dbus_con, "GlobalShortcuts")
         mock_intf = xdp.get_mock_iface(dbus_con)
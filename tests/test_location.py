@@ -114,6 +114,66 @@ class TestLocation:
 
         assert updated_count == 2
 
+    def test_shared_client(self, portals, dbus_con, dbus_con_sys):
+        location_intf = xdp.get_portal_iface(dbus_con, "Location")
+        geoclue_mock_intf = self.get_geoclue_mock(dbus_con_sys)
+
+        updates: dict[str, int] = {}
+
+        def cb_location_updated(session_handle, location):
+            updates[session_handle] = updates.get(session_handle, 0) + 1
+
+        location_intf.connect_to_signal("LocationUpdated", cb_location_updated)
+
+        # Both sessions use the same GeoClue client, the time threshold of
+        # the second one is applied by the portal
+        sessions = []
+        for i, options in enumerate([{}, {"time-threshold": dbus.UInt32(3600)}]):
+            session = xdp.Session(
+                dbus_con,
+                location_intf.CreateSession(
+                    {"session_handle_token": f"session_token{i}", **options}
+                ),
+            )
+            sessions.append(session)
+
+            start_session_request = xdp.Request(dbus_con, location_intf)
+            start_session_response = start_session_request.call(
+                "Start",
+                session_handle=session.handle,
+                parent_window="window-hndl",
+                options={},
+            )
+
+            assert start_session_response
+            assert start_session_response.response == 0
+
+            xdp.wait_for(lambda: updates.get(session.handle, 0) == 1)
+
+        geoclue_mock_intf.ChangeLocation(
+            {
+                "Latitude": dbus.UInt32(11),
+                "Longitude": dbus.UInt32(22),
+                "Accuracy": dbus.UInt32(3),
+            }
+        )
+
+        xdp.wait_for(lambda: updates.get(sessions[0].handle, 0) == 2)
+        xdp.wait(500)
+        assert updates[sessions[1].handle] == 1
+
+        # The client keeps running for the remaining session
+        sessions[1].close()
+        geoclue_mock_intf.ChangeLocation(
+            {
+                "Latitude": dbus.UInt32(33),
+                "Longitude": dbus.UInt32(44),
+                "Accuracy": dbus.UInt32(3),
+            }
+        )
+
+        xdp.wait_for(lambda: updates.get(sessions[0].handle, 0) == 3)
+
     def test_bad_accuracy(self, portals, dbus_con):
         location_intf = xdp.get_portal_iface(dbus_con, "Location")
         with pytest.raises(dbus.exceptions.DBusException) as excinfo:
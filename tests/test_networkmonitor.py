@@ -0,0 +1,141 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+#
+# This file is formatted with Python Black
+
+import dbus
+import pytest
+
+import tests.xdp_utils as xdp
+
+NM_BUS_NAME = "org.freedesktop.NetworkManager"
+NM_OBJ = "/org/freedesktop/NetworkManager"
+NM_IFACE = "org.freedesktop.NetworkManager"
+
+NM_METERED_YES = 1
+NM_METERED_NO = 2
+
+# Longer than the debounce timeout of the portal
+SETTLE_MS = 1000
+
+NO_NETWORK_METADATA = b"""
+[Application]
+name=org.example.Test
+runtime=org.freedesktop.Platform/x86_64/23.08
+sdk=org.freedesktop.Sdk/x86_64/23.08
+command=org.example.Test
+
+[Instance]
+instance-id=1234567890
+
+[Context]
+shared=ipc;
+"""
+
+
+@pytest.fixture
+def xdp_app_info() -> xdp.AppInfo:
+    return xdp.AppInfoHost()
+
+
+@pytest.fixture
+def required_templates():
+    return {
+        "networkmanager": {},
+    }
+
+
+@pytest.fixture
+def xdp_overwrite_env():
+    return {
+        "GIO_USE_NETWORK_MONITOR": "networkmanager",
+    }
+
+
+def set_metered(dbus_con_sys, metered):
+    nm = dbus_con_sys.get_object(NM_BUS_NAME, NM_OBJ)
+    properties = dbus.Interface(nm, dbus.PROPERTIES_IFACE)
+    properties.Set(NM_IFACE, "Metered", dbus.UInt32(metered))
+
+
+class TestNetworkMonitor:
+    def test_version(self, portals, dbus_con):
+        xdp.check_version(dbus_con, "NetworkMonitor", 4)
+
+    def test_status(self, portals, dbus_con):
+        network_monitor_intf = xdp.get_portal_iface(dbus_con, "NetworkMonitor")
+
+        status = network_monitor_intf.GetStatus()
+        assert status["available"] == network_monitor_intf.GetAvailable()
+        assert status["metered"] == network_monitor_intf.GetMetered()
+        assert status["connectivity"] == network_monitor_intf.GetConnectivity()
+
+    def test_status_changed(self, portals, dbus_con, dbus_con_sys):
+        network_monitor_intf = xdp.get_portal_iface(dbus_con, "NetworkMonitor")
+        changed_count = 0
+        statuses = []
+
+        def cb_changed():
+            nonlocal changed_count
+            changed_count += 1
+
+        def cb_status_changed(status):
+            statuses.append(status)
+
+        network_monitor_intf.connect_to_signal("changed", cb_changed)
+        network_monitor_intf.connect_to_signal("StatusChanged", cb_status_changed)
+
+        assert not network_monitor_intf.GetStatus()["metered"]
+
+        # A burst of changes is coalesced into one emission with the
+        # final values
+        set_metered(dbus_con_sys, NM_METERED_YES)
+        set_metered(dbus_con_sys, NM_METERED_NO)
+        set_metered(dbus_con_sys, NM_METERED_YES)
+
+        xdp.wait_for(lambda: len(statuses) == 1)
+        xdp.wait(SETTLE_MS)
+        assert changed_count == 1
+        assert len(statuses) == 1
+        assert statuses[0]["metered"]
+        assert statuses[0] == network_monitor_intf.GetStatus()
+
+        # Changes that end up where they started only emit changed
+        set_metered(dbus_con_sys, NM_METERED_NO)
+        set_metered(dbus_con_sys, NM_METERED_YES)
+
+        xdp.wait_for(lambda: changed_count == 2)
+        xdp.wait(SETTLE_MS)
+        assert changed_count == 2
+        assert len(statuses) == 1
+
+    @pytest.mark.parametrize(
+        "xdp_app_info", (xdp.AppInfoFlatpak(metadata=NO_NETWORK_METADATA),)
+    )
+    def test_status_changed_no_network(self, portals, dbus_con, dbus_con_sys):
+        network_monitor_intf = xdp.get_portal_iface(dbus_con, "NetworkMonitor")
+        changed_count = 0
+        statuses = []
+
+        def cb_changed():
+            nonlocal changed_count
+            changed_count += 1
+
+        def cb_status_changed(status):
+            statuses.append(status)
+
+        network_monitor_intf.connect_to_signal("changed", cb_changed)
+        network_monitor_intf.connect_to_signal("StatusChanged", cb_status_changed)
+
+        with pytest.raises(dbus.exceptions.DBusException) as excinfo:
+            network_monitor_intf.GetStatus()
+        assert (
+            excinfo.value.get_dbus_name()
+            == "org.freedesktop.portal.Error.NotAllowed"
+        )
+
+        set_metered(dbus_con_sys, NM_METERED_YES)
+
+        xdp.wait_for(lambda: changed_count == 1)
+        xdp.wait(SETTLE_MS)
+        assert statuses == []
@@ -87,6 +87,13 @@ class NotificationPortal(xdp.GDBusIface):
             fds,
         )
 
+    def AddNotificationAsync(self, id, notification, cb):
+        self._call_async(
+            "AddNotification",
+            GLib.Variant("(sa{sv})", (id, notification)),
+            cb=cb,
+        )
+
     def RemoveNotification(self, id):
         return self._call(
             "RemoveNotification",
@@ -654,3 +661,119 @@ class TestNotification:
                 assert False, "This statement should not be reached"
             except GLib.GError as e:
                 assert e.matches(Gio.io_error_quark(), Gio.IOErrorEnum.DBUS_ERROR)
+
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env", ({"XDG_DESKTOP_PORTAL_MAX_RUNNING_PER_APP": "1"},)
+    )
+    def test_replace_burst(self, portals, dbus_con, xdp_app_info):
+        notification_intf = NotificationPortal()
+        mock_intf = xdp.get_mock_iface(dbus_con)
+        n_replies = 0
+        n_calls = 20
+
+        def reply_cb(_):
+            nonlocal n_replies
+            n_replies += 1
+
+        # The icon has to be validated, so the replacements queue up behind
+        # the first call
+        for i in range(n_calls):
+            notification = NOTIFICATION_BASIC.copy()
+            notification["title"] = GLib.Variant("s", f"title{i}")
+            notification["icon"] = GLib.Variant(
+                "(sv)",
+                ("bytes", GLib.Variant("ay", SVG_IMAGE_DATA.encode("utf-8"))),
+            )
+            notification_intf.AddNotificationAsync("test1", notification, reply_cb)
+
+        xdp.wait_for(lambda: n_replies == n_calls)
+
+        def latest_reached_backend():
+            method_calls = mock_intf.GetMethodCalls("AddNotification")
+            _, args = method_calls[-1]
+            return args[2]["title"] == f"title{n_calls - 1}"
+
+        xdp.wait_for(latest_reached_backend)
+
+        method_calls = mock_intf.GetMethodCalls("AddNotification")
+        assert len(method_calls) < n_calls
+
+        # Nothing older may reach the backend after a newer replacement
+        indices = []
+        for _, args in method_calls:
+            assert args[0] == xdp_app_info.app_id
+            assert args[1] == "test1"
+            indices.append(int(args[2]["title"][len("title") :]))
+        assert indices == sorted(set(indices))
+        assert indices[-1] == n_calls - 1
+
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env",
+        (
+            {
+                "XDG_DESKTOP_PORTAL_NOTIFICATION_BURST": "3",
+                "XDG_DESKTOP_PORTAL_NOTIFICATIONS_PER_MINUTE": "1",
+            },
+        ),
+    )
+    def test_rate_limit(self, portals, dbus_con, xdp_app_info):
+        notification_intf = NotificationPortal()
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        for i in range(3):
+            notification_intf.AddNotification(f"test{i}", NOTIFICATION_BASIC)
+
+        with pytest.raises(GLib.GError) as excinfo:
+            notification_intf.AddNotification("test3", NOTIFICATION_BASIC)
+        assert "Too many notifications" in excinfo.value.message
+
+        method_calls = mock_intf.GetMethodCalls("AddNotification")
+        assert len(method_calls) == 3
+
+    # Only the refill rate is changed, so refills don't make this racy
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env",
+        ({"XDG_DESKTOP_PORTAL_NOTIFICATIONS_PER_MINUTE": "1"},),
+    )
+    def test_rate_limit_default_burst(self, portals, dbus_con, xdp_app_info):
+        notification_intf = NotificationPortal()
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        # The default burst is used up after 30 notifications
+        for i in range(30):
+            notification_intf.AddNotification(f"test{i}", NOTIFICATION_BASIC)
+
+        with pytest.raises(GLib.GError) as excinfo:
+            notification_intf.AddNotification("test30", NOTIFICATION_BASIC)
+        assert "Too many notifications" in excinfo.value.message
+
+        xdp.wait_for(lambda: len(mock_intf.GetMethodCalls("AddNotification")) == 30)
+
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env",
+        (
+            {
+                "XDG_DESKTOP_PORTAL_NOTIFICATION_BURST": "3",
+                "XDG_DESKTOP_PORTAL_NOTIFICATIONS_PER_MINUTE": "1",
+            },
+        ),
+    )
+    def test_rate_limit_replace(self, portals, dbus_con, xdp_app_info):
+        notification_intf = NotificationPortal()
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        notification_intf.AddNotification("test0", NOTIFICATION_BASIC)
+        xdp.wait_for(lambda: len(mock_intf.GetMethodCalls("AddNotification")) == 1)
+
+        # Replacing a notification that is shown already is not limited,
+        # the bucket only has tokens for two more notifications
+        for i in range(10):
+            notification = NOTIFICATION_BASIC.copy()
+            notification["title"] = GLib.Variant("s", f"title{i}")
+            notification_intf.AddNotification("test0", notification)
+
+        def latest_reached_backend():
+            _, args = mock_intf.GetMethodCalls("AddNotification")[-1]
+            return args[2]["title"] == "title9"
+
+        xdp.wait_for(latest_reached_backend)
@@ -3,11 +3,38 @@
 #
 # This file is formatted with Python Black
 
+import os
+from pathlib import Path
+
 import dbus
+import pytest
 from gi.repository import Gio, GLib
 
 import tests.xdp_utils as xdp
 
+# Check the tables every second and unload them after being idle for a second
+UNLOAD_TABLES_ENV = {
+    "XDG_PERMISSION_STORE_UNLOAD_CHECK_INTERVAL_S": "1",
+    "XDG_PERMISSION_STORE_IDLE_TIMEOUT_S": "1",
+    "XDG_PERMISSION_STORE_MIN_RESIDENT_S": "0",
+}
+# Long enough for an idle table to be unloaded
+UNLOAD_WAIT_MS = 3000
+# Must match MAX_SUBSCRIPTIONS_PER_SENDER in xdg-permission-store.c
+MAX_SUBSCRIPTIONS_PER_SENDER = 64
+
+
+def get_table_path(table):
+    return Path(os.environ["XDG_DATA_HOME"]) / "flatpak" / "db" / table
+
+
+def assert_not_found(func, *args):
+    try:
+        func(*args)
+        assert False, "This statement should not be reached"
+    except GLib.GError as e:
+        assert "org.freedesktop.portal.Error.NotFound" in e.message
+
 
 class PermissionStore(xdp.GDBusIface):
     def __init__(self):
@@ -23,6 +50,13 @@ class PermissionStore(xdp.GDBusIface):
             GLib.Variant("(ss)", (table, id)),
         )
 
+    def LookupMany(self, entries):
+        result, _ = self._call(
+            "LookupMany",
+            GLib.Variant("(a(ss))", (entries,)),
+        )
+        return result.unpack()[0]
+
     def Set(self, table, create, id, perm, data):
         return self._call(
             "Set",
@@ -74,6 +108,19 @@ class PermissionStore(xdp.GDBusIface):
             GLib.Variant("(sss)", (table, id, app)),
         )
 
+    def Subscribe(self, table, ids, apps, options):
+        result, _ = self._call(
+            "Subscribe",
+            GLib.Variant("(sasasa{sv})", (table, ids, apps, options)),
+        )
+        return result.unpack()[0]
+
+    def Unsubscribe(self, subscription):
+        return self._call(
+            "Unsubscribe",
+            GLib.Variant("(u)", (subscription,)),
+        )
+
 
 class TestPermissionStore:
     def test_version(self, portals, dbus_con):
@@ -90,7 +137,7 @@ class TestPermissionStore:
             "org.freedesktop.impl.portal.PermissionStore",
             "version",
         )
-        assert int(portal_version) == 2
+        assert int(portal_version) == 4
 
     def test_delete_race(self, portals, dbus_con):
         permission_store_intf = PermissionStore()
@@ -179,6 +226,99 @@ class TestPermissionStore:
         xdp.wait_for(lambda: changed_count >= 2)
         cs.disconnect()
 
+    def test_subscribe(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+        batches = []
+
+        table = "TEST"
+        id = "subscribed-resource"
+        app = "one.two.three"
+
+        def cb_changed_batch(results):
+            batches.append(results.unpack())
+
+        cs = permission_store_intf.connect_to_signal("ChangedBatch", cb_changed_batch)
+
+        subscription = permission_store_intf.Subscribe(table, [], [app], {})
+        assert subscription != 0
+
+        # Neither the table nor the app match
+        permission_store_intf.SetPermission("OTHER", True, id, app, ["one"])
+        permission_store_intf.SetPermission(table, True, id, "other.app", ["one"])
+        permission_store_intf.SetPermission(table, True, id, app, ["two"])
+        xdp.wait_for(lambda: len(batches) >= 1)
+
+        assert len(batches) == 1
+        cb_subscription, changes = batches[0]
+        assert cb_subscription == subscription
+        assert len(changes) == 1
+        cb_table, cb_id, deleted, _, cb_perms = changes[0]
+        assert cb_table == table
+        assert cb_id == id
+        assert not deleted
+        # Only the permissions of the subscribed apps are sent
+        assert cb_perms == {app: ["two"]}
+
+        # The app is part of the old entry, so deleting it is reported
+        permission_store_intf.Delete(table, id)
+        xdp.wait_for(lambda: len(batches) >= 2)
+        _, changes = batches[1]
+        assert len(changes) == 1
+        assert changes[0][1] == id
+        assert changes[0][2]
+
+        permission_store_intf.Unsubscribe(subscription)
+
+        # Changes within the delay are coalesced per id
+        subscription = permission_store_intf.Subscribe(
+            table, [id], [], {"delay": GLib.Variant("u", 200)}
+        )
+        permission_store_intf.SetPermission(table, True, id, app, ["one"])
+        permission_store_intf.SetPermission(table, True, id, app, ["one", "two"])
+        permission_store_intf.SetPermission(table, True, "other-resource", app, ["one"])
+        xdp.wait_for(lambda: len(batches) >= 3)
+
+        cb_subscription, changes = batches[2]
+        assert cb_subscription == subscription
+        assert len(changes) == 1
+        assert changes[0][1] == id
+        assert changes[0][4] == {app: ["one", "two"]}
+
+        permission_store_intf.Unsubscribe(subscription)
+        permission_store_intf.SetPermission(table, True, id, app, ["three"])
+        xdp.wait(300)
+        assert len(batches) == 3
+
+        try:
+            permission_store_intf.Unsubscribe(subscription)
+            assert False, "This statement should not be reached"
+        except GLib.GError as e:
+            assert "org.freedesktop.portal.Error.NotFound" in e.message
+
+        cs.disconnect()
+
+    def test_subscribe_limit(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+        table = "TEST"
+
+        subscriptions = [
+            permission_store_intf.Subscribe(table, [], [], {})
+            for _ in range(MAX_SUBSCRIPTIONS_PER_SENDER)
+        ]
+
+        try:
+            permission_store_intf.Subscribe(table, [], [], {})
+            assert False, "This statement should not be reached"
+        except GLib.GError as e:
+            assert "org.freedesktop.portal.Error.NotAllowed" in e.message
+
+        # Unsubscribing makes room for a new subscription
+        permission_store_intf.Unsubscribe(subscriptions.pop())
+        subscriptions.append(permission_store_intf.Subscribe(table, [], [], {}))
+
+        for subscription in subscriptions:
+            permission_store_intf.Unsubscribe(subscription)
+
     def test_lookup(self, portals, dbus_con):
         permission_store_intf = PermissionStore()
 
@@ -206,6 +346,43 @@ class TestPermissionStore:
 
         assert data_out == data
 
+    def test_lookup_many(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+
+        assert permission_store_intf.LookupMany([]) == []
+
+        for i in range(3):
+            permission_store_intf.Set(
+                "TEST",
+                True,
+                f"id{i}",
+                [("app", [f"perm{i}"])],
+                GLib.Variant("u", i),
+            )
+        permission_store_intf.Set(
+            "TEST2",
+            True,
+            "id0",
+            [("app", ["other"])],
+            GLib.Variant("s", "data"),
+        )
+
+        results = permission_store_intf.LookupMany(
+            [
+                ("TEST", "id2"),
+                ("TEST", "missing"),
+                ("TEST2", "id0"),
+                ("TEST", "id0"),
+                ("EMPTY", "id0"),
+            ]
+        )
+
+        assert results == [
+            ("TEST", "id2", {"app": ["perm2"]}, 2),
+            ("TEST2", "id0", {"app": ["other"]}, "data"),
+            ("TEST", "id0", {"app": ["perm0"]}, 0),
+        ]
+
     def test_set_value(self, portals, dbus_con):
         permission_store_intf = PermissionStore()
 
@@ -297,3 +474,97 @@ class TestPermissionStore:
         result, _ = permission_store_intf.GetPermission(table, id, "no-such-app")
         permissions = result.unpack()[0]
         assert permissions == []
+
+    @pytest.mark.parametrize("xdp_overwrite_env", (UNLOAD_TABLES_ENV,))
+    def test_unload_idle_table(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+
+        table = "TEST"
+        id = "test-resource"
+        perms = ["one", "two"]
+        path = get_table_path(table)
+        hidden_path = path.with_name(table + ".hidden")
+
+        permission_store_intf.Set(
+            table, True, id, [(id, perms)], GLib.Variant("b", True)
+        )
+        xdp.wait(UNLOAD_WAIT_MS)
+
+        # The table gets loaded again from disk
+        result, _ = permission_store_intf.Lookup(table, id)
+        assert result.unpack() == ({id: perms}, True)
+
+        # Without the file on disk, a reloaded table is empty
+        xdp.wait(UNLOAD_WAIT_MS)
+        path.rename(hidden_path)
+        assert_not_found(permission_store_intf.Lookup, table, id)
+
+        xdp.wait(UNLOAD_WAIT_MS)
+        hidden_path.rename(path)
+        result, _ = permission_store_intf.Lookup(table, id)
+        assert result.unpack() == ({id: perms}, True)
+
+    @pytest.mark.parametrize("xdp_overwrite_env", (UNLOAD_TABLES_ENV,))
+    def test_unload_failed_write(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+
+        table = "TEST"
+        perms = ["one", "two"]
+        path = get_table_path(table)
+
+        permission_store_intf.SetPermission(table, True, "saved", "a", perms)
+
+        # Writing the table fails while a directory is in the way
+        path.unlink()
+        path.mkdir()
+        try:
+            permission_store_intf.SetPermission(table, True, "unsaved", "a", perms)
+            assert False, "This statement should not be reached"
+        except GLib.GError as e:
+            assert "Unable to write db" in e.message
+
+        # The table must stay loaded, as the change only exists in memory
+        xdp.wait(UNLOAD_WAIT_MS)
+        for id in ["saved", "unsaved"]:
+            result, _ = permission_store_intf.Lookup(table, id)
+            assert result.unpack()[0] == {"a": perms}
+
+        # Once a write succeeds, the table can be unloaded and reloaded
+        path.rmdir()
+        permission_store_intf.SetPermission(table, True, "saved-later", "a", perms)
+        xdp.wait(UNLOAD_WAIT_MS)
+        for id in ["saved", "unsaved", "saved-later"]:
+            result, _ = permission_store_intf.Lookup(table, id)
+            assert result.unpack()[0] == {"a": perms}
+
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env",
+        ({**UNLOAD_TABLES_ENV, "XDG_PERMISSION_STORE_IDLE_TIMEOUT_S": "0"},),
+    )
+    def test_unload_pending_writes(self, portals, dbus_con):
+        permission_store_intf = PermissionStore()
+        finished_count = 0
+
+        table = "TEST"
+        perms = ["one", "two"]
+        n_writes = 30
+
+        def cb(_):
+            nonlocal finished_count
+
+            finished_count += 1
+
+        # Keep writing across several checks, which unload the table
+        # whenever it has no pending writes
+        for i in range(n_writes):
+            permission_store_intf.SetPermissionAsync(
+                table, True, f"id{i}", "a", perms, cb
+            )
+            xdp.wait(100)
+
+        xdp.wait_for(lambda: finished_count == n_writes)
+        xdp.wait(UNLOAD_WAIT_MS)
+
+        for i in range(n_writes):
+            result, _ = permission_store_intf.Lookup(table, f"id{i}")
+            assert result.unpack()[0] == {"a": perms}
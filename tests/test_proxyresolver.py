@@ -0,0 +1,154 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# SPDX-FileCopyrightText: Copyright © the xdg-desktop-portal contributors
+#
+# This file is formatted with Python Black
+
+import dbus
+import pytest
+
+import tests.xdp_utils as xdp
+
+NM_BUS_NAME = "org.freedesktop.NetworkManager"
+NM_OBJ = "/org/freedesktop/NetworkManager"
+NM_IFACE = "org.freedesktop.NetworkManager"
+
+# NMConnectivityState
+NM_CONNECTIVITY_PORTAL = 2
+NM_CONNECTIVITY_FULL = 4
+
+CACHE_TTL_S = 2
+
+
+@pytest.fixture
+def xdp_app_info() -> xdp.AppInfo:
+    return xdp.AppInfoHost()
+
+
+@pytest.fixture
+def required_templates():
+    return {
+        "networkmanager": {},
+    }
+
+
+@pytest.fixture
+def xdp_overwrite_env():
+    return {
+        "GIO_USE_PROXY_RESOLVER": "dummy",
+        "GIO_USE_NETWORK_MONITOR": "networkmanager",
+        "XDG_DESKTOP_PORTAL_METRICS": "1",
+        "XDG_DESKTOP_PORTAL_PROXY_CACHE_TTL_S": str(CACHE_TTL_S),
+    }
+
+
+def get_resolve_count(dbus_con):
+    """
+    Returns how many lookups reached the proxy resolver of the portal, rather
+    than being answered from its cache.
+    """
+    debug = dbus_con.get_object(
+        "org.freedesktop.portal.Desktop", "/org/freedesktop/portal/debug"
+    )
+    metrics = debug.GetMetrics(dbus_interface="org.freedesktop.portal.Debug")
+    if "proxy-resolver.resolve" not in metrics:
+        return 0
+    return metrics["proxy-resolver.resolve"][0]
+
+
+def set_connectivity(dbus_con_sys, connectivity):
+    nm = dbus_con_sys.get_object(NM_BUS_NAME, NM_OBJ)
+    properties = dbus.Interface(nm, dbus.PROPERTIES_IFACE)
+    properties.Set(NM_IFACE, "Connectivity", dbus.UInt32(connectivity))
+
+
+class TestProxyResolver:
+    def test_version(self, portals, dbus_con):
+        xdp.check_version(dbus_con, "ProxyResolver", 1)
+
+    def test_lookup(self, portals, dbus_con):
+        proxy_resolver_intf = xdp.get_portal_iface(dbus_con, "ProxyResolver")
+
+        proxies = proxy_resolver_intf.Lookup("https://example.org/index.html")
+        assert proxies == ["direct://"]
+
+    def test_lookup_cached(self, portals, dbus_con):
+        proxy_resolver_intf = xdp.get_portal_iface(dbus_con, "ProxyResolver")
+
+        proxies = proxy_resolver_intf.Lookup("https://example.org/0")
+        assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 1
+
+        # The same origin is answered from the cache
+        for i in range(1, 10):
+            proxies = proxy_resolver_intf.Lookup(f"https://example.org/{i}")
+            assert proxies == ["direct://"]
+        proxies = proxy_resolver_intf.Lookup("HTTPS://Example.ORG/index.html")
+        assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 1
+
+        # Other origins are not
+        for i in range(10):
+            proxies = proxy_resolver_intf.Lookup(f"http://host{i}.example.org:8080")
+            assert proxies == ["direct://"]
+            proxies = proxy_resolver_intf.Lookup(f"http://host{i}.example.org:8080/a")
+            assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 11
+
+        proxies = proxy_resolver_intf.Lookup("http://example.org/0")
+        assert proxies == ["direct://"]
+        proxies = proxy_resolver_intf.Lookup("https://example.org:8443/0")
+        assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 13
+
+    def test_lookup_cache_expires(self, portals, dbus_con):
+        proxy_resolver_intf = xdp.get_portal_iface(dbus_con, "ProxyResolver")
+
+        proxy_resolver_intf.Lookup("https://example.org/")
+        proxy_resolver_intf.Lookup("https://example.org/")
+        assert get_resolve_count(dbus_con) == 1
+
+        xdp.wait(CACHE_TTL_S * 1000 + 500)
+
+        proxies = proxy_resolver_intf.Lookup("https://example.org/")
+        assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 2
+
+        proxy_resolver_intf.Lookup("https://example.org/")
+        assert get_resolve_count(dbus_con) == 2
+
+    def test_lookup_cache_invalidated(self, portals, dbus_con, dbus_con_sys):
+        proxy_resolver_intf = xdp.get_portal_iface(dbus_con, "ProxyResolver")
+
+        proxy_resolver_intf.Lookup("https://example.org/")
+        proxy_resolver_intf.Lookup("https://example.org/")
+        assert get_resolve_count(dbus_con) == 1
+
+        # Logging in to a captive portal can change the proxy configuration
+        set_connectivity(dbus_con_sys, NM_CONNECTIVITY_PORTAL)
+        xdp.wait(500)
+        proxies = proxy_resolver_intf.Lookup("https://example.org/")
+        assert proxies == ["direct://"]
+        assert get_resolve_count(dbus_con) == 2
+
+        set_connectivity(dbus_con_sys, NM_CONNECTIVITY_FULL)
+        xdp.wait(500)
+        proxy_resolver_intf.Lookup("https://example.org/")
+        assert get_resolve_count(dbus_con) == 3
+
+        proxy_resolver_intf.Lookup("https://example.org/")
+        assert get_resolve_count(dbus_con) == 3
+
+    @pytest.mark.parametrize("xdp_app_info", (xdp.AppInfoFlatpak(),))
+    def test_debug_sandboxed(self, portals, dbus_con):
+        debug = dbus_con.get_object(
+            "org.freedesktop.portal.Desktop", "/org/freedesktop/portal/debug"
+        )
+
+        # The metrics cover all apps, so sandboxed apps can't read or reset them
+        for method in ("GetMetrics", "DumpMetrics", "ResetMetrics"):
+            with pytest.raises(dbus.exceptions.DBusException) as excinfo:
+                debug.get_dbus_method(method, "org.freedesktop.portal.Debug")()
+            assert (
+                excinfo.value.get_dbus_name()
+                == "org.freedesktop.portal.Error.NotAllowed"
+            )
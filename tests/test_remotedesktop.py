@@ -19,7 +19,7 @@ def required_templates():
 
 class TestRemoteDesktop:
     def test_version(self, portals, dbus_con):
-        xdp.check_version(dbus_con, "RemoteDesktop", 2)
+        xdp.check_version(dbus_con, "RemoteDesktop", 3)
 
     def test_create_close_session(self, portals, dbus_con):
         remotedesktop_intf = xdp.get_portal_iface(dbus_con, "RemoteDesktop")
@@ -253,3 +253,123 @@ class TestRemoteDesktop:
                 "Session is not allowed to call Notify"
                 in excinfo.value.get_dbus_message()
             )
+
+    @pytest.mark.parametrize("template_params", ({"remotedesktop": {"devices": 0x3}},))
+    def test_notify_input_events(self, portals, dbus_con):
+        remotedesktop_intf = xdp.get_portal_iface(dbus_con, "RemoteDesktop")
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        request = xdp.Request(dbus_con, remotedesktop_intf)
+        options = {
+            "session_handle_token": "session_token0",
+        }
+        response = request.call(
+            "CreateSession",
+            options=options,
+        )
+
+        assert response
+        assert response.response == 0
+
+        session = xdp.Session.from_response(dbus_con, response)
+        request = xdp.Request(dbus_con, remotedesktop_intf)
+        options = {
+            "types": dbus.UInt32(0x3),
+        }
+        response = request.call(
+            "SelectDevices",
+            session_handle=session.handle,
+            options=options,
+        )
+        assert response
+        assert response.response == 0
+
+        request = xdp.Request(dbus_con, remotedesktop_intf)
+        options = {}
+        response = request.call(
+            "Start",
+            session_handle=session.handle,
+            parent_window="",
+            options=options,
+        )
+        assert response
+        assert response.response == 0
+
+        def event(name, timestamp, params):
+            return dbus.Struct(
+                (name, dbus.UInt64(timestamp), dbus.Dictionary(params, signature="sv")),
+                signature="sta{sv}",
+            )
+
+        events = dbus.Array(
+            [
+                event("pointer-motion", 1, {"dx": 1.0, "dy": 2.0}),
+                event("pointer-motion", 2, {"dx": 3.0, "dy": 4.0}),
+                event("pointer-motion", 3, {"dx": 5.0, "dy": 6.0}),
+                event(
+                    "pointer-button",
+                    4,
+                    {"button": dbus.Int32(272), "state": dbus.UInt32(1)},
+                ),
+                event("pointer-motion", 5, {"dx": 1.0, "dy": 1.0}),
+                event(
+                    "keyboard-keycode",
+                    6,
+                    {"keycode": dbus.Int32(30), "state": dbus.UInt32(1)},
+                ),
+            ],
+            signature="(sta{sv})",
+        )
+        remotedesktop_intf.NotifyInputEvents(
+            session.handle, dbus.Dictionary({}, signature="sv"), events
+        )
+
+        xdp.wait_for(
+            lambda: len(mock_intf.GetMethodCalls("NotifyKeyboardKeycode")) == 1
+        )
+
+        # The first three relative motions are coalesced into one
+        method_calls = mock_intf.GetMethodCalls("NotifyPointerMotion")
+        assert len(method_calls) == 2
+        _, args = method_calls[0]
+        assert args[0] == session.handle
+        assert args[2] == 9.0
+        assert args[3] == 12.0
+        _, args = method_calls[1]
+        assert args[2] == 1.0
+        assert args[3] == 1.0
+
+        method_calls = mock_intf.GetMethodCalls("NotifyPointerButton")
+        assert len(method_calls) == 1
+        _, args = method_calls[0]
+        assert args[2] == 272
+        assert args[3] == 1
+
+        # Touch was not granted, so the whole batch is rejected
+        events = dbus.Array(
+            [
+                event("pointer-motion", 7, {"dx": 1.0, "dy": 1.0}),
+                event("touch-up", 8, {"slot": dbus.UInt32(0)}),
+            ],
+            signature="(sta{sv})",
+        )
+        with pytest.raises(dbus.exceptions.DBusException) as excinfo:
+            remotedesktop_intf.NotifyInputEvents(
+                session.handle, dbus.Dictionary({}, signature="sv"), events
+            )
+        assert "not allowed" in excinfo.value.get_dbus_message()
+
+        # Timestamps must not go backwards
+        events = dbus.Array(
+            [
+                event("pointer-motion", 10, {"dx": 1.0, "dy": 1.0}),
+                event("pointer-motion", 9, {"dx": 1.0, "dy": 1.0}),
+            ],
+            signature="(sta{sv})",
+        )
+        with pytest.raises(dbus.exceptions.DBusException):
+            remotedesktop_intf.NotifyInputEvents(
+                session.handle, dbus.Dictionary({}, signature="sv"), events
+            )
+
+        assert len(mock_intf.GetMethodCalls("NotifyPointerMotion")) == 2
@@ -71,7 +71,7 @@ class TestScreenshot:
         )
 
     def test_version(self, portals, dbus_con):
-        xdp.check_version(dbus_con, "Screenshot", 3)
+        xdp.check_version(dbus_con, "Screenshot", 4)
 
     def test_available_targets(self, portals, dbus_con):
         properties_intf = dbus.Interface(
@@ -244,6 +244,38 @@ class TestScreenshot:
             assert args[2] == ""  # parent window
             assert args[6]["modal"] == modal
 
+    def test_screenshot_read_only_fd(self, portals, dbus_con, xdp_app_info):
+        screenshot_intf = xdp.get_portal_iface(dbus_con, "Screenshot")
+        mock_intf = xdp.get_mock_iface(dbus_con)
+
+        request = xdp.Request(dbus_con, screenshot_intf)
+        response = request.call(
+            "Screenshot",
+            parent_window="",
+            options={
+                "interactive": True,
+                "read_only_fd": True,
+            },
+        )
+
+        assert response
+        assert response.response == 0
+        assert "uri" not in response.results
+
+        fd = response.results["fd"].take()
+        try:
+            assert os.read(fd, 100) == b"image contents"
+            with pytest.raises(OSError):
+                os.write(fd, b"new contents")
+        finally:
+            os.close(fd)
+
+        # The option is handled by the frontend and not forwarded
+        method_calls = mock_intf.GetMethodCalls("Screenshot")
+        assert len(method_calls) > 0
+        _, args = method_calls[-1]
+        assert "read_only_fd" not in args[3]
+
     @pytest.mark.parametrize(
         "template_params", ({"screenshot": {"expect-close": True}},)
     )
@@ -7,11 +7,51 @@ import os
 import tempfile
 from pathlib import Path
 
+import dbus
 import pytest
 from gi.repository import GLib
 
 import tests.xdp_utils as xdp
 
+# More than the directory fds the portal keeps open while checking a tree
+DEEP_TREE_DEPTH = 40
+
+
+def make_deep_tree(folder, depth):
+    deepest = folder.joinpath(*[f"d{i}" for i in range(depth)])
+    deepest.mkdir(parents=True)
+    (deepest / "file").write_text("foobar")
+    return deepest
+
+
+def trash_folder(trash_intf, folder):
+    fd = os.open(folder, os.O_RDONLY | os.O_CLOEXEC)
+    try:
+        return trash_intf.TrashFile(fd)
+    finally:
+        os.close(fd)
+
+
+def get_trashed_folder(folder):
+    info_dir = Path(os.environ["XDG_DATA_HOME"]) / "Trash/info"
+    files_dir = Path(os.environ["XDG_DATA_HOME"]) / "Trash/files"
+
+    if not info_dir.exists():
+        return None
+
+    for info_file in info_dir.iterdir():
+        keyfile = GLib.KeyFile.new()
+        content = info_file.read_text()
+        assert keyfile.load_from_data(
+            content,
+            len(content),
+            GLib.KeyFileFlags.NONE,
+        )
+        if keyfile.get_string("Trash Info", "Path") == folder.as_posix():
+            return files_dir / info_file.stem
+
+    return None
+
 
 class TestTrash:
     def test_version(self, portals, dbus_con):
@@ -101,3 +141,93 @@ class TestTrash:
 
         with pytest.raises(StopIteration):
             next(trashed_files)
+
+    # Only the host can pass directories, as they can't be opened for writing
+    @pytest.mark.parametrize("xdp_app_info", (xdp.AppInfoHost(),))
+    def test_trash_deep_folder(self, portals, dbus_con, xdp_app_info):
+        trash_intf = xdp.get_portal_iface(dbus_con, "Trash")
+
+        folder = Path(os.environ["HOME"]) / "deep-folder-to-trash"
+        deepest = make_deep_tree(folder, DEEP_TREE_DEPTH)
+        # Siblings make the walk return to ancestors whose fds were closed
+        for i in range(DEEP_TREE_DEPTH):
+            folder.joinpath(*[f"d{j}" for j in range(i)], f"sibling{i}").mkdir()
+
+        result = trash_folder(trash_intf, folder)
+
+        assert result == 1
+        assert not folder.exists()
+
+        trashed_folder = get_trashed_folder(folder)
+        assert trashed_folder
+        assert (trashed_folder / deepest.relative_to(folder) / "file").exists()
+
+    @pytest.mark.parametrize("xdp_app_info", (xdp.AppInfoHost(),))
+    def test_trash_deep_folder_foreign_child(self, portals, dbus_con, xdp_app_info):
+        trash_intf = xdp.get_portal_iface(dbus_con, "Trash")
+
+        folder = Path(os.environ["HOME"]) / "deep-folder-to-trash"
+        deepest = make_deep_tree(folder, DEEP_TREE_DEPTH)
+
+        # The trash can't remove the contents of a directory owned by someone
+        # else, so nothing may get trashed
+        foreign = deepest.parents[2]
+        try:
+            os.chown(foreign, os.geteuid() + 1, -1)
+        except PermissionError as e:
+            pytest.skip(f"Couldn't change the owner of a directory: {e}")
+
+        result = trash_folder(trash_intf, folder)
+
+        assert result == 0
+        assert (deepest / "file").exists()
+        assert get_trashed_folder(folder) is None
+
+    @pytest.mark.parametrize("xdp_app_info", (xdp.AppInfoHost(),))
+    @pytest.mark.parametrize(
+        "xdp_overwrite_env", ({"XDG_DESKTOP_PORTAL_MAX_RUNNING_PER_APP": "1"},)
+    )
+    def test_trash_folder_caller_disconnects(self, portals, dbus_con, xdp_app_info):
+        trash_intf = xdp.get_portal_iface(dbus_con, "Trash")
+
+        folder = Path(os.environ["HOME"]) / "large-folder-to-trash"
+        deepest = make_deep_tree(folder, DEEP_TREE_DEPTH)
+        for i in range(200):
+            for j in range(20):
+                (folder / f"wide{i}" / f"dir{j}").mkdir(parents=True)
+
+        peer_con = dbus.bus.BusConnection(dbus.bus.BusConnection.TYPE_SESSION)
+        peer_con.set_exit_on_disconnect(False)
+        peer_trash_intf = xdp.get_portal_iface(peer_con, "Trash")
+        fd = os.open(folder, os.O_RDONLY | os.O_CLOEXEC)
+        try:
+            peer_trash_intf.TrashFile(
+                fd,
+                reply_handler=lambda result: None,
+                error_handler=lambda error: None,
+            )
+        finally:
+            os.close(fd)
+        peer_con.flush()
+        peer_con.close()
+
+        # Jobs of the same app run one after the other, so the walk of the
+        # disconnected caller is over once this returns
+        fd, name = tempfile.mkstemp(prefix="trash_portal_mock_", dir=Path.home())
+        try:
+            result = trash_intf.TrashFile(fd)
+        finally:
+            os.close(fd)
+        assert result == 1
+        assert not Path(name).exists()
+
+        # The walk may or may not have been cancelled in time, but the folder
+        # must have been trashed completely or not at all
+        trashed_folder = get_trashed_folder(folder)
+        if trashed_folder:
+            assert not folder.exists()
+            root = trashed_folder
+        else:
+            root = folder
+        assert (root / deepest.relative_to(folder) / "file").exists()
+        assert len(list(root.iterdir())) == 201